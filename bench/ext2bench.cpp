@@ -0,0 +1,409 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ext2.h"
+#include "mkimage.h"
+
+// ext2 核心操作的微基准：先用 mkimage 合成一个指定规模的镜像（默认放在 /dev/shm，避免测到磁盘），
+// 再对 ext2_t 的各个公开操作逐个计时，输出 ops/s、MB/s 以及单次操作的 p50/p99 延迟。
+//
+// 用法：ext2bench [选项]
+//   --image FILE      镜像路径（默认 /dev/shm/ext2bench.img，没有 /dev/shm 时放在 /tmp）
+//   --size MB         文件系统大小，默认 64
+//   --bs N            块大小，默认 1024
+//   --files N         预置文件数，默认 1000
+//   --depth N         目录树层数，默认 2
+//   --fanout N        每个目录的子目录数，默认 4
+//   --file-size N     预置文件和写入文件的大小（字节），默认 4096
+//   --frag F          碎片化程度 0~1，默认 0
+//   --seed N          随机种子，默认 1
+//   --ops N           每轮分配/创建类操作的次数，默认 200
+//   --iters N         轮数（每轮重新生成镜像），默认 3
+//   --save FILE       把结果保存为基线
+//   --baseline FILE   与保存的基线比较，输出 ops/s 的变化百分比
+//   --keep            结束后保留镜像
+//   --stats           打开 ext2_t 的运行统计，输出每轮的 I/O 与分配器计数
+//   --trace FILE      把最后一轮的块访问记录到 FILE（用 ext2replay 回放）
+//   --cow             以写时复制覆盖层方式打开镜像，测量覆盖层的开销
+
+typedef std::chrono::steady_clock clock_type;
+
+static FILE* report = stdout; // ext2_t 会向 stdout 打印大量信息，结果写到单独的句柄
+static int stdout_fd = -1, null_fd = -1;
+
+// 计时期间把 stdout 指向 /dev/null，其余时间（如 make_image 的出错信息）照常输出
+static void quiet(bool on)
+{
+    fflush(stdout);
+    dup2(on ? null_fd : stdout_fd, 1);
+}
+
+struct result_t
+{
+    std::string name;
+    std::vector<double> lat; // 单次操作耗时（微秒）
+    double total_us;
+    double bytes;
+
+    result_t() : total_us(0), bytes(0) {}
+};
+
+static std::map<std::string, result_t> results;
+static ext2_t* current_fs; // 正在测试的文件系统，用于给块访问跟踪标注操作名
+static std::vector<std::string> order;
+
+// 计时一次操作并累计到 name 名下
+template <typename F>
+static void timed(const char* name, double bytes, F f)
+{
+    if (current_fs) current_fs->trace_command(name);
+    clock_type::time_point t0 = clock_type::now();
+    f();
+    double us = std::chrono::duration<double, std::micro>(clock_type::now() - t0).count();
+
+    result_t& r = results[name];
+    if (r.name.empty())
+    {
+        r.name = name;
+        order.push_back(name);
+    }
+    r.lat.push_back(us);
+    r.total_us += us;
+    r.bytes += bytes;
+}
+
+// 记录一批并发执行的操作：wall_us 为整批的墙钟时间，ops/s 按墙钟时间计算，延迟列为平均每次的墙钟时间
+static void batch(const std::string& name, size_t count, double wall_us, double bytes)
+{
+    result_t& r = results[name];
+    if (r.name.empty())
+    {
+        r.name = name;
+        order.push_back(name);
+    }
+    for (size_t i = 0; i < count; i++) r.lat.push_back(wall_us / count);
+    r.total_us += wall_us;
+    r.bytes += bytes;
+}
+
+// threads 个线程同时在同一个 ext2_t 上执行 f(线程号)，返回墙钟时间（微秒）
+template <typename F>
+static double in_parallel(unsigned threads, F f)
+{
+    clock_type::time_point t0 = clock_type::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) pool.push_back(std::thread(f, t));
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+    return std::chrono::duration<double, std::micro>(clock_type::now() - t0).count();
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static std::map<std::string, double> load_baseline(const char* path)
+{
+    std::map<std::string, double> base;
+    FILE* f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(report, "cannot open baseline %s\n", path);
+        return base;
+    }
+    char name[128];
+    double ops;
+    while (fscanf(f, "%127s %lf", name, &ops) == 2) base[name] = ops;
+    fclose(f);
+    return base;
+}
+
+static void print_results(const char* save, const char* baseline)
+{
+    std::map<std::string, double> base;
+    if (baseline) base = load_baseline(baseline);
+    FILE* out = save ? fopen(save, "w") : nullptr;
+    if (save && !out) fprintf(report, "cannot write %s\n", save);
+
+    fprintf(report, "%-16s %8s %12s %10s %10s %10s", "op", "count", "ops/s", "MB/s", "p50(us)", "p99(us)");
+    if (!base.empty()) fprintf(report, " %9s", "vs base");
+    fprintf(report, "\n");
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        result_t& r = results[order[i]];
+        std::sort(r.lat.begin(), r.lat.end());
+        double ops = r.total_us > 0 ? r.lat.size() * 1e6 / r.total_us : 0;
+        fprintf(report, "%-16s %8zu %12.0f ", r.name.c_str(), r.lat.size(), ops);
+        if (r.bytes > 0) fprintf(report, "%10.1f", r.bytes / r.total_us * 1e6 / (1024 * 1024));
+        else fprintf(report, "%10s", "-");
+        fprintf(report, " %10.1f %10.1f", percentile(r.lat, 0.5), percentile(r.lat, 0.99));
+        std::map<std::string, double>::iterator b = base.find(r.name);
+        if (b != base.end() && b->second > 0) fprintf(report, " %+8.1f%%", (ops / b->second - 1) * 100);
+        fprintf(report, "\n");
+        if (out) fprintf(out, "%s %.3f\n", r.name.c_str(), ops);
+    }
+    if (out) fclose(out);
+}
+
+// 在刚生成的镜像上依次执行各类操作
+static bool run_ops(ext2_t& fs, const mkimage_opts_t& opts, const mkimage_result_t& made, unsigned int ops)
+{
+    // 只读遍历
+    timed("list_root", 0, [&] { fs.list_directory(2, "/"); });
+    timed("show_tree", 0, [&] { fs.show_tree(2); });
+    for (unsigned int i = 0; i < ops; i++)
+    {
+        std::string name = "f" + std::to_string(i % (made.files ? made.files : 1));
+        unsigned char type;
+        timed("lookup", 0, [&] { fs.lookup_entry(2, name.c_str(), &type); });
+    }
+
+    // 分配器：先连续分配，再全部释放
+    std::vector<unsigned int> blocks, inodes;
+    for (unsigned int i = 0; i < ops; i++)
+        timed("alloc_block", 0, [&] { blocks.push_back(fs.allocate_block()); });
+    for (size_t i = 0; i < blocks.size(); i++)
+        if (blocks[i]) timed("free_block", 0, [&] { fs.free_block(blocks[i]); });
+    for (unsigned int i = 0; i < ops; i++)
+        timed("alloc_inode", 0, [&] { inodes.push_back(fs.allocate_inode()); });
+    for (size_t i = 0; i < inodes.size(); i++)
+        if (inodes[i]) timed("free_inode", 0, [&] { fs.free_inode(inodes[i]); });
+
+    // 在新目录中创建、写、读、删除文件
+    timed("mkdir", 0, [&] { fs.create_directory(2, "bench"); });
+    unsigned char type;
+    unsigned int dir = fs.lookup_entry(2, "bench", &type);
+    if (dir == 0)
+    {
+        fprintf(report, "mkdir failed\n");
+        return false;
+    }
+
+    std::vector<char> content(opts.file_size);
+    for (size_t i = 0; i < content.size(); i++) content[i] = (char)('A' + i % 26);
+    std::vector<unsigned int> files;
+    for (unsigned int i = 0; i < ops; i++)
+    {
+        std::string name = "b" + std::to_string(i);
+        timed("create_file", 0, [&] { files.push_back(fs.create_file(dir, name.c_str(), 0x81A4)); });
+    }
+    // 空间不足时写入失败的文件不参与读取校验
+    std::vector<bool> written(files.size(), false);
+    unsigned int write_failed = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!files[i]) continue;
+        bool ok = false;
+        timed("write_file", content.size(), [&] { ok = fs.write_file(files[i], content.data(), content.size()); });
+        written[i] = ok;
+        if (!ok) write_failed++;
+    }
+    if (write_failed) fprintf(report, "warning: %u of %zu writes failed (image full?)\n", write_failed, files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!written[i]) continue;
+        size_t size = 0;
+        char* data = nullptr;
+        timed("read_file", content.size(), [&] { data = fs.read_file(files[i], &size); });
+        if (!data || size != content.size() || memcmp(data, content.data(), size) != 0)
+        {
+            fprintf(report, "read_file returned wrong content for inode %u\n", files[i]);
+            delete[] data;
+            return false;
+        }
+        delete[] data;
+    }
+    // 整理碎片后再读一遍：交错写入的文件各自搬成连续的一段
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!written[i]) continue;
+        std::vector<std::string> args = { "defrag", std::to_string(files[i]) };
+        timed("defrag_file", content.size(), [&] { fs.defrag(args); });
+    }
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!written[i]) continue;
+        size_t size = 0;
+        char* data = nullptr;
+        timed("read_defragged", content.size(), [&] { data = fs.read_file(files[i], &size); });
+        if (!data || size != content.size() || memcmp(data, content.data(), size) != 0)
+        {
+            fprintf(report, "read_file returned wrong content after defrag for inode %u\n", files[i]);
+            delete[] data;
+            return false;
+        }
+        delete[] data;
+    }
+    // 多个线程同时查询同一个 ext2_t：每个线程把全部文件读一遍，再列出并打印根目录，ops/s 为各线程合计。
+    // 1、2、4 线程的正确性检查总是要跑（单核机器上也能暴露竞争），只有不超过核数的轮次才记录吞吐量
+    unsigned hw = std::thread::hardware_concurrency();
+    if (hw == 0) hw = 1;
+    size_t readable = std::count(written.begin(), written.end(), true);
+    for (unsigned threads = 1; threads <= 8 && (threads <= 4 || threads <= hw); threads *= 2)
+    {
+        std::atomic<bool> same(true);
+        double us = in_parallel(threads, [&](unsigned) {
+            for (size_t i = 0; i < files.size(); i++)
+            {
+                if (!written[i]) continue;
+                size_t size = 0;
+                char* data = fs.read_file(files[i], &size);
+                if (!data || size != content.size() || memcmp(data, content.data(), size) != 0) same = false;
+                delete[] data;
+            }
+        });
+        if (!same)
+        {
+            fprintf(report, "concurrent read_file returned wrong content with %u threads\n", threads);
+            return false;
+        }
+        if (threads <= hw) batch("read_par_" + std::to_string(threads), readable * threads, us, (double)readable * threads * content.size());
+        us = in_parallel(threads, [&](unsigned) {
+            for (int k = 0; k < 4; k++)
+            {
+                fs.list_directory(2, "/");
+                fs.dump_inode(2);
+            }
+        });
+        if (threads <= hw) batch("list_par_" + std::to_string(threads), 4 * threads, us, 0);
+    }
+
+    for (unsigned int i = 0; i < ops; i++)
+    {
+        std::string name = "b" + std::to_string(i);
+        timed("delete_file", 0, [&] { fs.delete_file(dir, name.c_str()); });
+    }
+    timed("rmdir", 0, [&] { fs.delete_directory(2, "bench"); });
+
+    // 递归删除预置的目录树（第一层目录）
+    if (opts.depth > 0)
+    {
+        for (unsigned int i = 0; i < opts.fanout; i++)
+        {
+            std::string name = "d" + std::to_string(i);
+            timed("rmdir_tree", 0, [&] { fs.delete_directory(2, name.c_str()); });
+        }
+    }
+    return true;
+}
+
+// 一轮测试
+static bool run_round(const std::string& image, const mkimage_opts_t& opts, const mkimage_result_t& made, unsigned int ops, bool stats,
+    const char* trace, bool cow)
+{
+    ext2_t fs(image.c_str(), 0, cow);
+    if (!fs.valid)
+    {
+        fprintf(report, "cannot open generated image %s\n", image.c_str());
+        return false;
+    }
+    fs.stats.enabled = stats;
+    if (trace) fs.trace_start(trace);
+    current_fs = &fs;
+    bool ok = run_ops(fs, opts, made, ops);
+    current_fs = nullptr;
+    if (trace) fs.trace_stop();
+    if (stats) fs.stats.print(report);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    mkimage_opts_t opts;
+    std::string image = access("/dev/shm", W_OK) == 0 ? "/dev/shm/ext2bench.img" : "/tmp/ext2bench.img";
+    unsigned int ops = 200, iters = 3;
+    const char* save = nullptr;
+    const char* baseline = nullptr;
+    const char* trace = nullptr;
+    bool keep = false;
+    bool stats = false;
+    bool cow = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (a == "--keep") { keep = true; continue; }
+        if (a == "--stats") { stats = true; continue; }
+        if (a == "--cow") { cow = true; continue; }
+        if (!v)
+        {
+            printf("missing value for %s\n", a.c_str());
+            return 1;
+        }
+        if (a == "--image") image = v;
+        else if (a == "--size") opts.size_mb = atoi(v);
+        else if (a == "--bs") opts.block_size = atoi(v);
+        else if (a == "--files") opts.files = atoi(v);
+        else if (a == "--depth") opts.depth = atoi(v);
+        else if (a == "--fanout") opts.fanout = atoi(v);
+        else if (a == "--file-size") opts.file_size = atoi(v);
+        else if (a == "--frag") opts.frag = atof(v);
+        else if (a == "--seed") opts.seed = atoi(v);
+        else if (a == "--ops") ops = atoi(v);
+        else if (a == "--iters") iters = atoi(v);
+        else if (a == "--save") save = v;
+        else if (a == "--baseline") baseline = v;
+        else if (a == "--trace") trace = v;
+        else
+        {
+            printf("unknown option %s\n", a.c_str());
+            return 1;
+        }
+        i++;
+    }
+
+    // 结果写到原来的 stdout，ext2_t 的打印重定向到 /dev/null
+    fflush(stdout);
+    stdout_fd = dup(1);
+    null_fd = open("/dev/null", O_WRONLY);
+    report = stdout_fd >= 0 ? fdopen(dup(stdout_fd), "w") : nullptr;
+    if (!report || null_fd < 0)
+    {
+        perror("redirect stdout");
+        return 1;
+    }
+
+    fprintf(report, "image %s: %u MB, bs %u, %u files of %u bytes, depth %u, fanout %u, frag %.2f\n",
+        image.c_str(), opts.size_mb, opts.block_size, opts.files, opts.file_size, opts.depth, opts.fanout, opts.frag);
+
+    bool ok = true;
+    for (unsigned int it = 0; it < iters && ok; it++)
+    {
+        mkimage_result_t made;
+        clock_type::time_point t0 = clock_type::now();
+        if (!make_image(image.c_str(), opts, &made)) return 1;
+        remove((image + ".cow").c_str()); // 上一轮的覆盖层和命名空间索引不属于新镜像
+        remove((image + ".idx").c_str());
+        double ms = std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+        if (it == 0)
+            fprintf(report, "generated %u dirs, %u files, %u free blocks, %u free inodes in %.1f ms\n",
+                made.dirs, made.files, made.free_blocks, made.free_inodes, ms);
+        quiet(true);
+        ok = run_round(image, opts, made, ops, stats, it + 1 == iters ? trace : nullptr, cow);
+        quiet(false);
+    }
+
+    print_results(save, baseline);
+    if (!keep)
+    {
+        remove(image.c_str());
+        remove((image + ".cow").c_str());
+        remove((image + ".idx").c_str());
+    }
+    fclose(report);
+    return ok ? 0 : 1;
+}
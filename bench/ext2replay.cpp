@@ -0,0 +1,430 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <list>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "trace.h"
+
+// 离线回放 dumpext3 记录的块访问跟踪（trace start / 第三个命令行参数），
+// 在不同容量下模拟 LRU、2Q、ARC 三种块缓存以及作为上界的 OPT（Belady），输出命中率。
+//
+// 用法：ext2replay <trace_file> [选项]
+//   --sizes N,N,...        缓存容量（块数），默认从 16 起按 4 倍递增直到覆盖全部不同的块
+//   --policies P,P,...     lru、2q、arc、opt 的任意组合，默认全部
+//   --reads-only           只回放读访问（默认写也经过缓存，即写分配）
+//   --by-command           另外按命令分别统计命中率
+
+typedef unsigned __int32 block_t;
+
+// 一次块访问
+struct access_t
+{
+    block_t block;
+    unsigned __int8 cmd;
+};
+
+class cache_sim_t
+{
+public:
+    virtual ~cache_sim_t() {}
+    virtual bool access(block_t b) = 0; // 返回是否命中
+};
+
+// 带位置索引的 LRU 链表，front 为最近使用
+class lru_list_t
+{
+public:
+    size_t size() const { return order.size(); }
+    bool contains(block_t b) const { return where.count(b) != 0; }
+    void push_front(block_t b)
+    {
+        order.push_front(b);
+        where[b] = order.begin();
+    }
+    void touch(block_t b) { order.splice(order.begin(), order, where[b]); }
+    void remove(block_t b)
+    {
+        auto it = where.find(b);
+        order.erase(it->second);
+        where.erase(it);
+    }
+    block_t pop_back()
+    {
+        block_t b = order.back();
+        where.erase(b);
+        order.pop_back();
+        return b;
+    }
+
+private:
+    std::list<block_t> order;
+    std::unordered_map<block_t, std::list<block_t>::iterator> where;
+};
+
+class lru_sim_t : public cache_sim_t
+{
+public:
+    explicit lru_sim_t(size_t c) : cap(c) {}
+    bool access(block_t b)
+    {
+        if (lru.contains(b))
+        {
+            lru.touch(b);
+            return true;
+        }
+        if (lru.size() >= cap) lru.pop_back();
+        lru.push_front(b);
+        return false;
+    }
+
+private:
+    size_t cap;
+    lru_list_t lru;
+};
+
+// 2Q（Johnson & Shasha）：首次访问的块进入 FIFO 队列 A1in，被淘汰后只在 A1out 中留下块号；
+// 在 A1out 中再次被访问的块才进入主 LRU 队列 Am，因此一次性扫描不会冲掉热块
+class twoq_sim_t : public cache_sim_t
+{
+public:
+    explicit twoq_sim_t(size_t c) : cap(c), kin(c / 4 ? c / 4 : 1), kout(c / 2 ? c / 2 : 1) {}
+    bool access(block_t b)
+    {
+        if (am.contains(b))
+        {
+            am.touch(b);
+            return true;
+        }
+        if (a1in.contains(b)) return true;
+        if (a1out.contains(b))
+        {
+            a1out.remove(b);
+            reclaim();
+            am.push_front(b);
+            return false;
+        }
+        reclaim();
+        a1in.push_front(b);
+        return false;
+    }
+
+private:
+    size_t cap, kin, kout;
+    lru_list_t am, a1in, a1out;
+
+    void reclaim()
+    {
+        if (am.size() + a1in.size() < cap) return;
+        if (a1in.size() > kin || am.size() == 0)
+        {
+            a1out.push_front(a1in.pop_back());
+            if (a1out.size() > kout) a1out.pop_back();
+        }
+        else
+        {
+            am.pop_back();
+        }
+    }
+};
+
+// ARC（Megiddo & Modha）：T1/T2 分别保存只访问过一次和多次的块，B1/B2 是它们的淘汰历史，
+// 根据在哪个历史中命中自适应地调整 T1 的目标大小 p
+class arc_sim_t : public cache_sim_t
+{
+public:
+    explicit arc_sim_t(size_t c) : cap(c), p(0) {}
+    bool access(block_t b)
+    {
+        if (t1.contains(b))
+        {
+            t1.remove(b);
+            t2.push_front(b);
+            return true;
+        }
+        if (t2.contains(b))
+        {
+            t2.touch(b);
+            return true;
+        }
+        if (b1.contains(b))
+        {
+            size_t d = b2.size() > b1.size() ? b2.size() / b1.size() : 1;
+            p = p + d < cap ? p + d : cap;
+            replace(false);
+            b1.remove(b);
+            t2.push_front(b);
+            return false;
+        }
+        if (b2.contains(b))
+        {
+            size_t d = b1.size() > b2.size() ? b1.size() / b2.size() : 1;
+            p = p > d ? p - d : 0;
+            replace(true);
+            b2.remove(b);
+            t2.push_front(b);
+            return false;
+        }
+
+        size_t l1 = t1.size() + b1.size();
+        size_t total = l1 + t2.size() + b2.size();
+        if (l1 == cap)
+        {
+            if (t1.size() < cap)
+            {
+                b1.pop_back();
+                replace(false);
+            }
+            else
+            {
+                t1.pop_back();
+            }
+        }
+        else if (total >= cap)
+        {
+            if (total == 2 * cap) b2.pop_back();
+            replace(false);
+        }
+        t1.push_front(b);
+        return false;
+    }
+
+private:
+    size_t cap, p;
+    lru_list_t t1, t2, b1, b2;
+
+    void replace(bool in_b2)
+    {
+        if (t1.size() > 0 && ((in_b2 && t1.size() == p) || t1.size() > p))
+            b1.push_front(t1.pop_back());
+        else if (t2.size() > 0)
+            b2.push_front(t2.pop_back());
+    }
+};
+
+// OPT（Belady）：淘汰下次使用最远的块，是任何在线策略命中率的上界
+class opt_sim_t : public cache_sim_t
+{
+public:
+    opt_sim_t(size_t c, const std::vector<size_t>& next_use) : cap(c), next(next_use), pos(0) {}
+    bool access(block_t b)
+    {
+        size_t n = next[pos++];
+        auto it = resident.find(b);
+        bool hit = it != resident.end();
+        if (hit)
+        {
+            by_next.erase(std::make_pair(it->second, b));
+        }
+        else if (resident.size() >= cap)
+        {
+            auto victim = std::prev(by_next.end());
+            resident.erase(victim->second);
+            by_next.erase(victim);
+        }
+        resident[b] = n;
+        by_next.insert(std::make_pair(n, b));
+        return hit;
+    }
+
+private:
+    size_t cap;
+    const std::vector<size_t>& next;
+    size_t pos;
+    std::unordered_map<block_t, size_t> resident; // 块 -> 下次使用的位置
+    std::set<std::pair<size_t, block_t>> by_next;
+};
+
+static cache_sim_t* make_sim(const std::string& policy, size_t cap, const std::vector<size_t>& next_use)
+{
+    if (policy == "lru") return new lru_sim_t(cap);
+    if (policy == "2q") return new twoq_sim_t(cap);
+    if (policy == "arc") return new arc_sim_t(cap);
+    if (policy == "opt") return new opt_sim_t(cap, next_use);
+    return nullptr;
+}
+
+static std::vector<std::string> split_list(const char* s)
+{
+    std::vector<std::string> v;
+    std::string cur;
+    for (; *s; s++)
+    {
+        if (*s == ',')
+        {
+            if (!cur.empty()) v.push_back(cur);
+            cur.clear();
+        }
+        else cur += *s;
+    }
+    if (!cur.empty()) v.push_back(cur);
+    return v;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("ext2replay <trace_file> [--sizes N,N,...] [--policies lru,2q,arc,opt] [--reads-only] [--by-command]\n");
+        return 1;
+    }
+    std::vector<size_t> sizes;
+    std::vector<std::string> policies = { "lru", "2q", "arc", "opt" };
+    bool reads_only = false, by_command = false;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a == "--reads-only") reads_only = true;
+        else if (a == "--by-command") by_command = true;
+        else if (a == "--sizes" && i + 1 < argc)
+        {
+            std::vector<std::string> v = split_list(argv[++i]);
+            for (size_t j = 0; j < v.size(); j++)
+                if (atoi(v[j].c_str()) > 0) sizes.push_back(atoi(v[j].c_str()));
+        }
+        else if (a == "--policies" && i + 1 < argc) policies = split_list(argv[++i]);
+        else
+        {
+            printf("unknown option %s\n", a.c_str());
+            return 1;
+        }
+    }
+    std::vector<size_t> no_next;
+    for (size_t i = 0; i < policies.size(); i++)
+    {
+        cache_sim_t* sim = make_sim(policies[i], 1, no_next);
+        if (!sim)
+        {
+            printf("unknown policy %s\n", policies[i].c_str());
+            return 1;
+        }
+        delete sim;
+    }
+
+    // 读入跟踪文件，把每条记录展开为它覆盖的块
+    FILE* f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+        header.block_size < 1024 || header.block_size > 65536)
+    {
+        printf("%s is not a trace file\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+
+    std::vector<std::string> cmd_names(256, "-");
+    std::vector<access_t> accesses;
+    unsigned __int64 reads = 0, writes = 0;
+    unsigned __int64 bytes_read = 0, bytes_written = 0, last_time = 0;
+    trace_record_t r;
+    while (fread(&r, sizeof(r), 1, f) == 1)
+    {
+        if (r.kind == TRACE_COMMAND)
+        {
+            char name[256];
+            if (r.size > 255 || fread(name, r.size, 1, f) != 1) break;
+            cmd_names[r.block & 0xFF] = std::string(name, r.size);
+            continue;
+        }
+        last_time = r.time_us;
+        if (r.kind == TRACE_WRITE)
+        {
+            writes++;
+            bytes_written += r.size;
+            if (reads_only) continue;
+        }
+        else
+        {
+            reads++;
+            bytes_read += r.size;
+        }
+        block_t last = r.block + (block_t)(((unsigned __int64)r.offset + r.size - 1) / header.block_size);
+        for (block_t b = r.block; b <= last; b++)
+        {
+            access_t a = { b, r.cmd };
+            accesses.push_back(a);
+        }
+    }
+    fclose(f);
+
+    // 每次访问的下一次使用位置，供 OPT 使用；同时统计不同的块数
+    std::vector<size_t> next_use(accesses.size());
+    std::unordered_map<block_t, size_t> seen;
+    for (size_t i = accesses.size(); i-- > 0;)
+    {
+        auto it = seen.find(accesses[i].block);
+        next_use[i] = it == seen.end() ? (size_t)-1 : it->second;
+        seen[accesses[i].block] = i;
+    }
+    size_t distinct = seen.size();
+
+    printf("trace %s: block size %u, %.3f s\n", argv[1], header.block_size, last_time / 1e6);
+    printf("  %llu reads (%llu bytes), %llu writes (%llu bytes)\n", reads, bytes_read, writes, bytes_written);
+    printf("  %zu block accesses%s, %zu distinct blocks\n", accesses.size(), reads_only ? " (reads only)" : "", distinct);
+    if (accesses.empty()) return 0;
+
+    if (sizes.empty())
+    {
+        for (size_t s = 16; ; s *= 4)
+        {
+            sizes.push_back(s < distinct ? s : distinct);
+            if (s >= distinct) break;
+        }
+    }
+
+    // hits[策略][容量][命令]
+    std::vector<unsigned __int64> per_cmd(256, 0);
+    for (size_t i = 0; i < accesses.size(); i++) per_cmd[accesses[i].cmd]++;
+    std::vector<std::vector<std::vector<unsigned __int64>>> hits(policies.size(),
+        std::vector<std::vector<unsigned __int64>>(sizes.size(), std::vector<unsigned __int64>(256, 0)));
+    for (size_t p = 0; p < policies.size(); p++)
+    {
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            cache_sim_t* sim = make_sim(policies[p], sizes[s], next_use);
+            for (size_t i = 0; i < accesses.size(); i++)
+                if (sim->access(accesses[i].block)) hits[p][s][accesses[i].cmd]++;
+            delete sim;
+        }
+    }
+
+    // c < 0 时输出总体命中率，否则只统计命令 c 的访问
+    auto print_table = [&](int c)
+    {
+        if (c < 0) printf("\nhit rate, all commands\n");
+        else printf("\nhit rate, command '%s' (%llu accesses)\n", cmd_names[c].c_str(), per_cmd[c]);
+
+        printf("%12s %10s", "blocks", "KB");
+        for (size_t p = 0; p < policies.size(); p++) printf(" %8s", policies[p].c_str());
+        printf("\n");
+        for (size_t s = 0; s < sizes.size(); s++)
+        {
+            printf("%12zu %10llu", sizes[s], (unsigned __int64)sizes[s] * header.block_size / 1024);
+            for (size_t p = 0; p < policies.size(); p++)
+            {
+                unsigned __int64 h = 0, n = c < 0 ? accesses.size() : per_cmd[c];
+                if (c < 0)
+                    for (int k = 0; k < 256; k++) h += hits[p][s][k];
+                else
+                    h = hits[p][s][c];
+                printf(" %7.2f%%", 100.0 * h / n);
+            }
+            printf("\n");
+        }
+    };
+    print_table(-1);
+    if (by_command)
+        for (int c = 0; c < 256; c++)
+            if (per_cmd[c]) print_table(c);
+    return 0;
+}
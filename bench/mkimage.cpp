@@ -0,0 +1,445 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "mkimage.h"
+
+// 在内存中按 ext2 修订版 1 的布局直接构造文件系统（不依赖 mke2fs），然后连同 MBR 一起写入文件。
+// 布局：每组都有超级块和组描述符表的副本（不启用 sparse_super），之后依次是块位图、inode 位图、
+// inode 表和数据块；inode 大小固定为 128 字节，只启用 filetype 特性。
+
+#define MKIMAGE_PART_START 2048 // 分区起始扇区
+#define MKIMAGE_INODE_SIZE 128
+#define MKIMAGE_ROOT_INO   2
+#define MKIMAGE_FIRST_INO  11   // lost+found，之前的 inode 保留
+#define MKIMAGE_FT_REG     1    // 目录项中的文件类型
+#define MKIMAGE_FT_DIR     2
+
+namespace {
+
+struct entry_t
+{
+    std::string name;
+    unsigned __int32 ino;
+    unsigned __int8 type;
+};
+
+struct dir_t
+{
+    unsigned __int32 ino;
+    unsigned __int32 parent;
+    unsigned __int32 subdirs;
+    std::vector<entry_t> entries;
+};
+
+class builder_t
+{
+public:
+    builder_t(const mkimage_opts_t& o) : opts(o), rng(o.seed), failed(false) {}
+    bool build(const char* path, mkimage_result_t* result);
+
+private:
+    const mkimage_opts_t& opts;
+    std::mt19937 rng;
+    bool failed;
+
+    unsigned __int32 bs, fdb, blocks_count, bpg, ipg, groups, gdt_blocks, itb, inodes_count;
+    std::vector<unsigned __int8> fs; // 整个分区的内容
+    std::vector<unsigned __int8> bused; // 块是否已用
+    std::vector<unsigned __int8> iused; // inode 是否已用，下标为 inode 号
+    unsigned __int32 cursor; // 下一次分配数据块的起点
+    unsigned __int32 next_ino;
+    std::vector<dir_t> dirs; // [0] 为根目录，[1] 为 lost+found
+
+    unsigned __int32 group_start(unsigned __int32 g) { return fdb + g * bpg; }
+    unsigned __int32 block_bitmap(unsigned __int32 g) { return group_start(g) + 1 + gdt_blocks; }
+    unsigned __int32 inode_bitmap(unsigned __int32 g) { return block_bitmap(g) + 1; }
+    unsigned __int32 inode_table(unsigned __int32 g) { return block_bitmap(g) + 2; }
+    unsigned __int8* block(unsigned __int32 bn) { return fs.data() + (size_t)bn * bs; }
+    ext2_inode* inode(unsigned __int32 ino)
+    {
+        unsigned __int32 g = (ino - 1) / ipg;
+        return (ext2_inode*)(block(inode_table(g)) + (size_t)((ino - 1) % ipg) * MKIMAGE_INODE_SIZE);
+    }
+
+    bool layout(unsigned __int64 dir_count);
+    unsigned __int32 alloc_block();
+    unsigned __int32 alloc_inode();
+    unsigned __int32 fill_indirect(int level, const std::vector<unsigned __int32>& data, size_t& pos, unsigned __int32& meta);
+    void set_blocks(ext2_inode* in, const std::vector<unsigned __int32>& data);
+    void write_dir(const dir_t& d);
+    void write_metadata(mkimage_result_t* result);
+};
+
+// 根据大小、块大小和需要的 inode 数确定块组划分
+bool builder_t::layout(unsigned __int64 dir_count)
+{
+    bs = opts.block_size;
+    if (bs < 1024 || bs > 65536 || (bs & (bs - 1)) != 0)
+    {
+        printf("mkimage: invalid block size %u\n", bs);
+        return false;
+    }
+    fdb = bs == 1024 ? 1 : 0;
+    // 组描述符中的空闲计数只有 16 位，每组块数和 inode 数都不能超过 65536（与 mke2fs 的上限一致）
+    bpg = 8 * bs < 65528 ? 8 * bs : 65528;
+    unsigned __int64 total = (unsigned __int64)opts.size_mb * 1024 * 1024 / bs;
+    if (total > 0xFFFFFFFFull) total = 0xFFFFFFFFull;
+    blocks_count = (unsigned __int32)total;
+
+    unsigned __int64 need = opts.files + dir_count + MKIMAGE_FIRST_INO + 16;
+    unsigned __int32 per_block = bs / MKIMAGE_INODE_SIZE;
+    unsigned __int32 unit = per_block > 8 ? per_block : 8;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (blocks_count <= fdb)
+        {
+            printf("mkimage: image too small\n");
+            return false;
+        }
+        groups = (blocks_count - fdb + bpg - 1) / bpg;
+        gdt_blocks = (unsigned __int32)(((unsigned __int64)groups * sizeof(ext2_group_desc) + bs - 1) / bs);
+
+        // 默认每 16KB 一个 inode，文件很多时按需要加大
+        unsigned __int64 want = (unsigned __int64)(blocks_count - fdb) / groups * bs / 16384;
+        unsigned __int64 min_ipg = (need + groups - 1) / groups;
+        if (want < min_ipg) want = min_ipg;
+        want = (want + unit - 1) / unit * unit;
+        unsigned __int64 max_ipg = 8ull * bs < 65536 - per_block ? 8ull * bs : 65536 - per_block;
+        if (want > max_ipg)
+        {
+            printf("mkimage: too many files/directories for a %u MB image\n", opts.size_mb);
+            return false;
+        }
+        ipg = (unsigned __int32)want;
+        itb = ipg * MKIMAGE_INODE_SIZE / bs;
+
+        // 最后一组太小放不下元数据时舍弃
+        unsigned __int32 last = blocks_count - fdb - (groups - 1) * bpg;
+        if (last >= 1 + gdt_blocks + 2 + itb + 50) break;
+        if (groups == 1)
+        {
+            printf("mkimage: image too small\n");
+            return false;
+        }
+        blocks_count = fdb + (groups - 1) * bpg;
+    }
+    inodes_count = ipg * groups;
+    return true;
+}
+
+unsigned __int32 builder_t::alloc_block()
+{
+    // 碎片化：以 frag 的概率跳过 1~16 个块，留下空洞，使文件和空闲空间都不连续
+    if (opts.frag > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < opts.frag)
+        cursor += 1 + rng() % 16;
+    for (unsigned __int32 n = 0; n < blocks_count; n++, cursor++)
+    {
+        if (cursor >= blocks_count) cursor = fdb;
+        if (!bused[cursor])
+        {
+            bused[cursor] = 1;
+            return cursor++;
+        }
+    }
+    if (!failed) printf("mkimage: out of blocks\n");
+    failed = true;
+    return 0;
+}
+
+unsigned __int32 builder_t::alloc_inode()
+{
+    if (next_ino > inodes_count)
+    {
+        if (!failed) printf("mkimage: out of inodes\n");
+        failed = true;
+        return 0;
+    }
+    iused[next_ino] = 1;
+    return next_ino++;
+}
+
+// 分配一个 level 级间接块，依次填入 data[pos...]
+unsigned __int32 builder_t::fill_indirect(int level, const std::vector<unsigned __int32>& data, size_t& pos, unsigned __int32& meta)
+{
+    unsigned __int32 bn = alloc_block();
+    if (bn == 0) return 0;
+    meta++;
+    le32* ptr = (le32*)block(bn);
+    for (unsigned __int32 i = 0; i < bs / 4 && pos < data.size(); i++)
+        ptr[i] = level == 1 ? data[pos++] : fill_indirect(level - 1, data, pos, meta);
+    return bn;
+}
+
+// 把数据块号写入 inode 的块映射（必要时建立间接块），并设置 i_blocks
+void builder_t::set_blocks(ext2_inode* in, const std::vector<unsigned __int32>& data)
+{
+    unsigned __int32 meta = 0;
+    size_t pos = 0;
+    for (; pos < 12 && pos < data.size(); pos++)
+        in->i_block[pos] = data[pos];
+    for (int level = 1; level <= 3 && pos < data.size(); level++)
+        in->i_block[11 + level] = fill_indirect(level, data, pos, meta);
+    in->i_blocks = (unsigned __int32)((data.size() + meta) * (bs / 512));
+}
+
+// 生成目录块：依次放入 "."、".." 和全部子项，每块最后一项的 rec_len 延伸到块尾
+void builder_t::write_dir(const dir_t& d)
+{
+    std::vector<entry_t> all;
+    entry_t dot = { ".", d.ino, MKIMAGE_FT_DIR };
+    entry_t dotdot = { "..", d.parent, MKIMAGE_FT_DIR };
+    all.push_back(dot);
+    all.push_back(dotdot);
+    all.insert(all.end(), d.entries.begin(), d.entries.end());
+
+    std::vector<unsigned __int32> blocks;
+    unsigned __int8* cur = nullptr;
+    unsigned __int32 off = 0, prev = 0;
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        unsigned __int32 rec_len = 8 + (((unsigned __int32)all[i].name.size() + 3) & ~3u);
+        if (!cur || off + rec_len > bs)
+        {
+            if (cur) ((ext2_dir_entry*)(cur + prev))->rec_len = rec_len_to_disk(bs - prev);
+            unsigned __int32 bn = alloc_block();
+            if (bn == 0) return;
+            blocks.push_back(bn);
+            cur = block(bn);
+            off = 0;
+        }
+        ext2_dir_entry* de = (ext2_dir_entry*)(cur + off);
+        de->inode = all[i].ino;
+        de->rec_len = rec_len;
+        de->name_len = (unsigned __int8)all[i].name.size();
+        de->file_type = all[i].type;
+        memcpy(de->name, all[i].name.data(), all[i].name.size());
+        prev = off;
+        off += rec_len;
+    }
+    ((ext2_dir_entry*)(cur + prev))->rec_len = rec_len_to_disk(bs - prev);
+
+    ext2_inode* in = inode(d.ino);
+    unsigned __int32 now = (unsigned __int32)time(NULL);
+    in->i_mode = d.ino == MKIMAGE_FIRST_INO ? 0x41C0 : 0x41ED;
+    in->i_size = (unsigned __int32)blocks.size() * bs;
+    in->i_atime = now;
+    in->i_ctime = now;
+    in->i_mtime = now;
+    in->i_links_count = 2 + d.subdirs;
+    set_blocks(in, blocks);
+}
+
+// 写位图、组描述符表和超级块（含各组的副本）
+void builder_t::write_metadata(mkimage_result_t* result)
+{
+    std::vector<ext2_group_desc> gdt(groups);
+    memset(gdt.data(), 0, gdt.size() * sizeof(ext2_group_desc));
+    unsigned __int32 free_blocks = 0, free_inodes = 0;
+
+    for (unsigned __int32 g = 0; g < groups; g++)
+    {
+        unsigned __int32 gs = group_start(g);
+        unsigned __int8* bb = block(block_bitmap(g));
+        unsigned __int32 gfree = 0;
+        for (unsigned __int32 i = 0; i < 8 * bs; i++)
+        {
+            unsigned __int32 bn = gs + i;
+            if (i >= bpg || bn >= blocks_count || bused[bn]) bb[i >> 3] |= 1 << (i & 7);
+            else gfree++;
+        }
+
+        unsigned __int8* ib = block(inode_bitmap(g));
+        unsigned __int32 ifree = 0;
+        for (unsigned __int32 i = 0; i < 8 * bs; i++)
+        {
+            if (i >= ipg || iused[g * ipg + i + 1]) ib[i >> 3] |= 1 << (i & 7);
+            else ifree++;
+        }
+
+        gdt[g].bg_block_bitmap = block_bitmap(g);
+        gdt[g].bg_inode_bitmap = inode_bitmap(g);
+        gdt[g].bg_inode_table = inode_table(g);
+        gdt[g].bg_free_blocks_count = (unsigned __int16)gfree;
+        gdt[g].bg_free_inodes_count = (unsigned __int16)ifree;
+        free_blocks += gfree;
+        free_inodes += ifree;
+    }
+    for (size_t i = 0; i < dirs.size(); i++)
+        gdt[(dirs[i].ino - 1) / ipg].bg_used_dirs_count += 1;
+
+    ext2_super_block sb;
+    memset(&sb, 0, sizeof(sb));
+    unsigned __int32 now = (unsigned __int32)time(NULL);
+    unsigned __int32 log = 0;
+    while ((1024u << log) < bs) log++;
+    sb.s_inodes_count = inodes_count;
+    sb.s_blocks_count = blocks_count;
+    sb.s_free_blocks_count = free_blocks;
+    sb.s_free_inodes_count = free_inodes;
+    sb.s_first_data_block = fdb;
+    sb.s_log_block_size = log;
+    sb.s_log_frag_size = log;
+    sb.s_blocks_per_group = bpg;
+    sb.s_frags_per_group = bpg;
+    sb.s_inodes_per_group = ipg;
+    sb.s_wtime = now;
+    sb.s_max_mnt_count = 0xFFFF;
+    sb.s_magic = 0xEF53;
+    sb.s_state = 1;  // 干净卸载
+    sb.s_errors = 1; // 出错时继续
+    sb.s_lastcheck = now;
+    sb.s_rev_level = 1;
+    sb.s_first_ino = MKIMAGE_FIRST_INO;
+    sb.s_inode_size = MKIMAGE_INODE_SIZE;
+    sb.s_feature_incompat = 0x0002; // filetype
+    for (int i = 0; i < 16; i++) sb.s_uuid[i] = (unsigned __int8)rng();
+    memcpy(sb.s_volume_name, "bench", 5);
+    sb.s_mkfs_time = now;
+
+    for (unsigned __int32 g = 0; g < groups; g++)
+    {
+        sb.s_block_group_nr = (unsigned __int16)g;
+        unsigned __int8* at = g == 0 ? fs.data() + 1024 : block(group_start(g));
+        memcpy(at, &sb, sizeof(sb));
+        memcpy(block(group_start(g) + 1), gdt.data(), gdt.size() * sizeof(ext2_group_desc));
+    }
+
+    if (result)
+    {
+        result->free_blocks = free_blocks;
+        result->free_inodes = free_inodes;
+    }
+}
+
+bool builder_t::build(const char* path, mkimage_result_t* result)
+{
+    // 目录树：depth 层，每层每个目录 fanout 个子目录
+    unsigned __int64 dir_count = 0, level_count = 1;
+    for (unsigned __int32 l = 0; l < opts.depth && dir_count < 0xFFFFFFFFull; l++)
+    {
+        level_count *= opts.fanout;
+        dir_count += level_count;
+    }
+    if (!layout(dir_count)) return false;
+
+    fs.assign((size_t)blocks_count * bs, 0);
+    bused.assign(blocks_count, 0);
+    iused.assign(inodes_count + 1, 0);
+    for (unsigned __int32 bn = 0; bn < fdb; bn++) bused[bn] = 1;
+    for (unsigned __int32 g = 0; g < groups; g++)
+        for (unsigned __int32 bn = group_start(g); bn < inode_table(g) + itb; bn++)
+            bused[bn] = 1;
+    for (unsigned __int32 ino = 1; ino <= MKIMAGE_FIRST_INO; ino++) iused[ino] = 1;
+    next_ino = MKIMAGE_FIRST_INO + 1;
+    cursor = inode_table(0) + itb;
+
+    dir_t root = { MKIMAGE_ROOT_INO, MKIMAGE_ROOT_INO, 1 };
+    dir_t lost = { MKIMAGE_FIRST_INO, MKIMAGE_ROOT_INO, 0 };
+    entry_t lost_entry = { "lost+found", MKIMAGE_FIRST_INO, MKIMAGE_FT_DIR };
+    root.entries.push_back(lost_entry);
+    dirs.push_back(root);
+    dirs.push_back(lost);
+
+    // 按层生成目录；文件轮转分布在根目录和所有生成的目录中
+    std::vector<size_t> holders(1, 0), frontier(1, 0);
+    unsigned __int32 dir_index = 0;
+    for (unsigned __int32 l = 0; l < opts.depth && !failed; l++)
+    {
+        std::vector<size_t> next;
+        for (size_t p = 0; p < frontier.size() && !failed; p++)
+        {
+            for (unsigned __int32 k = 0; k < opts.fanout && !failed; k++)
+            {
+                dir_t d = { alloc_inode(), dirs[frontier[p]].ino, 0 };
+                entry_t e = { "d" + std::to_string(dir_index++), d.ino, MKIMAGE_FT_DIR };
+                dirs[frontier[p]].entries.push_back(e);
+                dirs[frontier[p]].subdirs++;
+                dirs.push_back(d);
+                next.push_back(dirs.size() - 1);
+                holders.push_back(dirs.size() - 1);
+            }
+        }
+        frontier.swap(next);
+    }
+
+    unsigned __int32 nb = (opts.file_size + bs - 1) / bs;
+    unsigned __int32 now = (unsigned __int32)time(NULL);
+    std::vector<unsigned __int32> data;
+    for (unsigned __int32 i = 0; i < opts.files && !failed; i++)
+    {
+        unsigned __int32 ino = alloc_inode();
+        data.clear();
+        for (unsigned __int32 b = 0; b < nb && !failed; b++)
+        {
+            unsigned __int32 bn = alloc_block();
+            data.push_back(bn);
+            unsigned __int32 len = b + 1 < nb ? bs : opts.file_size - b * bs;
+            memset(block(bn), 'a' + (i + b) % 26, len);
+        }
+        if (failed) break;
+
+        ext2_inode* in = inode(ino);
+        in->i_mode = 0x81A4;
+        in->i_size = opts.file_size;
+        in->i_atime = now;
+        in->i_ctime = now;
+        in->i_mtime = now;
+        in->i_links_count = 1;
+        set_blocks(in, data);
+
+        entry_t e = { "f" + std::to_string(i), ino, MKIMAGE_FT_REG };
+        dirs[holders[i % holders.size()]].entries.push_back(e);
+    }
+
+    for (size_t i = 0; i < dirs.size() && !failed; i++)
+        write_dir(dirs[i]);
+    if (failed) return false;
+    write_metadata(result);
+
+    // MBR：只有第 0 个分区表项，类型 0x83
+    unsigned __int8 mbr[512];
+    memset(mbr, 0, sizeof(mbr));
+    unsigned __int8* pe = mbr + 0x1be;
+    pe[4] = 0x83;
+    *(le32*)(pe + 8) = MKIMAGE_PART_START;
+    *(le32*)(pe + 12) = (unsigned __int32)((unsigned __int64)blocks_count * bs / 512);
+    mbr[510] = 0x55;
+    mbr[511] = 0xAA;
+
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        printf("mkimage: cannot create %s\n", path);
+        return false;
+    }
+    std::vector<unsigned __int8> gap(MKIMAGE_PART_START * 512 - sizeof(mbr), 0);
+    bool ok = fwrite(mbr, sizeof(mbr), 1, f) == 1 && fwrite(gap.data(), gap.size(), 1, f) == 1 &&
+        fwrite(fs.data(), fs.size(), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+    {
+        printf("mkimage: write to %s failed\n", path);
+        return false;
+    }
+
+    if (result)
+    {
+        result->dirs = (unsigned __int32)(dirs.size() - 2);
+        result->files = opts.files;
+        result->data_bytes = (unsigned __int64)opts.files * opts.file_size;
+    }
+    return true;
+}
+
+} // namespace
+
+bool make_image(const char* path, const mkimage_opts_t& opts, mkimage_result_t* result)
+{
+    builder_t b(opts);
+    return b.build(path, result);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ext2.h"
+
+// 合成 ext2 镜像的参数
+struct mkimage_opts_t
+{
+    unsigned __int32 size_mb;     // 文件系统大小（MB）
+    unsigned __int32 block_size;  // 1024/2048/4096/...
+    unsigned __int32 files;       // 普通文件数量
+    unsigned __int32 depth;       // 目录树层数（0 表示只有根目录）
+    unsigned __int32 fanout;      // 每个目录的子目录数
+    unsigned __int32 file_size;   // 每个文件的字节数
+    double frag;                  // 碎片化程度 0~1：分配数据块时以该概率跳过一段空闲块
+    unsigned __int32 seed;
+
+    mkimage_opts_t()
+        : size_mb(64), block_size(1024), files(1000), depth(2), fanout(4),
+        file_size(4096), frag(0.0), seed(1) {}
+};
+
+// 生成结果，便于基准测试挑选操作对象
+struct mkimage_result_t
+{
+    unsigned __int32 dirs;        // 目录数（不含根目录和 lost+found）
+    unsigned __int32 files;
+    unsigned __int64 data_bytes;  // 文件内容总字节数
+    unsigned __int32 free_blocks;
+    unsigned __int32 free_inodes;
+};
+
+// 在 path 生成一个磁盘镜像：MBR 的第 0 个分区从第 2048 扇区开始，内容是按 opts 填充好的 ext2 文件系统。
+// 目录 i 命名为 "d<i>"，文件命名为 "f<i>"，按轮转分布在所有目录中。失败时返回 false 并打印原因。
+bool make_image(const char* path, const mkimage_opts_t& opts, mkimage_result_t* result);
@@ -0,0 +1,178 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include "ext2.h"
+#include "parallel.h"
+#include "digest.h"
+
+// dedup_report：块级去重分析。
+// 1. 块位图中已分配、且属于文件数据（或没有任何属主）的块按物理顺序大块读取，工作线程计算 XXH3 指纹；
+//    指纹按高 8 位分到 256 个分片，每个线程各有一套分片，不需要加锁。
+// 2. 每个分片由一个工作项合并各线程的部分并排序，指纹相同的块归为一簇。
+//    64 位指纹在上亿个块中碰撞的概率可以忽略，不再逐字节比较。
+// 3. 每簇保留物理块号最小的一块，其余的算作可节省的空间，记到它的属主文件和所在目录上。
+
+#define DEDUP_SHARD_BITS 8
+#define DEDUP_SHOW 20 // 每个排行最多列出的项数
+
+static unsigned __int64 block_fingerprint(const unsigned __int8* data, size_t len)
+{
+    xxh3_t h;
+    h.update(data, len);
+    return h.digest();
+}
+
+void ext2_t::dedup_report(const std::vector<std::string>& args)
+{
+    unsigned threads = parallel_run_t::default_threads();
+    bool usage = false;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-j" && i + 1 < args.size()) threads = (unsigned)atoi(args[++i].c_str());
+        else usage = true;
+    }
+    if (usage || threads == 0 || threads > 64)
+    {
+        printf("Usage: dedup_report [-j threads]\n");
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const owner_map_t* map = owner_map();
+    std::vector<unsigned __int8> bitmap;
+    if (!map || !read_block_bitmaps(threads, bitmap))
+    {
+        printf("Failed to read block bitmaps.\n");
+        return;
+    }
+
+    // 1. 要比较的块：已分配的数据块，以及已分配但没有属主的块
+    const std::vector<owner_extent_t>& items = map->extents();
+    std::vector<unsigned __int32> blocks;
+    size_t e = 0;
+    for (unsigned __int32 bn = first_data_block; bn < blocks_count; bn++)
+    {
+        while (e < items.size() && items[e].pblk + items[e].len <= bn) e++;
+        if (e < items.size() && items[e].pblk <= bn)
+        {
+            if (!owner_map_t::is_data(items[e].kind))
+            {
+                bn = items[e].pblk + items[e].len - 1; // 跳过整段元数据
+                continue;
+            }
+        }
+        if (bitmap_test(bitmap, bn)) blocks.push_back(bn);
+    }
+
+    struct fp_t
+    {
+        unsigned __int64 fp;
+        unsigned __int32 index; // 在 blocks 中的下标
+    };
+    const unsigned shards = 1u << DEDUP_SHARD_BITS;
+    std::vector<std::vector<std::vector<fp_t>>> parts(threads, std::vector<std::vector<fp_t>>(shards));
+    if (!scan_blocks(blocks, threads, [&](unsigned w, size_t index, const unsigned __int8* data) {
+        fp_t f = { block_fingerprint(data, block_size), (unsigned __int32)index };
+        parts[w][f.fp >> (64 - DEDUP_SHARD_BITS)].push_back(f);
+    }))
+    {
+        printf("Failed to read data blocks.\n");
+        return;
+    }
+    unsigned __int64 scan_ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // 2. 分片内排序并找出重复的块
+    std::vector<unsigned __int8> zero(block_size, 0);
+    unsigned __int64 zero_fp = block_fingerprint(zero.data(), block_size);
+    struct shard_result_t
+    {
+        std::vector<unsigned __int32> redundant; // 每簇中除保留的一块以外的块（blocks 中的下标）
+        unsigned __int64 clusters;
+        unsigned __int64 zero_blocks;
+    };
+    std::vector<shard_result_t> results(shards);
+    {
+        parallel_run_t run(shards, threads, [&](size_t s, unsigned) {
+            std::vector<fp_t> all;
+            for (unsigned t = 0; t < threads; t++)
+            {
+                all.insert(all.end(), parts[t][s].begin(), parts[t][s].end());
+                std::vector<fp_t>().swap(parts[t][s]);
+            }
+            std::sort(all.begin(), all.end(), [](const fp_t& x, const fp_t& y) { return x.fp != y.fp ? x.fp < y.fp : x.index < y.index; });
+            shard_result_t& r = results[s];
+            r.clusters = 0;
+            r.zero_blocks = 0;
+            for (size_t i = 0; i < all.size(); )
+            {
+                size_t j = i + 1;
+                while (j < all.size() && all[j].fp == all[i].fp) j++;
+                if (all[i].fp == zero_fp) r.zero_blocks += j - i;
+                if (j - i > 1)
+                {
+                    r.clusters++;
+                    for (size_t k = i + 1; k < j; k++) r.redundant.push_back(all[k].index);
+                }
+                i = j;
+            }
+        });
+    }
+
+    // 3. 按属主文件和所在目录汇总可节省的块
+    unsigned __int64 clusters = 0, zero_blocks = 0, redundant = 0, unowned = 0;
+    std::unordered_map<unsigned __int32, unsigned __int64> per_file;
+    for (unsigned s = 0; s < shards; s++)
+    {
+        clusters += results[s].clusters;
+        zero_blocks += results[s].zero_blocks;
+        for (size_t i = 0; i < results[s].redundant.size(); i++)
+        {
+            const owner_extent_t* o = map->find(blocks[results[s].redundant[i]]);
+            if (o) per_file[o->owner]++;
+            else unowned++;
+            redundant++;
+        }
+    }
+    std::vector<std::pair<unsigned __int64, std::string>> files, dirs;
+    std::unordered_map<std::string, unsigned __int64> per_dir;
+    for (auto it = per_file.begin(); it != per_file.end(); ++it)
+    {
+        std::string path;
+        if (!path_of(it->first, path)) path = "?/inode " + std::to_string(it->first);
+        files.push_back(std::make_pair(it->second, path));
+        size_t slash = path.rfind('/');
+        per_dir[slash == 0 ? "/" : path.substr(0, slash)] += it->second;
+    }
+    for (auto it = per_dir.begin(); it != per_dir.end(); ++it) dirs.push_back(std::make_pair(it->second, it->first));
+    auto by_savings = [](const std::pair<unsigned __int64, std::string>& x, const std::pair<unsigned __int64, std::string>& y) {
+        return x.first != y.first ? x.first > y.first : x.second < y.second;
+    };
+    std::sort(files.begin(), files.end(), by_savings);
+    std::sort(dirs.begin(), dirs.end(), by_savings);
+
+    unsigned __int64 total = blocks.size();
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    unsigned __int64 mb = (total << block_shift) >> 20;
+    printf("%llu data blocks (%llu MB) fingerprinted in %llu ms (%llu MB/s, %u threads)\n", total, mb, scan_ms,
+        scan_ms ? mb * 1000 / scan_ms : 0, threads);
+    printf("%llu unique, %llu duplicate blocks in %llu clusters, %llu all-zero blocks\n", total - redundant, redundant,
+        clusters, zero_blocks);
+    printf("Potential savings: %llu MB (%.1f%% of data)\n", (redundant << block_shift) >> 20,
+        total ? 100.0 * redundant / total : 0.0);
+    auto show = [&](const char* title, const std::vector<std::pair<unsigned __int64, std::string>>& v) {
+        if (v.empty()) return;
+        printf("%s\n", title);
+        for (size_t i = 0; i < v.size() && i < DEDUP_SHOW; i++)
+            printf("  %10llu blocks %8llu KB  %s\n", v[i].first, (v[i].first << block_shift) >> 10, v[i].second.c_str());
+        if (v.size() > DEDUP_SHOW) printf("  ... %zu more\n", v.size() - DEDUP_SHOW);
+    };
+    show("Savings by file:", files);
+    show("Savings by directory:", dirs);
+    if (unowned) printf("%llu duplicate blocks are allocated but not referenced by any file\n", unowned);
+    printf("(%llu ms total)\n", ms);
+}
@@ -0,0 +1,409 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include "ext2.h"
+
+// defrag：把文件的数据块和间接块搬到一段连续的空闲块中，按 ext2 的惯例排列
+// （直接块、一级间接块及其数据块、二级间接块……，即块映射的先序）。
+// 每个文件分两步，保证中途崩溃时文件系统仍然一致：
+// 1. 把数据和改写好的间接块写入目标段。目标段此时在位图中仍是空闲的，没有任何 inode 引用它；
+//    写完后同步到磁盘。
+// 2. 在一个事务中标记目标段已分配、改写 inode 中的块指针、释放旧块，经重做日志原子地提交。
+// 目录整体整理时按文件当前的第一个物理块排序，目标段从前一个文件的末尾往后找，读和写都单向推进。
+
+#define DEFRAG_BATCH_BYTES (4u << 20) // 每次复制的数据量
+#define DEFRAG_ROOT 0xFFFFFFFFu       // 父节点为 inode 本身
+
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+
+struct ext2_t::defrag_node_t
+{
+    unsigned __int32 old;    // 现在的物理块号
+    unsigned __int32 parent; // 父间接块在序列中的下标，DEFRAG_ROOT 表示在 i_block 中
+    unsigned __int32 slot;   // 在父节点（或 i_block）中的位置
+    unsigned __int32 level;  // 0 为数据块，其余为间接块的级数
+};
+
+struct ext2_t::defrag_state_t
+{
+    std::map<unsigned __int32, unsigned __int32> free_runs; // 空闲段：起始块 -> 块数
+    unsigned __int32 goal; // 从这里开始找目标段
+    bool dry_run;
+    unsigned __int64 moved_files, moved_blocks, fragmented;
+};
+
+// 按先序收集 inode 引用的全部块；有越界的块号时返回 false
+bool ext2_t::defrag_walk(const ext2_inode* inode, std::vector<defrag_node_t>& seq)
+{
+    seq.clear();
+    for (unsigned __int32 i = 0; i < 15; i++)
+    {
+        unsigned __int32 b = inode->i_block[i];
+        if (b == 0) continue;
+        if (b < first_data_block || b >= blocks_count) return false;
+        defrag_node_t n = { b, DEFRAG_ROOT, i, i < 12 ? 0 : i - 11 };
+        seq.push_back(n);
+        if (n.level == 0) continue;
+
+        // 间接块用显式栈展开，每层记住下一个要看的指针
+        struct frame_t
+        {
+            unsigned __int32 index; // 在 seq 中的下标
+            unsigned __int32 next;
+            std::vector<le32> ptrs;
+        };
+        std::vector<frame_t> stack(1);
+        stack[0].index = (unsigned __int32)seq.size() - 1;
+        stack[0].next = 0;
+        stack[0].ptrs.resize(block_size / 4);
+        if (!load_block(b, stack[0].ptrs.data())) return false;
+        while (!stack.empty())
+        {
+            frame_t& f = stack.back();
+            if (f.next >= f.ptrs.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            unsigned __int32 slot = f.next++;
+            unsigned __int32 child = f.ptrs[slot];
+            if (child == 0) continue;
+            if (child < first_data_block || child >= blocks_count) return false;
+            unsigned __int32 level = seq[f.index].level - 1;
+            defrag_node_t c = { child, f.index, slot, level };
+            seq.push_back(c);
+            if (level == 0) continue;
+            frame_t nf;
+            nf.index = (unsigned __int32)seq.size() - 1;
+            nf.next = 0;
+            nf.ptrs.resize(block_size / 4);
+            if (!load_block(child, nf.ptrs.data())) return false;
+            stack.push_back(std::move(nf));
+        }
+    }
+    return true;
+}
+
+// 目录 dir（路径为 base）之下的全部普通文件，按路径广度优先；硬链接只列出一次
+void ext2_t::files_under(unsigned __int32 dir, const std::string& base, std::vector<std::pair<unsigned __int32, std::string>>& out)
+{
+    std::vector<ns_entry_t> entries;
+    ns->entries(entries);
+    std::unordered_map<unsigned __int32, std::vector<size_t>> children;
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].ino != entries[i].parent) children[entries[i].parent].push_back(i);
+    std::unordered_set<unsigned __int32> seen;
+    std::string root = base;
+    while (!root.empty() && root[root.size() - 1] == '/') root.erase(root.size() - 1);
+    std::vector<std::pair<unsigned __int32, std::string>> queue(1, std::make_pair(dir, root));
+    for (size_t q = 0; q < queue.size() && queue.size() <= entries.size(); q++)
+    {
+        std::unordered_map<unsigned __int32, std::vector<size_t>>::iterator c = children.find(queue[q].first);
+        if (c == children.end()) continue;
+        for (size_t k = 0; k < c->second.size(); k++)
+        {
+            const ns_entry_t& e = entries[c->second[k]];
+            std::string p = queue[q].second + "/" + e.name;
+            if (e.file_type == EXT2_FT_DIR) queue.push_back(std::make_pair(e.ino, p));
+            else if (e.file_type == EXT2_FT_REG_FILE && seen.insert(e.ino).second) out.push_back(std::make_pair(e.ino, p));
+        }
+    }
+}
+
+// 设置或清除一段块的位图位，并更新各组的空闲计数
+bool ext2_t::mark_blocks(unsigned __int32 start, unsigned __int32 count, bool used)
+{
+    scratch_t scratch(arena());
+    unsigned __int8* bitmap = scratch.alloc<unsigned __int8>(block_size);
+    while (count > 0)
+    {
+        unsigned __int32 g = group_of_block(start);
+        unsigned __int32 i = index_in_group(start);
+        unsigned __int32 n = blocks_per_group - i < count ? blocks_per_group - i : count;
+        unsigned __int32 bb = block_group_descriptor_table[g].bg_block_bitmap;
+        if (!load_block(bb, bitmap)) return false;
+        int changed = 0;
+        for (unsigned __int32 k = i; k < i + n; k++)
+        {
+            unsigned __int8 mask = (unsigned __int8)(1 << (k & 7));
+            if (((bitmap[k >> 3] & mask) != 0) == used) continue;
+            bitmap[k >> 3] ^= mask;
+            changed++;
+        }
+        if (changed)
+        {
+            if (!store_block(bb, bitmap)) return false;
+            adjust_counts(g, used ? -changed : changed, 0, 0);
+            EXT2_STAT(STAT_BITMAP_RMW, 1);
+            EXT2_STAT(used ? STAT_BLOCK_ALLOCS : STAT_BLOCK_FREES, changed);
+        }
+        start += n;
+        count -= n;
+    }
+    return true;
+}
+
+// 在空闲段中从 goal 开始找第一个至少 count 块的位置，找到后从空闲段中扣除；没有时返回 0
+static unsigned __int32 take_run(std::map<unsigned __int32, unsigned __int32>& runs, unsigned __int32 goal, unsigned __int32 count)
+{
+    std::map<unsigned __int32, unsigned __int32>::iterator it = runs.upper_bound(goal);
+    if (it != runs.begin())
+    {
+        std::map<unsigned __int32, unsigned __int32>::iterator prev = it;
+        --prev;
+        if (prev->first + prev->second > goal) it = prev; // goal 落在这一段中
+    }
+    for (int pass = 0; pass < 2; pass++, it = runs.begin())
+    {
+        for (; it != runs.end(); ++it)
+        {
+            unsigned __int32 s = it->first > goal || pass ? it->first : goal;
+            if (it->first + it->second - s < count) continue;
+            unsigned __int32 first = it->first, len = it->second;
+            runs.erase(it);
+            if (s > first) runs[first] = s - first;
+            if (first + len > s + count) runs[s + count] = first + len - (s + count);
+            return s;
+        }
+    }
+    return 0;
+}
+
+static void give_run(std::map<unsigned __int32, unsigned __int32>& runs, unsigned __int32 start, unsigned __int32 count)
+{
+    std::map<unsigned __int32, unsigned __int32>::iterator next = runs.lower_bound(start);
+    if (next != runs.end() && next->first == start + count)
+    {
+        count += next->second;
+        runs.erase(next);
+    }
+    std::map<unsigned __int32, unsigned __int32>::iterator it = runs.lower_bound(start);
+    if (it != runs.begin())
+    {
+        --it;
+        if (it->first + it->second == start)
+        {
+            it->second += count;
+            return;
+        }
+    }
+    runs[start] = count;
+}
+
+// 整理一个文件；返回 false 表示出错（跳过的文件不算出错）
+bool ext2_t::defrag_file(unsigned __int32 ino, const std::string& path, defrag_state_t& st)
+{
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(ino, inode)) return false;
+    if ((inode->i_mode & 0xF000) != 0x8000) return true; // 只整理普通文件
+    std::vector<defrag_node_t> seq;
+    if (!defrag_walk(inode, seq))
+    {
+        printf("inode %u %s: bad block pointers, skipped\n", ino, path.c_str());
+        return true;
+    }
+    unsigned __int32 extents = seq.empty() ? 0 : 1;
+    for (size_t k = 1; k < seq.size(); k++)
+        if (seq[k].old != seq[k - 1].old + 1) extents++;
+    if (extents <= 1) return true;
+    st.fragmented++;
+    unsigned __int32 n = (unsigned __int32)seq.size();
+    if (st.dry_run)
+    {
+        printf("inode %u %s: %u extents (ideal 1), %u blocks\n", ino, path.c_str(), extents, n);
+        return true;
+    }
+    unsigned __int32 dest = take_run(st.free_runs, st.goal, n);
+    if (dest == 0)
+    {
+        printf("inode %u %s: %u extents, no free run of %u blocks\n", ino, path.c_str(), extents, n);
+        return true;
+    }
+
+    // 间接块的新内容：子节点都搬到 dest + 下标处
+    unsigned __int32 ptrs = block_size / 4;
+    std::map<unsigned __int32, std::vector<le32>> tables; // 间接块在 seq 中的下标 -> 新内容
+    le32 roots[15];
+    for (int i = 0; i < 15; i++) roots[i] = inode->i_block[i];
+    for (unsigned __int32 k = 0; k < n; k++)
+    {
+        if (seq[k].level > 0) tables[k].assign(ptrs, le32());
+        if (seq[k].parent == DEFRAG_ROOT) roots[seq[k].slot] = dest + k;
+        else tables[seq[k].parent][seq[k].slot] = dest + k;
+    }
+
+    // 1. 复制到目标段：数据块按物理连续的段合并读取，整批写入
+    unsigned __int32 batch = DEFRAG_BATCH_BYTES >> block_shift;
+    std::vector<unsigned __int8> buf((size_t)batch << block_shift);
+    bool ok = true;
+    for (unsigned __int32 a = 0; a < n && ok; a += batch)
+    {
+        unsigned __int32 b = a + batch < n ? a + batch : n;
+        for (unsigned __int32 k = a; k < b && ok; )
+        {
+            unsigned __int8* out = buf.data() + ((size_t)(k - a) << block_shift);
+            if (seq[k].level > 0)
+            {
+                le32* t = (le32*)out;
+                for (unsigned __int32 i = 0; i < ptrs; i++) t[i] = tables[k][i];
+                k++;
+                continue;
+            }
+            unsigned __int32 e = k + 1;
+            while (e < b && seq[e].level == 0 && seq[e].old == seq[e - 1].old + 1) e++;
+            ok = read_bytes((unsigned __int64)seq[k].old << block_shift, out, (size_t)(e - k) << block_shift);
+            k = e;
+        }
+        if (ok) ok = write_bytes((unsigned __int64)(dest + a) << block_shift, buf.data(), (size_t)(b - a) << block_shift);
+    }
+    if (ok) ok = sync_image();
+    if (!ok)
+    {
+        give_run(st.free_runs, dest, n);
+        printf("inode %u %s: failed to copy data\n", ino, path.c_str());
+        return false;
+    }
+
+    // 2. 一个事务中切换块指针并释放旧块
+    std::vector<unsigned __int32> old(n);
+    for (unsigned __int32 k = 0; k < n; k++) old[k] = seq[k].old;
+    std::sort(old.begin(), old.end());
+    txn_begin();
+    ok = mark_blocks(dest, n, true);
+    for (int i = 0; i < 15; i++) inode->i_block[i] = roots[i];
+    if (ok) ok = store_inode(ino, inode);
+    for (unsigned __int32 k = 0; k < n && ok; )
+    {
+        unsigned __int32 e = k + 1;
+        while (e < n && old[e] == old[e - 1] + 1) e++;
+        ok = mark_blocks(old[k], e - k, false);
+        k = e;
+    }
+    if (!ok)
+    {
+        txn_abort();
+        give_run(st.free_runs, dest, n);
+        printf("inode %u %s: failed to update block map\n", ino, path.c_str());
+        return false;
+    }
+    if (!txn_commit())
+    {
+        printf("inode %u %s: failed to commit\n", ino, path.c_str());
+        return false;
+    }
+    if (ns) ns->touch(ino);
+    for (unsigned __int32 k = 0; k < n; )
+    {
+        unsigned __int32 e = k + 1;
+        while (e < n && old[e] == old[e - 1] + 1) e++;
+        give_run(st.free_runs, old[k], e - k);
+        k = e;
+    }
+    st.goal = dest + n;
+    st.moved_files++;
+    st.moved_blocks += n;
+    printf("inode %u %s: %u extents -> 1, %u blocks moved to %u-%u\n", ino, path.c_str(), extents, n, dest, dest + n - 1);
+    return true;
+}
+
+void ext2_t::defrag(const std::vector<std::string>& args)
+{
+    defrag_state_t st;
+    st.dry_run = false;
+    st.goal = 0;
+    st.moved_files = st.moved_blocks = st.fragmented = 0;
+    std::string target;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-n") st.dry_run = true;
+        else target = args[i];
+    }
+    if (target.empty())
+    {
+        printf("Usage: defrag [-n] <path|inode>\n");
+        return;
+    }
+    if (txn_depth > 0)
+    {
+        printf("Commit or abort the current transaction first.\n");
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // 要整理的文件：inode 号、单个文件，或目录下的全部普通文件
+    std::vector<std::pair<unsigned __int32, std::string>> files;
+    unsigned __int32 top;
+    unsigned __int8 type = 0;
+    if (isdigit((unsigned char)target[0]))
+    {
+        top = (unsigned __int32)strtoul(target.c_str(), NULL, 10);
+        if (top < 1 || top > inodes_count)
+        {
+            printf("Invalid inode number.\n");
+            return;
+        }
+        std::string path;
+        if (!path_of(top, path)) path = "?";
+        files.push_back(std::make_pair(top, path));
+    }
+    else if ((top = resolve_path(target.c_str(), &type)) == 0)
+    {
+        printf("'%s' not found.\n", target.c_str());
+        return;
+    }
+    else if (type != EXT2_FT_DIR) files.push_back(std::make_pair(top, target));
+    else files_under(top, target, files);
+
+    // 当前的空闲段
+    std::vector<unsigned __int8> bitmap;
+    if (!read_block_bitmaps(1, bitmap))
+    {
+        printf("Failed to read block bitmaps.\n");
+        return;
+    }
+    for (unsigned __int32 bn = first_data_block; bn < blocks_count; bn++)
+    {
+        if (bitmap_test(bitmap, bn)) continue;
+        unsigned __int32 e = bn + 1;
+        while (e < blocks_count && !bitmap_test(bitmap, e)) e++;
+        st.free_runs[bn] = e - bn;
+        bn = e;
+    }
+
+    // 多个文件时按当前第一个物理块排序
+    if (files.size() > 1)
+    {
+        std::vector<std::pair<unsigned __int32, size_t>> order; // (第一个块, 下标)
+        scratch_t scratch(arena());
+        ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            unsigned __int32 first = 0;
+            if (load_inode(files[i].first, inode)) first = inode->i_block[0];
+            order.push_back(std::make_pair(first, i));
+        }
+        std::sort(order.begin(), order.end());
+        std::vector<std::pair<unsigned __int32, std::string>> sorted;
+        for (size_t i = 0; i < order.size(); i++) sorted.push_back(files[order[i].second]);
+        files.swap(sorted);
+    }
+    for (size_t i = 0; i < files.size(); i++)
+        if (!defrag_file(files[i].first, files[i].second, st)) break;
+
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    unsigned __int64 mb = (st.moved_blocks << block_shift) >> 20;
+    if (st.dry_run)
+        printf("%zu files, %llu fragmented\n", files.size(), st.fragmented);
+    else
+        printf("%zu files, %llu fragmented, %llu moved (%llu MB in %llu ms, %llu MB/s)\n", files.size(), st.fragmented,
+            st.moved_files, mb, ms, ms ? mb * 1000 / ms : 0);
+}
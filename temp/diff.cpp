@@ -0,0 +1,344 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include "ext2.h"
+#include "parallel.h"
+#include "digest.h"
+
+// diff：比较本镜像和另一个镜像（同一文件系统不同时间的副本），列出增加、删除和修改的路径。
+// 从上往下逐层缩小范围，尽量少读两个镜像：
+// 1. 超级块和块组描述符表：描述符不同的组，分配情况有变化。
+// 2. 这些组的块位图和 inode 位图，统计分配和释放的块与 inode。
+// 3. inode 表：两边各自按物理顺序读取，工作线程为每块计算 XXH3 校验和，只有校验和不同的块才逐个比较 inode。
+//    原地改写文件只改 inode 表中的时间戳，不改描述符，所以默认比较全部组的 inode 表；-q 只比较描述符不同的组。
+// 4. 只有变化了的目录 inode 才读取两边的目录项，按名字比较得出增加和删除的路径。
+// 目录的路径沿 ".." 向上查得；没有被目录项比较命名的文件（原地修改）才用命名空间索引反查。
+
+#define DIFF_ROOT_INO 2
+
+struct ext2_t::diff_change_t
+{
+    char kind;      // '+' 增加，'-' 删除，'M' 修改，'R' 同号 inode 被重新分配
+    bool dir_a;     // 在本镜像中是目录
+    bool dir_b;     // 在另一个镜像中是目录
+    bool named;     // 已经由目录项比较得出路径
+};
+
+// 目录中的全部目录项（不含 . 和 ..）：名字 -> inode 号
+bool ext2_t::dir_entry_map(unsigned __int32 dir, std::map<std::string, unsigned __int32>& out)
+{
+    out.clear();
+    scratch_t scratch(arena());
+    block_list_t blocks;
+    if (!dir_blocks(dir, blocks)) return false;
+    unsigned __int8* data = scratch.alloc<unsigned __int8>(block_size);
+    for (unsigned __int32 b = 0; b < blocks.n; b++)
+    {
+        if (blocks.v[b] == 0 || blocks.v[b] >= blocks_count || !load_block(blocks.v[b], data)) continue;
+        for (unsigned int off = 0; off + 8 <= block_size;)
+        {
+            const ext2_dir_entry* de = (const ext2_dir_entry*)(data + off);
+            unsigned int rec_len = rec_len_from_disk(de->rec_len);
+            if (rec_len < 8 || off + rec_len > block_size) break;
+            off += rec_len;
+            if (de->inode == 0 || de->inode > inodes_count || de->name_len == 0 || 8u + de->name_len > rec_len) continue;
+            std::string name(de->name, de->name_len);
+            if (name != "." && name != "..") out[name] = de->inode;
+        }
+    }
+    return true;
+}
+
+// 沿 ".." 向上查出目录的路径，只读取路径上的各级目录；结果记在 memo 中
+bool ext2_t::dir_path(unsigned __int32 dir, std::unordered_map<unsigned __int32, std::string>& memo, std::string& out)
+{
+    if (dir == DIFF_ROOT_INO)
+    {
+        out = "";
+        return true;
+    }
+    std::unordered_map<unsigned __int32, std::string>::iterator it = memo.find(dir);
+    if (it != memo.end())
+    {
+        out = it->second;
+        return true;
+    }
+    unsigned __int32 chain[256]; // 从 dir 往上，直到已知路径的目录或根目录
+    unsigned depth = 0;
+    unsigned __int32 top;
+    std::string base;
+    for (unsigned __int32 d = dir; ; d = top)
+    {
+        if (depth == 256) return false;
+        chain[depth++] = d;
+        top = lookup_entry(d, "..", nullptr);
+        if (top == 0 || top == d) return false;
+        if (top == DIFF_ROOT_INO) break;
+        it = memo.find(top);
+        if (it != memo.end())
+        {
+            base = it->second;
+            break;
+        }
+    }
+    // 从上往下，在父目录中找出每一级的名字
+    std::map<std::string, unsigned __int32> entries;
+    for (unsigned k = depth; k-- > 0; top = chain[k])
+    {
+        if (!dir_entry_map(top, entries)) return false;
+        std::map<std::string, unsigned __int32>::const_iterator e = entries.begin();
+        while (e != entries.end() && e->second != chain[k]) ++e;
+        if (e == entries.end()) return false;
+        base += "/" + e->first;
+        memo[chain[k]] = base;
+    }
+    out = base;
+    return true;
+}
+
+void ext2_t::diff(const std::vector<std::string>& args)
+{
+    unsigned threads = parallel_run_t::default_threads();
+    bool quick = false, usage = false;
+    std::string other_path;
+    int partition = 0;
+    int positional = 0;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-q") quick = true;
+        else if (args[i] == "-j" && i + 1 < args.size()) threads = (unsigned)atoi(args[++i].c_str());
+        else if (args[i][0] == '-') usage = true;
+        else if (positional == 0) other_path = args[i], positional++;
+        else if (positional == 1) partition = atoi(args[i].c_str()), positional++;
+        else usage = true;
+    }
+    if (usage || other_path.empty() || threads == 0 || threads > 64)
+    {
+        printf("Usage: diff [-q] [-j threads] <other_image> [partition]\n");
+        return;
+    }
+    if (!txn_dirty.empty())
+    {
+        printf("Commit or abort the current transaction first.\n");
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // 另一个镜像以只读方式打开：不回放也不删除它的日志，不建立索引文件，不修改镜像和任何旁路文件
+    ext2_t other(other_path.c_str(), partition, false, true);
+    if (!other.valid)
+    {
+        printf("Cannot open %s\n", other_path.c_str());
+        return;
+    }
+    if (other.block_size != block_size || other.blocks_count != blocks_count || other.inodes_count != inodes_count ||
+        other.blocks_per_group != blocks_per_group || other.inodes_per_group != inodes_per_group || other.inode_size != inode_size)
+    {
+        printf("%s has a different geometry (%u blocks of %u bytes, %u inodes), cannot diff incrementally\n",
+            other_path.c_str(), other.blocks_count, other.block_size, other.inodes_count);
+        return;
+    }
+    // 两边都记录读取的字节数
+    bool stats_a = stats.enabled;
+    unsigned __int64 read_a = stats.counters[STAT_BYTES_READ];
+    stats.enabled = true;
+    other.stats.enabled = true;
+    unsigned __int64 read_b = other.stats.counters[STAT_BYTES_READ];
+
+    // 1. 超级块和块组描述符表
+    const ext2_super_block& sa = super_block;
+    const ext2_super_block& sb = other.super_block;
+    if (sa.s_free_blocks_count != sb.s_free_blocks_count || sa.s_free_inodes_count != sb.s_free_inodes_count)
+        printf("Superblock: free blocks %u -> %u, free inodes %u -> %u\n", (unsigned)sa.s_free_blocks_count,
+            (unsigned)sb.s_free_blocks_count, (unsigned)sa.s_free_inodes_count, (unsigned)sb.s_free_inodes_count);
+    else if (memcmp(&sa, &sb, sizeof(sa)) != 0)
+        printf("Superblock: counts unchanged, other fields differ\n");
+    std::vector<unsigned __int32> changed_groups;
+    for (unsigned __int32 g = 0; g < block_group_count; g++)
+        if (memcmp(&block_group_descriptor_table[g], &other.block_group_descriptor_table[g], sizeof(ext2_group_desc)) != 0)
+            changed_groups.push_back(g);
+
+    // 2. 分配有变化的组：比较位图
+    unsigned __int64 blocks_alloc = 0, blocks_freed = 0, inodes_alloc = 0, inodes_freed = 0;
+    {
+        scratch_t scratch(arena());
+        unsigned __int8* ba = scratch.alloc<unsigned __int8>(block_size);
+        unsigned __int8* bb = scratch.alloc<unsigned __int8>(block_size);
+        for (size_t i = 0; i < changed_groups.size(); i++)
+        {
+            const ext2_group_desc& ga = block_group_descriptor_table[changed_groups[i]];
+            const ext2_group_desc& gb = other.block_group_descriptor_table[changed_groups[i]];
+            for (int kind = 0; kind < 2; kind++)
+            {
+                unsigned __int32 nbits = kind == 0 ? blocks_per_group : inodes_per_group;
+                if (!load_block(kind == 0 ? ga.bg_block_bitmap : ga.bg_inode_bitmap, ba) ||
+                    !other.load_block(kind == 0 ? gb.bg_block_bitmap : gb.bg_inode_bitmap, bb)) continue;
+                for (unsigned __int32 k = 0; k < nbits && k < block_size * 8; k++)
+                {
+                    int a = (ba[k >> 3] >> (k & 7)) & 1, b = (bb[k >> 3] >> (k & 7)) & 1;
+                    if (a == b) continue;
+                    if (kind == 0) (b ? blocks_alloc : blocks_freed)++;
+                    else (b ? inodes_alloc : inodes_freed)++;
+                }
+            }
+        }
+    }
+
+    // 3. inode 表块的校验和
+    std::vector<unsigned __int32> groups;
+    if (quick) groups = changed_groups;
+    else for (unsigned __int32 g = 0; g < block_group_count; g++) groups.push_back(g);
+    unsigned __int32 table_blocks = (unsigned __int32)(((unsigned __int64)inodes_per_group * inode_size + block_size - 1) >> block_shift);
+    size_t slots = groups.size() * table_blocks;
+    auto checksum_tables = [&](ext2_t& fs, std::vector<unsigned __int64>& sums) {
+        std::vector<std::pair<unsigned __int32, size_t>> refs(slots); // (物理块号, 槽位)
+        for (size_t i = 0; i < groups.size(); i++)
+            for (unsigned __int32 k = 0; k < table_blocks; k++)
+                refs[i * table_blocks + k] = std::make_pair(fs.block_group_descriptor_table[groups[i]].bg_inode_table + k, i * table_blocks + k);
+        std::sort(refs.begin(), refs.end());
+        std::vector<unsigned __int32> blocks(slots);
+        for (size_t i = 0; i < slots; i++) blocks[i] = refs[i].first;
+        sums.assign(slots, 0);
+        return fs.scan_blocks(blocks, threads, [&](unsigned, size_t index, const unsigned __int8* data) {
+            xxh3_t h;
+            h.update(data, fs.block_size);
+            sums[refs[index].second] = h.digest();
+        });
+    };
+    std::vector<unsigned __int64> sums_a, sums_b;
+    if (!checksum_tables(*this, sums_a) || !checksum_tables(other, sums_b))
+    {
+        printf("Failed to read inode tables.\n");
+        stats.enabled = stats_a;
+        return;
+    }
+
+    // 校验和不同的块逐个比较 inode（忽略访问时间）
+    std::map<unsigned __int32, diff_change_t> changes;
+    unsigned __int32 per_block = block_size / inode_size;
+    unsigned __int64 tables_differ = 0;
+    {
+        scratch_t scratch(arena());
+        unsigned __int8* ta = scratch.alloc<unsigned __int8>(block_size);
+        unsigned __int8* tb = scratch.alloc<unsigned __int8>(block_size);
+        for (size_t s = 0; s < slots; s++)
+        {
+            if (sums_a[s] == sums_b[s]) continue;
+            tables_differ++;
+            unsigned __int32 g = groups[s / table_blocks], k = (unsigned __int32)(s % table_blocks);
+            if (!load_block(block_group_descriptor_table[g].bg_inode_table + k, ta) ||
+                !other.load_block(other.block_group_descriptor_table[g].bg_inode_table + k, tb)) continue;
+            for (unsigned __int32 j = 0; j < per_block; j++)
+            {
+                unsigned __int32 index = k * per_block + j;
+                if (index >= inodes_per_group) break;
+                unsigned __int32 ino = g * inodes_per_group + index + 1;
+                ext2_inode* a = (ext2_inode*)(ta + j * inode_size);
+                ext2_inode* b = (ext2_inode*)(tb + j * inode_size);
+                b->i_atime = a->i_atime;
+                if (memcmp(a, b, inode_size) == 0) continue;
+                bool used_a = a->i_mode != 0 && a->i_links_count != 0 && a->i_dtime == 0;
+                bool used_b = b->i_mode != 0 && b->i_links_count != 0 && b->i_dtime == 0;
+                diff_change_t c = { 'M', used_a && (a->i_mode & 0xF000) == 0x4000, used_b && (b->i_mode & 0xF000) == 0x4000, false };
+                if (!used_a && !used_b) continue;
+                if (!used_a) c.kind = '+';
+                else if (!used_b) c.kind = '-';
+                else if ((a->i_mode & 0xF000) != (b->i_mode & 0xF000) || a->i_generation != b->i_generation) c.kind = 'R'; // 同号 inode 被重新分配
+                changes[ino] = c;
+            }
+        }
+    }
+
+    // 4. 变化了的目录：比较两边的目录项
+    std::vector<std::pair<std::string, char>> out;
+    std::unordered_map<unsigned __int32, std::string> memo_a, memo_b;
+    std::map<std::string, unsigned __int32> ea, eb;
+    for (std::map<unsigned __int32, diff_change_t>::iterator it = changes.begin(); it != changes.end(); ++it)
+    {
+        const diff_change_t& c = it->second;
+        if (!c.dir_a && !c.dir_b) continue;
+        std::string pa, pb;
+        bool ok_a = c.dir_a && dir_path(it->first, memo_a, pa) && dir_entry_map(it->first, ea);
+        bool ok_b = c.dir_b && other.dir_path(it->first, memo_b, pb) && other.dir_entry_map(it->first, eb);
+        if (!ok_a) ea.clear();
+        if (!ok_b) eb.clear();
+        bool entries_changed = false;
+        std::map<std::string, unsigned __int32>::const_iterator x = ea.begin(), y = eb.begin();
+        while (x != ea.end() || y != eb.end())
+        {
+            int cmp = x == ea.end() ? 1 : y == eb.end() ? -1 : x->first.compare(y->first);
+            unsigned __int32 child;
+            if (cmp < 0)
+            {
+                out.push_back(std::make_pair(pa + "/" + x->first, '-'));
+                entries_changed = true;
+                child = x->second;
+                ++x;
+            }
+            else if (cmp > 0)
+            {
+                out.push_back(std::make_pair(pb + "/" + y->first, '+'));
+                entries_changed = true;
+                child = y->second;
+                ++y;
+            }
+            else
+            {
+                std::map<unsigned __int32, diff_change_t>::const_iterator ch = changes.find(y->second);
+                if (x->second != y->second) // 同名换成了别的文件
+                {
+                    out.push_back(std::make_pair(pb + "/" + y->first, 'M'));
+                    entries_changed = true;
+                }
+                else if (ch != changes.end() && !ch->second.dir_a && !ch->second.dir_b) out.push_back(std::make_pair(pb + "/" + y->first, 'M'));
+                child = y->second;
+                ++x;
+                ++y;
+            }
+            std::map<unsigned __int32, diff_change_t>::iterator ch = changes.find(child);
+            if (ch != changes.end()) ch->second.named = true;
+        }
+        // 目录项没有变化的目录（只改了属性）本身算作修改
+        if (!entries_changed && c.kind == 'M' && ok_b) out.push_back(std::make_pair(pb + "/", 'M'));
+    }
+
+    // 没有经目录项命名的文件（原地修改）用命名空间索引反查路径
+    unsigned __int64 lookups = 0;
+    for (std::map<unsigned __int32, diff_change_t>::iterator it = changes.begin(); it != changes.end(); ++it)
+    {
+        const diff_change_t& c = it->second;
+        if (c.named || c.dir_a || c.dir_b) continue;
+        std::string p;
+        lookups++;
+        if (c.kind == '-' ? !path_of(it->first, p) : !other.path_of(it->first, p)) p = "?/inode " + std::to_string(it->first);
+        out.push_back(std::make_pair(p, c.kind == 'R' ? 'M' : c.kind));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    size_t added = 0, removed = 0, modified = 0;
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        printf("%c %s\n", out[i].second, out[i].first.c_str());
+        if (out[i].second == '+') added++;
+        else if (out[i].second == '-') removed++;
+        else modified++;
+    }
+
+    read_a = stats.counters[STAT_BYTES_READ] - read_a;
+    read_b = other.stats.counters[STAT_BYTES_READ] - read_b;
+    stats.enabled = stats_a;
+    unsigned __int64 total = (unsigned __int64)blocks_count << block_shift;
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%zu added, %zu removed, %zu modified\n", added, removed, modified);
+    printf("%zu of %u groups changed allocation (%llu blocks allocated, %llu freed, %llu inodes allocated, %llu freed); "
+        "%llu of %zu inode table blocks differ, %zu inodes changed\n", changed_groups.size(), block_group_count,
+        blocks_alloc, blocks_freed, inodes_alloc, inodes_freed, tables_differ, slots, changes.size());
+    printf("Read %llu KB of this image and %llu KB of %s (%.2f%% / %.2f%% of %llu MB) in %llu ms%s\n", read_a >> 10, read_b >> 10,
+        other_path.c_str(), 100.0 * read_a / total, 100.0 * read_b / total, total >> 20, ms,
+        lookups ? "; files changed in place were named through the path index" : "");
+}
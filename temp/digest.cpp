@@ -0,0 +1,382 @@
+#include <string.h>
+#include "digest.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <stdlib.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DIGEST_SSE2 1
+#endif
+
+static inline unsigned __int32 read32(const unsigned __int8* p)
+{
+    unsigned __int32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned __int64 read64(const unsigned __int8* p)
+{
+    unsigned __int64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline unsigned __int32 rotr32(unsigned __int32 x, int n) { return (x >> n) | (x << (32 - n)); }
+static inline unsigned __int64 rotl64(unsigned __int64 x, int n) { return (x << n) | (x >> (64 - n)); }
+
+// ---- SHA-256 ----
+
+static const unsigned __int32 sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+sha256_t::sha256_t() : buf_len(0), total(0)
+{
+    static const unsigned __int32 init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(h, init, sizeof(h));
+}
+
+void sha256_t::compress(const unsigned __int8* block)
+{
+    unsigned __int32 w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (unsigned __int32)block[i * 4] << 24 | (unsigned __int32)block[i * 4 + 1] << 16 | (unsigned __int32)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        unsigned __int32 s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned __int32 s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    unsigned __int32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++)
+    {
+        unsigned __int32 t1 = k + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        unsigned __int32 t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
+}
+
+void sha256_t::update(const void* data, size_t len)
+{
+    const unsigned __int8* p = (const unsigned __int8*)data;
+    total += len;
+    if (buf_len)
+    {
+        size_t n = 64 - buf_len < len ? 64 - buf_len : len;
+        memcpy(buf + buf_len, p, n);
+        buf_len += n;
+        p += n;
+        len -= n;
+        if (buf_len < 64) return;
+        compress(buf);
+        buf_len = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64) compress(p);
+    memcpy(buf, p, len);
+    buf_len = len;
+}
+
+void sha256_t::final(unsigned __int8 out[32])
+{
+    unsigned __int64 bits = total * 8;
+    unsigned __int8 pad[72];
+    size_t n = (buf_len < 56 ? 56 : 120) - buf_len;
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (int i = 0; i < 8; i++) pad[n + i] = (unsigned __int8)(bits >> (56 - 8 * i));
+    update(pad, n + 8);
+    for (int i = 0; i < 8; i++)
+    {
+        out[i * 4] = (unsigned __int8)(h[i] >> 24);
+        out[i * 4 + 1] = (unsigned __int8)(h[i] >> 16);
+        out[i * 4 + 2] = (unsigned __int8)(h[i] >> 8);
+        out[i * 4 + 3] = (unsigned __int8)h[i];
+    }
+}
+
+// ---- XXH3 64 位 ----
+
+#define XXH_PRIME32_1 0x9E3779B1u
+#define XXH_PRIME32_2 0x85EBCA77u
+#define XXH_PRIME32_3 0xC2B2AE3Du
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ull
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME64_3 0x165667B19E3779F9ull
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ull
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ull
+#define XXH_PRIME_MX1 0x165667919E3779F9ull
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ull
+#define XXH_SECRET_SIZE 192
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SIZE - 64) / 8)
+
+static const unsigned __int8 xxh3_secret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline unsigned __int64 mul128_fold64(unsigned __int64 a, unsigned __int64 b)
+{
+#ifdef _MSC_VER
+    unsigned __int64 hi;
+    unsigned __int64 lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    unsigned __int128 p = (unsigned __int128)a * b;
+    return (unsigned __int64)p ^ (unsigned __int64)(p >> 64);
+#endif
+}
+
+static inline unsigned __int64 xxh64_avalanche(unsigned __int64 h)
+{
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static inline unsigned __int64 xxh3_avalanche(unsigned __int64 h)
+{
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static inline unsigned __int64 xxh3_mix16(const unsigned __int8* p, const unsigned __int8* s)
+{
+    return mul128_fold64(read64(p) ^ read64(s), read64(p + 8) ^ read64(s + 8));
+}
+
+// 总长不超过 240 字节时的一次性算法
+static unsigned __int64 xxh3_short(const unsigned __int8* p, size_t len)
+{
+    const unsigned __int8* s = xxh3_secret;
+    if (len == 0) return xxh64_avalanche(read64(s + 56) ^ read64(s + 64));
+    if (len <= 3)
+    {
+        unsigned __int32 combined = (unsigned __int32)p[0] << 16 | (unsigned __int32)p[len >> 1] << 24 | p[len - 1] | (unsigned __int32)len << 8;
+        return xxh64_avalanche(combined ^ (unsigned __int64)(read32(s) ^ read32(s + 4)));
+    }
+    if (len <= 8)
+    {
+        unsigned __int64 v = read32(p + len - 4) + ((unsigned __int64)read32(p) << 32);
+        unsigned __int64 h = v ^ (read64(s + 8) ^ read64(s + 16));
+        h ^= rotl64(h, 49) ^ rotl64(h, 24);
+        h *= XXH_PRIME_MX2;
+        h ^= (h >> 35) + len;
+        h *= XXH_PRIME_MX2;
+        return h ^ (h >> 28);
+    }
+    if (len <= 16)
+    {
+        unsigned __int64 lo = read64(p) ^ (read64(s + 24) ^ read64(s + 32));
+        unsigned __int64 hi = read64(p + len - 8) ^ (read64(s + 40) ^ read64(s + 48));
+        unsigned __int64 swapped = 0;
+        for (int i = 0; i < 8; i++) swapped |= ((lo >> (8 * i)) & 0xFF) << (56 - 8 * i);
+        return xxh3_avalanche(len + swapped + hi + mul128_fold64(lo, hi));
+    }
+    unsigned __int64 acc = len * XXH_PRIME64_1;
+    if (len <= 128)
+    {
+        if (len > 32)
+        {
+            if (len > 64)
+            {
+                if (len > 96)
+                {
+                    acc += xxh3_mix16(p + 48, s + 96);
+                    acc += xxh3_mix16(p + len - 64, s + 112);
+                }
+                acc += xxh3_mix16(p + 32, s + 64);
+                acc += xxh3_mix16(p + len - 48, s + 80);
+            }
+            acc += xxh3_mix16(p + 16, s + 32);
+            acc += xxh3_mix16(p + len - 32, s + 48);
+        }
+        acc += xxh3_mix16(p, s);
+        acc += xxh3_mix16(p + len - 16, s + 16);
+        return xxh3_avalanche(acc);
+    }
+    for (size_t i = 0; i < 8; i++) acc += xxh3_mix16(p + 16 * i, s + 16 * i);
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8; i < len / 16; i++) acc += xxh3_mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+    acc += xxh3_mix16(p + len - 16, s + 136 - 17);
+    return xxh3_avalanche(acc);
+}
+
+// 累加一个条带；SSE2 下每条指令处理两个 64 位累加器
+static inline void xxh3_accumulate(unsigned __int64 acc[8], const unsigned __int8* p, const unsigned __int8* s)
+{
+#ifdef DIGEST_SSE2
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+        __m128i k = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)(s + 16 * i)));
+        __m128i product = _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+        a = _mm_add_epi64(a, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_si128((__m128i*)(acc + 2 * i), _mm_add_epi64(a, product));
+    }
+#else
+    for (int i = 0; i < 8; i++)
+    {
+        unsigned __int64 v = read64(p + 8 * i);
+        unsigned __int64 k = v ^ read64(s + 8 * i);
+        acc[i ^ 1] += v;
+        acc[i] += (k & 0xFFFFFFFFu) * (k >> 32);
+    }
+#endif
+}
+
+static inline void xxh3_scramble(unsigned __int64 acc[8], const unsigned __int8* s)
+{
+#ifdef DIGEST_SSE2
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(s + 16 * i)));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128((__m128i*)(acc + 2 * i), _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+#else
+    for (int i = 0; i < 8; i++)
+    {
+        unsigned __int64 a = acc[i];
+        a ^= a >> 47;
+        a ^= read64(s + 8 * i);
+        acc[i] = a * XXH_PRIME32_1;
+    }
+#endif
+}
+
+xxh3_t::xxh3_t() : buf_len(0), stripes(0), total(0)
+{
+    static const unsigned __int64 init[8] = {
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3, XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1
+    };
+    memcpy(acc, init, sizeof(acc));
+    memset(last, 0, sizeof(last));
+}
+
+void xxh3_t::consume(const unsigned __int8* stripe)
+{
+    xxh3_accumulate(acc, stripe, xxh3_secret + stripes * 8);
+    if (++stripes < XXH_STRIPES_PER_BLOCK) return;
+    xxh3_scramble(acc, xxh3_secret + XXH_SECRET_SIZE - 64);
+    stripes = 0;
+}
+
+// 一个条带只有在它之后还有数据时才累加，最后一个条带留到 digest() 按末尾 64 字节处理
+void xxh3_t::update(const void* data, size_t len)
+{
+    const unsigned __int8* p = (const unsigned __int8*)data;
+    total += len;
+    if (total <= 240)
+    {
+        memcpy(buf + buf_len, p, len);
+        buf_len += len;
+        return;
+    }
+    while (len > 0)
+    {
+        if (buf_len == 0)
+        {
+            if (len > 64)
+            {
+                for (; len > 64; p += 64, len -= 64) consume(p);
+                memcpy(last, p - 64, 64);
+            }
+        }
+        size_t n = sizeof(buf) - buf_len < len ? sizeof(buf) - buf_len : len;
+        memcpy(buf + buf_len, p, n);
+        buf_len += n;
+        p += n;
+        len -= n;
+        size_t off = 0;
+        for (; buf_len - off > 64 || (buf_len - off == 64 && len > 0); off += 64) consume(buf + off);
+        if (off) memcpy(last, buf + off - 64, 64);
+        memmove(buf, buf + off, buf_len - off);
+        buf_len -= off;
+    }
+}
+
+unsigned __int64 xxh3_t::digest() const
+{
+    if (total <= 240) return xxh3_short(buf, (size_t)total);
+    unsigned __int64 a[8];
+    memcpy(a, acc, sizeof(a));
+    unsigned __int8 tail[64];
+    memcpy(tail, last + buf_len, 64 - buf_len);
+    memcpy(tail + 64 - buf_len, buf, buf_len);
+    const unsigned __int8* s = xxh3_secret;
+    xxh3_accumulate(a, tail, s + XXH_SECRET_SIZE - 64 - 7);
+    unsigned __int64 h = total * XXH_PRIME64_1;
+    for (int i = 0; i < 4; i++) h += mul128_fold64(a[2 * i] ^ read64(s + 11 + 16 * i), a[2 * i + 1] ^ read64(s + 11 + 16 * i + 8));
+    return xxh3_avalanche(h);
+}
+
+std::string digest_t::hex()
+{
+    static const char digits[] = "0123456789abcdef";
+    unsigned __int8 raw[32];
+    size_t n;
+    if (algo == DIGEST_SHA256)
+    {
+        sha.final(raw);
+        n = 32;
+    }
+    else
+    {
+        unsigned __int64 v = xxh.digest();
+        for (int i = 0; i < 8; i++) raw[i] = (unsigned __int8)(v >> (56 - 8 * i));
+        n = 8;
+    }
+    std::string s(n * 2, '0');
+    for (size_t i = 0; i < n; i++)
+    {
+        s[2 * i] = digits[raw[i] >> 4];
+        s[2 * i + 1] = digits[raw[i] & 15];
+    }
+    return s;
+}
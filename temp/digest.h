@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include "platform.h"
+
+// 流式摘要：数据可以分多次按任意长度送入，结果与一次性计算相同。
+// sha256_t 为 FIPS 180-4 的 SHA-256；xxh3_t 为 XXH3 64 位（种子 0、默认密钥），与 xxhsum -H3 的结果一致
+
+class sha256_t
+{
+public:
+    sha256_t();
+    void update(const void* data, size_t len);
+    void final(unsigned __int8 out[32]);
+
+private:
+    void compress(const unsigned __int8* block);
+    unsigned __int32 h[8];
+    unsigned __int8 buf[64];
+    size_t buf_len;
+    unsigned __int64 total;
+};
+
+class xxh3_t
+{
+public:
+    xxh3_t();
+    void update(const void* data, size_t len);
+    unsigned __int64 digest() const;
+
+private:
+    void consume(const unsigned __int8* stripe); // 累加一个 64 字节条带，满一块时打乱
+    unsigned __int64 acc[8];
+    unsigned __int8 buf[256]; // 总长不超过 240 字节时保存全部输入，之后保存尚未累加的尾部
+    size_t buf_len;
+    unsigned __int8 last[64]; // 最后一个已累加的条带，结束时可能要用到其中的字节
+    unsigned stripes; // 当前块中已累加的条带数
+    unsigned __int64 total;
+};
+
+enum digest_algo_t
+{
+    DIGEST_SHA256,
+    DIGEST_XXH3
+};
+
+// 按算法选择其一的摘要，hex() 为小写十六进制（xxh3 为大端序，与 xxhsum 的输出相同）
+class digest_t
+{
+public:
+    explicit digest_t(digest_algo_t a) : algo(a) {}
+    void update(const void* data, size_t len)
+    {
+        if (algo == DIGEST_SHA256) sha.update(data, len);
+        else xxh.update(data, len);
+    }
+    std::string hex();
+    static const char* name(digest_algo_t a) { return a == DIGEST_SHA256 ? "sha256" : "xxh3"; }
+
+private:
+    digest_algo_t algo;
+    sha256_t sha;
+    xxh3_t xxh;
+};
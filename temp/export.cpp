@@ -0,0 +1,170 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "ext2.h"
+
+// 只含元数据的镜像（类似 e2image）：超级块及其备份、组描述符表、位图、含有在用 inode 的
+// inode 表块、目录块、间接块、扩展属性块和日志，写成 monolithicSparse VMDK。
+// 普通文件的数据块不导出，读出为 0；磁盘布局（MBR 和分区位置）保持不变，
+// 因此导出的文件可以直接用 dumpext3 <文件> <分区号> 打开做 tree、ls、dump_inode 等分析。
+
+#define EXPORT_RUN_BLOCKS 256 // 连续的元数据块合并读取，每次最多这么多块
+
+// 开启 sparse_super 时只有第 0、1 组和 3、5、7 的幂次组有超级块备份
+bool ext2_t::group_has_super(unsigned __int32 g)
+{
+    if (!(super_block.s_feature_ro_compat & 0x1) || g <= 1) return true;
+    for (unsigned __int32 p = 3; p <= 7; p += 2)
+    {
+        unsigned __int64 n = p;
+        while (n < g) n *= p;
+        if (n == g) return true;
+    }
+    return false;
+}
+
+// 收集一个在用 inode 引用的元数据块
+void ext2_t::collect_inode_meta(unsigned __int32 ino, const ext2_inode* inode, std::vector<unsigned __int32>& out)
+{
+    if (inode->i_file_acl != 0 && inode->i_file_acl < blocks_count) out.push_back(inode->i_file_acl);
+
+    if (!has_block_map(inode)) return;
+    unsigned __int32 type = inode->i_mode & 0xF000;
+
+    bool journal = (super_block.s_feature_compat & 0x4) && ino == (super_block.s_journal_inum ? super_block.s_journal_inum : 8u);
+    bool keep_data = type == 0x4000 || type == 0xA000 || journal;
+
+    scratch_t scratch(arena());
+    unsigned __int32 count = size_in_blocks(inode);
+    block_list_t blocks = new_block_list(count);
+    block_list_t meta = new_block_list(6 + 2 * (count >> addr_shift) + (count >> 2 * addr_shift)); // 三级间接块数量的上界
+    collect_blocks(inode, blocks, &meta);
+    out.insert(out.end(), meta.v, meta.v + meta.n);
+    if (keep_data)
+        for (unsigned __int32 i = 0; i < blocks.n; i++)
+            if (blocks.v[i] != 0) out.push_back(blocks.v[i]);
+}
+
+bool ext2_t::export_meta(const char* path)
+{
+    std::vector<unsigned __int32> blocks;
+    scratch_t scratch(arena());
+    unsigned __int8* bitmap = scratch.alloc<unsigned __int8>(block_size);
+    unsigned __int8* table = scratch.alloc<unsigned __int8>(block_size);
+
+    unsigned __int32 gdt_blocks = (unsigned __int32)((block_group_count * sizeof(ext2_group_desc) + block_size - 1) >> block_shift);
+    unsigned __int32 inodes_per_block = block_size / inode_size;
+    blocks.push_back(0); // 引导块（1K 块时超级块在第 1 块，其余情况下就在第 0 块中）
+
+    for (unsigned __int32 g = 0; g < block_group_count; g++)
+    {
+        const ext2_group_desc& desc = block_group_descriptor_table[g];
+        if (group_has_super(g))
+        {
+            unsigned __int32 start = first_data_block + g * blocks_per_group;
+            unsigned __int32 n = 1 + gdt_blocks + super_block.s_reserved_gdt_blocks;
+            for (unsigned __int32 b = start; b < start + n && b < blocks_count; b++) blocks.push_back(b);
+        }
+        blocks.push_back(desc.bg_block_bitmap);
+        blocks.push_back(desc.bg_inode_bitmap);
+
+        if (!load_block(desc.bg_inode_bitmap, bitmap)) return false;
+        unsigned __int32 table_blocks = (inodes_per_group + inodes_per_block - 1) / inodes_per_block;
+        for (unsigned __int32 t = 0; t < table_blocks; t++)
+        {
+            unsigned __int32 first = t * inodes_per_block;
+            unsigned __int32 last = std::min(first + inodes_per_block, inodes_per_group);
+            bool used = false;
+            for (unsigned __int32 i = first; i < last && !used; i++) used = (bitmap[i >> 3] >> (i & 7)) & 1;
+            if (!used) continue; // 没有在用 inode 的表块不导出
+
+            blocks.push_back(desc.bg_inode_table + t);
+            if (!load_block(desc.bg_inode_table + t, table)) return false;
+            for (unsigned __int32 i = first; i < last; i++)
+            {
+                if (!((bitmap[i >> 3] >> (i & 7)) & 1)) continue;
+                collect_inode_meta(g * inodes_per_group + i + 1, (const ext2_inode*)(table + (size_t)(i - first) * inode_size), blocks);
+            }
+        }
+    }
+
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    while (!blocks.empty() && blocks.back() >= blocks_count) blocks.pop_back();
+
+    // 粒度至少 4KB（VMDK 的下限），1K/2K 块时一个粒度包含多个块，没有导出的部分填 0
+    unsigned __int32 grain = block_size > 4096 ? block_size : 4096;
+    sparse_writer_t out;
+    if (!out.open(path, image_size, grain))
+    {
+        printf("Cannot create %s\n", path);
+        return false;
+    }
+
+    std::vector<unsigned __int8> buf(grain);
+    unsigned __int64 cur = 0; // 正在填充的粒度号
+    // 按磁盘偏移升序把数据放进粒度，写满（切换到下一个粒度）时写出；分区起点不一定与粒度对齐
+    auto emit = [&](unsigned __int64 abs, const unsigned __int8* data, size_t len) -> bool {
+        size_t done = 0;
+        while (done < len)
+        {
+            unsigned __int64 g = (abs + done) / grain;
+            if (g != cur)
+            {
+                if (!out.put_grain(cur, buf.data())) return false;
+                memset(buf.data(), 0, grain);
+                cur = g;
+            }
+            size_t in = (size_t)((abs + done) % grain);
+            size_t n = std::min((size_t)grain - in, len - done);
+            memcpy(buf.data() + in, data + done, n);
+            done += n;
+        }
+        return true;
+    };
+
+    // 分区表（MBR、GPT 及其备份、EBR 链）原样复制，导出的镜像中分区仍然在原来的位置、能按同样的编号打开。
+    // 它们都在分区之外，与文件系统的块按偏移交错写出
+    unsigned __int64 base = (unsigned __int64)partition_start * 512;
+    std::vector<std::pair<unsigned __int64, unsigned __int64>> tables;
+    partition_table_ranges(tables);
+    size_t next_table = 0;
+    auto emit_tables_before = [&](unsigned __int64 limit) -> bool {
+        for (; next_table < tables.size() && tables[next_table].first < limit; next_table++)
+        {
+            // 没有分区表的镜像中 0 号扇区就是文件系统的引导块，已经随块导出
+            if (tables[next_table].first + tables[next_table].second > base && tables[next_table].first < base + partition_size * 512) continue;
+            std::vector<unsigned __int8> data((size_t)tables[next_table].second);
+            if (!read_disk(tables[next_table].first, data.data(), data.size()) ||
+                !emit(tables[next_table].first, data.data(), data.size())) return false;
+        }
+        return true;
+    };
+
+    std::vector<unsigned __int8> run((size_t)EXPORT_RUN_BLOCKS << block_shift);
+    for (size_t i = 0; i < blocks.size();)
+    {
+        // 物理上连续的块一次读出
+        size_t j = i + 1;
+        while (j < blocks.size() && j - i < EXPORT_RUN_BLOCKS && blocks[j] == blocks[j - 1] + 1) j++;
+        size_t len = (j - i) << block_shift;
+        if (!read_bytes((unsigned __int64)blocks[i] << block_shift, run.data(), len)) return false;
+
+        unsigned __int64 abs = base + ((unsigned __int64)blocks[i] << block_shift);
+        if (!emit_tables_before(abs) || !emit(abs, run.data(), len)) return false;
+        i = j;
+    }
+    if (!emit_tables_before(~0ull)) return false;
+    if (!out.put_grain(cur, buf.data())) return false;
+    if (!out.close())
+    {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+
+    printf("Exported %zu metadata blocks (%llu KB) to %s, file size %llu KB\n", blocks.size(),
+        ((unsigned __int64)blocks.size() << block_shift) / 1024, path, out.file_size() / 1024);
+    return true;
+}
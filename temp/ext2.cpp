@@ -17,23 +17,33 @@
 #include <time.h>
 #include "ext2.h"
 
-// 定义块大小，假设是 1024 字节
-#define BLOCK_SIZE 1024
-
-// 计算每个指针项的大小
-#define POINTER_SIZE sizeof(uint32_t)
+#define EXT2_INDEX_FL          0x1000 // i_flags：目录使用哈希索引
+#define EXT2_FEATURE_DIR_INDEX 0x0020 // s_feature_compat
+
+// 名称长度为 n 的目录项实际占用的字节数（按 4 字节对齐）
+#define DIR_REC_LEN(n) (8 + (((n) + 3) & ~3))
+
+// 目录遍历预读：间隙不超过这么多块的两块合并成一次读取，一次最多读这么多块
+#define READAHEAD_GAP 8
+#define READAHEAD_RUN 256
+
+// 在作用域内开启一个（可嵌套的）事务：调用 commit() 才提交，没有提交就离开作用域（出错返回）时放弃这一层，
+// 外层事务随之作废，最外层不会把做了一半的修改写盘
+struct txn_scope_t {
+    ext2_t& fs;
+    bool done;
+    unsigned __int64 mark;
+    txn_scope_t(ext2_t& f) : fs(f), done(false), mark(f.txn_mark()) { fs.txn_begin(); }
+    ~txn_scope_t() { if (!done) fs.txn_fail(mark); }
+    bool commit() { done = true; return fs.txn_commit(); }
+};
 
 unsigned int* ext2_t::read_block(unsigned int block_num)
 {
-    unsigned int* block = new unsigned int[BLOCK_SIZE / POINTER_SIZE];
-    if (!block) {
-        printf("Memory allocation failed for block %u.\n", block_num);
-        return nullptr;
-    }
+    unsigned int* block = (unsigned int*)arena().alloc(block_size);
 
-    // 跳转到块的偏移位置并读取块内容
-    _fseeki64(fp, partition_start * 512 + block_num * BLOCK_SIZE, SEEK_SET);
-    fread(block, BLOCK_SIZE, 1, fp);
+    // 读取块内容
+    load_block(block_num, block);
 
     return block;
 }
@@ -44,169 +54,420 @@ void ext2_t::get_file_blocks(unsigned _int32 inode_num) {
         return;
     }
 
-    // 读取inode
-    unsigned char* inode = new unsigned char[inode_size];
-    if (!inode) {
-        printf("Memory allocation failed for inode.\n");
-        return;
-    }
-
-    // 计算 inode 所在的块组和偏移
-    unsigned int gn = (inode_num - 1) / inodes_per_group;
-    unsigned int index = (inode_num - 1) % inodes_per_group;
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
 
-    // 获取块组描述符表中的 inode 表位置
-    unsigned long bgdt_offset = gn * 32;
-    if (bgdt_offset >= block_group_count * 32) {
+    // 计算 inode 所在的块组
+    unsigned int gn = group_of_inode(inode_num);
+    if (gn >= block_group_count) {
         printf("Invalid block group number.\n");
-        delete[] inode;
         return;
     }
 
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + bgdt_offset + 8);
+    // 获取块组描述符表中的 inode 表位置
+    unsigned int inode_table_block = block_group_descriptor_table[gn].bg_inode_table;
     if (inode_table_block >= blocks_count) {
         printf("Invalid inode table block number.\n");
-        delete[] inode;
         return;
     }
 
-    // 计算 inode 在文件系统中的实际位置
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
     // 读取 inode
-    if (_fseeki64(fp, inode_offset, SEEK_SET) != 0) {
-        printf("Failed to seek to inode position.\n");
-        delete[] inode;
-        return;
-    }
-
-    if (fread(inode, inode_size, 1, fp) != 1) {
+    if (!load_inode(inode_num, inode)) {
         printf("Failed to read inode.\n");
-        delete[] inode;
         return;
     }
 
+    // 结构化格式下每个块指针一条记录：kind 为 data 或 indirect，level 为所在的层（0 为 i_block），parent 为所在的间接块
+    out_writer_t w;
+    record_writer_t r(w, out_format);
+    bool text = out_format == OUT_TEXT;
+    auto record = [&](const char* kind, unsigned level, unsigned __int32 parent, int index, unsigned __int32 bn) {
+        r.begin();
+        r.field("ino", inode_num);
+        r.field("kind", kind);
+        r.field("level", level);
+        r.field("parent", parent);
+        r.field("index", (unsigned)index);
+        r.field("block", bn);
+        r.end();
+    };
+
     // 获取文件大小以确定是否需要处理间接块
-    unsigned int file_size = *(unsigned int*)(inode + 0x04);
-    printf("File size: %u bytes\n", file_size);
+    unsigned int file_size = inode->i_size;
+    if (text) w.put("File size: ").put_u64(file_size).put(" bytes\n");
+    if (!has_block_map(inode)) return; // 设备文件和快速符号链接的 i_block 不是块号
 
     // 获取 i_block 数组
-    unsigned int* block_pointers = new unsigned int[15];
-    memcpy(block_pointers, inode + 0x28, 60);
+    const le32* block_pointers = inode->i_block;
 
     // 处理直接块
     for (int i = 0; i < 12; i++) {
-        if (block_pointers[i] != 0) {
-            if (block_pointers[i] >= blocks_count) {
-                printf("Warning: Invalid direct block number: %u\n", block_pointers[i]);
+        unsigned int bn = block_pointers[i];
+        if (bn != 0) {
+            if (bn >= blocks_count) {
+                if (text) w.put("Warning: Invalid direct block number: ").put_u64(bn).put('\n');
+                else fprintf(stderr, "Warning: Invalid direct block number: %u\n", bn);
                 continue;
             }
-            printf("Direct block %d: %u\n", i, block_pointers[i]);
+            if (text) w.put("Direct block ").put_u64(i).put(": ").put_u64(bn).put('\n');
+            else record("data", 0, 0, i, bn);
         }
     }
 
+    int entries = block_size / sizeof(unsigned int);
+
     // 处理一级间接块
-    if (block_pointers[12] != 0 && block_pointers[12] < blocks_count && inode_num == 12) {
-        printf("\nSingle indirect block: %u\n", block_pointers[12]);
-        unsigned int* indirect = read_block(block_pointers[12]);
-        if (indirect) {
-            int entries = block_size / sizeof(unsigned int);
-            for (int i = 0; i < entries; i++) {
-                if (indirect[i] != 0 && indirect[i] < blocks_count) {
-                    printf("  Block %d: %u\n", i, indirect[i]);
-                }
+    if (block_pointers[12] != 0 && block_pointers[12] < blocks_count) {
+        if (text) w.put("\nSingle indirect block: ").put_u64(block_pointers[12]).put('\n');
+        else record("indirect", 0, 0, 12, block_pointers[12]);
+        const le32* indirect = (const le32*)read_block(block_pointers[12]);
+        for (int i = 0; i < entries; i++) {
+            if (indirect[i] != 0 && indirect[i] < blocks_count) {
+                if (text) w.put("  Block ").put_u64(i).put(": ").put_u64(indirect[i]).put('\n');
+                else record("data", 1, block_pointers[12], i, indirect[i]);
             }
-            delete[] indirect;
         }
     }
 
     // 处理二级间接块
-    if (block_pointers[13] != 0 && block_pointers[13] < blocks_count && inode_num == 13) {
-        printf("\nDouble indirect block: %u\n", block_pointers[13]);
-        unsigned int* dbl_indirect = read_block(block_pointers[13]);
-        if (dbl_indirect) {
-            int entries = block_size / sizeof(unsigned int);
-            for (int i = 0; i < entries; i++) {
-                if (dbl_indirect[i] != 0 && dbl_indirect[i] < blocks_count) {
-                    printf("  Single indirect block %d: %u\n", i, dbl_indirect[i]);
-                    unsigned int* indirect = read_block(dbl_indirect[i]);
-                    if (indirect) {
-                        for (int j = 0; j < entries; j++) {
-                            if (indirect[j] != 0 && indirect[j] < blocks_count) {
-                                printf("    Block %d: %u\n", j, indirect[j]);
+    if (block_pointers[13] != 0 && block_pointers[13] < blocks_count) {
+        if (text) w.put("\nDouble indirect block: ").put_u64(block_pointers[13]).put('\n');
+        else record("indirect", 0, 0, 13, block_pointers[13]);
+        const le32* dbl_indirect = (const le32*)read_block(block_pointers[13]);
+        for (int i = 0; i < entries; i++) {
+            if (dbl_indirect[i] != 0 && dbl_indirect[i] < blocks_count) {
+                if (text) w.put("  Single indirect block ").put_u64(i).put(": ").put_u64(dbl_indirect[i]).put('\n');
+                else record("indirect", 1, block_pointers[13], i, dbl_indirect[i]);
+                scratch_t inner(arena());
+                const le32* indirect = (const le32*)read_block(dbl_indirect[i]);
+                for (int j = 0; j < entries; j++) {
+                    if (indirect[j] != 0 && indirect[j] < blocks_count) {
+                        if (text) w.put("    Block ").put_u64(j).put(": ").put_u64(indirect[j]).put('\n');
+                        else record("data", 2, dbl_indirect[i], j, indirect[j]);
+                    }
+                }
+            }
+        }
+    }
+
+    // 处理三级间接块
+    if (block_pointers[14] != 0 && block_pointers[14] < blocks_count) {
+        if (text) w.put("\nTriple indirect block: ").put_u64(block_pointers[14]).put('\n');
+        else record("indirect", 0, 0, 14, block_pointers[14]);
+        const le32* tpl_indirect = (const le32*)read_block(block_pointers[14]);
+        for (int i = 0; i < entries; i++) {
+            if (tpl_indirect[i] != 0 && tpl_indirect[i] < blocks_count) {
+                if (text) w.put("  Double indirect block ").put_u64(i).put(": ").put_u64(tpl_indirect[i]).put('\n');
+                else record("indirect", 1, block_pointers[14], i, tpl_indirect[i]);
+                scratch_t middle(arena());
+                const le32* dbl_indirect = (const le32*)read_block(tpl_indirect[i]);
+                for (int j = 0; j < entries; j++) {
+                    if (dbl_indirect[j] != 0 && dbl_indirect[j] < blocks_count) {
+                        if (text) w.put("    Single indirect block ").put_u64(j).put(": ").put_u64(dbl_indirect[j]).put('\n');
+                        else record("indirect", 2, tpl_indirect[i], j, dbl_indirect[j]);
+                        scratch_t inner(arena());
+                        const le32* indirect = (const le32*)read_block(dbl_indirect[j]);
+                        for (int k = 0; k < entries; k++) {
+                            if (indirect[k] != 0 && indirect[k] < blocks_count) {
+                                if (text) w.put("      Block ").put_u64(k).put(": ").put_u64(indirect[k]).put('\n');
+                                else record("data", 3, dbl_indirect[j], k, indirect[k]);
                             }
                         }
-                        delete[] indirect;
                     }
                 }
             }
-            delete[] dbl_indirect;
         }
     }
-
-    delete[] block_pointers;
-    delete[] inode;
 }
 
 // 将文件名为 vdfn 的虚拟磁盘文件的第 p (>=0)个分区按照 ext2 文件系统解释
-ext2_t::ext2_t(const char* vdfn, int p)
+ext2_t::ext2_t(const char* vdfn, int p, bool cow, bool ro)
 {
     valid = false;
-    fp = fopen("d:\\20GB-flat.vmdk", "r+b"); // 以读写二进制方式打开
-    if (!fp)
+    block_group_descriptor_table = nullptr;
+    kern = nullptr;
+    txn_depth = 0;
+    txn_seq = 0;
+    txn_writes = 0;
+    txn_failed = false;
+    io_pos = 0;
+    io_dir = 0;
+    trace = nullptr;
+    fp = nullptr;
+    disk = nullptr;
+    cow_fp = nullptr;
+    cow_end = 0;
+    read_only = ro;
+    if (ro) cow = false; // 只读方式下已有的覆盖层读入内存，不需要打开旁路文件
+    con = stdout;
+    io_gate = nullptr;
+    image_path = vdfn;
+    // 日志、覆盖层和索引文件按分区分开；0 号分区沿用不带分区号的文件名
+    std::string side = p == 0 ? image_path : image_path + ".p" + std::to_string(p);
+    journal_path = side + ".jnl";
+    cow_path = side + ".cow";
+    ns_path = side + ".idx";
+    ns = nullptr;
+    owners = nullptr;
+    out_format = OUT_TEXT;
+
+    // 上次以覆盖层方式运行留下的修改必须继续叠加，否则会读到过期的内容
+    FILE* probe = ro ? nullptr : fopen(cow_path.c_str(), "rb");
+    if (probe)
     {
-        printf("Open fail\n");
+        fclose(probe);
+        cow = true;
+    }
+
+    // 首先从分区表（MBR、EBR 链或 GPT）中找到第 p 个分区的起始地址和大小
+    if (vdisk_t::probe(vdfn))
+    {
+        // VMDK 容器：稀疏区段只读，写入只能进入覆盖层
+        disk = new vdisk_t(stats);
+        if (!disk->open(vdfn, !cow && !ro))
+        {
+            printf("Open fail\n");
+            return;
+        }
+        if (!cow && !ro && !disk->writable())
+        {
+            printf("%s has sparse extents and is opened read-only, writes go to the overlay\n", vdfn);
+            cow = true;
+        }
+        image_size = disk->size();
+    }
+    else
+    {
+        fp = fopen(vdfn, cow || ro ? "rb" : "r+b"); // 覆盖层和只读方式下镜像只读
+        if (!fp)
+        {
+            printf("Open fail\n");
+            return;
+        }
+        _fseeki64(fp, 0, SEEK_END);
+        image_size = (unsigned __int64)_ftelli64(fp);
+    }
+    std::vector<partition_t> parts;
+    list_partitions(parts);
+    const partition_t* part = nullptr;
+    for (size_t i = 0; i < parts.size(); i++)
+        if (parts[i].index == p) part = &parts[i];
+    if (!part)
+    {
+        printf("Partition %d not found\n", p);
         return;
     }
+    if (!part->is_ext())
+    {
+        printf("Partition %d (type %s) is not an ext2/ext3 filesystem\n", p, part->type_name().c_str());
+        return;
+    }
+    partition_start = part->start;
+    partition_size = part->sectors;
 
-    // 首先读取磁盘的第 0 扇中的分区表中的第 p 项 ，得到第 p 个分区的起始地址和大小
-    unsigned __int8 boot[512];
-    fread(boot, 1, 512, fp);
-    partition_start = *(unsigned __int32*)(boot + 0x1be + p * 16 + 8); // 得到第 p 个分区的起始扇区号 
-    partition_size = *(unsigned __int32*)(boot + 0x1be + p * 16 + 12);  // 得到第 p 个分区的大小
+    if (cow && !cow_open()) return;
+    if (ro && !cow_load()) return;
 
-    _fseeki64(fp, partition_start * 512L + 1024, 0);
-    fread(super_block, 1, 1024, fp);
-    block_size = 1024 << *(unsigned __int32*)(super_block + 0x18); // 0x18  4 s_log_block_size  Block size
-    blocks_per_group = *(unsigned __int32*)(super_block + 0x20); // 0x20    4       s_blocks_per_group      # Blocks per group
-    inodes_per_group = *(unsigned __int32*)(super_block + 0x28); // 0x28    4       s_inodes_per_group      # Inodes per group
-    inode_size = *(unsigned __int16*)(super_block + 0x58); // 0x58  2       s_inode_size        size of inode structure
-    blocks_count = *(unsigned __int32*)(super_block + 0x4);
-    block_group_count = (unsigned __int32)ceil((double)blocks_count / blocks_per_group);
-    inodes_count = *(unsigned __int32*)(super_block + 0);
+    // 上次运行中已提交但未回写完成的事务，在解析超级块之前先重放
+    txn_recover();
 
-    block_group_descriptor_table = new unsigned __int8[32 * block_group_count];
+    raw_read(1024, &super_block, sizeof(super_block));
+    block_size = 1024 << super_block.s_log_block_size;
+    blocks_per_group = super_block.s_blocks_per_group;
+    inodes_per_group = super_block.s_inodes_per_group;
+    inode_size = super_block.s_rev_level == 0 ? 128 : super_block.s_inode_size; // 版本 0 的 inode 固定为 128 字节
+    blocks_count = super_block.s_blocks_count;
+    block_group_count = (unsigned __int32)ceil((double)(blocks_count - super_block.s_first_data_block) / blocks_per_group);
+    inodes_count = super_block.s_inodes_count;
+    first_data_block = super_block.s_first_data_block;
+
+    // 选定与块大小匹配的内核，并预先算好各个位移
+    kern = select_kernels(block_size);
+    if (!kern || blocks_per_group == 0 || inodes_per_group == 0)
+    {
+        printf("Unsupported block size %u\n", block_size);
+        return;
+    }
+    block_shift = 10 + super_block.s_log_block_size;
+    addr_shift = block_shift - 2;
+    bpg_shift = (blocks_per_group & (blocks_per_group - 1)) == 0 ? (unsigned __int32)log2((double)blocks_per_group) : 0;
+    ipg_shift = (inodes_per_group & (inodes_per_group - 1)) == 0 ? (unsigned __int32)log2((double)inodes_per_group) : 0;
+
+    block_group_descriptor_table = new ext2_group_desc[block_group_count];
     if (!block_group_descriptor_table) return;
-    unsigned __int64 bgdt = partition_start * 512L + align_up(1024 + 1024, block_size);
-    _fseeki64(fp, bgdt, 0); //gdt 的在卷中的始址必须按照块边界对齐
-    fread(block_group_descriptor_table, 1, 32 * block_group_count, fp);
+    //gdt 的在卷中的始址必须按照块边界对齐
+    raw_read(gdt_offset(), block_group_descriptor_table, sizeof(ext2_group_desc) * block_group_count);
 
     valid = true;
+    ns_open(); // 索引文件不存在时不建立，第一次路径查询时再扫描
+}
+
+ext2_t::~ext2_t()
+{
+    // 退出前提交尚未结束的显式事务；其中有命令出错时丢弃
+    if (valid && txn_failed)
+    {
+        printf("Open transaction had a failed command, discarded.\n");
+        txn_abort();
+    }
+    else if (valid && !txn_dirty.empty())
+    {
+        txn_depth = 0;
+        txn_flush();
+    }
+    trace_stop();
+    ns_close();
+    if (cow_fp)
+    {
+        // 没有任何修改的覆盖层不必保留
+        fclose(cow_fp);
+        if (cow_index.empty()) remove(cow_path.c_str());
+    }
+    if (fp) fclose(fp);
+    delete disk;
+    delete owners;
+    delete[] block_group_descriptor_table;
+}
+
+// 把文件指针移到 pos。C 标准要求读写切换之间必须定位，因此只有方向相同且位置连续时才省略
+bool ext2_t::io_seek(unsigned __int64 pos, int dir)
+{
+    if (io_dir == dir && io_pos == pos) return true;
+    EXT2_STAT(STAT_SEEKS, 1);
+    io_dir = 0;
+    if (_fseeki64(fp, pos, SEEK_SET) != 0) return false;
+    io_pos = pos;
+    io_dir = dir;
+    return true;
+}
+
+bool ext2_t::raw_read(unsigned __int64 off, void* buf, size_t len)
+{
+    if (len == 0) return true;
+    if (!mem_grains.empty()) return mem_read(off, buf, len);
+    if (!cow_index.empty()) return cow_read(off, buf, len);
+    return base_read(off, buf, len);
+}
+
+bool ext2_t::raw_write(unsigned __int64 off, const void* buf, size_t len)
+{
+    if (len == 0) return true;
+    if (read_only) return mem_write(off, buf, len);
+    if (cow_fp) return cow_write(off, buf, len);
+    return base_write(off, buf, len);
+}
+
+bool ext2_t::base_read(unsigned __int64 off, void* buf, size_t len)
+{
+    EXT2_STAT(STAT_READ_CALLS, 1);
+    EXT2_STAT(STAT_BYTES_READ, len);
+    if (disk) return disk->read((unsigned __int64)partition_start * 512 + off, buf, len);
+#ifdef _WIN32
+    if (io_dir.load(std::memory_order_relaxed) != 0) io_dir.store(0, std::memory_order_relaxed); // 下一次写必须重新定位
+#endif
+    return read_at(fp, (unsigned __int64)partition_start * 512 + off, buf, len);
+}
+
+bool ext2_t::base_write(unsigned __int64 off, const void* buf, size_t len)
+{
+    EXT2_STAT(STAT_WRITE_CALLS, 1);
+    EXT2_STAT(STAT_BYTES_WRITTEN, len);
+    if (disk) return disk->write((unsigned __int64)partition_start * 512 + off, buf, len);
+    if (!io_seek((unsigned __int64)partition_start * 512 + off, 2)) return false;
+    // 立即交给操作系统：读不经过 stdio 的缓冲，留在缓冲区里的内容读不到
+    if (fwrite(buf, len, 1, fp) != 1 || fflush(fp) != 0)
+    {
+        io_dir = 0;
+        return false;
+    }
+    io_pos += len;
+    return true;
+}
+
+bool ext2_t::read_bytes(unsigned __int64 off, void* buf, size_t len)
+{
+    if (trace) trace->record(TRACE_READ, off, len, block_shift);
+    if (!raw_read(off, buf, len)) return false;
+    if (txn_dirty.empty() || len == 0) return true;
+
+    // 用事务中尚未落盘的脏块覆盖读到的内容
+    unsigned __int32 first = (unsigned __int32)(off >> block_shift);
+    unsigned __int32 last = (unsigned __int32)((off + len - 1) >> block_shift);
+    for (auto it = txn_dirty.lower_bound(first); it != txn_dirty.end() && it->first <= last; ++it)
+    {
+        unsigned __int64 bstart = (unsigned __int64)it->first << block_shift;
+        unsigned __int64 from = bstart > off ? bstart : off;
+        unsigned __int64 to = bstart + block_size < off + len ? bstart + block_size : off + len;
+        memcpy((unsigned __int8*)buf + (from - off), it->second.data() + (from - bstart), (size_t)(to - from));
+        EXT2_STAT(STAT_TXN_OVERLAYS, 1);
+    }
+    return true;
+}
+
+bool ext2_t::write_bytes(unsigned __int64 off, const void* buf, size_t len)
+{
+    if (trace) trace->record(TRACE_WRITE, off, len, block_shift);
+    if (owners) owners_reset(); // 块映射或位图可能变了
+    // 被改写的块不能再从索引块缓存中读取
+    if (len > 0) index_cache.erase_range((unsigned __int32)(off >> block_shift), (unsigned __int32)((off + len - 1) >> block_shift));
+
+    if (txn_depth == 0) return raw_write(off, buf, len);
+    txn_writes++;
+
+    // 事务中：按块拆分，修改脏块缓存，提交时才写盘
+    const unsigned __int8* src = (const unsigned __int8*)buf;
+    while (len > 0)
+    {
+        unsigned __int32 bn = (unsigned __int32)(off >> block_shift);
+        unsigned __int32 in_block = (unsigned __int32)(off & (block_size - 1));
+        size_t n = block_size - in_block < len ? block_size - in_block : len;
+
+        auto it = txn_dirty.find(bn);
+        if (it == txn_dirty.end())
+        {
+            std::vector<unsigned __int8> data(block_size);
+            if (n != block_size && !raw_read((unsigned __int64)bn << block_shift, data.data(), block_size))
+                return false;
+            it = txn_dirty.insert(std::make_pair(bn, std::move(data))).first;
+        }
+        memcpy(it->second.data() + in_block, src, n);
+
+        src += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+unsigned __int64 ext2_t::inode_offset(unsigned __int32 ino)
+{
+    unsigned __int32 gn = group_of_inode(ino);
+    unsigned __int32 index = index_in_inode_group(ino);
+    return ((unsigned __int64)block_group_descriptor_table[gn].bg_inode_table << block_shift) + (unsigned __int64)index * inode_size;
 }
 
 // 将缓冲区中的数据以十六进制和 ASCII 形式打印出来
 void ext2_t::dump(unsigned __int8* buf, unsigned __int32 size, unsigned __int64 offset)
 {
+    out_writer_t w;
     for (unsigned int p = 0; p < size;)
     {
-        printf("%016llX ", offset);
+        w.put_hex(offset, 16).put(' ');
         for (int i = 0; i < 16; i++)
         {
-            if (i == 8) printf("- ");
-            printf("%02X ", (unsigned __int8)buf[p + i]);
+            if (i == 8) w.put("- ", 2);
+            w.put_hex((unsigned __int8)buf[p + i], 2).put(' ');
         }
 
         for (int i = 0; i < 16; i++)
         {
             if (buf[p + i] >= 0x20 && buf[p + i] <= 0x7e)
-                printf("%c", buf[p + i]);
+                w.put((char)buf[p + i]);
             else
-                printf(".");
+                w.put('.');
         }
 
-        printf("\n");
+        w.put('\n');
         p = p + 16;
         offset = offset + 16;
     }
@@ -215,20 +476,19 @@ void ext2_t::dump(unsigned __int8* buf, unsigned __int32 size, unsigned __int64
 // 显示指定块的内容
 void ext2_t::dump_block(unsigned int bn)
 {
-    unsigned __int8* block = new unsigned __int8[block_size];
-    if (!block) return;
+    scratch_t scratch(arena());
+    unsigned __int8* block = scratch.alloc<unsigned __int8>(block_size);
 
-    _fseeki64(fp, (unsigned __int64)partition_start * 512 + bn * block_size, 0);
-    fread(block, block_size, 1, fp);
+    memset(block, 0, block_size);
+    load_block(bn, block);
 
-    dump(block, block_size, bn * (unsigned __int64)block_size);
-    delete[] block;
+    dump(block, block_size, (unsigned __int64)bn << block_shift);
 }
 
 // 显示超级块的内容
 void ext2_t::dump_super_block()
 {
-    dump(super_block, 1024, 1024);
+    dump((unsigned __int8*)&super_block, sizeof(super_block), 1024);
 }
 
 // 显示指定索引节点的内容
@@ -236,123 +496,343 @@ void ext2_t::dump_inode(unsigned _int32 i)
 {
     if (i < 1 || i > inodes_count)
         return; // 不存在索引节点号为 0 的索引节点
-    unsigned __int8* inode = new unsigned __int8[inode_size];
-    if (!inode) return;
-
-    unsigned __int32 gn = (i - 1) / inodes_per_group;
-    unsigned __int32 index = (i - 1) % inodes_per_group;
-
-    unsigned __int64 bgdt = *(unsigned __int32*)(block_group_descriptor_table + 32 * gn + 8);// 计算第 gn 块中的索引表的地址
-    unsigned __int64 off = (unsigned __int64)partition_start * 512 + bgdt * block_size + index * (unsigned __int64)inode_size;
-    _fseeki64(fp, off, 0);
-    fread(inode, 1, inode_size, fp);
-    dump(inode, inode_size, bgdt * block_size + (unsigned __int64)index * inode_size);
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+
+    unsigned __int64 off = inode_offset(i);
+    load_inode(i, inode);
+    if (out_format != OUT_TEXT) {
+        // 结构化格式：一条记录，数值均为十进制
+        out_writer_t w;
+        record_writer_t r(w, out_format);
+        r.begin();
+        r.field("ino", i);
+        r.field("offset", off);
+        r.field("mode", inode->i_mode);
+        r.field("uid", inode->i_uid);
+        r.field("size", inode->i_size | (unsigned __int64)inode->i_size_high << 32);
+        r.field("atime", inode->i_atime);
+        r.field("ctime", inode->i_ctime);
+        r.field("mtime", inode->i_mtime);
+        r.field("dtime", inode->i_dtime);
+        r.field("gid", inode->i_gid);
+        r.field("links_count", inode->i_links_count);
+        r.field("blocks", inode->i_blocks);
+        r.field("flags", inode->i_flags);
+        r.field("generation", inode->i_generation);
+        r.field("file_acl", inode->i_file_acl);
+        static const char* block_names[15] = { "block0", "block1", "block2", "block3", "block4", "block5", "block6", "block7",
+            "block8", "block9", "block10", "block11", "ind_block", "dind_block", "tind_block" };
+        for (int j = 0; j < 15; j++) r.field(block_names[j], inode->i_block[j]);
+        r.end();
+        return;
+    }
+    dump((unsigned __int8*)inode, inode_size, off);
 
     // 打印索引节点的详细信息
-    printf("\ni_mode\t%04X", *(unsigned __int16*)(inode + 0));
-    printf("\ni_uid\t%04X", *(unsigned __int16*)(inode + 0x02));
-    printf("\ni_size\t%08X", *(unsigned __int32*)(inode + 0x04));
-    printf("\ni_atime\t%08X (%s)", *(unsigned __int32*)(inode + 0x08), time2str((time_t) * (unsigned __int32*)(inode + 0x08)));
-    printf("\ni_ctime\t%08X", *(unsigned __int32*)(inode + 0x0C));
-    printf("\ni_mtime\t%08X", *(unsigned __int32*)(inode + 0x10));
-    printf("\ni_dtime\t%08X", *(unsigned __int32*)(inode + 0x14));
-    printf("\ni_gid\t%04X", *(unsigned __int16*)(inode + 0x18));
-    printf("\ni_links_count\t%04X", *(unsigned __int16*)(inode + 0x1A));
-    printf("\ni_blocks\t%08X", *(unsigned __int32*)(inode + 0x1C));
-    printf("\ni_flags\t%08X", *(unsigned __int32*)(inode + 0x20));
-    printf("\ni_reserved1\t%08X", *(unsigned __int32*)(inode + 0x24));
+    out_writer_t w;
+    w.put("\ni_mode\t").put_hex(inode->i_mode, 4);
+    w.put("\ni_uid\t").put_hex(inode->i_uid, 4);
+    w.put("\ni_size\t").put_hex(inode->i_size, 8);
+    w.put("\ni_atime\t").put_hex(inode->i_atime, 8).put(" (").put(time2str((time_t)inode->i_atime)).put(')');
+    w.put("\ni_ctime\t").put_hex(inode->i_ctime, 8);
+    w.put("\ni_mtime\t").put_hex(inode->i_mtime, 8);
+    w.put("\ni_dtime\t").put_hex(inode->i_dtime, 8);
+    w.put("\ni_gid\t").put_hex(inode->i_gid, 4);
+    w.put("\ni_links_count\t").put_hex(inode->i_links_count, 4);
+    w.put("\ni_blocks\t").put_hex(inode->i_blocks, 8);
+    w.put("\ni_flags\t").put_hex(inode->i_flags, 8);
+    w.put("\ni_reserved1\t").put_hex(inode->i_reserved1, 8);
 
     for (int j = 0; j < 15; j++)
     {
-        printf("\ni_block[%d]\t%08X", j, *(unsigned __int32*)(inode + 0x28 + j * 4));
+        w.put("\ni_block[").put_u64(j).put("]\t").put_hex(inode->i_block[j], 8);
     }
+}
 
-    delete[] inode;
+// 按逻辑顺序收集 inode 的前 blocks.cap 个数据块号（空洞为 0）；meta 非空时同时收集用到的间接块
+void ext2_t::collect_blocks(const ext2_inode* inode, block_list_t& blocks, block_list_t* meta)
+{
+    blocks.n = 0;
+    for (int i = 0; i < 12 && !blocks.full(); i++)
+        blocks.push(inode->i_block[i] < blocks_count ? (unsigned __int32)inode->i_block[i] : 0);
+    for (int level = 1; level <= 3 && !blocks.full(); level++)
+        collect_indirect(inode->i_block[11 + level], level, blocks, meta);
 }
 
-void ext2_t::list_directory(unsigned int dir_inode, const std::string& path = "/") {
-    unsigned char* inode = new unsigned char[inode_size];
-    if (!inode) return;
-
-    // 读取目录的inode
-    unsigned int gn = (dir_inode - 1) / inodes_per_group;
-    unsigned int index = (dir_inode - 1) % inodes_per_group;
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + gn * 32 + 8);
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
-    _fseeki64(fp, inode_offset, SEEK_SET);
-    fread(inode, inode_size, 1, fp);
-
-    // 读取目录数据块
-    unsigned int dir_block = *(unsigned int*)(inode + 0x28);
-    unsigned char* block_data = new unsigned char[block_size];
-    if (!block_data) {
-        delete[] inode;
-        return;
+// 分配一个清零的块（用作目录块或间接块），并计入 inode 的 i_blocks
+unsigned __int32 ext2_t::alloc_zeroed_block(ext2_inode* inode)
+{
+    unsigned __int32 bn = allocate_block();
+    if (bn == 0) return 0;
+    scratch_t scratch(arena());
+    unsigned __int8* zero = scratch.alloc<unsigned __int8>(block_size);
+    memset(zero, 0, block_size);
+    store_block(bn, zero);
+    inode->i_blocks += block_size / 512;
+    return bn;
+}
+
+// 把物理块 pbn 映射到 inode 的逻辑块 lblk，必要时分配间接块
+bool ext2_t::map_block(ext2_inode* inode, unsigned __int32 lblk, unsigned __int32 pbn)
+{
+    le32* i_block = inode->i_block;
+    if (lblk < 12) {
+        i_block[lblk] = pbn;
+        return true;
+    }
+
+    // 确定落在几级间接块中
+    unsigned __int64 rel = lblk - 12;
+    int level = 1;
+    while (rel >= (1ull << (addr_shift * level))) {
+        rel -= 1ull << (addr_shift * level);
+        if (++level > 3) return false;
+    }
+
+    if (i_block[11 + level] == 0) {
+        i_block[11 + level] = alloc_zeroed_block(inode);
+        if (i_block[11 + level] == 0) return false;
+    }
+
+    unsigned __int32 parent = i_block[11 + level];
+    scratch_t scratch(arena());
+    le32* ptr = scratch.alloc<le32>(block_size);
+    for (int l = level; l >= 1; l--) {
+        unsigned __int32 idx = (unsigned __int32)(rel >> (addr_shift * (l - 1))) & ((block_size >> 2) - 1);
+        if (!load_block(parent, ptr)) return false;
+        if (l == 1) {
+            ptr[idx] = pbn;
+            return store_block(parent, ptr);
+        }
+        if (ptr[idx] == 0) {
+            ptr[idx] = alloc_zeroed_block(inode);
+            if (ptr[idx] == 0 || !store_block(parent, ptr)) return false;
+        }
+        parent = ptr[idx];
     }
+    return false;
+}
 
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + dir_block * block_size, SEEK_SET);
-    fread(block_data, block_size, 1, fp);
+// 释放 inode 占用的所有数据块和间接块
+void ext2_t::free_inode_blocks(const ext2_inode* inode)
+{
+    scratch_t scratch(arena());
+    unsigned __int32 count = size_in_blocks(inode);
+    block_list_t blocks = new_block_list(count);
+    block_list_t meta = new_block_list(6 + 2 * (count >> addr_shift) + (count >> 2 * addr_shift)); // 三级间接块数量的上界
+    collect_blocks(inode, blocks, &meta);
+    for (unsigned __int32 i = 0; i < blocks.n; i++)
+        if (blocks.v[i] != 0) free_block(blocks.v[i]);
+    for (unsigned __int32 i = 0; i < meta.n; i++)
+        free_block(meta.v[i]);
+}
 
-    // 解析目录项
-    unsigned int offset = 0;
-    while (offset < block_size) {
-        struct ext2_dir_entry {
-            unsigned int inode;
-            unsigned short rec_len;
-            unsigned char name_len;
-            unsigned char file_type;
-            char name[256];
-        } *dir_entry = (ext2_dir_entry*)(block_data + offset);
-
-        if (dir_entry->inode != 0) {
-            char filename[256];
-            memset(filename, 0, sizeof(filename));
-            strncpy(filename, (char*)dir_entry->name, dir_entry->name_len);
-
-            // 跳过 "." 和 ".." 目录
-            if (strcmp(filename, ".") != 0 && strcmp(filename, "..") != 0) {
-                // 构建完整路径
-                std::string fullpath = path;
-                if (fullpath != "/") fullpath += "/";
-                fullpath += filename;
-
-                // 获取文件类型字符串
-                const char* type_str;
-                switch (dir_entry->file_type) {
-                case 1: type_str = "FILE"; break;
-                case 2: type_str = "DIR "; break;
-                case 3: type_str = "CHR "; break;
-                case 4: type_str = "BLK "; break;
-                case 5: type_str = "FIFO"; break;
-                case 6: type_str = "SOCK"; break;
-                case 7: type_str = "LINK"; break;
-                default: type_str = "????"; break;
-                }
+// 读取目录 inode 并收集它的全部目录块（列表分配在调用者的内存池作用域中）
+bool ext2_t::dir_blocks(unsigned __int32 dir_inode, block_list_t& blocks)
+{
+    blocks.n = 0;
+    if (dir_inode < 1 || dir_inode > inodes_count) return false;
 
-                // 打印当前项信息
-                printf("%-40s %-10u %-6s\n", fullpath.c_str(), dir_entry->inode, type_str);
+    ext2_inode* inode = (ext2_inode*)arena().alloc(inode_size);
+    if (!load_inode(dir_inode, inode)) return false;
+    if ((inode->i_mode & 0xF000) != 0x4000) return false; // 不是目录
 
-                // 如果是目录，递归处理
-                if (dir_entry->file_type == 2) {
-                    list_directory(dir_entry->inode, fullpath);
-                }
-            }
+    blocks = new_block_list(size_in_blocks(inode));
+    collect_blocks(inode, blocks, nullptr);
+    return true;
+}
+
+// 取得目录的空闲槽位表，第一次访问时扫描全部目录块建立
+ext2_t::dir_slots_t* ext2_t::load_dir_slots(unsigned __int32 dir_inode)
+{
+    auto it = dir_slot_map.find(dir_inode);
+    if (it != dir_slot_map.end()) {
+        EXT2_STAT(STAT_DIRSLOT_HITS, 1);
+        return &it->second;
+    }
+    EXT2_STAT(STAT_DIRSLOT_MISSES, 1);
+
+    scratch_t scratch(arena());
+    block_list_t blocks;
+    if (!dir_blocks(dir_inode, blocks)) return nullptr;
+
+    dir_slots_t& slots = dir_slot_map[dir_inode];
+    slots.blocks.assign(blocks.v, blocks.v + blocks.n);
+    slots.max_gap.resize(slots.blocks.size(), 0);
+    slots.hint = 0;
+
+    unsigned __int8* block = scratch.alloc<unsigned __int8>(block_size);
+    for (size_t i = 0; i < slots.blocks.size(); i++) {
+        if (slots.blocks[i] == 0 || !load_block(slots.blocks[i], block)) continue;
+        slots.max_gap[i] = dir_block_gap(block);
+
+        unsigned __int32 offset = 0;
+        while (offset + 8 <= block_size) {
+            const ext2_dir_entry* de = (const ext2_dir_entry*)(block + offset);
+            unsigned __int32 rec_len = rec_len_from_disk(de->rec_len);
+            if (rec_len < 8 || offset + rec_len > block_size) break;
+            if (de->inode != 0) slots.names.insert(std::string(de->name, de->name_len));
+            offset += rec_len;
         }
+    }
+    return &slots;
+}
+
+// 在目录中查找名为 name 的目录项，返回其 inode 号（0 表示不存在）
+unsigned __int32 ext2_t::lookup_entry(unsigned __int32 dir_inode, const char* name, unsigned char* file_type)
+{
+    if (dir_inode < 1 || dir_inode > inodes_count) return 0;
+
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(dir_inode, inode)) return 0;
+    if ((inode->i_mode & 0xF000) != 0x4000) return 0; // 不是目录
 
-        offset += dir_entry->rec_len;
-        if (dir_entry->rec_len == 0) break;
+    // 哈希目录：沿 dx_root/dx_node 直接定位到叶子块
+    size_t name_len = strlen(name);
+    if ((inode->i_flags & EXT2_INDEX_FL) && (super_block.s_feature_compat & EXT2_FEATURE_DIR_INDEX)) {
+        bool usable = false;
+        unsigned __int32 ino = dx_lookup(inode, name, name_len, file_type, &usable);
+        if (usable) return ino;
     }
 
-    delete[] block_data;
-    delete[] inode;
+    // 线性目录（或索引损坏）：逐块扫描
+    block_list_t blocks = new_block_list(size_in_blocks(inode));
+    collect_blocks(inode, blocks, nullptr);
+
+    unsigned __int8* block = scratch.alloc<unsigned __int8>(block_size);
+    for (unsigned __int32 i = 0; i < blocks.n; i++) {
+        if (blocks.v[i] == 0 || !load_block(blocks.v[i], block)) continue;
+
+        const ext2_dir_entry* de = kern->dir_find(block, name, name_len);
+        if (de) {
+            if (file_type) *file_type = de->file_type;
+            return de->inode;
+        }
+    }
+    return 0;
+}
+
+// 合并读取一批块：排序去重后，间隙不超过 READAHEAD_GAP 块的合成一段（间隙也一并读入），一段一次 read_bytes
+bool ext2_t::read_blocks_merged(std::vector<unsigned __int32>& blocks, const std::function<void(unsigned __int32 bn, const unsigned __int8* data)>& fn)
+{
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    std::vector<unsigned __int8> buf;
+    for (size_t i = 0; i < blocks.size(); ) {
+        size_t j = i + 1;
+        while (j < blocks.size() && blocks[j] - blocks[j - 1] <= READAHEAD_GAP && blocks[j] - blocks[i] < READAHEAD_RUN) j++;
+        unsigned __int32 n = blocks[j - 1] - blocks[i] + 1;
+        buf.resize((size_t)n << block_shift);
+        if (!read_bytes((unsigned __int64)blocks[i] << block_shift, buf.data(), buf.size())) return false;
+        for (size_t k = i; k < j; k++) fn(blocks[k], buf.data() + ((size_t)(blocks[k] - blocks[i]) << block_shift));
+        i = j;
+    }
+    return true;
+}
+
+// 目录遍历的预读：先合并读取这批目录所在的 inode 表块，再合并读取它们的全部目录块。
+// 结果为目录 inode 号 -> 按逻辑顺序拼接的目录块内容（空洞为 0）；不是目录的 inode 不出现在结果中
+bool ext2_t::prefetch_dirs(const std::vector<unsigned __int32>& dirs, std::unordered_map<unsigned __int32, std::vector<unsigned __int8>>& out)
+{
+    std::vector<unsigned __int32> table_blocks;
+    for (size_t i = 0; i < dirs.size(); i++)
+        if (dirs[i] >= 1 && dirs[i] <= inodes_count) table_blocks.push_back((unsigned __int32)(inode_offset(dirs[i]) >> block_shift));
+    std::unordered_map<unsigned __int32, std::vector<unsigned __int8>> tables; // inode 表块号 -> 内容
+    if (!read_blocks_merged(table_blocks, [&](unsigned __int32 bn, const unsigned __int8* data) {
+        tables[bn].assign(data, data + block_size);
+    })) return false;
+
+    // 每个目录的块号；块号相同的目录块（不应出现）各自复制一份
+    std::vector<std::pair<unsigned __int32, std::pair<unsigned __int32, unsigned __int32>>> refs; // (物理块号, (目录, 逻辑块号))
+    for (size_t i = 0; i < dirs.size(); i++) {
+        if (dirs[i] < 1 || dirs[i] > inodes_count || out.count(dirs[i])) continue;
+        unsigned __int64 off = inode_offset(dirs[i]);
+        const ext2_inode* inode = (const ext2_inode*)(tables[(unsigned __int32)(off >> block_shift)].data() + (off & (block_size - 1)));
+        if ((inode->i_mode & 0xF000) != 0x4000) continue; // 不是目录
+        scratch_t inner(arena());
+        block_list_t blocks = new_block_list(size_in_blocks(inode));
+        collect_blocks(inode, blocks, nullptr);
+        out[dirs[i]].assign((size_t)blocks.n << block_shift, 0);
+        for (unsigned __int32 b = 0; b < blocks.n; b++)
+            if (blocks.v[b] != 0) refs.push_back(std::make_pair(blocks.v[b], std::make_pair(dirs[i], b)));
+    }
+    std::sort(refs.begin(), refs.end());
+    std::vector<unsigned __int32> data_blocks(refs.size());
+    for (size_t i = 0; i < refs.size(); i++) data_blocks[i] = refs[i].first;
+    size_t r = 0;
+    return read_blocks_merged(data_blocks, [&](unsigned __int32 bn, const unsigned __int8* data) {
+        for (; r < refs.size() && refs[r].first == bn; r++)
+            memcpy(out[refs[r].second.first].data() + ((size_t)refs[r].second.second << block_shift), data, block_size);
+    });
+}
+
+void ext2_t::list_directory(unsigned int dir_inode, const std::string& path = "/") {
+    // 先按层读出整棵子树，再按磁盘上的顺序深度优先打印
+    flat_tree_t tree;
+    if (!build_tree(dir_inode, false, tree)) return;
+
+    struct frame_t {
+        unsigned __int32 node;
+        unsigned __int32 next; // 下一个要打印的子项
+        size_t path_len;       // 该目录的路径在 fullpath 中的长度
+    };
+    out_writer_t w;
+    record_writer_t r(w, out_format);
+    std::string fullpath = path;
+    std::vector<frame_t> stack(1, frame_t{ 0, 0, fullpath.size() });
+    while (!stack.empty()) {
+        frame_t& f = stack.back();
+        const flat_node_t& dir = tree[f.node];
+        if (f.next >= dir.child_count) {
+            stack.pop_back();
+            continue;
+        }
+        unsigned __int32 c = dir.first_child + f.next++;
+        const flat_node_t& child = tree[c];
+
+        // 构建完整路径
+        fullpath.resize(f.path_len);
+        if (fullpath != "/") fullpath += "/";
+        fullpath.append(tree.name(c), child.name_len);
+
+        // 获取文件类型字符串
+        const char* type_str;
+        switch (child.file_type) {
+        case 1: type_str = "FILE"; break;
+        case 2: type_str = "DIR "; break;
+        case 3: type_str = "CHR "; break;
+        case 4: type_str = "BLK "; break;
+        case 5: type_str = "FIFO"; break;
+        case 6: type_str = "SOCK"; break;
+        case 7: type_str = "LINK"; break;
+        default: type_str = "????"; break;
+        }
+
+        // 打印当前项信息（%-40s %-10u %-6s）
+        if (out_format == OUT_TEXT) {
+            w.put_left(fullpath.data(), fullpath.size(), 40).put(' ');
+            w.put_u64_left(child.ino, 10).put(' ');
+            w.put_left(type_str, 4, 6).put('\n');
+        } else {
+            r.begin();
+            r.field("path", fullpath);
+            r.field("ino", child.ino);
+            r.field("type", file_type_name(child.file_type));
+            r.end();
+        }
+
+        // 如果是目录，接着处理它的子项
+        if (child.file_type == EXT2_FT_DIR && child.child_count > 0) stack.push_back(frame_t{ c, 0, fullpath.size() });
+    }
 }
 
 void ext2_t::ls_root() {
-    printf("%-40s %-10s %-6s\n", "Path", "Inode", "Type");
-    printf("--------------------------------------------------------\n");
+    if (out_format == OUT_TEXT) {
+        printf("%-40s %-10s %-6s\n", "Path", "Inode", "Type");
+        printf("--------------------------------------------------------\n");
+    }
     list_directory(2);  // 从根目录开始
 }
 
@@ -363,42 +843,26 @@ void ext2_t::create_directory(unsigned _int32 parent_inode_num, const char* dir_
         return;
     }
 
-    // 读取父目录 inode
-    unsigned char* parent_inode_data = new unsigned char[inode_size];
-    if (!parent_inode_data) {
-        printf("Memory allocation failed for parent inode.\n");
-        return;
-    }
-
-    // 计算父 inode 位置
-    unsigned int parent_gn = (parent_inode_num - 1) / inodes_per_group;
-    unsigned int parent_index = (parent_inode_num - 1) % inodes_per_group;
-    unsigned long parent_inode_table_block = *(unsigned long*)(block_group_descriptor_table + parent_gn * 32 + 8);
-    unsigned long long parent_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)parent_inode_table_block * block_size +
-        (unsigned long long)parent_index * inode_size;
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
 
-    // 读取父 inode
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fread(parent_inode_data, inode_size, 1, fp) != 1) {
+    // 读取父目录 inode
+    ext2_inode* parent_inode_data = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(parent_inode_num, parent_inode_data)) {
         printf("Failed to read parent inode.\n");
-        delete[] parent_inode_data;
         return;
     }
 
     // 验证父目录是否为目录类型
-    unsigned short parent_mode = *(unsigned short*)(parent_inode_data + 0x00);
-    if ((parent_mode & 0x4000) != 0x4000) {
+    if ((parent_inode_data->i_mode & 0x4000) != 0x4000) {
         printf("Parent inode is not a directory.\n");
-        delete[] parent_inode_data;
         return;
     }
 
     // 分配新的 inode
-    unsigned int new_inode_num = allocate_inode();
+    unsigned int new_inode_num = allocate_inode(true);
     if (new_inode_num == 0) {
         printf("Failed to allocate inode.\n");
-        delete[] parent_inode_data;
         return;
     }
 
@@ -406,225 +870,164 @@ void ext2_t::create_directory(unsigned _int32 parent_inode_num, const char* dir_
     unsigned int new_block = allocate_block();
     if (new_block == 0) {
         printf("Failed to allocate block.\n");
-        delete[] parent_inode_data;
         return;
     }
 
     // 创建并初始化新目录的 inode
-    unsigned char* new_inode = new unsigned char[inode_size];
+    ext2_inode* new_inode = scratch.alloc<ext2_inode>(inode_size);
     memset(new_inode, 0, inode_size);
 
     // 设置新目录 inode 的属性
-    time_t current_time = time(NULL);
-    *(unsigned short*)(new_inode + 0x00) = 0x41ED;    // i_mode: 目录类型 + 权限
-    *(unsigned short*)(new_inode + 0x02) = 0;         // i_uid
-    *(unsigned int*)(new_inode + 0x04) = block_size;  // i_size: 目录大小
-    *(unsigned int*)(new_inode + 0x08) = current_time; // i_atime
-    *(unsigned int*)(new_inode + 0x0C) = current_time; // i_ctime
-    *(unsigned int*)(new_inode + 0x10) = current_time; // i_mtime
-    *(unsigned int*)(new_inode + 0x14) = 0;           // i_dtime
-    *(unsigned short*)(new_inode + 0x18) = 0;         // i_gid
-    *(unsigned short*)(new_inode + 0x1A) = 2;         // i_links_count: . 和 ..
-    *(unsigned int*)(new_inode + 0x1C) = 1;           // i_blocks (以512字节为单位)
-    *(unsigned int*)(new_inode + 0x28) = new_block;   // i_block[0]
+    unsigned __int32 current_time = (unsigned __int32)time(NULL);
+    new_inode->i_mode = 0x41ED;             // 目录类型 + 权限
+    new_inode->i_size = block_size;         // 目录大小
+    new_inode->i_atime = current_time;
+    new_inode->i_ctime = current_time;
+    new_inode->i_mtime = current_time;
+    new_inode->i_links_count = 2;           // . 和 ..
+    new_inode->i_blocks = block_size / 512; // 以512字节为单位
+    new_inode->i_block[0] = new_block;
 
     // 写入新的 inode
-    unsigned int new_gn = (new_inode_num - 1) / inodes_per_group;
-    unsigned int new_index = (new_inode_num - 1) % inodes_per_group;
-    unsigned long new_inode_table_block = *(unsigned long*)(block_group_descriptor_table + new_gn * 32 + 8);
-    unsigned long long new_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)new_inode_table_block * block_size +
-        (unsigned long long)new_index * inode_size;
-
-    if (_fseeki64(fp, new_inode_offset, SEEK_SET) != 0 ||
-        fwrite(new_inode, inode_size, 1, fp) != 1) {
+    if (!store_inode(new_inode_num, new_inode)) {
         printf("Failed to write new inode.\n");
-        delete[] new_inode;
-        delete[] parent_inode_data;
         return;
     }
 
     // 初始化新目录的数据块
-    unsigned char* dir_block = new unsigned char[block_size];
+    unsigned char* dir_block = scratch.alloc<unsigned char>(block_size);
     memset(dir_block, 0, block_size);
 
     // 创建 "." 目录项
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
-
-    dir_entry = (ext2_dir_entry*)dir_block;
+    ext2_dir_entry* dir_entry = (ext2_dir_entry*)dir_block;
     dir_entry->inode = new_inode_num;
     dir_entry->name_len = 1;
     dir_entry->file_type = 2;  // 目录类型
-    strcpy(dir_entry->name, ".");
+    memcpy(dir_entry->name, ".", 1);
     dir_entry->rec_len = 12;  // 4 + 2 + 1 + 1 + 4 (对齐到4字节)
 
     // 创建 ".." 目录项
-    dir_entry = (ext2_dir_entry*)(dir_block + dir_entry->rec_len);
+    dir_entry = (ext2_dir_entry*)(dir_block + 12);
     dir_entry->inode = parent_inode_num;
     dir_entry->name_len = 2;
     dir_entry->file_type = 2;
-    strcpy(dir_entry->name, "..");
-    dir_entry->rec_len = block_size - 12;  // 剩余空间全部分配给 ".."
+    memcpy(dir_entry->name, "..", 2);
+    dir_entry->rec_len = rec_len_to_disk(block_size - 12);  // 剩余空间全部分配给 ".."
 
     // 写入目录数据块
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + new_block * block_size, SEEK_SET) != 0 ||
-        fwrite(dir_block, block_size, 1, fp) != 1) {
+    if (!store_block(new_block, dir_block)) {
         printf("Failed to write directory block.\n");
-        delete[] dir_block;
-        delete[] new_inode;
-        delete[] parent_inode_data;
         return;
     }
 
-    // 更新父目录
-    unsigned int parent_block = *(unsigned int*)(parent_inode_data + 0x28);
-    unsigned char* parent_block_data = new unsigned char[block_size];
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET) != 0 ||
-        fread(parent_block_data, block_size, 1, fp) != 1) {
-        printf("Failed to read parent directory block.\n");
-        delete[] parent_block_data;
-        delete[] dir_block;
-        delete[] new_inode;
-        delete[] parent_inode_data;
+    // 在父目录中添加目录项（父目录满时会自动扩展新块）
+    if (!add_entry_to_dir(parent_inode_num, new_inode_num, dir_name, EXT2_FT_DIR)) {
+        printf("Failed to add directory entry.\n");
         return;
     }
 
-    // 查找父目录中的空闲空间
-    unsigned int offset = 0;
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(parent_block_data + offset);
-        if (offset + dir_entry->rec_len >= block_size) {
-            // 找到最后一个目录项
-            unsigned int actual_len = 8 + ((dir_entry->name_len + 3) & ~3);
-            if (dir_entry->rec_len - actual_len >= 8 + ((strlen(dir_name) + 3) & ~3)) {
-                // 有足够空间插入新目录项
-                unsigned int new_rec_len = dir_entry->rec_len - actual_len;
-                dir_entry->rec_len = actual_len;
-
-                // 创建新目录项
-                dir_entry = (ext2_dir_entry*)(parent_block_data + offset + actual_len);
-                dir_entry->inode = new_inode_num;
-                dir_entry->name_len = strlen(dir_name);
-                dir_entry->file_type = 2;
-                strcpy(dir_entry->name, dir_name);
-                dir_entry->rec_len = new_rec_len;
-
-                break;
-            }
-        }
-        offset += dir_entry->rec_len;
+    // 增加父目录的链接计数（add_entry_to_dir 可能已修改父目录 inode，需要重新读取）
+    if (!load_inode(parent_inode_num, parent_inode_data)) {
+        printf("Failed to update parent directory.\n");
+        return;
     }
-
-    // 更新父目录的修改时间
-    *(unsigned int*)(parent_inode_data + 0x10) = current_time; // i_mtime
-    *(unsigned int*)(parent_inode_data + 0x0C) = current_time; // i_ctime
-
-    // 增加父目录的链接计数
-    unsigned short parent_links = *(unsigned short*)(parent_inode_data + 0x1A);
-    *(unsigned short*)(parent_inode_data + 0x1A) = parent_links + 1;
-
-    // 写回父目录的 inode 和数据块
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fwrite(parent_inode_data, inode_size, 1, fp) != 1 ||
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET) != 0 ||
-        fwrite(parent_block_data, block_size, 1, fp) != 1) {
+    parent_inode_data->i_links_count += 1;
+    if (!store_inode(parent_inode_num, parent_inode_data)) {
         printf("Failed to update parent directory.\n");
+        return;
     }
 
+    if (!txn.commit()) return;
     printf("Directory '%s' created successfully with inode %u\n", dir_name, new_inode_num);
-
-    // 清理
-    delete[] parent_block_data;
-    delete[] dir_block;
-    delete[] new_inode;
-    delete[] parent_inode_data;
 }
 
 unsigned int ext2_t::allocate_block() {
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
+    unsigned char* block_bitmap = scratch.alloc<unsigned char>(block_size);
+
     // 遍历所有块组，查找空闲块
     for (unsigned int group = 0; group < block_group_count; group++) {
+        if (block_group_descriptor_table[group].bg_free_blocks_count == 0) continue;
+
         // 读取块位图
-        unsigned long bgdt_offset = group * 32;
-        unsigned long block_bitmap_block = *(unsigned long*)(block_group_descriptor_table + bgdt_offset);
-        unsigned char* block_bitmap = new unsigned char[block_size];
-        if (!block_bitmap) {
-            printf("Memory allocation failed for block bitmap.\n");
-            return 0;
-        }
+        unsigned int block_bitmap_block = block_group_descriptor_table[group].bg_block_bitmap;
+        if (!load_block(block_bitmap_block, block_bitmap)) continue;
+        EXT2_STAT(STAT_BITMAP_SCANS, 1);
 
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + block_bitmap_block * block_size, SEEK_SET);
-        fread(block_bitmap, block_size, 1, fp);
-
-        // 查找空闲块
-        for (unsigned int byte = 0; byte < block_size; byte++) {
-            if (block_bitmap[byte] != 0xFF) { // 不是全1，说明有空闲块
-                for (unsigned int bit = 0; bit < 8; bit++) {
-                    if (!(block_bitmap[byte] & (1 << bit))) { // 找到空闲块
-                        // 标记块为已使用
-                        block_bitmap[byte] |= (1 << bit);
-                        _fseeki64(fp, (unsigned long long)partition_start * 512 + block_bitmap_block * block_size, SEEK_SET);
-                        fwrite(block_bitmap, block_size, 1, fp);
-
-                        delete[] block_bitmap;
-                        return group * blocks_per_group + byte * 8 + bit;
-                    }
-                }
-            }
-        }
+        // 最后一组可能不满，只扫描组内实际存在的块
+        unsigned int group_start = first_data_block + group * blocks_per_group;
+        unsigned int nbits = blocks_count - group_start < blocks_per_group ? blocks_count - group_start : blocks_per_group;
+        int bit = kern->bitmap_find_zero(block_bitmap, nbits);
+        if (bit < 0) continue;
 
-        delete[] block_bitmap;
+        // 标记块为已使用
+        block_bitmap[bit >> 3] |= (1 << (bit & 7));
+        store_block(block_bitmap_block, block_bitmap);
+        adjust_counts(group, -1, 0, 0);
+        EXT2_STAT(STAT_BITMAP_RMW, 1);
+        EXT2_STAT(STAT_BLOCK_ALLOCS, 1);
+        return txn.commit() ? group_start + bit : 0;
     }
 
     printf("No free blocks available.\n");
     return 0;
 }
 
-unsigned int ext2_t::allocate_inode() {
+unsigned int ext2_t::allocate_inode(bool is_dir) {
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
+    unsigned char* inode_bitmap = scratch.alloc<unsigned char>(block_size);
+
     // 遍历所有块组，查找空闲 inode
     for (unsigned int group = 0; group < block_group_count; group++) {
+        if (block_group_descriptor_table[group].bg_free_inodes_count == 0) continue;
+
         // 读取 inode 位图
-        unsigned long bgdt_offset = group * 32;
-        unsigned long inode_bitmap_block = *(unsigned long*)(block_group_descriptor_table + bgdt_offset + 4);
-        unsigned char* inode_bitmap = new unsigned char[block_size];
-        if (!inode_bitmap) {
-            printf("Memory allocation failed for inode bitmap.\n");
-            return 0;
-        }
+        unsigned int inode_bitmap_block = block_group_descriptor_table[group].bg_inode_bitmap;
+        if (!load_block(inode_bitmap_block, inode_bitmap)) continue;
+        EXT2_STAT(STAT_BITMAP_SCANS, 1);
 
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + inode_bitmap_block * block_size, SEEK_SET);
-        fread(inode_bitmap, block_size, 1, fp);
-
-        // 查找空闲 inode
-        for (unsigned int byte = 0; byte < block_size; byte++) {
-            if (inode_bitmap[byte] != 0xFF) { // 不是全1，说明有空闲 inode
-                for (unsigned int bit = 0; bit < 8; bit++) {
-                    if (!(inode_bitmap[byte] & (1 << bit))) { // 找到空闲 inode
-                        // 标记 inode 为已使用
-                        inode_bitmap[byte] |= (1 << bit);
-                        _fseeki64(fp, (unsigned long long)partition_start * 512 + inode_bitmap_block * block_size, SEEK_SET);
-                        fwrite(inode_bitmap, block_size, 1, fp);
-
-                        delete[] inode_bitmap;
-                        return group * inodes_per_group + byte * 8 + bit + 1; // inode 编号从 1 开始
-                    }
-                }
-            }
-        }
+        int bit = kern->bitmap_find_zero(inode_bitmap, inodes_per_group);
+        if (bit < 0) continue;
 
-        delete[] inode_bitmap;
+        // 标记 inode 为已使用
+        inode_bitmap[bit >> 3] |= (1 << (bit & 7));
+        store_block(inode_bitmap_block, inode_bitmap);
+        adjust_counts(group, 0, -1, is_dir ? 1 : 0);
+        EXT2_STAT(STAT_BITMAP_RMW, 1);
+        EXT2_STAT(STAT_INODE_ALLOCS, 1);
+        return txn.commit() ? group * inodes_per_group + bit + 1 : 0; // inode 编号从 1 开始
     }
 
     printf("No free inodes available.\n");
     return 0;
 }
 
+// 调整块组描述符和超级块中的空闲块数、空闲 inode 数和目录数，并写回镜像
+void ext2_t::adjust_counts(unsigned __int32 group, int blocks, int inodes, int dirs)
+{
+    ext2_group_desc& gd = block_group_descriptor_table[group];
+    gd.bg_free_blocks_count = (unsigned __int16)(gd.bg_free_blocks_count + blocks);
+    gd.bg_free_inodes_count = (unsigned __int16)(gd.bg_free_inodes_count + inodes);
+    gd.bg_used_dirs_count = (unsigned __int16)(gd.bg_used_dirs_count + dirs);
+    super_block.s_free_blocks_count = (unsigned __int32)(super_block.s_free_blocks_count + blocks);
+    super_block.s_free_inodes_count = (unsigned __int32)(super_block.s_free_inodes_count + inodes);
+
+    write_bytes(gdt_offset() + (unsigned __int64)group * sizeof(ext2_group_desc), &gd, sizeof(gd));
+    write_bytes(1024, &super_block, sizeof(super_block));
+}
+
+void ext2_t::reload_summary()
+{
+    raw_read(1024, &super_block, sizeof(super_block));
+    raw_read(gdt_offset(), block_group_descriptor_table, sizeof(ext2_group_desc) * block_group_count);
+}
+
 unsigned int ext2_t::create_file(unsigned int parent_inode, const char* filename, unsigned int mode) {
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
+
     // 分配新的 inode
     unsigned int new_inode_num = allocate_inode();
     if (new_inode_num == 0) {
@@ -632,259 +1035,226 @@ unsigned int ext2_t::create_file(unsigned int parent_inode, const char* filename
         return 0;
     }
 
-    // 读取父目录的 inode
-    unsigned char* parent_inode_data = new unsigned char[inode_size];
-    unsigned int parent_gn = (parent_inode - 1) / inodes_per_group;
-    unsigned int parent_index = (parent_inode - 1) % inodes_per_group;
-    unsigned long parent_inode_table_block = *(unsigned long*)(block_group_descriptor_table + parent_gn * 32 + 8);
-    unsigned long long parent_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)parent_inode_table_block * block_size +
-        (unsigned long long)parent_index * inode_size;
-
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fread(parent_inode_data, inode_size, 1, fp) != 1) {
-        free_inode(new_inode_num);
-        delete[] parent_inode_data;
-        return 0;
-    }
-
     // 初始化新文件的 inode
-    unsigned char* new_inode = new unsigned char[inode_size];
+    ext2_inode* new_inode = scratch.alloc<ext2_inode>(inode_size);
     memset(new_inode, 0, inode_size);
 
-    time_t current_time = time(NULL);
-    *(unsigned short*)(new_inode + 0x00) = mode;              // 文件模式
-    *(unsigned short*)(new_inode + 0x02) = 0;                 // uid
-    *(unsigned int*)(new_inode + 0x04) = 0;                   // size
-    *(unsigned int*)(new_inode + 0x08) = current_time;        // atime
-    *(unsigned int*)(new_inode + 0x0C) = current_time;        // ctime
-    *(unsigned int*)(new_inode + 0x10) = current_time;        // mtime
-    *(unsigned short*)(new_inode + 0x1A) = 1;                 // links count
+    unsigned __int32 current_time = (unsigned __int32)time(NULL);
+    new_inode->i_mode = (unsigned __int16)mode; // 文件模式
+    new_inode->i_atime = current_time;
+    new_inode->i_ctime = current_time;
+    new_inode->i_mtime = current_time;
+    new_inode->i_links_count = 1;
 
     // 写入新的 inode
-    unsigned int new_gn = (new_inode_num - 1) / inodes_per_group;
-    unsigned int new_index = (new_inode_num - 1) % inodes_per_group;
-    unsigned long new_inode_table_block = *(unsigned long*)(block_group_descriptor_table + new_gn * 32 + 8);
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + new_inode_table_block * block_size + new_index * inode_size, SEEK_SET);
-    fwrite(new_inode, inode_size, 1, fp);
-
-    // 获取父目录的数据块并添加新文件的目录项
-    unsigned int parent_block = *(unsigned int*)(parent_inode_data + 0x28);
-    if (!add_entry_to_dir(fp, partition_start, block_size, parent_block, new_inode_num, filename, 1)) {
-        free_inode(new_inode_num);
-        delete[] new_inode;
-        delete[] parent_inode_data;
+    store_inode(new_inode_num, new_inode);
+
+    // 在父目录中添加新文件的目录项（同时更新父目录的时间戳）
+    if (!add_entry_to_dir(parent_inode, new_inode_num, filename, EXT2_FT_REG_FILE)) {
+        printf("Failed to add directory entry.\n");
         return 0;
     }
 
-    // 更新父目录的时间戳
-    *(unsigned int*)(parent_inode_data + 0x10) = current_time; // mtime
-    *(unsigned int*)(parent_inode_data + 0x0C) = current_time; // ctime
-    _fseeki64(fp, parent_inode_offset, SEEK_SET);
-    fwrite(parent_inode_data, inode_size, 1, fp);
-
-    delete[] new_inode;
-    delete[] parent_inode_data;
-
+    if (!txn.commit()) return 0;
     printf("File '%s' created successfully with inode %u\n", filename, new_inode_num);
     return new_inode_num;
 }
 
 bool ext2_t::write_file(unsigned int inode_num, const char* content, size_t size) {
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
+
     // 读取文件的 inode
-    unsigned char* inode = new unsigned char[inode_size];
-    unsigned int gn = (inode_num - 1) / inodes_per_group;
-    unsigned int index = (inode_num - 1) % inodes_per_group;
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + gn * 32 + 8);
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
-    if (_fseeki64(fp, inode_offset, SEEK_SET) != 0 ||
-        fread(inode, inode_size, 1, fp) != 1) {
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(inode_num, inode)) {
         printf("Failed to read inode.\n");
-        delete[] inode;
         return false;
     }
 
+    // 覆盖写：先释放原有的数据块和间接块
+    free_inode_blocks(inode);
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    inode->i_blocks = 0;
+
     // 计算需要的块数
-    unsigned int blocks_needed = (size + block_size - 1) / block_size;
-    unsigned int* block_nums = new unsigned int[blocks_needed];
+    unsigned int blocks_needed = (unsigned int)((size + block_size - 1) >> block_shift);
+    unsigned int* block_nums = scratch.alloc<unsigned int>((size_t)blocks_needed * sizeof(unsigned int));
 
     // 分配所需的块
     for (unsigned int i = 0; i < blocks_needed; i++) {
         block_nums[i] = allocate_block();
         if (block_nums[i] == 0) {
             printf("Failed to allocate block.\n");
-            delete[] block_nums;
-            delete[] inode;
             return false;
         }
     }
 
-    // 更新 inode 的数据块指针
-    for (unsigned int i = 0; i < blocks_needed && i < 12; i++) {
-        *(unsigned int*)(inode + 0x28 + i * 4) = block_nums[i];
-    }
-
-    // 如果需要间接块
-    if (blocks_needed > 12) {
-        unsigned int indirect_block = allocate_block();
-        *(unsigned int*)(inode + 0x28 + 48) = indirect_block; // i_block[12]
-
-        unsigned int* indirect_data = new unsigned int[block_size / 4];
-        for (unsigned int i = 12; i < blocks_needed; i++) {
-            indirect_data[i - 12] = block_nums[i];
+    // 更新 inode 的块映射，超过直接块的部分按需建立一、二、三级间接块
+    inode->i_blocks = blocks_needed << (block_shift - 9);
+    for (unsigned int i = 0; i < blocks_needed; i++) {
+        if (!map_block(inode, i, block_nums[i])) {
+            printf("File too large.\n");
+            return false;
         }
-
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + indirect_block * block_size, SEEK_SET);
-        fwrite(indirect_data, block_size, 1, fp);
-        delete[] indirect_data;
     }
 
     // 更新 inode 的文件大小和时间
-    *(unsigned int*)(inode + 0x04) = size;  // i_size
-    time_t current_time = time(NULL);
-    *(unsigned int*)(inode + 0x08) = current_time; // i_atime
-    *(unsigned int*)(inode + 0x0C) = current_time; // i_ctime
-    *(unsigned int*)(inode + 0x10) = current_time; // i_mtime
+    inode->i_size = (unsigned __int32)size;
+    unsigned __int32 current_time = (unsigned __int32)time(NULL);
+    inode->i_atime = current_time;
+    inode->i_ctime = current_time;
+    inode->i_mtime = current_time;
 
     // 写回 inode
-    _fseeki64(fp, inode_offset, SEEK_SET);
-    fwrite(inode, inode_size, 1, fp);
+    store_inode(inode_num, inode);
 
     // 写入文件内容
     size_t remaining = size;
     const char* current_pos = content;
     for (unsigned int i = 0; i < blocks_needed; i++) {
         size_t write_size = (remaining > block_size) ? block_size : remaining;
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + block_nums[i] * block_size, SEEK_SET);
-        fwrite(current_pos, write_size, 1, fp);
+        write_bytes((unsigned __int64)block_nums[i] << block_shift, current_pos, write_size);
         current_pos += write_size;
         remaining -= write_size;
     }
 
-    delete[] block_nums;
-    delete[] inode;
-    return true;
+    if (ns) ns->touch(inode_num);
+    return txn.commit();
 }
 
-bool ext2_t::add_entry_to_dir(FILE* fp, unsigned __int64 partition_start, unsigned int block_size, unsigned int dir_block,
-    unsigned int new_inode, const char* name, unsigned char file_type) {
+bool ext2_t::add_entry_to_dir(unsigned int dir_inode, unsigned int new_inode, const char* name, unsigned char file_type) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > 255) {
+        printf("Invalid entry name.\n");
+        return false;
+    }
 
-    unsigned char* block_data = new unsigned char[block_size];
-    if (!block_data) return false;
+    dir_slots_t* slots = load_dir_slots(dir_inode);
+    if (!slots) return false;
+    if (slots->names.count(std::string(name, name_len))) {
+        printf("Entry '%s' already exists.\n", name);
+        return false;
+    }
+
+    // 计算新目录项需要的大小
+    unsigned int new_entry_size = DIR_REC_LEN(name_len);
+
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(dir_inode, inode)) return false;
+
+    // 线性插入会破坏哈希索引：和不支持 dir_index 的内核一样清除索引标志，
+    // 之后 dx_root/dx_node 块只被当作含有一个大空目录项的普通目录块
+    inode->i_flags &= ~EXT2_INDEX_FL;
+
+    // 按空闲槽位表找到第一个放得下的块，找不到就给目录追加一个新块
+    size_t idx = slots->hint;
+    while (idx < slots->max_gap.size() && slots->max_gap[idx] < new_entry_size) idx++;
 
-    // 读取目录块
-    _fseeki64(fp, (unsigned __int64)partition_start * 512 + dir_block * block_size, SEEK_SET);
-    fread(block_data, block_size, 1, fp);
+    unsigned char* block_data = scratch.alloc<unsigned char>(block_size);
 
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
+    if (idx == slots->max_gap.size()) {
+        unsigned __int32 bn = allocate_block();
+        if (bn == 0) return false;
+        if (!map_block(inode, (unsigned __int32)idx, bn)) return false;
+
+        // 新块只有一个覆盖整块的空目录项
+        memset(block_data, 0, block_size);
+        ((ext2_dir_entry*)block_data)->rec_len = rec_len_to_disk(block_size);
+        inode->i_size += block_size;
+        inode->i_blocks += block_size / 512;
+
+        slots->blocks.push_back(bn);
+        slots->max_gap.push_back(block_size);
+    }
+    else if (!load_block(slots->blocks[idx], block_data)) {
+        return false;
+    }
 
+    // 在块内找到空隙足够的目录项，把它拆成两项
     unsigned int offset = 0;
-    dir_entry = (ext2_dir_entry*)block_data;
-
-    // 遍历现有目录项直到最后一个
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(block_data + offset);
-
-        // 找到最后一个目录项
-        if (offset + dir_entry->rec_len >= block_size) {
-            // 计算最后一个目录项实际需要的大小
-            unsigned int actual_size = 8 + ((dir_entry->name_len + 3) & ~3);
-            // 计算新目录项需要的大小
-            unsigned int new_entry_size = 8 + ((strlen(name) + 3) & ~3);
-
-            // 检查是否有足够空间
-            if (dir_entry->rec_len - actual_size >= new_entry_size) {
-                // 调整最后一个目录项的大小
-                unsigned int last_rec_len = dir_entry->rec_len;
-                dir_entry->rec_len = actual_size;
-
-                // 在其后添加新目录项
+    bool inserted = false;
+    while (offset + 8 <= block_size) {
+        ext2_dir_entry* dir_entry = (ext2_dir_entry*)(block_data + offset);
+        unsigned int rec_len = rec_len_from_disk(dir_entry->rec_len);
+        if (rec_len < 8 || offset + rec_len > block_size) break;
+
+        // 计算该目录项实际需要的大小（空目录项为 0，可以直接复用）
+        unsigned int actual_size = dir_entry->inode ? DIR_REC_LEN(dir_entry->name_len) : 0;
+        if (rec_len - actual_size >= new_entry_size) {
+            if (actual_size) {
+                dir_entry->rec_len = rec_len_to_disk(actual_size);
                 dir_entry = (ext2_dir_entry*)(block_data + offset + actual_size);
-                dir_entry->inode = new_inode;
-                dir_entry->name_len = strlen(name);
-                dir_entry->file_type = file_type;
-                strncpy(dir_entry->name, name, strlen(name));
-                dir_entry->rec_len = last_rec_len - actual_size;  // 使用剩余空间
-
-                // 写回目录块
-                _fseeki64(fp, (unsigned __int64)partition_start * 512 + dir_block * block_size, SEEK_SET);
-                fwrite(block_data, block_size, 1, fp);
-                delete[] block_data;
-                return true;
             }
+            dir_entry->inode = new_inode;
+            dir_entry->rec_len = rec_len_to_disk(rec_len - actual_size);  // 使用剩余空间
+            dir_entry->name_len = (unsigned char)name_len;
+            dir_entry->file_type = file_type;
+            memcpy(dir_entry->name, name, name_len);
+            inserted = true;
+            break;
         }
-        offset += dir_entry->rec_len;
+        offset += rec_len;
     }
 
-    delete[] block_data;
-    return false;
+    if (!inserted) {
+        // 槽位表与磁盘内容不一致，丢弃后由下次访问重建
+        dir_slot_map.erase(dir_inode);
+        return false;
+    }
+
+    // 写回目录块，更新槽位表和目录的时间戳
+    store_block(slots->blocks[idx], block_data);
+    slots->max_gap[idx] = dir_block_gap(block_data);
+    slots->hint = (unsigned __int32)idx;
+    slots->names.insert(std::string(name, name_len));
+
+    unsigned __int32 current_time = (unsigned __int32)time(NULL);
+    inode->i_mtime = current_time;
+    inode->i_ctime = current_time;
+    store_inode(dir_inode, inode);
+    if (ns) {
+        ns->link(dir_inode, name, new_inode, file_type);
+        ns->touch(dir_inode); // 目录可能多了一个块
+    }
+    return true;
 }
 
 char* ext2_t::read_file(unsigned int inode_num, size_t* size) {
+    scratch_t scratch(arena());
+
     // 读取文件的 inode
-    unsigned char* inode = new unsigned char[inode_size];
-    unsigned int gn = (inode_num - 1) / inodes_per_group;
-    unsigned int index = (inode_num - 1) % inodes_per_group;
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + gn * 32 + 8);
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
-    if (_fseeki64(fp, inode_offset, SEEK_SET) != 0 ||
-        fread(inode, inode_size, 1, fp) != 1) {
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(inode_num, inode)) {
         printf("Failed to read inode.\n");
-        delete[] inode;
         return nullptr;
     }
 
     // 获取文件大小
-    *size = *(unsigned int*)(inode + 0x04);
+    *size = inode->i_size;
     char* content = new char[*size + 1];
     content[*size] = '\0';
 
-    // 读取直接块
+    // 按逻辑顺序读取全部数据块（含多级间接块），物理上连续的块合并成一次读取，空洞读出为 0
+    block_list_t blocks = new_block_list(size_in_blocks(inode));
+    collect_blocks(inode, blocks, nullptr);
     size_t bytes_read = 0;
-    for (int i = 0; i < 12 && bytes_read < *size; i++) {
-        unsigned int block_num = *(unsigned int*)(inode + 0x28 + i * 4);
-        if (block_num == 0) break;
-
-        size_t read_size = (*size - bytes_read > block_size) ? block_size : (*size - bytes_read);
-        _fseeki64(fp, (unsigned long long)partition_start * 512 + block_num * block_size, SEEK_SET);
-        fread(content + bytes_read, read_size, 1, fp);
-        bytes_read += read_size;
-    }
-
-    // 读取间接块
-    if (bytes_read < *size) {
-        unsigned int indirect_block = *(unsigned int*)(inode + 0x28 + 48);
-        if (indirect_block != 0) {
-            unsigned int* indirect_data = new unsigned int[block_size / 4];
-            _fseeki64(fp, (unsigned long long)partition_start * 512 + indirect_block * block_size, SEEK_SET);
-            fread(indirect_data, block_size, 1, fp);
-
-            for (unsigned int i = 0; i < block_size / 4 && bytes_read < *size; i++) {
-                if (indirect_data[i] == 0) break;
-
-                size_t read_size = (*size - bytes_read > block_size) ? block_size : (*size - bytes_read);
-                _fseeki64(fp, (unsigned long long)partition_start * 512 + indirect_data[i] * block_size, SEEK_SET);
-                fread(content + bytes_read, read_size, 1, fp);
-                bytes_read += read_size;
-            }
-
-            delete[] indirect_data;
+    for (unsigned __int32 i = 0; i < blocks.n && bytes_read < *size; ) {
+        unsigned __int32 j = i + 1;
+        if (blocks.v[i] == 0) {
+            while (j < blocks.n && blocks.v[j] == 0) j++;
+        } else {
+            while (j < blocks.n && blocks.v[j] == blocks.v[j - 1] + 1) j++;
         }
+        size_t run = (size_t)(j - i) << block_shift;
+        size_t read_size = (*size - bytes_read > run) ? run : (*size - bytes_read);
+        if (blocks.v[i] == 0) memset(content + bytes_read, 0, read_size);
+        else read_bytes((unsigned __int64)blocks.v[i] << block_shift, content + bytes_read, read_size);
+        bytes_read += read_size;
+        i = j;
     }
+    if (bytes_read < *size) memset(content + bytes_read, 0, *size - bytes_read);
 
-    delete[] inode;
     return content;
 }
 
@@ -894,424 +1264,256 @@ bool ext2_t::delete_file(unsigned int parent_inode, const char* name) {
         return false;
     }
 
-    // 读取父目录的 inode
-    unsigned char* parent_inode_data = new unsigned char[inode_size];
-    if (!parent_inode_data) {
-        return false;
-    }
-
-    // 计算父目录 inode 的位置
-    unsigned int parent_gn = (parent_inode - 1) / inodes_per_group;
-    unsigned int parent_index = (parent_inode - 1) % inodes_per_group;
-    unsigned long parent_inode_table_block = *(unsigned long*)(block_group_descriptor_table + parent_gn * 32 + 8);
-    unsigned long long parent_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)parent_inode_table_block * block_size +
-        (unsigned long long)parent_index * inode_size;
-
-    // 读取父目录的 inode
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fread(parent_inode_data, inode_size, 1, fp) != 1) {
-        delete[] parent_inode_data;
-        return false;
-    }
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
 
-    // 读取父目录的数据块
-    unsigned int parent_block = *(unsigned int*)(parent_inode_data + 0x28);
-    unsigned char* dir_data = new unsigned char[block_size];
-    if (!dir_data) {
-        delete[] parent_inode_data;
-        return false;
-    }
-
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET) != 0 ||
-        fread(dir_data, block_size, 1, fp) != 1) {
-        delete[] parent_inode_data;
-        delete[] dir_data;
+    // 在父目录的所有块中查找文件条目
+    unsigned int target_inode = lookup_entry(parent_inode, name, nullptr);
+    if (target_inode == 0) {
+        printf("File '%s' not found in directory.\n", name);
         return false;
     }
 
-    // 在目录中查找文件条目
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
-
-    unsigned int offset = 0;
-    unsigned int prev_offset = 0;
-    unsigned int target_inode = 0;
-    bool found = false;
-
-    // 遍历目录项查找要删除的文件
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(dir_data + offset);
-
-        if (dir_entry->rec_len == 0 || offset + dir_entry->rec_len > block_size) {
-            break;
-        }
-
-        if (dir_entry->inode != 0 &&
-            dir_entry->name_len == strlen(name) &&
-            memcmp(dir_entry->name, name, dir_entry->name_len) == 0) {
-
-            target_inode = dir_entry->inode;
-            found = true;
-
-            // 如果这是最后一个条目
-            if (offset + dir_entry->rec_len >= block_size) {
-                // 如果不是第一个条目，增加前一个条目的长度
-                if (prev_offset > 0) {
-                    ext2_dir_entry* prev_entry = (ext2_dir_entry*)(dir_data + prev_offset);
-                    prev_entry->rec_len += dir_entry->rec_len;
-                }
-            }
-            else {
-                // 将后续条目向前移动
-                unsigned int next_offset = offset + dir_entry->rec_len;
-                unsigned int move_size = block_size - next_offset;
-                memmove(dir_data + offset, dir_data + next_offset, move_size);
-            }
-            break;
-        }
-
-        prev_offset = offset;
-        offset += dir_entry->rec_len;
-    }
-
-    if (!found) {
-        printf("File '%s' not found in directory.\n", name);
-        delete[] dir_data;
-        delete[] parent_inode_data;
+    // 从父目录中移除目录项（同时更新父目录的时间戳）
+    if (!remove_directory_entry(parent_inode, name)) {
         return false;
     }
 
-    // 写回修改后的目录块
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET);
-    fwrite(dir_data, block_size, 1, fp);
-
-    // 读取并处理文件的 inode
-    unsigned char* file_inode = new unsigned char[inode_size];
-    if (file_inode) {
-        unsigned int file_gn = (target_inode - 1) / inodes_per_group;
-        unsigned int file_index = (target_inode - 1) % inodes_per_group;
-        unsigned long file_inode_table_block = *(unsigned long*)(block_group_descriptor_table + file_gn * 32 + 8);
-        unsigned long long file_inode_offset = (unsigned long long)partition_start * 512 +
-            (unsigned long long)file_inode_table_block * block_size +
-            (unsigned long long)file_index * inode_size;
-
-        if (_fseeki64(fp, file_inode_offset, SEEK_SET) == 0 &&
-            fread(file_inode, inode_size, 1, fp) == 1) {
-
-            // 释放文件的数据块
-            for (int i = 0; i < 12; i++) {
-                unsigned int block_num = *(unsigned int*)(file_inode + 0x28 + i * 4);
-                if (block_num != 0) {
-                    free_block(block_num);
-                }
-            }
-
-            // 处理间接块
-            unsigned int indirect_block = *(unsigned int*)(file_inode + 0x28 + 48);
-            if (indirect_block != 0) {
-                unsigned int* indirect_data = new unsigned int[block_size / 4];
-                if (indirect_data) {
-                    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + indirect_block * block_size, SEEK_SET) == 0 &&
-                        fread(indirect_data, block_size, 1, fp) == 1) {
-                        for (unsigned int i = 0; i < block_size / 4; i++) {
-                            if (indirect_data[i] != 0) {
-                                free_block(indirect_data[i]);
-                            }
-                        }
-                    }
-                    free_block(indirect_block);
-                    delete[] indirect_data;
-                }
-            }
-        }
-        delete[] file_inode;
+    // 读取并处理文件的 inode，释放文件的数据块和间接块
+    ext2_inode* file_inode = scratch.alloc<ext2_inode>(inode_size);
+    if (load_inode(target_inode, file_inode)) {
+        free_inode_blocks(file_inode);
     }
 
     // 释放文件的 inode
     free_inode(target_inode);
 
-    // 更新父目录的时间戳
-    time_t current_time = time(NULL);
-    *(unsigned int*)(parent_inode_data + 0x10) = current_time; // mtime
-    *(unsigned int*)(parent_inode_data + 0x0C) = current_time; // ctime
-
-    // 写回父目录的 inode
-    _fseeki64(fp, parent_inode_offset, SEEK_SET);
-    fwrite(parent_inode_data, inode_size, 1, fp);
-
-    delete[] dir_data;
-    delete[] parent_inode_data;
+    if (!txn.commit()) return false;
     printf("Successfully deleted file '%s' (inode %u)\n", name, target_inode);
     return true;
 }
 
 bool ext2_t::delete_directory(unsigned _int32 parent_inode, const char* name) {
-    // 首先找到目录的 inode 号
-    unsigned char* parent_inode_data = new unsigned char[inode_size];
-    unsigned int parent_gn = (parent_inode - 1) / inodes_per_group;
-    unsigned int parent_index = (parent_inode - 1) % inodes_per_group;
-    unsigned long parent_inode_table_block = *(unsigned long*)(block_group_descriptor_table + parent_gn * 32 + 8);
-    unsigned long long parent_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)parent_inode_table_block * block_size +
-        (unsigned long long)parent_index * inode_size;
-
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fread(parent_inode_data, inode_size, 1, fp) != 1) {
-        printf("Failed to read parent inode.\n");
-        delete[] parent_inode_data;
-        return false;
-    }
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
 
-    // 获取目录的 inode 号
-    unsigned int dir_block = *(unsigned int*)(parent_inode_data + 0x28);
-    unsigned char* dir_data = new unsigned char[block_size];
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + dir_block * block_size, SEEK_SET) != 0 ||
-        fread(dir_data, block_size, 1, fp) != 1) {
-        printf("Failed to read directory block.\n");
-        delete[] dir_data;
-        delete[] parent_inode_data;
-        return false;
-    }
-
-    // 查找目录项
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
-
-    unsigned int offset = 0;
-    unsigned int target_inode = 0;
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(dir_data + offset);
-        if (dir_entry->inode != 0 &&
-            dir_entry->name_len == strlen(name) &&
-            strncmp(dir_entry->name, name, dir_entry->name_len) == 0) {
-            target_inode = dir_entry->inode;
-            break;
-        }
-        offset += dir_entry->rec_len;
-    }
-
-    if (target_inode == 0) {
+    // 首先找到目录的 inode 号
+    unsigned char file_type = 0;
+    unsigned int target_inode = lookup_entry(parent_inode, name, &file_type);
+    if (target_inode == 0 || file_type != EXT2_FT_DIR) {
         printf("Directory not found.\n");
-        delete[] dir_data;
-        delete[] parent_inode_data;
         return false;
     }
 
     // 递归删除目录及其内容
     if (!recursive_delete_directory(target_inode)) {
         printf("Failed to delete directory contents.\n");
-        delete[] dir_data;
-        delete[] parent_inode_data;
         return false;
     }
 
     // 从父目录中移除目录项
     if (!remove_directory_entry(parent_inode, name)) {
         printf("Failed to remove directory entry.\n");
-        delete[] dir_data;
-        delete[] parent_inode_data;
         return false;
     }
 
-    delete[] dir_data;
-    delete[] parent_inode_data;
-    return true;
+    // 被删除目录的 ".." 不再指向父目录
+    ext2_inode* parent_inode_data = scratch.alloc<ext2_inode>(inode_size);
+    if (load_inode(parent_inode, parent_inode_data)) {
+        if (parent_inode_data->i_links_count > 2) parent_inode_data->i_links_count -= 1;
+        store_inode(parent_inode, parent_inode_data);
+    }
+    return txn.commit();
 }
 
 bool ext2_t::recursive_delete_directory(unsigned int dir_inode) {
-    unsigned char* inode_data = new unsigned char[inode_size];
-    unsigned int gn = (dir_inode - 1) / inodes_per_group;
-    unsigned int index = (dir_inode - 1) % inodes_per_group;
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + gn * 32 + 8);
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
-    if (_fseeki64(fp, inode_offset, SEEK_SET) != 0 ||
-        fread(inode_data, inode_size, 1, fp) != 1) {
-        delete[] inode_data;
+    scratch_t scratch(arena());
+    ext2_inode* inode_data = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(dir_inode, inode_data)) {
         return false;
     }
 
-    // 读取目录的数据块
-    unsigned int dir_block = *(unsigned int*)(inode_data + 0x28);
-    unsigned char* dir_data = new unsigned char[block_size];
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + dir_block * block_size, SEEK_SET) != 0 ||
-        fread(dir_data, block_size, 1, fp) != 1) {
-        delete[] dir_data;
-        delete[] inode_data;
+    // 读取目录的所有数据块
+    block_list_t blocks;
+    if (!dir_blocks(dir_inode, blocks)) {
         return false;
     }
 
-    // 遍历目录项
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
+    unsigned char* dir_data = scratch.alloc<unsigned char>(block_size);
+    ext2_inode* file_inode = scratch.alloc<ext2_inode>(inode_size);
+    for (unsigned __int32 b = 0; b < blocks.n; b++) {
+        if (blocks.v[b] == 0 || !load_block(blocks.v[b], dir_data)) continue;
 
-    unsigned int offset = 0;
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(dir_data + offset);
-        if (dir_entry->inode != 0) {
-            // 跳过 "." 和 ".." 目录
-            if (!(dir_entry->name_len == 1 && dir_entry->name[0] == '.') &&
-                !(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.')) {
-
-                char entry_name[256];
-                strncpy(entry_name, dir_entry->name, dir_entry->name_len);
-                entry_name[dir_entry->name_len] = '\0';
-
-                if (dir_entry->file_type == 2) { // 目录
-                    if (!recursive_delete_directory(dir_entry->inode)) {
-                        delete[] dir_data;
-                        delete[] inode_data;
-                        return false;
+        // 遍历目录项
+        unsigned int offset = 0;
+        while (offset + 8 <= block_size) {
+            ext2_dir_entry* dir_entry = (ext2_dir_entry*)(dir_data + offset);
+            unsigned int rec_len = rec_len_from_disk(dir_entry->rec_len);
+            if (rec_len < 8 || offset + rec_len > block_size) break;
+
+            if (dir_entry->inode != 0) {
+                // 跳过 "." 和 ".." 目录
+                if (!(dir_entry->name_len == 1 && dir_entry->name[0] == '.') &&
+                    !(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.')) {
+
+                    if (dir_entry->file_type == 2) { // 目录，递归释放其内容、数据块和 inode
+                        if (!recursive_delete_directory(dir_entry->inode)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        // 释放文件的数据块和 inode
+                        if (load_inode(dir_entry->inode, file_inode)) {
+                            free_inode_blocks(file_inode);
+                        }
+                        free_inode(dir_entry->inode);
                     }
                 }
-                // 释放 inode 和数据块
-                free_inode(dir_entry->inode);
             }
+            offset += rec_len;
         }
-        offset += dir_entry->rec_len;
     }
 
-    // 释放目录自身的 inode 和数据块
-    free_block(dir_block);
+    // 释放目录自身的数据块、间接块和 inode
+    free_inode_blocks(inode_data);
     free_inode(dir_inode);
-
-    delete[] dir_data;
-    delete[] inode_data;
+    dir_slot_map.erase(dir_inode);
     return true;
 }
 
 bool ext2_t::remove_directory_entry(unsigned int parent_inode, const char* name) {
-    unsigned char* parent_inode_data = new unsigned char[inode_size];
-    unsigned int parent_gn = (parent_inode - 1) / inodes_per_group;
-    unsigned int parent_index = (parent_inode - 1) % inodes_per_group;
-    unsigned long parent_inode_table_block = *(unsigned long*)(block_group_descriptor_table + parent_gn * 32 + 8);
-    unsigned long long parent_inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)parent_inode_table_block * block_size +
-        (unsigned long long)parent_index * inode_size;
-
-    if (_fseeki64(fp, parent_inode_offset, SEEK_SET) != 0 ||
-        fread(parent_inode_data, inode_size, 1, fp) != 1) {
-        delete[] parent_inode_data;
+    scratch_t scratch(arena());
+    block_list_t blocks;
+    if (!dir_blocks(parent_inode, blocks)) {
         return false;
     }
 
-    // 读取父目录的数据块
-    unsigned int parent_block = *(unsigned int*)(parent_inode_data + 0x28);
-    unsigned char* dir_data = new unsigned char[block_size];
-    if (_fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET) != 0 ||
-        fread(dir_data, block_size, 1, fp) != 1) {
-        delete[] dir_data;
-        delete[] parent_inode_data;
-        return false;
-    }
+    size_t name_len = strlen(name);
+    unsigned char* dir_data = scratch.alloc<unsigned char>(block_size);
+    for (unsigned __int32 b = 0; b < blocks.n; b++) {
+        if (blocks.v[b] == 0 || !load_block(blocks.v[b], dir_data)) continue;
 
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry, * prev_entry = nullptr;
+        ext2_dir_entry* dir_entry, * prev_entry = nullptr;
+        unsigned int offset = 0;
+        while (offset + 8 <= block_size) {
+            dir_entry = (ext2_dir_entry*)(dir_data + offset);
+            unsigned int rec_len = rec_len_from_disk(dir_entry->rec_len);
+            if (rec_len < 8 || offset + rec_len > block_size) break;
 
-    unsigned int offset = 0;
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(dir_data + offset);
-        if (dir_entry->name_len == strlen(name) &&
-            strncmp(dir_entry->name, name, dir_entry->name_len) == 0) {
-
-            // 如果不是最后一个条目，将后面的条目向前移动
-            if (offset + dir_entry->rec_len < block_size) {
-                memmove(dir_data + offset,
-                    dir_data + offset + dir_entry->rec_len,
-                    block_size - offset - dir_entry->rec_len);
+            if (dir_entry->inode != 0 && dir_entry->name_len == name_len &&
+                memcmp(dir_entry->name, name, name_len) == 0) {
+
+                // 并入前一个目录项；块内第一项没有前驱，只能清空 inode 号
                 if (prev_entry) {
-                    prev_entry->rec_len += dir_entry->rec_len;
+                    prev_entry->rec_len = rec_len_to_disk(rec_len_from_disk(prev_entry->rec_len) + rec_len);
+                }
+                else {
+                    dir_entry->inode = 0;
                 }
-            }
-            else if (prev_entry) {
-                // 如果是最后一个条目，增加前一个条目的长度
-                prev_entry->rec_len += dir_entry->rec_len;
-            }
 
-            // 写回目录块
-            _fseeki64(fp, (unsigned long long)partition_start * 512 + parent_block * block_size, SEEK_SET);
-            fwrite(dir_data, block_size, 1, fp);
+                // 写回目录块
+                store_block(blocks.v[b], dir_data);
+
+                // 更新空闲槽位表：该块出现了新空隙，下次插入从这里开始找
+                auto it = dir_slot_map.find(parent_inode);
+                if (it != dir_slot_map.end() && b < it->second.max_gap.size()) {
+                    it->second.max_gap[b] = dir_block_gap(dir_data);
+                    if (b < it->second.hint) it->second.hint = b;
+                    it->second.names.erase(std::string(name, name_len));
+                }
 
-            delete[] dir_data;
-            delete[] parent_inode_data;
-            return true;
+                // 更新父目录的时间戳
+                ext2_inode* parent_inode_data = scratch.alloc<ext2_inode>(inode_size);
+                if (load_inode(parent_inode, parent_inode_data)) {
+                    unsigned __int32 current_time = (unsigned __int32)time(NULL);
+                    parent_inode_data->i_mtime = current_time;
+                    parent_inode_data->i_ctime = current_time;
+                    store_inode(parent_inode, parent_inode_data);
+                }
+                if (ns) ns->unlink(parent_inode, name);
+                return true;
+            }
+            prev_entry = dir_entry;
+            offset += rec_len;
         }
-        prev_entry = dir_entry;
-        offset += dir_entry->rec_len;
     }
 
-    delete[] dir_data;
-    delete[] parent_inode_data;
     return false;
 }
 
 void ext2_t::free_inode(unsigned int inode_num) {
-    unsigned int group = (inode_num - 1) / inodes_per_group;
-    unsigned int index = (inode_num - 1) % inodes_per_group;
-    unsigned int byte_index = index / 8;
-    unsigned int bit_index = index % 8;
+    if (inode_num < 1 || inode_num > inodes_count) return;
 
-    // 读取 inode 位图
-    unsigned long inode_bitmap_block = *(unsigned long*)(block_group_descriptor_table + group * 32 + 4);
-    unsigned char* bitmap = new unsigned char[block_size];
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
 
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + inode_bitmap_block * block_size, SEEK_SET);
-    fread(bitmap, block_size, 1, fp);
+    unsigned int group = group_of_inode(inode_num);
+    unsigned int index = index_in_inode_group(inode_num);
+    unsigned int byte_index = index >> 3;
+    unsigned int bit_index = index & 7;
+
+    // 读取 inode 位图；已经是空闲的 inode 不再重复计数
+    unsigned int inode_bitmap_block = block_group_descriptor_table[group].bg_inode_bitmap;
+    unsigned char* bitmap = scratch.alloc<unsigned char>(block_size);
+
+    if (!load_block(inode_bitmap_block, bitmap)) return;
+    if (!(bitmap[byte_index] & (1 << bit_index))) {
+        txn.commit();
+        return;
+    }
 
     // 清除位图中的相应位
     bitmap[byte_index] &= ~(1 << bit_index);
 
     // 写回位图
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + inode_bitmap_block * block_size, SEEK_SET);
-    fwrite(bitmap, block_size, 1, fp);
-
-    delete[] bitmap;
+    store_block(inode_bitmap_block, bitmap);
+    EXT2_STAT(STAT_BITMAP_RMW, 1);
+    EXT2_STAT(STAT_INODE_FREES, 1);
+
+    // 和内核一样记录删除时间并清零链接计数，块指针保留不动
+    bool is_dir = false;
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (load_inode(inode_num, inode)) {
+        is_dir = (inode->i_mode & 0xF000) == 0x4000;
+        inode->i_dtime = (unsigned __int32)time(NULL);
+        inode->i_links_count = 0;
+        store_inode(inode_num, inode);
+    }
+    adjust_counts(group, 0, 1, is_dir ? -1 : 0);
+    if (ns) ns->drop(inode_num);
+    txn.commit();
 }
 
 void ext2_t::free_block(unsigned int block_num) {
-    unsigned int group = block_num / blocks_per_group;
-    unsigned int index = block_num % blocks_per_group;
-    unsigned int byte_index = index / 8;
-    unsigned int bit_index = index % 8;
+    if (block_num < first_data_block || block_num >= blocks_count) return;
 
-    // 读取块位图
-    unsigned long block_bitmap_block = *(unsigned long*)(block_group_descriptor_table + group * 32);
-    unsigned char* bitmap = new unsigned char[block_size];
+    txn_scope_t txn(*this);
+    scratch_t scratch(arena());
 
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + block_bitmap_block * block_size, SEEK_SET);
-    fread(bitmap, block_size, 1, fp);
+    unsigned int group = group_of_block(block_num);
+    unsigned int index = index_in_group(block_num);
+    unsigned int byte_index = index >> 3;
+    unsigned int bit_index = index & 7;
+
+    // 读取块位图；已经是空闲的块不再重复计数
+    unsigned int block_bitmap_block = block_group_descriptor_table[group].bg_block_bitmap;
+    unsigned char* bitmap = scratch.alloc<unsigned char>(block_size);
+
+    if (!load_block(block_bitmap_block, bitmap)) return;
+    if (!(bitmap[byte_index] & (1 << bit_index))) {
+        txn.commit();
+        return;
+    }
 
     // 清除位图中的相应位
     bitmap[byte_index] &= ~(1 << bit_index);
 
     // 写回位图
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + block_bitmap_block * block_size, SEEK_SET);
-    fwrite(bitmap, block_size, 1, fp);
-
-    delete[] bitmap;
+    store_block(block_bitmap_block, bitmap);
+    adjust_counts(group, 1, 0, 0);
+    EXT2_STAT(STAT_BITMAP_RMW, 1);
+    EXT2_STAT(STAT_BLOCK_FREES, 1);
+    txn.commit();
 }
 
 void ext2_t::show_tree(unsigned int inode_num) {
@@ -1319,124 +1521,63 @@ void ext2_t::show_tree(unsigned int inode_num) {
 }
 
 void ext2_t::show_tree_recursive(unsigned int inode_num, const char* prefix, bool last) {
-    // 读取当前目录的inode
-    unsigned char* inode = new unsigned char[inode_size];
-    if (!inode) return;
-
-    unsigned int gn = (inode_num - 1) / inodes_per_group;
-    unsigned int index = (inode_num - 1) % inodes_per_group;
-    unsigned long inode_table_block = *(unsigned long*)(block_group_descriptor_table + gn * 32 + 8);
-    unsigned long long inode_offset = (unsigned long long)partition_start * 512 +
-        (unsigned long long)inode_table_block * block_size +
-        (unsigned long long)index * inode_size;
-
-    if (_fseeki64(fp, inode_offset, SEEK_SET) != 0 ||
-        fread(inode, inode_size, 1, fp) != 1) {
-        delete[] inode;
-        return;
-    }
-
-    // 确认这是一个目录
-    unsigned short mode = *(unsigned short*)inode;
-    if ((mode & 0x4000) != 0x4000) {  // 不是目录
-        delete[] inode;
-        return;
-    }
-
-    // 读取目录数据块
-    unsigned int dir_block = *(unsigned int*)(inode + 0x28);
-    if (dir_block == 0) {
-        delete[] inode;
-        return;
-    }
-
-    unsigned char* block_data = new unsigned char[block_size];
-    if (!block_data) {
-        delete[] inode;
-        return;
-    }
-
-    _fseeki64(fp, (unsigned long long)partition_start * 512 + dir_block * block_size, SEEK_SET);
-    fread(block_data, block_size, 1, fp);
-
-    // 解析目录项
-    struct ext2_dir_entry {
-        unsigned int inode;
-        unsigned short rec_len;
-        unsigned char name_len;
-        unsigned char file_type;
-        char name[256];
-    } *dir_entry;
-
-    // 收集所有目录项用于排序
-    std::vector<std::pair<std::string, std::pair<unsigned int, unsigned char>>> entries;
-    unsigned int offset = 0;
-
-    while (offset < block_size) {
-        dir_entry = (ext2_dir_entry*)(block_data + offset);
-
-        // 检查记录长度的有效性
-        if (dir_entry->rec_len == 0 || offset + dir_entry->rec_len > block_size) {
-            break;
+    // 先按层读出整棵子树（每个目录的子项已按名称排序），再用显式栈深度优先打印，不受目录深度限制
+    flat_tree_t tree;
+    if (!build_tree(inode_num, true, tree)) return;
+
+    struct frame_t {
+        unsigned __int32 node;
+        unsigned __int32 next;  // 下一个要打印的子项
+        size_t prefix_len;      // 打印该目录的子项时使用的前缀长度
+        size_t path_len;        // 该目录的路径长度（结构化输出用）
+        bool last;              // 该目录是否为上级的最后一项
+    };
+    out_writer_t w;
+    record_writer_t r(w, out_format);
+    bool text = out_format == OUT_TEXT;
+    std::string line_prefix = prefix;
+    std::string path;
+    std::vector<frame_t> stack(1, frame_t{ 0, 0, line_prefix.size(), 0, last });
+    while (!stack.empty()) {
+        frame_t& f = stack.back();
+        const flat_node_t& dir = tree[f.node];
+        if (f.next >= dir.child_count) {
+            stack.pop_back();
+            continue;
         }
-
-        // 如果inode号不为0且名称长度有效
-        if (dir_entry->inode != 0 && dir_entry->name_len > 0 && dir_entry->name_len < 255) {
-            char temp_name[256];
-            memset(temp_name, 0, sizeof(temp_name));
-            strncpy(temp_name, dir_entry->name, dir_entry->name_len);
-
-
-
-            // 跳过 "." 和 ".." 目录
-            if (strcmp(temp_name, ".") != 0 && strcmp(temp_name, "..") != 0) {
-                entries.push_back({ std::string(temp_name), {dir_entry->inode, dir_entry->file_type} });
+        unsigned __int32 c = dir.first_child + f.next++;
+        const flat_node_t& entry = tree[c];
+        bool is_last = f.next == dir.child_count;
+        line_prefix.resize(f.prefix_len);
+        path.resize(f.path_len);
+        path += '/';
+        path.append(tree.name(c), entry.name_len);
+
+        if (!text) {
+            r.begin();
+            r.field("path", path);
+            r.field("ino", entry.ino);
+            r.field("type", file_type_name(entry.file_type));
+            r.field("depth", stack.size());
+            r.end();
+        } else {
+            w.put(line_prefix).put(is_last ? "└── " : "├── ").put(tree.name(c), entry.name_len);
+            switch (entry.file_type) {
+            case EXT2_FT_DIR:      w.put("/\n"); break;         // 目录
+            case EXT2_FT_SYMLINK:  w.put("@\n"); break;         // 符号链接
+            case EXT2_FT_CHRDEV:                                // 字符设备
+            case EXT2_FT_BLKDEV:   w.put(" (device)\n"); break; // 块设备
+            case EXT2_FT_FIFO:     w.put(" (FIFO)\n"); break;
+            case EXT2_FT_SOCK:     w.put(" (socket)\n"); break;
+            case EXT2_FT_REG_FILE: // 普通文件
+            default:               w.put('\n'); break;
             }
         }
 
-        offset += dir_entry->rec_len;
-    }
-
-    // 按名称排序
-    std::sort(entries.begin(), entries.end());
-
-    // 准备下一级的前缀
-    char new_prefix[512];
-    strcpy(new_prefix, prefix);
-    strcat(new_prefix, last ? "    " : "│   ");
-
-    // 打印所有目录项
-    for (size_t i = 0; i < entries.size(); ++i) {
-        const auto& entry = entries[i];
-        bool is_last = (i == entries.size() - 1);
-
-        printf("%s%s%s", prefix, is_last ? "└── " : "├── ", entry.first.c_str());
-
-        switch (entry.second.second) {
-        case EXT2_FT_DIR:  // 目录
-            printf("/\n");
-            show_tree_recursive(entry.second.first, new_prefix, is_last);
-            break;
-        case EXT2_FT_SYMLINK:  // 符号链接
-            printf("@\n");
-            break;
-        case EXT2_FT_CHRDEV:   // 字符设备
-        case EXT2_FT_BLKDEV:   // 块设备
-            printf(" (device)\n");
-            break;
-        case EXT2_FT_FIFO:     // FIFO
-            printf(" (FIFO)\n");
-            break;
-        case EXT2_FT_SOCK:     // Socket
-            printf(" (socket)\n");
-            break;
-        case EXT2_FT_REG_FILE: // 普通文件
-        default:
-            printf("\n");
-            break;
+        if (entry.file_type == EXT2_FT_DIR && entry.child_count > 0) {
+            // 下一级的前缀
+            line_prefix += f.last ? "    " : "│   ";
+            stack.push_back(frame_t{ c, 0, line_prefix.size(), path.size(), is_last });
         }
     }
-
-    delete[] block_data;
-    delete[] inode;
-}
\ No newline at end of file
+}
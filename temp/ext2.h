@@ -6,22 +6,123 @@
 #include <set>
 #include <vector>
 #include <string>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <atomic>
 #include<algorithm>
+#include "ext2_fs.h"
+#include "stats.h"
+#include "trace.h"
+#include "vdisk.h"
+#include "nsindex.h"
+#include "owner.h"
+#include "flattree.h"
+#include "output.h"
+#include "partition.h"
+#include "shardcache.h"
 
+bool sync_file(FILE* f); // 把文件缓冲区和操作系统缓存刷到磁盘
+bool read_at(FILE* f, unsigned __int64 off, void* buf, size_t len); // 按绝对位置读取，可以多线程同时调用（journal.cpp）
+unsigned __int32 fnv1a(unsigned __int32 h, const void* data, size_t len); // FNV-1a 校验和，h 初值为 2166136261
+
+// 并发约定：只读查询（read_file、lookup_entry、list_directory、dump_inode、show_tree 等）可以在多个线程中
+// 同时对同一个 ext2_t 调用——读盘都是按绝对位置读，块缓存按块号分片加锁，临时缓冲区是线程局部的，统计是原子计数。
+// 写操作、事务（txn_begin/txn_commit）、日志回放、碎片整理以及切换 io/cow/trace 等设置必须单线程进行，期间不能有查询。
 class ext2_t
 {
-    FILE* fp; // 文件指针
-    unsigned __int32 partition_start; // 分区起始地址
-    unsigned __int32 partition_size; // 分区大小
-    unsigned __int8 super_block[1024]; // 超级块
+    FILE* fp; // 文件指针；镜像为 VMDK 容器时为空
+    vdisk_t* disk; // VMDK 描述符或稀疏镜像经它读写，裸镜像（包括 -flat.vmdk）时为空
+    // 写入时文件指针的位置和上一次操作的方向（0 未知，2 写）；连续的顺序写不再定位。
+    // 读一律用 read_at 按位置读，不依赖也不改变这里的状态（Windows 上读会移动文件指针，因此把方向清为未知）
+    unsigned __int64 io_pos;
+    std::atomic<int> io_dir;
+    bool io_seek(unsigned __int64 pos, int dir);
+    unsigned __int64 partition_start; // 分区起始扇区
+    unsigned __int64 partition_size; // 分区扇区数
+    ext2_super_block super_block; // 超级块
     unsigned __int32 inodes_count; // 索引节点数量
     unsigned __int32 block_size; // 块大小
     unsigned __int32 blocks_per_group; // 每组块数
     unsigned __int32 inodes_per_group; // 每组索引节点数
     unsigned __int16 inode_size; // 索引节点大小
-    unsigned __int8* block_group_descriptor_table;  // 组描述符表，记得在析构中释放
+    ext2_group_desc* block_group_descriptor_table;  // 组描述符表，记得在析构中释放
     unsigned __int32 blocks_count; // 块总数
     unsigned __int32 block_group_count; // 块组总数
+    unsigned __int32 first_data_block; // 第 0 组的起始块号（1K 块为 1，其余为 0）
+
+    // 热路径上用位移和掩码代替除法：块大小总是 2 的幂；每组块数/inode 数为 2 的幂时 *_shift 非 0
+    unsigned __int32 block_shift; // log2(block_size)
+    unsigned __int32 addr_shift; // log2(block_size / 4)，即每个间接块中指针数的对数
+    unsigned __int32 bpg_shift; // log2(blocks_per_group)
+    unsigned __int32 ipg_shift; // log2(inodes_per_group)
+    unsigned __int32 group_of_block(unsigned __int32 bn) { return bpg_shift ? (bn - first_data_block) >> bpg_shift : (bn - first_data_block) / blocks_per_group; }
+    unsigned __int32 index_in_group(unsigned __int32 bn) { return bpg_shift ? (bn - first_data_block) & (blocks_per_group - 1) : (bn - first_data_block) % blocks_per_group; }
+    unsigned __int32 group_of_inode(unsigned __int32 ino) { return ipg_shift ? (ino - 1) >> ipg_shift : (ino - 1) / inodes_per_group; }
+    unsigned __int32 index_in_inode_group(unsigned __int32 ino) { return ipg_shift ? (ino - 1) & (inodes_per_group - 1) : (ino - 1) % inodes_per_group; }
+
+    // 元数据事务：事务期间所有写入先缓存在 txn_dirty 中，提交时整体写入旁路重做日志，
+    // fsync 一次后再回写到镜像（checkpoint），从而保证一批 mkdir/touch/rm 的原子性
+    std::string journal_path; // 旁路重做日志文件名（镜像文件名 + ".jnl"）
+    int txn_depth; // 事务嵌套深度，只有最外层提交才真正写盘
+    unsigned __int64 txn_seq; // 已提交事务的序号
+    std::map<unsigned __int32, std::vector<unsigned __int8>> txn_dirty; // 事务中被修改的块号 -> 块内容
+    unsigned __int64 txn_writes; // 事务中经 write_bytes 的写入次数，用来判断出错的一层是否已经改过东西
+    bool txn_failed; // 内层事务出错放弃后置位，最外层提交时改为丢弃全部修改
+
+    // 命令级内存池：块缓冲区、inode 缓冲区和块号列表都从这里借用，避免热路径上的 new/delete。
+    // 每个线程一个（同一线程中的各个 ext2_t 共用），多个线程同时查询同一个对象时互不干扰
+    static arena_t& arena()
+    {
+        static thread_local arena_t a;
+        return a;
+    }
+
+    // 块号列表，存放在命令内存池中，随调用者的 scratch_t 一起释放
+    struct block_list_t
+    {
+        unsigned __int32* v;
+        unsigned __int32 n; // 已有的块数
+        unsigned __int32 cap; // 最多收集的块数
+        void push(unsigned __int32 b) { if (n < cap) v[n++] = b; }
+        bool full() const { return n >= cap; }
+    };
+    block_list_t new_block_list(unsigned __int32 cap)
+    {
+        block_list_t l;
+        l.v = (unsigned __int32*)arena().alloc((size_t)cap * 4 + 4);
+        l.n = 0;
+        l.cap = cap;
+        return l;
+    }
+    // inode 数据占用的逻辑块数（按 i_size 计算，不超过文件系统块总数）
+    unsigned __int32 size_in_blocks(const ext2_inode* inode)
+    {
+        unsigned __int64 n = ((unsigned __int64)inode->i_size + block_size - 1) >> block_shift;
+        return n < blocks_count ? (unsigned __int32)n : blocks_count;
+    }
+    // i_block 是否为块映射：设备文件、FIFO、套接字没有数据块，快速符号链接把目标直接存在 i_block 中
+    bool has_block_map(const ext2_inode* inode)
+    {
+        unsigned __int32 type = inode->i_mode & 0xF000;
+        if (type == 0x2000 || type == 0x6000 || type == 0x1000 || type == 0xC000) return false;
+        return type != 0xA000 || inode->i_blocks > (inode->i_file_acl ? block_size / 512 : 0u);
+    }
+
+    // 按块大小特化的内核（kernels.cpp）：块映射、目录块遍历和位图扫描，打开镜像时按 block_size 选定一组
+    struct kernels_t
+    {
+        unsigned __int32 (ext2_t::* bmap)(const ext2_inode* inode, unsigned __int32 lblk);
+        void (ext2_t::* collect_indirect)(unsigned __int32 bn, int level, block_list_t& blocks, block_list_t* meta);
+        unsigned __int32 (*dir_block_gap)(const unsigned __int8* block);
+        const ext2_dir_entry* (*dir_find)(const unsigned __int8* block, const char* name, size_t name_len);
+        int (*bitmap_find_zero)(const unsigned __int8* bitmap, unsigned __int32 nbits);
+    };
+    const kernels_t* kern;
+    static const kernels_t* select_kernels(unsigned __int32 block_size);
+    template <unsigned __int32 BS> unsigned __int32 bmap_k(const ext2_inode* inode, unsigned __int32 lblk);
+    template <unsigned __int32 BS> void collect_indirect_k(unsigned __int32 bn, int level, block_list_t& blocks, block_list_t* meta);
 
     // 向上对齐
     unsigned __int64 align_up(unsigned __int64 p, unsigned __int32 s)
@@ -33,29 +134,173 @@ class ext2_t
     }
 
     // 将时间转换为字符串
-    char* time2str(time_t t)
+    char* time2str(time_t t) // 结果在本线程的缓冲区中，到下一次调用前有效
     {
-        char* s = ctime(&t);
-        s[strlen(s) - 1] = '\0';
-        return s;
+        static thread_local char buf[26];
+        if (ctime_s(buf, sizeof(buf), &t) != 0) buf[0] = '\0';
+        size_t n = strlen(buf);
+        if (n) buf[n - 1] = '\0';
+        return buf;
     }
 
     // 打印缓冲区内容
     void dump(unsigned __int8* buf, unsigned __int32 size, unsigned __int64 offset);
 
+    // 底层读写：off 为相对分区起始的字节偏移，直接访问镜像文件
+    bool raw_read(unsigned __int64 off, void* buf, size_t len);
+    bool raw_write(unsigned __int64 off, const void* buf, size_t len);
+    // 经过事务层的读写：读取时叠加事务中的脏块，写入时在事务内只修改脏块缓存
+    bool read_bytes(unsigned __int64 off, void* buf, size_t len);
+    bool write_bytes(unsigned __int64 off, const void* buf, size_t len);
+    bool load_block(unsigned __int32 bn, void* buf) { return read_bytes((unsigned __int64)bn << block_shift, buf, block_size); }
+    bool store_block(unsigned __int32 bn, const void* buf) { return write_bytes((unsigned __int64)bn << block_shift, buf, block_size); }
+    unsigned __int64 inode_offset(unsigned __int32 ino); // 索引节点相对分区起始的字节偏移
+    bool load_inode(unsigned __int32 ino, void* buf) { return read_bytes(inode_offset(ino), buf, inode_size); }
+    bool store_inode(unsigned __int32 ino, const void* buf) { return write_bytes(inode_offset(ino), buf, inode_size); }
+
+    // 目录空闲槽位表：记录目录每个块中能容纳新目录项的最大空隙和已有的名字，
+    // 插入时只需从 hint 开始找第一个放得下的块，不必重新扫描整个目录
+    struct dir_slots_t
+    {
+        std::vector<unsigned __int32> blocks; // 逻辑块号 -> 物理块号
+        std::vector<unsigned __int32> max_gap; // 逻辑块号 -> 块内最大可用空隙（字节）
+        std::set<std::string> names; // 目录中已有的名字，用于查重
+        unsigned __int32 hint; // 从这里开始查找有空位的块
+    };
+    std::map<unsigned __int32, dir_slots_t> dir_slot_map; // 目录 inode 号 -> 空闲槽位表
+
+    void collect_indirect(unsigned __int32 bn, int level, block_list_t& blocks, block_list_t* meta) { (this->*kern->collect_indirect)(bn, level, blocks, meta); }
+    void collect_blocks(const ext2_inode* inode, block_list_t& blocks, block_list_t* meta); // 按逻辑顺序收集数据块号
+    unsigned __int32 alloc_zeroed_block(ext2_inode* inode);
+    bool map_block(ext2_inode* inode, unsigned __int32 lblk, unsigned __int32 pbn); // 设置逻辑块的映射
+    void free_inode_blocks(const ext2_inode* inode); // 释放 inode 的全部数据块和间接块
+    bool dir_blocks(unsigned __int32 dir_inode, block_list_t& blocks); // 目录的全部数据块（列表在内存池中）
+    unsigned __int32 dir_block_gap(const unsigned __int8* block) { return kern->dir_block_gap(block); } // 块内能容纳新目录项的最大空隙
+    dir_slots_t* load_dir_slots(unsigned __int32 dir_inode);
+
+    // 目录遍历预读（tree、ls_root）：展开一批目录之前先合并读取它们的 inode 表块和目录块
+    bool read_blocks_merged(std::vector<unsigned __int32>& blocks, const std::function<void(unsigned __int32 bn, const unsigned __int8* data)>& fn);
+    bool prefetch_dirs(const std::vector<unsigned __int32>& dirs, std::unordered_map<unsigned __int32, std::vector<unsigned __int8>>& out);
+    bool build_tree(unsigned __int32 root, bool sorted, flat_tree_t& tree); // 按层读出 root 下的整棵目录树（flattree.cpp）
+
+    // 哈希目录（htree）：索引块缓存，按物理块号保存 dx_root/dx_node 以及查找路径上的间接块；分片加锁，可以并发查询
+    shard_cache_t index_cache;
+    const unsigned __int8* index_block(unsigned __int32 bn);
+    unsigned __int32 bmap(const ext2_inode* inode, unsigned __int32 lblk) { return (this->*kern->bmap)(inode, lblk); } // 单个逻辑块 -> 物理块
+    unsigned __int32 dx_lookup(const ext2_inode* inode, const char* name, size_t name_len,
+        unsigned char* file_type, bool* usable);
+
+    // 块组描述符表的位置，以及分配/释放时同步更新块组和超级块中的空闲计数
+    unsigned __int64 gdt_offset() { return align_up(1024 + 1024, block_size); }
+    void adjust_counts(unsigned __int32 group, int blocks, int inodes, int dirs);
+    void reload_summary(); // 事务被丢弃后从镜像重新读取超级块和块组描述符表
+
+    bool txn_flush(); // 把脏块写入重做日志并 fsync，再回写到镜像，最后删除日志
+
+    trace_writer_t* trace; // 块访问跟踪，未开启时为空
+
+    // 写时复制覆盖层（<镜像名>.cow）：开启后镜像以只读方式打开，所有写入按粒度落到旁路文件，
+    // 读取时优先取覆盖层中的内容。cow commit 把覆盖层写回镜像，cow discard 直接丢弃
+    std::string image_path;
+    std::string cow_path;
+    FILE* cow_fp; // 未开启覆盖层时为空
+    std::map<unsigned __int32, unsigned __int64> cow_index; // 粒度号 -> 数据在旁路文件中的偏移
+    unsigned __int64 cow_end; // 旁路文件中下一条记录的位置
+    unsigned __int64 image_size; // 镜像文件（VMDK 为虚拟磁盘）的大小，回写时不越过末尾
+    bool cow_open(); // 打开已有的覆盖层并重建索引，没有时新建
+    bool cow_reset(); // 清空覆盖层
+    bool cow_write_back(); // 把覆盖层写回镜像并清空，回写期间头部标记为“正在提交”
+    unsigned __int32 cow_fingerprint(); // 镜像中分区第一个粒度的校验和，用于识别覆盖层属于哪个镜像
+    bool cow_read(unsigned __int64 off, void* buf, size_t len);
+    bool cow_write(unsigned __int64 off, const void* buf, size_t len);
+
+    // 只读方式：镜像和全部旁路文件都不修改。已有的覆盖层读入内存，日志重放和其他写入都只进内存覆盖层，
+    // 命名空间索引也只在内存中建立。用于 diff 的另一个镜像和 each 中的其他分区
+    bool read_only;
+    std::map<unsigned __int32, std::vector<unsigned __int8>> mem_grains; // 粒度号 -> 内容
+    bool cow_load(); // 把已有的覆盖层读入 mem_grains，不存在时什么也不做
+    bool mem_read(unsigned __int64 off, void* buf, size_t len);
+    bool mem_write(unsigned __int64 off, const void* buf, size_t len);
+    bool base_read(unsigned __int64 off, void* buf, size_t len); // 直接读镜像
+    bool base_write(unsigned __int64 off, const void* buf, size_t len); // 直接写镜像
+    bool sync_image(); // 把写入（镜像或覆盖层）同步到磁盘
+    bool read_disk(unsigned __int64 off, void* buf, size_t len); // 按磁盘（而不是分区）内的偏移读取，用于分区表
+    void collect_inode_meta(unsigned __int32 ino, const ext2_inode* inode, std::vector<unsigned __int32>& out); // 导出时收集 inode 引用的元数据块
+    void txn_recover(); // 打开镜像时重放已完整提交但尚未回写的日志
+
+    // 命名空间索引（<镜像名>.idx，见 nsindex.h）：路径查询直接查映射的索引文件，本工具的修改追加到索引末尾
+    std::string ns_path;
+    ns_index_t* ns; // 索引不存在或已作废时为空，第一次路径查询时建立
+    ns_summary_t ns_summary(); // 当前超级块中用于校验索引的字段
+    void ns_open();
+    bool ns_build(); // 全盘扫描建立索引
+    void ns_close(); // 标记索引有效；修改记录太多时先合并
+    void ns_invalidate(); // 修改被丢弃后索引与镜像不再一致，直接删除
+    void inode_extents(unsigned __int32 ino, std::vector<ns_extent_t>& out);
+
+    // 全盘并行扫描（scan.cpp）：调用线程按物理顺序大块读取，回调在工作线程中执行，worker 为线程序号。
+    // 回调之间没有同步，结果应按 worker 分开收集
+    typedef std::function<void(unsigned worker, unsigned __int32 ino, const ext2_inode* inode)> inode_visitor_t;
+    typedef std::function<void(unsigned worker, unsigned __int32 dir, const ext2_dir_entry* de)> dirent_visitor_t;
+    bool scan_inodes(unsigned threads, const inode_visitor_t& fn, unsigned __int64* scanned, // 全部在用 inode；
+        const inode_visitor_t* unused = nullptr); // unused 不为空时空闲 inode 交给它
+    typedef std::function<void(unsigned worker, size_t index, const unsigned __int8* data)> block_visitor_t;
+    bool scan_blocks(const std::vector<unsigned __int32>& blocks, unsigned threads, const block_visitor_t& fn); // blocks 已按块号排序，index 为在其中的下标
+    bool scan_dir_entries(const std::vector<unsigned __int32>& dirs, unsigned threads, const dirent_visitor_t& fn, unsigned __int64* scanned); // dirs 的全部目录项
+    bool read_block_bitmaps(unsigned threads, std::vector<unsigned __int8>& bitmap); // 全部块位图，每组 (blocks_per_group + 7) / 8 字节
+    bool bitmap_test(const std::vector<unsigned __int8>& bitmap, unsigned __int32 bn) // bn 在 read_block_bitmaps 的结果中是否已分配
+    {
+        unsigned __int32 i = index_in_group(bn);
+        return (bitmap[(size_t)group_of_block(bn) * ((blocks_per_group + 7) >> 3) + (i >> 3)] >> (i & 7)) & 1;
+    }
+
+    // 块属主反查表（owner.cpp）：第一次需要时并行扫描全部块映射建立，任何写入之后作废
+    owner_map_t* owners;
+    const owner_map_t* owner_map(); // 建立失败时返回空
+    void owners_reset();
+    bool block_in_use(unsigned __int32 bn); // 块位图中的状态
+    bool group_has_super(unsigned __int32 g); // 该组是否有超级块备份（sparse_super）
+
+    // 删除文件恢复（undelete.cpp）：候选 inode 的块映射逐块对照属主表和块位图，判断数据是否还在
+    struct undelete_t;
+    bool undelete_map(std::vector<undelete_t>& cands, unsigned threads, bool keep_blocks);
+
+    // 碎片整理（defrag.cpp）：先把数据复制到连续的空闲段，再在一个事务中切换块指针并释放旧块
+    struct defrag_node_t;
+    struct defrag_state_t;
+    bool defrag_walk(const ext2_inode* inode, std::vector<defrag_node_t>& seq); // 按先序列出全部数据块和间接块
+    bool defrag_file(unsigned __int32 ino, const std::string& path, defrag_state_t& st);
+    bool mark_blocks(unsigned __int32 start, unsigned __int32 count, bool used); // 设置或清除一段块的位图位并更新空闲计数
+    void files_under(unsigned __int32 dir, const std::string& base, std::vector<std::pair<unsigned __int32, std::string>>& out);
+
+    // 镜像比较（diff.cpp）
+    struct diff_change_t;
+    bool dir_entry_map(unsigned __int32 dir, std::map<std::string, unsigned __int32>& out); // 名字 -> inode 号，不含 . 和 ..
+    bool dir_path(unsigned __int32 dir, std::unordered_map<unsigned __int32, std::string>& memo, std::string& out); // 沿 ".." 向上查出路径，根目录为空串
+
+    // 分区（partition.cpp）
+    void probe_partition(partition_t& p); // 读起点处的超级块
+    bool read_gpt(unsigned __int64 lba, std::vector<partition_t>& out);
+    void read_ebr_chain(unsigned __int64 ext_start, unsigned __int64 ext_sectors, int next_index, std::vector<partition_t>& out,
+        std::vector<unsigned __int64>* ebrs = nullptr); // ebrs 非空时同时收集各 EBR 所在的扇区
+    void partition_table_ranges(std::vector<std::pair<unsigned __int64, unsigned __int64>>& out); // 分区表本身占用的磁盘字节范围（偏移, 长度），按偏移排序
+    std::mutex* io_gate; // each 命令中各分区共用，扫描的批量读取轮流进行；平时为空
+    std::unique_lock<std::mutex> io_turn(); // 扫描读一批数据前取得 io_gate（scan.cpp）
+
 public:
-    ext2_t(const char* vdfn, int p); // 将文件名为 vdfn 的虚拟磁盘文件的第 p 个分区按照 ext2 文件系统解释
+    ext2_t(const char* vdfn, int p, bool cow = false, bool ro = false); // 将文件名为 vdfn 的虚拟磁盘文件的第 p 个分区按照 ext2 文件系统解释；cow 为 true 时写入只进覆盖层，ro 为 true 时不修改任何文件
+    ~ext2_t();
     void dump_block(unsigned int bn); // 打印指定块
     void dump_super_block(); // 打印超级块
     void dump_inode(unsigned _int32 inode); // 打印指定索引节点
     void list_directory(unsigned int dir_inode, const std::string& prefix);
     void ls_root(); // 查找并显示根目录内容
-    unsigned int* read_block(unsigned int block_num);
+    unsigned int* read_block(unsigned int block_num); // 返回的缓冲区在命令内存池中
     void get_file_blocks(unsigned _int32 inode_num); // 获取文件的数据块，支持多级索引
     bool validate_block_number(unsigned int block_num, const char* block_type);
     void read_indirect_block(unsigned int block_num, int level, std::set<unsigned int>& seen_blocks);
     void create_directory(unsigned _int32 parent_inode, const char* dir_name); // 创建新目录
-    unsigned int allocate_inode(); // 分配一个新的 inode
+    unsigned int allocate_inode(bool is_dir = false); // 分配一个新的 inode
     unsigned int allocate_block();
     // 文件操作函数
     unsigned int create_file(unsigned int parent_inode, const char* filename, unsigned int mode);
@@ -70,10 +315,54 @@ public:
     void show_tree(unsigned int inode_num);
     void show_tree_recursive(unsigned int inode_num, const char* prefix, bool last);
     bool recursive_delete_directory(unsigned int dir_inode);
-    bool add_entry_to_dir(FILE* fp, unsigned __int64 partition_start, unsigned int block_size, unsigned int dir_block,
-        unsigned int new_inode, const char* name, unsigned char file_type);
+    bool add_entry_to_dir(unsigned int dir_inode, unsigned int new_inode, const char* name, unsigned char file_type);
+    unsigned __int32 lookup_entry(unsigned __int32 dir_inode, const char* name, unsigned char* file_type); // 在目录中按名字查找
+    // 事务接口：可嵌套，begin/commit 之间的所有修改作为一次提交原子地落盘
+    void txn_begin();
+    bool txn_commit();
+    void txn_abort();
+    unsigned __int64 txn_mark() const { return txn_writes; }
+    void txn_fail(unsigned __int64 mark); // 放弃当前这一层事务，mark 为这一层开始时的 txn_mark()
+
+    // 块访问跟踪：开启后 read_bytes/write_bytes 的每次读写都记录到 path（见 trace.h）
+    bool trace_start(const char* path);
+    bool trace_stop();
+    void trace_command(const std::string& name) { if (trace) trace->set_command(name); } // 之后的访问归到该命令
+
+    // 写时复制覆盖层
+    bool cow_enable(); // 之后的写入都进入覆盖层
+    bool cow_commit(); // 把覆盖层写回镜像并清空
+    bool cow_discard(); // 丢弃覆盖层中的全部修改
+    void cow_status();
+    void disk_info(); // 显示虚拟磁盘的格式和区段
+    bool export_meta(const char* path); // 把全部元数据导出为稀疏 VMDK，可以直接打开分析
+
+    // 命名空间索引
+    bool index_build() { return ns_build(); }
+    void index_status();
+    unsigned __int32 resolve_path(const char* path, unsigned __int8* file_type); // 按绝对路径查找，返回 0 表示不存在
+    bool path_of(unsigned __int32 ino, std::string& out); // inode 的完整路径（主目录项）
+    void show_path(const char* path); // 打印 inode 号、类型和区段
+
+    void find(const std::vector<std::string>& args); // find [-name 通配符] [-regex 正则] [-size ±N] [-mtime ±天] ...
+    void show_owner(unsigned __int32 bn); // 块的属主：inode 和逻辑块号，或元数据类型
+    void check(); // 对照块位图检查属主表：泄漏、未标记、重复引用的块和空闲计数
+    void undelete_scan(const std::vector<std::string>& args); // undelete_scan [-j 线程数] [-m 最低可信度]：列出可恢复的已删除文件
+    bool recover(unsigned __int32 ino, const char* host_path); // 把已删除 inode 的数据写到主机文件
+    void hash(const std::vector<std::string>& args); // hash [-a sha256|xxh3] [-j 线程数] [-o 清单] [路径]：文件摘要清单和重复文件报告
+    void dedup_report(const std::vector<std::string>& args); // dedup_report [-j 线程数]：块级去重分析，按文件和目录列出可节省的空间
+    void defrag(const std::vector<std::string>& args); // defrag [-n] <路径|inode>：把文件（或目录下的全部文件）整理成连续的一段
+    void diff(const std::vector<std::string>& args); // diff [-q] [-j 线程数] <另一个镜像> [分区]：列出两个镜像之间增加、删除和修改的路径
+    void list_partitions(std::vector<partition_t>& out); // 镜像中的全部分区（MBR、EBR 链、GPT）
+    void parts(); // 列出分区及其文件系统
+    void df(); // 当前分区的块和 inode 用量
+    void each(const std::vector<std::string>& args); // each <find|check|undelete_scan|df> [参数...]：在全部 ext2/ext3 分区上并行执行
+    void grep(const std::vector<std::string>& args); // grep [-j 线程数] [-x] <模式>...：在已分配的块中查找字节串并反查到文件
 
     bool valid; // 文件系统是否有效
+    stats_t stats; // 运行统计（stats 命令）
+    out_format_t out_format; // 列表类命令的输出格式（format 命令）
+    FILE* con; // 扫描类命令（find、check、undelete_scan、df）的输出，平时为 stdout；each 命令中为各分区的临时文件
 
 
 };
\ No newline at end of file
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <string.h>
+#include "platform.h"
+#include <vector>
+
+// ext2/ext3 磁盘结构的类型化视图。
+// 字段一律按小端存储，le_t 在读写时自动转换，因此可以把块缓冲区直接强制转换为这些结构使用，
+// 不需要再用 *(unsigned __int32*)(buf + 偏移) 的方式手工解析。
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define EXT2_BIG_ENDIAN_HOST 1
+#endif
+
+template <typename T>
+struct le_t
+{
+    unsigned __int8 raw[sizeof(T)];
+
+    operator T() const
+    {
+        T v;
+        memcpy(&v, raw, sizeof(T));
+        return swap(v);
+    }
+    le_t& operator=(T v)
+    {
+        v = swap(v);
+        memcpy(raw, &v, sizeof(T));
+        return *this;
+    }
+    le_t& operator+=(T d) { return *this = (T)(*this + d); }
+    le_t& operator-=(T d) { return *this = (T)(*this - d); }
+    le_t& operator|=(T m) { return *this = (T)(*this | m); }
+    le_t& operator&=(T m) { return *this = (T)(*this & m); }
+
+private:
+    static T swap(T v)
+    {
+#ifdef EXT2_BIG_ENDIAN_HOST
+        T r = 0;
+        for (size_t i = 0; i < sizeof(T); i++)
+            r = (T)((r << 8) | ((v >> (8 * i)) & 0xFF));
+        return r;
+#else
+        return v;
+#endif
+    }
+};
+
+typedef le_t<unsigned __int16> le16;
+typedef le_t<unsigned __int32> le32;
+
+#pragma pack(push, 1)
+
+// 超级块（偏移 1024，长度 1024）
+struct ext2_super_block
+{
+    le32 s_inodes_count;         // 0x00
+    le32 s_blocks_count;         // 0x04
+    le32 s_r_blocks_count;       // 0x08
+    le32 s_free_blocks_count;    // 0x0C
+    le32 s_free_inodes_count;    // 0x10
+    le32 s_first_data_block;     // 0x14
+    le32 s_log_block_size;       // 0x18
+    le32 s_log_frag_size;        // 0x1C
+    le32 s_blocks_per_group;     // 0x20
+    le32 s_frags_per_group;      // 0x24
+    le32 s_inodes_per_group;     // 0x28
+    le32 s_mtime;                // 0x2C
+    le32 s_wtime;                // 0x30
+    le16 s_mnt_count;            // 0x34
+    le16 s_max_mnt_count;        // 0x36
+    le16 s_magic;                // 0x38
+    le16 s_state;                // 0x3A
+    le16 s_errors;               // 0x3C
+    le16 s_minor_rev_level;      // 0x3E
+    le32 s_lastcheck;            // 0x40
+    le32 s_checkinterval;        // 0x44
+    le32 s_creator_os;           // 0x48
+    le32 s_rev_level;            // 0x4C
+    le16 s_def_resuid;           // 0x50
+    le16 s_def_resgid;           // 0x52
+    le32 s_first_ino;            // 0x54
+    le16 s_inode_size;           // 0x58
+    le16 s_block_group_nr;       // 0x5A
+    le32 s_feature_compat;       // 0x5C
+    le32 s_feature_incompat;     // 0x60
+    le32 s_feature_ro_compat;    // 0x64
+    unsigned __int8 s_uuid[16];  // 0x68
+    char s_volume_name[16];      // 0x78
+    char s_last_mounted[64];     // 0x88
+    le32 s_algorithm_usage_bitmap; // 0xC8
+    unsigned __int8 s_prealloc_blocks;     // 0xCC
+    unsigned __int8 s_prealloc_dir_blocks; // 0xCD
+    le16 s_reserved_gdt_blocks;  // 0xCE
+    unsigned __int8 s_journal_uuid[16]; // 0xD0
+    le32 s_journal_inum;         // 0xE0
+    le32 s_journal_dev;          // 0xE4
+    le32 s_last_orphan;          // 0xE8
+    le32 s_hash_seed[4];         // 0xEC
+    unsigned __int8 s_def_hash_version; // 0xFC
+    unsigned __int8 s_jnl_backup_type;  // 0xFD
+    le16 s_desc_size;            // 0xFE
+    le32 s_default_mount_opts;   // 0x100
+    le32 s_first_meta_bg;        // 0x104
+    le32 s_mkfs_time;            // 0x108
+    le32 s_jnl_blocks[17];       // 0x10C
+    le32 s_blocks_count_hi;      // 0x150
+    le32 s_r_blocks_count_hi;    // 0x154
+    le32 s_free_blocks_hi;       // 0x158
+    le16 s_min_extra_isize;      // 0x15C
+    le16 s_want_extra_isize;     // 0x15E
+    le32 s_flags;                // 0x160
+    unsigned __int8 s_reserved[1024 - 0x164];
+};
+
+// 块组描述符（32 字节）
+struct ext2_group_desc
+{
+    le32 bg_block_bitmap;        // 块位图所在块
+    le32 bg_inode_bitmap;        // inode 位图所在块
+    le32 bg_inode_table;         // inode 表起始块
+    le16 bg_free_blocks_count;
+    le16 bg_free_inodes_count;
+    le16 bg_used_dirs_count;
+    le16 bg_pad;
+    unsigned __int8 bg_reserved[12];
+};
+
+// 索引节点（前 128 字节；inode_size 更大时其余部分为扩展字段）
+struct ext2_inode
+{
+    le16 i_mode;                 // 0x00
+    le16 i_uid;                  // 0x02
+    le32 i_size;                 // 0x04
+    le32 i_atime;                // 0x08
+    le32 i_ctime;                // 0x0C
+    le32 i_mtime;                // 0x10
+    le32 i_dtime;                // 0x14
+    le16 i_gid;                  // 0x18
+    le16 i_links_count;          // 0x1A
+    le32 i_blocks;               // 0x1C  以 512 字节为单位
+    le32 i_flags;                // 0x20
+    le32 i_reserved1;            // 0x24
+    le32 i_block[15];            // 0x28  12 个直接块 + 一、二、三级间接块
+    le32 i_generation;           // 0x64
+    le32 i_file_acl;             // 0x68
+    le32 i_size_high;            // 0x6C
+    le32 i_faddr;                // 0x70
+    unsigned __int8 i_osd2[12];  // 0x74
+};
+
+// 目录项（ext2_dir_entry_2）
+struct ext2_dir_entry
+{
+    le32 inode;
+    le16 rec_len;
+    unsigned __int8 name_len;
+    unsigned __int8 file_type;
+    char name[255];
+};
+
+// rec_len 只有 16 位：64K 块里占满整块的目录项按内核的约定存成 65535（旧版本写 0），读写都要经过这两个函数
+inline unsigned __int32 rec_len_from_disk(unsigned __int16 v)
+{
+    return (v == 65535 || v == 0) ? 65536u : v;
+}
+
+inline unsigned __int16 rec_len_to_disk(unsigned __int32 len)
+{
+    return len >= 65536 ? (unsigned __int16)65535 : (unsigned __int16)len;
+}
+
+// 哈希目录：dx_root 中 "." 和 ".." 之后的信息
+struct dx_root_info
+{
+    le32 reserved_zero;
+    unsigned __int8 hash_version;
+    unsigned __int8 info_length;
+    unsigned __int8 indirect_levels;
+    unsigned __int8 unused_flags;
+};
+
+// 哈希目录索引项；数组第 0 项的 hash 字段存放 { limit, count }
+struct dx_entry
+{
+    le32 hash;
+    le32 block;
+};
+
+struct dx_countlimit
+{
+    le16 limit;
+    le16 count;
+};
+
+#pragma pack(pop)
+
+// 命令级内存池：块缓冲区、inode 缓冲区等临时内存从预先分配的大块中顺序切出，
+// scratch_t 离开作用域时整体回退。大块在命令之间保留复用，热路径上不再有堆分配，
+// 提前 return 的路径也不会泄漏。
+class arena_t
+{
+public:
+    struct pos_t
+    {
+        size_t chunk;
+        size_t off;
+    };
+
+    arena_t() { cur.chunk = 0; cur.off = 0; }
+    ~arena_t()
+    {
+        for (size_t i = 0; i < chunks.size(); i++) delete[] chunks[i].data;
+    }
+
+    void* alloc(size_t n)
+    {
+        n = (n + 15) & ~(size_t)15;
+        while (cur.chunk < chunks.size() && chunks[cur.chunk].size - cur.off < n)
+        {
+            cur.chunk++;
+            cur.off = 0;
+        }
+        if (cur.chunk == chunks.size())
+        {
+            chunk_t c;
+            c.size = n > CHUNK_SIZE ? n : CHUNK_SIZE;
+            c.data = new unsigned __int8[c.size];
+            chunks.push_back(c);
+            cur.off = 0;
+        }
+        void* p = chunks[cur.chunk].data + cur.off;
+        cur.off += n;
+        return p;
+    }
+
+    pos_t mark() const { return cur; }
+    void release(pos_t p) { cur = p; }
+    void reset() { cur.chunk = 0; cur.off = 0; }
+
+private:
+    enum { CHUNK_SIZE = 1 << 20 };
+    struct chunk_t
+    {
+        unsigned __int8* data;
+        size_t size;
+    };
+    std::vector<chunk_t> chunks;
+    pos_t cur;
+
+    arena_t(const arena_t&);
+    arena_t& operator=(const arena_t&);
+};
+
+// 在作用域内从内存池借用临时内存，析构时归还
+class scratch_t
+{
+public:
+    explicit scratch_t(arena_t& a) : arena(a), saved(a.mark()) {}
+    ~scratch_t() { arena.release(saved); }
+
+    template <typename T>
+    T* alloc(size_t bytes) { return (T*)arena.alloc(bytes); }
+
+private:
+    arena_t& arena;
+    arena_t::pos_t saved;
+};
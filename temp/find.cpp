@@ -0,0 +1,353 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex>
+#include <chrono>
+#include <unordered_map>
+#include "ext2.h"
+#include "parallel.h"
+
+#define EXT2_FT_DIR 2
+
+// find：按名字（通配符或正则表达式）、大小、修改/变更时间和类型查找。
+// 先并行扫描 inode 表求出满足属性条件的 inode，再并行扫描全部目录块按名字过滤，
+// 两边按 inode 号连接；路径由扫描到的目录项逐级向上拼出，不需要递归遍历目录树。
+
+struct find_query_t
+{
+    std::string glob; // 空表示不限
+    bool use_regex;
+    std::regex re;
+    unsigned __int64 size_lo, size_hi; // 闭区间
+    __int64 mtime_lo, mtime_hi;
+    __int64 ctime_lo, ctime_hi;
+    unsigned __int32 type; // i_mode 的类型位，0 表示不限
+    unsigned threads;
+};
+
+// 字符类 [abc]、[a-z]、[!x]；返回 ']' 之后的位置，没有结束的 ']' 时返回空
+static const char* match_class(const char* p, char c, bool* matched)
+{
+    bool negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    bool hit = false;
+    for (bool first = true; *p && (*p != ']' || first); first = false)
+    {
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+            if ((unsigned char)c >= (unsigned char)p[0] && (unsigned char)c <= (unsigned char)p[2]) hit = true;
+            p += 3;
+        }
+        else
+        {
+            if (*p == c) hit = true;
+            p++;
+        }
+    }
+    if (*p != ']') return nullptr;
+    *matched = hit != negate;
+    return p + 1;
+}
+
+// 通配符匹配：* 任意串，? 任意字符，[...] 字符类；回溯只记住最后一个 *
+static bool glob_match(const char* p, const char* s, const char* end)
+{
+    const char* star_p = nullptr;
+    const char* star_s = nullptr;
+    while (s < end)
+    {
+        if (*p == '*')
+        {
+            star_p = ++p;
+            star_s = s;
+            continue;
+        }
+        if (*p == '[')
+        {
+            bool matched = false;
+            const char* next = match_class(p + 1, *s, &matched);
+            if (next && matched)
+            {
+                p = next;
+                s++;
+                continue;
+            }
+            if (!next && *s == '[') // 不完整的字符类按普通字符处理
+            {
+                p++;
+                s++;
+                continue;
+            }
+        }
+        else if (*p && (*p == '?' || *p == *s))
+        {
+            p++;
+            s++;
+            continue;
+        }
+        if (!star_p) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+    while (*p == '*') p++;
+    return *p == 0;
+}
+
+// 解析 +N、-N 或 N，N 可以带 k/M/G 后缀（unit 为 true 时）；结果写入闭区间 [lo, hi]
+static bool parse_bound(const std::string& v, bool unit, unsigned __int64 scale, __int64 now,
+    __int64* lo, __int64* hi)
+{
+    const char* p = v.c_str();
+    char sign = (*p == '+' || *p == '-') ? *p++ : 0;
+    if (*p < '0' || *p > '9') return false;
+    char* end;
+    unsigned __int64 n = strtoull(p, &end, 10);
+    if (unit && *end)
+    {
+        switch (*end)
+        {
+        case 'c': break;
+        case 'k': n <<= 10; break;
+        case 'M': n <<= 20; break;
+        case 'G': n <<= 30; break;
+        default: return false;
+        }
+        end++;
+    }
+    if (*end) return false;
+
+    if (now == 0)
+    {
+        // 大小：+N 大于，-N 小于，N 等于
+        if (sign == '+') *lo = (__int64)n + 1 > *lo ? (__int64)n + 1 : *lo;
+        else if (sign == '-') *hi = (__int64)n - 1 < *hi ? (__int64)n - 1 : *hi;
+        else *lo = *hi = (__int64)n;
+        return true;
+    }
+    // 时间（天）：+N 早于 N 天前，-N 在 N 天之内，N 正好在第 N 天
+    __int64 edge = now - (__int64)(n * scale);
+    if (sign == '+') *hi = edge - 1 < *hi ? edge - 1 : *hi;
+    else if (sign == '-') *lo = edge + 1 > *lo ? edge + 1 : *lo;
+    else
+    {
+        *lo = edge - (__int64)scale;
+        *hi = edge;
+    }
+    return true;
+}
+
+static bool parse_find(const std::vector<std::string>& args, find_query_t& q, FILE* out)
+{
+    q.use_regex = false;
+    q.size_lo = 0;
+    q.size_hi = ~0ull;
+    q.mtime_lo = q.ctime_lo = 0;
+    q.mtime_hi = q.ctime_hi = 0x7FFFFFFFFFFFFFFFll;
+    q.type = 0;
+    q.threads = parallel_run_t::default_threads();
+
+    __int64 now = (__int64)time(NULL);
+    __int64 size_lo = 0, size_hi = 0x7FFFFFFFFFFFFFFFll;
+    for (size_t i = 1; i < args.size(); i += 2)
+    {
+        const std::string& opt = args[i];
+        if (i + 1 >= args.size())
+        {
+            fprintf(out, "Missing value for %s\n", opt.c_str());
+            return false;
+        }
+        const std::string& v = args[i + 1];
+        bool ok = true;
+        if (opt == "-name") q.glob = v;
+        else if (opt == "-regex")
+        {
+            try
+            {
+                q.re = std::regex(v, std::regex::ECMAScript | std::regex::optimize);
+                q.use_regex = true;
+            }
+            catch (const std::regex_error&)
+            {
+                ok = false;
+            }
+        }
+        else if (opt == "-size") ok = parse_bound(v, true, 1, 0, &size_lo, &size_hi);
+        else if (opt == "-mtime") ok = parse_bound(v, false, 86400, now, &q.mtime_lo, &q.mtime_hi);
+        else if (opt == "-ctime") ok = parse_bound(v, false, 86400, now, &q.ctime_lo, &q.ctime_hi);
+        else if (opt == "-mmin") ok = parse_bound(v, false, 60, now, &q.mtime_lo, &q.mtime_hi);
+        else if (opt == "-type")
+        {
+            static const char types[] = "fdlcbps";
+            static const unsigned __int32 modes[] = { 0x8000, 0x4000, 0xA000, 0x2000, 0x6000, 0x1000, 0xC000 };
+            const char* t = v.size() == 1 ? strchr(types, v[0]) : nullptr;
+            if (t) q.type = modes[t - types];
+            else ok = false;
+        }
+        else if (opt == "-j")
+        {
+            q.threads = (unsigned)atoi(v.c_str());
+            ok = q.threads > 0 && q.threads <= 64;
+        }
+        else
+        {
+            fprintf(out, "Unknown option %s\n", opt.c_str());
+            return false;
+        }
+        if (!ok)
+        {
+            fprintf(out, "Invalid value for %s: %s\n", opt.c_str(), v.c_str());
+            return false;
+        }
+    }
+    q.size_lo = size_lo < 0 ? 0 : (unsigned __int64)size_lo;
+    q.size_hi = size_hi < 0 ? 0 : (unsigned __int64)size_hi;
+    if (size_hi < 0) q.size_lo = 1; // -size -0：空集
+    return true;
+}
+
+void ext2_t::find(const std::vector<std::string>& args)
+{
+    find_query_t q;
+    if (!parse_find(args, q, con)) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // 匹配的 inode 的属性，按工作线程分开收集
+    struct hit_t
+    {
+        unsigned __int32 ino;
+        unsigned __int64 size;
+        unsigned __int32 mtime;
+    };
+    enum { F_MATCH = 1, F_DIR = 2 };
+    std::vector<unsigned __int8> flags((size_t)inodes_count + 1, 0); // 每个 inode 只由一个线程写
+    std::vector<std::vector<hit_t>> hits(q.threads);
+    std::vector<std::vector<unsigned __int32>> dirs(q.threads);
+
+    // 1. inode 表：属性条件
+    unsigned __int64 inodes = 0;
+    bool ok = scan_inodes(q.threads, [&](unsigned w, unsigned __int32 ino, const ext2_inode* inode) {
+        if (inode->i_links_count == 0 || inode->i_mode == 0) return;
+        unsigned __int32 type = inode->i_mode & 0xF000;
+        if (type == 0x4000)
+        {
+            flags[ino] |= F_DIR;
+            dirs[w].push_back(ino);
+        }
+        unsigned __int64 size = inode->i_size;
+        if (type == 0x8000) size |= (unsigned __int64)inode->i_size_high << 32;
+        if (q.type && type != q.type) return;
+        if (size < q.size_lo || size > q.size_hi) return;
+        if ((__int64)inode->i_mtime < q.mtime_lo || (__int64)inode->i_mtime > q.mtime_hi) return;
+        if ((__int64)inode->i_ctime < q.ctime_lo || (__int64)inode->i_ctime > q.ctime_hi) return;
+        flags[ino] |= F_MATCH;
+        hit_t h = { ino, size, inode->i_mtime };
+        hits[w].push_back(h);
+    }, &inodes);
+    if (!ok)
+    {
+        fprintf(con, "Failed to read inode tables.\n");
+        return;
+    }
+
+    // 2. 目录块：名字条件，同时记下每个目录的上级和名字用于拼路径
+    struct edge_t
+    {
+        unsigned __int32 parent;
+        unsigned __int32 ino;
+        std::string name;
+    };
+    std::vector<std::vector<edge_t>> names(q.threads), dir_edges(q.threads);
+    std::vector<unsigned __int32> all_dirs;
+    for (unsigned t = 0; t < q.threads; t++) all_dirs.insert(all_dirs.end(), dirs[t].begin(), dirs[t].end());
+    unsigned __int64 dir_blocks_read = 0;
+    ok = scan_dir_entries(all_dirs, q.threads, [&](unsigned w, unsigned __int32 dir, const ext2_dir_entry* de) {
+        if (de->name[0] == '.' && (de->name_len == 1 || (de->name_len == 2 && de->name[1] == '.'))) return;
+        unsigned __int8 f = flags[de->inode];
+        if (!f) return;
+        if (f & F_DIR)
+        {
+            edge_t e = { dir, de->inode, std::string(de->name, de->name_len) };
+            dir_edges[w].push_back(e);
+        }
+        if (!(f & F_MATCH)) return;
+        if (!q.glob.empty() && !glob_match(q.glob.c_str(), de->name, de->name + de->name_len)) return;
+        if (q.use_regex && !std::regex_search(de->name, de->name + de->name_len, q.re)) return;
+        edge_t e = { dir, de->inode, std::string(de->name, de->name_len) };
+        names[w].push_back(e);
+    }, &dir_blocks_read);
+    if (!ok)
+    {
+        fprintf(con, "Failed to read directory blocks.\n");
+        return;
+    }
+
+    // 3. 目录连成扁平树（下标 0 为根目录），名字进字符串池；路径按需从树上拼出
+    flat_tree_t tree;
+    tree.add(FLAT_NONE, 2, EXT2_FT_DIR, "", 0);
+    std::unordered_map<unsigned __int32, unsigned __int32> node_of; // 目录 inode -> 树中下标
+    std::vector<unsigned __int32> parent_ino(1, 0); // 树中下标 -> 上级目录的 inode
+    node_of[2] = 0;
+    for (unsigned t = 0; t < q.threads; t++)
+        for (size_t i = 0; i < dir_edges[t].size(); i++)
+        {
+            const edge_t& e = dir_edges[t][i];
+            if (node_of.count(e.ino)) continue; // 硬链接的目录只取一个名字
+            node_of[e.ino] = tree.add(FLAT_NONE, e.ino, EXT2_FT_DIR, e.name.data(), e.name.size());
+            parent_ino.push_back(e.parent);
+        }
+    for (size_t i = 1; i < tree.size(); i++)
+    {
+        auto up = node_of.find(parent_ino[i]);
+        if (up != node_of.end()) tree[i].parent = up->second;
+    }
+    std::unordered_map<unsigned __int32, std::string> dir_path; // 拼过的目录路径
+    auto path_of_dir = [&](unsigned __int32 dir) -> const std::string& {
+        auto known = dir_path.find(dir);
+        if (known != dir_path.end()) return known->second;
+        std::string& p = dir_path[dir];
+        auto node = node_of.find(dir);
+        if (node == node_of.end()) p = "?"; // 从根目录到不了（孤立的目录）
+        else tree.path(node->second, p);
+        return p;
+    };
+
+    std::unordered_map<unsigned __int32, const hit_t*> attr;
+    for (unsigned t = 0; t < q.threads; t++)
+        for (size_t i = 0; i < hits[t].size(); i++) attr[hits[t][i].ino] = &hits[t][i];
+
+    std::vector<std::pair<std::string, const hit_t*>> results;
+    for (unsigned t = 0; t < q.threads; t++)
+        for (size_t i = 0; i < names[t].size(); i++)
+            results.push_back(std::make_pair(path_of_dir(names[t][i].parent) + "/" + names[t][i].name, attr[names[t][i].ino]));
+    // 根目录没有目录项，单独判断
+    if ((flags[2] & F_MATCH) && q.glob.empty() && !q.use_regex) results.push_back(std::make_pair(std::string("/"), attr[2]));
+    std::sort(results.begin(), results.end());
+
+    out_writer_t w(con);
+    record_writer_t r(w, out_format);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const hit_t& h = *results[i].second;
+        if (out_format == OUT_TEXT)
+        {
+            // %8u %12llu  %s  %s
+            w.put_u64_right(h.ino, 8).put(' ').put_u64_right(h.size, 12).put("  ");
+            w.put(time2str(h.mtime)).put("  ").put(results[i].first).put('\n');
+            continue;
+        }
+        r.begin();
+        r.field("path", results[i].first);
+        r.field("ino", h.ino);
+        r.field("size", h.size);
+        r.field("mtime", h.mtime);
+        r.end();
+    }
+    w.flush();
+    if (out_format != OUT_TEXT) return; // 结构化输出中只有匹配项
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    fprintf(con, "%zu matches (%llu inodes, %llu directory blocks, %u threads, %llu ms)\n", results.size(), inodes,
+        dir_blocks_read, q.threads, ms);
+}
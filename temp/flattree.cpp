@@ -0,0 +1,121 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <string.h>
+#include <algorithm>
+#include "ext2.h"
+
+#define FLAT_BATCH_DIRS 1024 // 建树时一次预读这么多个目录
+
+#define EXT2_FT_DIR 2
+
+// ---- flat_tree_t ----
+
+unsigned __int32 flat_tree_t::add(unsigned __int32 parent, unsigned __int32 ino, unsigned __int8 file_type, const char* name, size_t len)
+{
+    flat_node_t n;
+    n.ino = ino;
+    n.parent = parent;
+    n.name_off = (unsigned __int32)pool.size();
+    n.first_child = 0;
+    n.child_count = 0;
+    n.name_len = (unsigned __int8)len;
+    n.file_type = file_type;
+    pool.insert(pool.end(), name, name + len);
+    nodes.push_back(n);
+    return (unsigned __int32)nodes.size() - 1;
+}
+
+void flat_tree_t::sort_children(unsigned __int32 first, unsigned __int32 count)
+{
+    const char* p = pool.data();
+    std::sort(nodes.begin() + first, nodes.begin() + first + count, [p](const flat_node_t& x, const flat_node_t& y) {
+        int c = memcmp(p + x.name_off, p + y.name_off, x.name_len < y.name_len ? x.name_len : y.name_len);
+        return c != 0 ? c < 0 : x.name_len < y.name_len;
+    });
+}
+
+void flat_tree_t::path(size_t i, std::string& out) const
+{
+    // 第一遍往上走到根，算出路径长度；第二遍从末尾往前填名字。父节点总在子节点之前加入，一定能走到头
+    size_t len = 0;
+    bool orphan = false;
+    for (size_t d = i; d != 0; d = nodes[d].parent)
+    {
+        len += 1 + nodes[d].name_len;
+        if (nodes[d].parent == FLAT_NONE)
+        {
+            orphan = true;
+            break;
+        }
+    }
+    size_t lead = orphan ? 1 : 0;
+    out.assign(lead + len, '?');
+    size_t pos = out.size();
+    for (size_t d = i; d != 0 && pos > lead; d = nodes[d].parent)
+    {
+        pos -= nodes[d].name_len;
+        memcpy(&out[pos], name(d), nodes[d].name_len);
+        out[--pos] = '/';
+    }
+}
+
+// ---- ext2_t ----
+
+// 从 root 开始按层建立扁平目录树。每层的目录成批预读（inode 表块和目录块合并读取），
+// 目录项直接解析进字符串池；sorted 为真时每个目录的子项按名字排序，否则保持磁盘上的顺序
+bool ext2_t::build_tree(unsigned __int32 root, bool sorted, flat_tree_t& tree)
+{
+    tree.clear();
+    tree.add(FLAT_NONE, root, EXT2_FT_DIR, "", 0);
+    std::vector<bool> seen((size_t)inodes_count + 1, false); // 已经展开的目录，防止目录环
+    if (root >= 1 && root <= inodes_count) seen[root] = true;
+    std::vector<unsigned __int32> level(1, 0), next;
+    std::vector<unsigned __int32> inos;
+    std::unordered_map<unsigned __int32, std::vector<unsigned __int8>> data;
+    while (!level.empty())
+    {
+        next.clear();
+        for (size_t b = 0; b < level.size(); b += FLAT_BATCH_DIRS)
+        {
+            size_t e = b + FLAT_BATCH_DIRS < level.size() ? b + FLAT_BATCH_DIRS : level.size();
+            inos.clear();
+            for (size_t i = b; i < e; i++) inos.push_back(tree[level[i]].ino);
+            data.clear();
+            if (!prefetch_dirs(inos, data)) return false;
+            for (size_t i = b; i < e; i++)
+            {
+                auto it = data.find(tree[level[i]].ino);
+                if (it == data.end()) continue; // 不是目录
+                const std::vector<unsigned __int8>& blocks = it->second;
+                unsigned __int32 first = (unsigned __int32)tree.size();
+                for (size_t base = 0; base + block_size <= blocks.size(); base += block_size)
+                {
+                    for (unsigned int off = 0; off + 8 <= block_size;)
+                    {
+                        const ext2_dir_entry* de = (const ext2_dir_entry*)(blocks.data() + base + off);
+                        unsigned int rec_len = rec_len_from_disk(de->rec_len);
+                        if (rec_len < 8 || off + rec_len > block_size) break;
+                        off += rec_len;
+                        if (de->inode == 0 || de->name_len == 0 || 8u + de->name_len > rec_len) continue;
+                        if (de->name[0] == '.' && (de->name_len == 1 || (de->name_len == 2 && de->name[1] == '.'))) continue;
+                        tree.add(level[i], de->inode, de->file_type, de->name, de->name_len);
+                    }
+                }
+                unsigned __int32 count = (unsigned __int32)tree.size() - first;
+                tree[level[i]].first_child = first;
+                tree[level[i]].child_count = count;
+                if (sorted) tree.sort_children(first, count);
+                for (unsigned __int32 c = first; c < first + count; c++)
+                {
+                    unsigned __int32 ino = tree[c].ino;
+                    if (tree[c].file_type != EXT2_FT_DIR || ino < 1 || ino > inodes_count || seen[ino]) continue;
+                    seen[ino] = true;
+                    next.push_back(c);
+                }
+                data.erase(it);
+            }
+        }
+        level.swap(next);
+    }
+    return true;
+}
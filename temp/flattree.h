@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "platform.h"
+
+// 扁平目录树：全部目录项放在一个数组里，名字集中存放在一个字符串池中，不为每个名字单独分配内存。
+// 下标 0 为根。同一目录的子项连续存放，[first_child, first_child + child_count)；按层建立时子项总是排在上级之后。
+// 遍历用显式栈，深度不受递归和固定缓冲区的限制。
+
+#define FLAT_NONE 0xFFFFFFFFu // 根节点没有上级
+
+struct flat_node_t
+{
+    unsigned __int32 ino;
+    unsigned __int32 parent;      // 上级目录在数组中的下标
+    unsigned __int32 name_off;    // 名字在字符串池中的偏移
+    unsigned __int32 first_child;
+    unsigned __int32 child_count;
+    unsigned __int8 name_len;
+    unsigned __int8 file_type;    // 目录项中的类型（EXT2_FT_*）
+};
+
+class flat_tree_t
+{
+public:
+    void clear() { nodes.clear(); pool.clear(); }
+    size_t size() const { return nodes.size(); }
+    const flat_node_t& operator[](size_t i) const { return nodes[i]; }
+    flat_node_t& operator[](size_t i) { return nodes[i]; }
+    const char* name(size_t i) const { return pool.data() + nodes[i].name_off; }
+    unsigned __int32 add(unsigned __int32 parent, unsigned __int32 ino, unsigned __int8 file_type, const char* name, size_t len); // 返回下标
+    void sort_children(unsigned __int32 first, unsigned __int32 count); // 按名字排序；只能在这些子项还没有子项时调用
+    void path(size_t i, std::string& out) const; // 从根起的完整路径（每级为 "/" 加名字，根为空串）；到不了根时以 "?" 开头
+    size_t memory() const { return nodes.capacity() * sizeof(flat_node_t) + pool.capacity(); }
+
+private:
+    std::vector<flat_node_t> nodes;
+    std::vector<char> pool;
+};
@@ -0,0 +1,379 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include "ext2.h"
+#include "parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GREP_SSE2 1
+#endif
+
+// grep：在全部已分配的块中查找字节串，再把命中的块经块映射反查到 inode 和路径。
+// 1. 按块位图得到已分配块的连续段，调用线程大块顺序读取，工作线程用多模式匹配器查找；
+//    物理连续的块在缓冲区中也连续，跨这些块边界的匹配直接能找到。
+// 2. 经块属主表（owner.h）得到命中块的属主和逻辑块号；文件中物理不连续的相邻两块
+//    （以及被分批读取切开的连续段）是接缝，单独读出接缝两侧的字节再匹配一次。
+// 3. 跨块的匹配只有两块属于同一文件且逻辑上相邻时才算数。
+
+#define GREP_BATCH_BYTES (16u << 20) // 每批读取的数据量
+#define GREP_SLICE_BYTES (1u << 20)  // 每个工作项查找的字节数
+#define GREP_SHOW_OFFSETS 16         // 每个文件最多列出的匹配偏移
+
+static inline unsigned lowest_bit(unsigned v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(v);
+#endif
+}
+
+// 多模式字节串匹配：先按首字节筛选候选位置（首字节不超过 4 种时用 SSE2 一次比较 16 字节），
+// 再按首字节分桶逐个比较。
+class multi_matcher_t
+{
+public:
+    explicit multi_matcher_t(const std::vector<std::string>& pats) : patterns(pats), max_len(0)
+    {
+        memset(first, 0, sizeof(first));
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            unsigned char c = (unsigned char)patterns[i][0];
+            if (!first[c]) firsts.push_back(c);
+            first[c] = 1;
+            buckets[c].push_back(i);
+            if (patterns[i].size() > max_len) max_len = patterns[i].size();
+        }
+    }
+
+    size_t longest() const { return max_len; }
+
+    // 查找起点在 [from, to) 内的全部匹配，比较可以读到 limit 为止；fn(位置, 模式号)
+    template <typename F>
+    void scan(const unsigned __int8* base, size_t from, size_t to, size_t limit, F fn) const
+    {
+        size_t i = from;
+#ifdef GREP_SSE2
+        if (firsts.size() <= 4)
+        {
+            __m128i f[4];
+            for (size_t k = 0; k < 4; k++) f[k] = _mm_set1_epi8((char)firsts[k < firsts.size() ? k : 0]);
+            for (; i + 16 <= to; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(base + i));
+                __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, f[0]), _mm_cmpeq_epi8(v, f[1])),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, f[2]), _mm_cmpeq_epi8(v, f[3])));
+                unsigned mask = (unsigned)_mm_movemask_epi8(m);
+                while (mask)
+                {
+                    size_t pos = i + lowest_bit(mask);
+                    verify(base, pos, limit, fn);
+                    mask &= mask - 1;
+                }
+            }
+        }
+#endif
+        for (; i < to; i++)
+            if (first[base[i]]) verify(base, i, limit, fn);
+    }
+
+private:
+    std::vector<std::string> patterns;
+    std::vector<size_t> buckets[256];
+    unsigned __int8 first[256];
+    std::vector<unsigned __int8> firsts;
+    size_t max_len;
+
+    template <typename F>
+    void verify(const unsigned __int8* base, size_t pos, size_t limit, F fn) const
+    {
+        const std::vector<size_t>& b = buckets[base[pos]];
+        for (size_t k = 0; k < b.size(); k++)
+        {
+            const std::string& p = patterns[b[k]];
+            if (pos + p.size() <= limit && memcmp(base + pos, p.data(), p.size()) == 0) fn(pos, b[k]);
+        }
+    }
+};
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void ext2_t::grep(const std::vector<std::string>& args)
+{
+    unsigned threads = parallel_run_t::default_threads();
+    bool hex = false;
+    std::vector<std::string> patterns;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-j" && i + 1 < args.size()) threads = (unsigned)atoi(args[++i].c_str());
+        else if (args[i] == "-x") hex = true;
+        else patterns.push_back(args[i]);
+    }
+    if (patterns.empty() || threads == 0 || threads > 64)
+    {
+        printf("Usage: grep [-j threads] [-x] <pattern> [pattern ...]\n");
+        return;
+    }
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        if (hex)
+        {
+            std::string bytes;
+            const std::string& h = patterns[i];
+            for (size_t k = 0; k + 1 < h.size() && hex_value(h[k]) >= 0 && hex_value(h[k + 1]) >= 0; k += 2)
+                bytes += (char)(hex_value(h[k]) * 16 + hex_value(h[k + 1]));
+            if (bytes.size() * 2 != h.size())
+            {
+                printf("Invalid hex pattern %s\n", h.c_str());
+                return;
+            }
+            patterns[i] = bytes;
+        }
+        if (patterns[i].size() > block_size) // 只考虑跨一个块边界的匹配
+        {
+            printf("Patterns longer than a block (%u bytes) are not supported.\n", block_size);
+            return;
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    multi_matcher_t matcher(patterns);
+    size_t overlap = matcher.longest() - 1; // 接缝两侧各需要的字节数
+
+    // 1. 按块位图得到已分配块的连续段
+    std::vector<std::pair<unsigned __int32, unsigned __int32>> runs; // (起始块, 块数)
+    {
+        scratch_t scratch(arena());
+        unsigned __int8* bitmap = scratch.alloc<unsigned __int8>(block_size);
+        for (unsigned __int32 g = 0; g < block_group_count; g++)
+        {
+            if (!load_block(block_group_descriptor_table[g].bg_block_bitmap, bitmap))
+            {
+                printf("Failed to read block bitmap of group %u.\n", g);
+                return;
+            }
+            unsigned __int32 first_block = first_data_block + g * blocks_per_group;
+            unsigned __int32 n = blocks_count - first_block < blocks_per_group ? blocks_count - first_block : blocks_per_group;
+            for (unsigned __int32 i = 0; i < n; i++)
+            {
+                if (!((bitmap[i >> 3] >> (i & 7)) & 1)) continue;
+                if (!runs.empty() && runs.back().first + runs.back().second == first_block + i) runs.back().second++;
+                else runs.push_back(std::make_pair(first_block + i, 1u));
+            }
+        }
+    }
+
+    // 2. 分批读取并查找
+    struct hit_t
+    {
+        unsigned __int32 pblk;
+        unsigned __int32 off; // 块内偏移
+        unsigned __int32 pattern;
+    };
+    struct seg_t
+    {
+        unsigned __int32 pblk;
+        size_t off;
+        size_t len;
+    };
+    std::vector<std::vector<hit_t>> hits(threads);
+    std::unordered_set<unsigned __int32> splits; // 连续段在这些块之后被分批切开
+    size_t run = 0;
+    unsigned __int32 run_done = 0;
+    unsigned __int64 scanned = 0;
+    bool ok = true;
+    auto read_batch = [&](std::vector<unsigned __int8>& data, std::vector<seg_t>& segs) {
+        data.clear();
+        segs.clear();
+        while (run < runs.size() && data.size() < GREP_BATCH_BYTES && ok)
+        {
+            unsigned __int32 want = (unsigned __int32)((GREP_BATCH_BYTES - data.size() + block_size - 1) >> block_shift);
+            unsigned __int32 n = runs[run].second - run_done < want ? runs[run].second - run_done : want;
+            seg_t s = { runs[run].first + run_done, data.size(), (size_t)n << block_shift };
+            data.resize(s.off + s.len);
+            if (!read_bytes((unsigned __int64)s.pblk << block_shift, data.data() + s.off, s.len)) ok = false;
+            segs.push_back(s);
+            scanned += n;
+            run_done += n;
+            if (run_done == runs[run].second)
+            {
+                run++;
+                run_done = 0;
+            }
+            else
+            {
+                splits.insert(s.pblk + n - 1);
+            }
+        }
+    };
+
+    std::vector<unsigned __int8> cur, next;
+    std::vector<seg_t> cur_segs, next_segs;
+    read_batch(cur, cur_segs);
+    while (!cur_segs.empty() && ok)
+    {
+        std::vector<std::pair<size_t, size_t>> items; // (段, 段内起点)
+        for (size_t s = 0; s < cur_segs.size(); s++)
+            for (size_t o = 0; o < cur_segs[s].len; o += GREP_SLICE_BYTES) items.push_back(std::make_pair(s, o));
+        {
+            parallel_run_t work(items.size(), threads, [&](size_t i, unsigned worker) {
+                const seg_t& s = cur_segs[items[i].first];
+                const unsigned __int8* base = cur.data() + s.off;
+                size_t from = items[i].second;
+                size_t to = from + GREP_SLICE_BYTES < s.len ? from + GREP_SLICE_BYTES : s.len;
+                matcher.scan(base, from, to, s.len, [&](size_t pos, size_t pat) {
+                    hit_t h = { s.pblk + (unsigned __int32)(pos >> block_shift), (unsigned __int32)(pos & (block_size - 1)), (unsigned __int32)pat };
+                    hits[worker].push_back(h);
+                });
+            });
+            read_batch(next, next_segs);
+        }
+        cur.swap(next);
+        cur_segs.swap(next_segs);
+    }
+    if (!ok)
+    {
+        printf("Failed to read data blocks.\n");
+        return;
+    }
+
+    // 3. 块属主表：命中块的 inode 和逻辑块号；同一文件中逻辑相邻、物理不相邻的两块是接缝
+    const owner_map_t* map = owner_map();
+    if (!map) return;
+    struct seam_t
+    {
+        unsigned __int32 a, b; // 逻辑上相邻的两个物理块
+        unsigned __int32 ino;
+        unsigned __int32 lblk; // a 的逻辑块号
+    };
+    std::vector<seam_t> seams;
+    if (overlap > 0)
+    {
+        std::vector<const owner_extent_t*> data;
+        for (size_t i = 0; i < map->extents().size(); i++)
+            if (owner_map_t::is_data(map->extents()[i].kind)) data.push_back(&map->extents()[i]);
+        std::sort(data.begin(), data.end(), [](const owner_extent_t* x, const owner_extent_t* y) {
+            return x->owner != y->owner ? x->owner < y->owner : x->lblk < y->lblk;
+        });
+        for (size_t i = 1; i < data.size(); i++)
+        {
+            const owner_extent_t* p = data[i - 1];
+            const owner_extent_t* q = data[i];
+            if (p->owner != q->owner || p->lblk + p->len != q->lblk) continue;
+            seam_t s = { p->pblk + p->len - 1, q->pblk, p->owner, p->lblk + p->len - 1 };
+            seams.push_back(s);
+        }
+        // 分批读取时切开的连续段：两侧若是同一文件的相邻逻辑块，也要单独检查
+        for (std::unordered_set<unsigned __int32>::const_iterator it = splits.begin(); it != splits.end(); ++it)
+        {
+            const owner_extent_t* p = map->find(*it);
+            const owner_extent_t* q = map->find(*it + 1);
+            if (!p || !q || !owner_map_t::is_data(p->kind) || !owner_map_t::is_data(q->kind) || p->owner != q->owner) continue;
+            unsigned __int32 lblk = p->lblk + (*it - p->pblk);
+            if (q->lblk + (*it + 1 - q->pblk) != lblk + 1) continue;
+            seam_t s = { *it, *it + 1, p->owner, lblk };
+            seams.push_back(s);
+        }
+    }
+
+    // 4. 接缝：读出两侧的字节再匹配，只保留跨过接缝的结果
+    struct result_t
+    {
+        unsigned __int32 ino;
+        unsigned __int64 offset; // 文件内偏移
+        unsigned __int32 pattern;
+        bool operator<(const result_t& o) const
+        {
+            return ino != o.ino ? ino < o.ino : offset != o.offset ? offset < o.offset : pattern < o.pattern;
+        }
+        bool operator==(const result_t& o) const { return ino == o.ino && offset == o.offset && pattern == o.pattern; }
+    };
+    std::vector<result_t> results;
+    std::sort(seams.begin(), seams.end(), [](const seam_t& x, const seam_t& y) { return x.a < y.a; });
+    std::vector<unsigned __int8> joint(overlap * 2);
+    for (size_t i = 0; i < seams.size(); i++)
+    {
+        const seam_t& s = seams[i];
+        if (!read_bytes(((unsigned __int64)s.a << block_shift) + block_size - overlap, joint.data(), overlap) ||
+            !read_bytes((unsigned __int64)s.b << block_shift, joint.data() + overlap, overlap))
+            continue;
+        matcher.scan(joint.data(), 0, overlap, joint.size(), [&](size_t pos, size_t pat) {
+            if (pos + patterns[pat].size() <= overlap) return; // 没有跨过接缝，前面已经找到
+            result_t r = { s.ino, ((unsigned __int64)s.lblk << block_shift) + block_size - overlap + pos, (unsigned __int32)pat };
+            results.push_back(r);
+        });
+    }
+
+    // 5. 块内和物理连续的匹配：跨块的必须落在同一文件的相邻逻辑块上
+    unsigned __int64 unowned = 0;
+    for (unsigned t = 0; t < threads; t++)
+        for (size_t i = 0; i < hits[t].size(); i++)
+        {
+            const hit_t& h = hits[t][i];
+            const owner_extent_t* o = map->find(h.pblk);
+            if (!o || !owner_map_t::is_data(o->kind))
+            {
+                unowned++; // 元数据块、位图中已分配但不属于任何文件的块
+                continue;
+            }
+            unsigned __int32 lblk = o->lblk + (h.pblk - o->pblk);
+            if (h.off + patterns[h.pattern].size() > block_size)
+            {
+                const owner_extent_t* n = map->find(h.pblk + 1);
+                if (!n || n->owner != o->owner || !owner_map_t::is_data(n->kind) || n->lblk + (h.pblk + 1 - n->pblk) != lblk + 1)
+                    continue; // 属于别的文件，不是真正的匹配
+            }
+            result_t r = { o->owner, ((unsigned __int64)lblk << block_shift) + h.off, h.pattern };
+            results.push_back(r);
+        }
+    std::sort(results.begin(), results.end());
+    results.erase(std::unique(results.begin(), results.end()), results.end());
+
+    std::unordered_map<unsigned __int32, unsigned __int64> sizes; // 有命中的 inode 的文件大小
+    {
+        scratch_t scratch(arena());
+        ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (sizes.count(results[i].ino) || !load_inode(results[i].ino, inode)) continue;
+            unsigned __int64 size = inode->i_size;
+            if ((inode->i_mode & 0xF000) == 0x8000) size |= (unsigned __int64)inode->i_size_high << 32;
+            sizes[results[i].ino] = size;
+        }
+    }
+
+    // 每个文件一行，列出前 GREP_SHOW_OFFSETS 个偏移；超过文件大小的匹配在块的尾部空间（slack）中
+    for (size_t i = 0, j; i < results.size(); i = j)
+    {
+        unsigned __int32 ino = results[i].ino;
+        for (j = i; j < results.size() && results[j].ino == ino; j++) {}
+        std::string path;
+        if (!path_of(ino, path)) path = "?";
+        printf("inode %u  %s  %zu matches:", ino, path.c_str(), j - i);
+        for (size_t k = i; k < j && k < i + GREP_SHOW_OFFSETS; k++)
+        {
+            printf(" %llu", results[k].offset);
+            if (patterns.size() > 1) printf("[%u]", results[k].pattern + 1);
+            if (results[k].offset >= sizes[ino]) printf("(slack)");
+        }
+        printf(j - i > GREP_SHOW_OFFSETS ? " ...\n" : "\n");
+    }
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    unsigned __int64 mb = (scanned << block_shift) >> 20;
+    printf("%zu matches (%llu more in metadata or unowned blocks); scanned %llu MB in %llu ms with %u threads, %zu seams\n",
+        results.size(), unowned, mb, ms, threads, seams.size());
+}
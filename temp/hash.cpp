@@ -0,0 +1,258 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include "ext2.h"
+#include "parallel.h"
+#include "digest.h"
+
+// hash：为目录下的全部普通文件计算摘要，输出清单（与 sha256sum 的格式相同）和重复文件报告。
+// 文件按第一个物理块排序，调用线程按逻辑顺序大块读取各文件的区段；一批读完后交给工作线程计算摘要，
+// 同时读取下一批。同一文件的数据在一批中只由一个工作项按顺序处理，批与批之间天然有序。
+
+#define HASH_BATCH_BYTES (16u << 20) // 每批读取的数据量
+#define HASH_RUN_BLOCKS 256          // 一次最多读取的连续块数
+#define HASH_ZERO_BYTES (64u << 10)  // 空洞按这么大的全零缓冲区分段送入摘要
+
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR 2
+
+void ext2_t::hash(const std::vector<std::string>& args)
+{
+    digest_algo_t algo = DIGEST_SHA256;
+    unsigned threads = parallel_run_t::default_threads();
+    std::string path = "/", manifest;
+    bool usage = false;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-a" && i + 1 < args.size())
+        {
+            const std::string& a = args[++i];
+            if (a == "sha256") algo = DIGEST_SHA256;
+            else if (a == "xxh3") algo = DIGEST_XXH3;
+            else usage = true;
+        }
+        else if (args[i] == "-j" && i + 1 < args.size()) threads = (unsigned)atoi(args[++i].c_str());
+        else if (args[i] == "-o" && i + 1 < args.size()) manifest = args[++i];
+        else if (args[i][0] != '-') path = args[i];
+        else usage = true;
+    }
+    if (usage || threads == 0 || threads > 64)
+    {
+        printf("Usage: hash [-a sha256|xxh3] [-j threads] [-o manifest] [path]\n");
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // 1. 经命名空间索引列出 path 之下的全部普通文件；硬链接只计算一次
+    unsigned __int8 type = 0;
+    unsigned __int32 top = resolve_path(path.c_str(), &type);
+    if (top == 0)
+    {
+        printf("'%s' not found.\n", path.c_str());
+        return;
+    }
+    struct file_t
+    {
+        unsigned __int32 ino;
+        unsigned __int64 size;
+        std::vector<ns_extent_t> extents;
+        std::vector<std::string> paths;
+        std::unique_ptr<digest_t> digest;
+        std::string hex;
+    };
+    std::vector<file_t> files;
+    std::unordered_map<unsigned __int32, size_t> by_ino;
+    auto add = [&](unsigned __int32 ino, const std::string& p, std::vector<ns_extent_t>* extents) {
+        std::unordered_map<unsigned __int32, size_t>::iterator it = by_ino.find(ino);
+        if (it == by_ino.end())
+        {
+            it = by_ino.insert(std::make_pair(ino, files.size())).first;
+            files.push_back(file_t());
+            files.back().ino = ino;
+            if (extents) files.back().extents.swap(*extents);
+        }
+        files[it->second].paths.push_back(p);
+    };
+    std::string base = path == "/" ? "" : path;
+    while (base.size() > 1 && base[base.size() - 1] == '/') base.erase(base.size() - 1);
+    if (type == EXT2_FT_REG_FILE) add(top, base, nullptr);
+    else if (type == EXT2_FT_DIR)
+    {
+        std::vector<ns_entry_t> entries;
+        ns->entries(entries);
+        std::unordered_map<unsigned __int32, std::vector<size_t>> children;
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].ino != entries[i].parent) children[entries[i].parent].push_back(i);
+        std::vector<std::pair<unsigned __int32, std::string>> queue(1, std::make_pair(top, base));
+        for (size_t q = 0; q < queue.size() && queue.size() <= entries.size(); q++)
+        {
+            std::unordered_map<unsigned __int32, std::vector<size_t>>::iterator c = children.find(queue[q].first);
+            if (c == children.end()) continue;
+            for (size_t k = 0; k < c->second.size(); k++)
+            {
+                ns_entry_t& e = entries[c->second[k]];
+                std::string p = queue[q].second + "/" + e.name;
+                if (e.file_type == EXT2_FT_DIR) queue.push_back(std::make_pair(e.ino, p));
+                else if (e.file_type == EXT2_FT_REG_FILE) add(e.ino, p, &e.extents);
+            }
+        }
+    }
+
+    // 2. 大小取自 inode（按 inode 号顺序读取）；索引中区段已过期的文件现场计算
+    std::sort(files.begin(), files.end(), [](const file_t& x, const file_t& y) { return x.ino < y.ino; });
+    {
+        scratch_t scratch(arena());
+        ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            file_t& f = files[i];
+            f.size = 0;
+            if (load_inode(f.ino, inode)) f.size = inode->i_size | (unsigned __int64)inode->i_size_high << 32;
+            if (f.size && (f.extents.empty() || ns->dirty(f.ino))) inode_extents(f.ino, f.extents);
+            f.digest.reset(new digest_t(algo));
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const file_t& x, const file_t& y) {
+        unsigned __int32 a = x.extents.empty() ? 0 : x.extents[0].pblk, b = y.extents.empty() ? 0 : y.extents[0].pblk;
+        return a != b ? a < b : x.ino < y.ino;
+    });
+
+    // 3. 流水线：一段是某个文件中连续的一块数据或一个空洞；空文件也有一段（长度为 0）
+    struct piece_t
+    {
+        size_t file;
+        size_t offset; // 在本批缓冲区中的位置
+        size_t len;
+        bool hole;
+        bool last; // 文件的最后一段，处理完就得出摘要
+    };
+    size_t fi = 0, ei = 0;        // 读到第几个文件的第几个区段
+    unsigned __int64 pos = 0;     // 当前文件已送出的字节数
+    unsigned __int64 bytes = 0;
+    bool ok = true;
+    auto read_batch = [&](std::vector<unsigned __int8>& data, std::vector<piece_t>& pieces) {
+        data.clear();
+        pieces.clear();
+        size_t fed = 0; // 包括空洞
+        while (fi < files.size() && fed < HASH_BATCH_BYTES && ok)
+        {
+            file_t& f = files[fi];
+            unsigned __int64 lblk = pos >> block_shift;
+            while (ei < f.extents.size() && f.extents[ei].lblk + f.extents[ei].len <= lblk) ei++;
+            piece_t p = { fi, data.size(), 0, true, false };
+            bool inside = ei < f.extents.size() && f.extents[ei].lblk <= lblk;
+            if (inside && f.extents[ei].pblk != 0)
+            {
+                const ns_extent_t& e = f.extents[ei];
+                unsigned __int64 n = e.lblk + e.len - lblk;
+                if (n > HASH_RUN_BLOCKS) n = HASH_RUN_BLOCKS;
+                p.len = (size_t)(n << block_shift);
+                p.hole = false;
+            }
+            else
+            {
+                // 空洞：到这个空洞区段的末尾、下一个区段或文件末尾为止
+                unsigned __int64 end = ei >= f.extents.size() ? f.size
+                    : (unsigned __int64)(inside ? f.extents[ei].lblk + f.extents[ei].len : f.extents[ei].lblk) << block_shift;
+                p.len = (size_t)(end - pos < HASH_BATCH_BYTES ? end - pos : HASH_BATCH_BYTES);
+            }
+            if (p.len > f.size - pos) p.len = (size_t)(f.size - pos);
+            if (!p.hole)
+            {
+                data.resize(p.offset + p.len);
+                if (!read_bytes(((unsigned __int64)f.extents[ei].pblk + (lblk - f.extents[ei].lblk)) << block_shift, data.data() + p.offset, p.len)) ok = false;
+            }
+            pos += p.len;
+            fed += p.len;
+            bytes += p.len;
+            p.last = pos >= f.size;
+            pieces.push_back(p);
+            if (p.last)
+            {
+                fi++;
+                ei = 0;
+                pos = 0;
+            }
+        }
+    };
+
+    static const unsigned __int8 zeros[HASH_ZERO_BYTES] = { 0 };
+    std::vector<unsigned __int8> cur, next;
+    std::vector<piece_t> cur_pieces, next_pieces;
+    read_batch(cur, cur_pieces);
+    while (!cur_pieces.empty() && ok)
+    {
+        // 同一文件的相邻几段组成一个工作项
+        std::vector<std::pair<size_t, size_t>> items; // cur_pieces 中的 [起, 止)
+        for (size_t i = 0; i < cur_pieces.size(); i++)
+            if (items.empty() || cur_pieces[items.back().first].file != cur_pieces[i].file) items.push_back(std::make_pair(i, i + 1));
+            else items.back().second = i + 1;
+        {
+            parallel_run_t run(items.size(), threads, [&](size_t i, unsigned) {
+                for (size_t k = items[i].first; k < items[i].second; k++)
+                {
+                    const piece_t& p = cur_pieces[k];
+                    file_t& f = files[p.file];
+                    if (!p.hole) f.digest->update(cur.data() + p.offset, p.len);
+                    else for (size_t done = 0; done < p.len; done += HASH_ZERO_BYTES)
+                        f.digest->update(zeros, p.len - done < HASH_ZERO_BYTES ? p.len - done : HASH_ZERO_BYTES);
+                    if (p.last) f.hex = f.digest->hex();
+                }
+            });
+            read_batch(next, next_pieces);
+        }
+        cur.swap(next);
+        cur_pieces.swap(next_pieces);
+    }
+    if (!ok)
+    {
+        printf("Failed to read file data.\n");
+        return;
+    }
+    // 4. 清单按路径排序；内容相同（大小和摘要都相同）的不同 inode 归为一组
+    std::vector<std::pair<std::string, size_t>> lines;
+    for (size_t i = 0; i < files.size(); i++)
+        for (size_t k = 0; k < files[i].paths.size(); k++) lines.push_back(std::make_pair(files[i].paths[k], i));
+    std::sort(lines.begin(), lines.end());
+    FILE* out = stdout;
+    if (!manifest.empty() && !(out = fopen(manifest.c_str(), "w")))
+    {
+        printf("Cannot create %s\n", manifest.c_str());
+        return;
+    }
+    for (size_t i = 0; i < lines.size(); i++) fprintf(out, "%s  %s\n", files[lines[i].second].hex.c_str(), lines[i].first.c_str());
+    if (out != stdout) fclose(out);
+
+    std::vector<size_t> order(files.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        if (files[x].size != files[y].size) return files[x].size > files[y].size;
+        return files[x].hex != files[y].hex ? files[x].hex < files[y].hex : files[x].paths[0] < files[y].paths[0];
+    });
+    unsigned __int64 groups = 0, wasted = 0;
+    for (size_t i = 0; i < order.size(); )
+    {
+        size_t j = i + 1;
+        while (j < order.size() && files[order[j]].size == files[order[i]].size && files[order[j]].hex == files[order[i]].hex) j++;
+        if (j - i > 1 && files[order[i]].size > 0)
+        {
+            if (groups == 0) printf("Duplicate files:\n");
+            printf("  %llu bytes x %zu  %s\n", files[order[i]].size, j - i, files[order[i]].hex.c_str());
+            for (size_t k = i; k < j; k++) printf("    %8u  %s\n", files[order[k]].ino, files[order[k]].paths[0].c_str());
+            groups++;
+            wasted += files[order[i]].size * (j - i - 1);
+        }
+        i = j;
+    }
+
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%zu files, %llu MB hashed with %s (%u threads, %llu ms, %llu MB/s); %llu duplicate groups, %llu MB redundant%s%s\n",
+        files.size(), bytes >> 20, digest_t::name(algo), threads, ms, ms ? (bytes >> 20) * 1000 / ms : 0, groups, wasted >> 20,
+        manifest.empty() ? "" : "; manifest written to ", manifest.c_str());
+}
@@ -0,0 +1,255 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include "ext2.h"
+
+// 哈希目录（dir_index / htree）只读支持。
+// 目录第 0 块是 dx_root：伪造的 "." 和 ".." 目录项之后是 dx_root_info 和 dx_entry 数组；
+// 中间层 dx_node 是一个覆盖整块的空目录项，之后是 dx_entry 数组。
+// dx_entry = { hash, 逻辑块号 }，第 0 项的 hash 字段存放 { limit, count }。
+
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002 // s_flags
+
+#define DX_HASH_LEGACY            0
+#define DX_HASH_HALF_MD4          1
+#define DX_HASH_TEA               2
+#define DX_HASH_LEGACY_UNSIGNED   3
+#define DX_HASH_HALF_MD4_UNSIGNED 4
+#define DX_HASH_TEA_UNSIGNED      5
+
+#define DX_MAX_LEVELS 3
+
+// 传统哈希（dx_hack_hash）
+static unsigned __int32 dx_hack_hash(const char* name, size_t len, bool is_unsigned)
+{
+    unsigned __int32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (size_t i = 0; i < len; i++)
+    {
+        int c = is_unsigned ? (int)(unsigned char)name[i] : (int)(signed char)name[i];
+        hash = hash1 + (hash0 ^ (unsigned __int32)(c * 7152373));
+        if (hash & 0x80000000) hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// 把名字按 4 字节打包成 num 个字，不足部分用长度填充
+static void str2hashbuf(const char* msg, size_t len, unsigned __int32* buf, int num, bool is_unsigned)
+{
+    unsigned __int32 pad = (unsigned __int32)len | ((unsigned __int32)len << 8);
+    pad |= pad << 16;
+
+    unsigned __int32 val = pad;
+    if (len > (size_t)num * 4) len = num * 4;
+    for (size_t i = 0; i < len; i++)
+    {
+        int c = is_unsigned ? (int)(unsigned char)msg[i] : (int)(signed char)msg[i];
+        val = (unsigned __int32)c + (val << 8);
+        if ((i % 4) == 3)
+        {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = val;
+    while (--num >= 0) *buf++ = pad;
+}
+
+static unsigned __int32 rol32(unsigned __int32 x, int s)
+{
+    return (x << s) | (x >> (32 - s));
+}
+
+// 半 MD4 变换
+static void half_md4_transform(unsigned __int32 buf[4], const unsigned __int32 in[8])
+{
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = rol32(a, s))
+    const unsigned __int32 K2 = 013240474631u, K3 = 015666365641u;
+    unsigned __int32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    ROUND(F, a, b, c, d, in[0], 3);
+    ROUND(F, d, a, b, c, in[1], 7);
+    ROUND(F, c, d, a, b, in[2], 11);
+    ROUND(F, b, c, d, a, in[3], 19);
+    ROUND(F, a, b, c, d, in[4], 3);
+    ROUND(F, d, a, b, c, in[5], 7);
+    ROUND(F, c, d, a, b, in[6], 11);
+    ROUND(F, b, c, d, a, in[7], 19);
+
+    ROUND(G, a, b, c, d, in[1] + K2, 3);
+    ROUND(G, d, a, b, c, in[3] + K2, 5);
+    ROUND(G, c, d, a, b, in[5] + K2, 9);
+    ROUND(G, b, c, d, a, in[7] + K2, 13);
+    ROUND(G, a, b, c, d, in[0] + K2, 3);
+    ROUND(G, d, a, b, c, in[2] + K2, 5);
+    ROUND(G, c, d, a, b, in[4] + K2, 9);
+    ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+    ROUND(H, a, b, c, d, in[3] + K3, 3);
+    ROUND(H, d, a, b, c, in[7] + K3, 9);
+    ROUND(H, c, d, a, b, in[2] + K3, 11);
+    ROUND(H, b, c, d, a, in[6] + K3, 15);
+    ROUND(H, a, b, c, d, in[1] + K3, 3);
+    ROUND(H, d, a, b, c, in[5] + K3, 9);
+    ROUND(H, c, d, a, b, in[0] + K3, 11);
+    ROUND(H, b, c, d, a, in[4] + K3, 15);
+#undef F
+#undef G
+#undef H
+#undef ROUND
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+// TEA 变换
+static void tea_transform(unsigned __int32 buf[4], const unsigned __int32 in[4])
+{
+    unsigned __int32 sum = 0;
+    unsigned __int32 b0 = buf[0], b1 = buf[1];
+    unsigned __int32 a = in[0], b = in[1], c = in[2], d = in[3];
+    for (int n = 0; n < 16; n++)
+    {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+// 计算目录项名字的 htree 哈希值（最低位恒为 0，用作冲突标记）
+static unsigned __int32 dx_hash(const char* name, size_t len, int version, const unsigned __int32 seed[4])
+{
+    unsigned __int32 buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    if (seed[0] || seed[1] || seed[2] || seed[3])
+        memcpy(buf, seed, sizeof(buf));
+
+    unsigned __int32 in[8], hash = 0;
+    const char* p = name;
+    bool is_unsigned = version >= DX_HASH_LEGACY_UNSIGNED;
+    switch (version)
+    {
+    case DX_HASH_LEGACY:
+    case DX_HASH_LEGACY_UNSIGNED:
+        hash = dx_hack_hash(name, len, is_unsigned);
+        break;
+    case DX_HASH_HALF_MD4:
+    case DX_HASH_HALF_MD4_UNSIGNED:
+        for (long left = (long)len; left > 0; left -= 32, p += 32)
+        {
+            str2hashbuf(p, left, in, 8, is_unsigned);
+            half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    case DX_HASH_TEA:
+    case DX_HASH_TEA_UNSIGNED:
+        for (long left = (long)len; left > 0; left -= 16, p += 16)
+        {
+            str2hashbuf(p, left, in, 4, is_unsigned);
+            tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
+    }
+
+    hash &= ~1u;
+    if (hash == (0x7fffffffu << 1)) hash = (0x7fffffffu - 1) << 1;
+    return hash;
+}
+
+// 读取索引块（dx_root / dx_node / 间接块），命中缓存时不产生 I/O
+const unsigned __int8* ext2_t::index_block(unsigned __int32 bn)
+{
+    const unsigned __int8* hit = index_cache.find(bn);
+    if (hit) {
+        EXT2_STAT(STAT_INDEX_HITS, 1);
+        return hit;
+    }
+    EXT2_STAT(STAT_INDEX_MISSES, 1);
+
+    std::vector<unsigned __int8> data(block_size);
+    if (!load_block(bn, data.data())) return nullptr;
+    return index_cache.insert(bn, std::move(data));
+}
+
+// 在哈希目录中查找 name。*usable 为 false 表示索引无法使用，调用者应退回线性扫描
+unsigned __int32 ext2_t::dx_lookup(const ext2_inode* inode, const char* name, size_t name_len,
+    unsigned char* file_type, bool* usable)
+{
+    *usable = false;
+
+    const unsigned __int8* root = nullptr;
+    unsigned __int32 root_bn = bmap(inode, 0);
+    if (root_bn == 0 || !(root = index_block(root_bn))) return 0;
+
+    // dx_root_info 位于 "." 和 ".." 之后
+    const dx_root_info* info = (const dx_root_info*)(root + 24);
+    int hash_version = info->hash_version;
+    int levels = info->indirect_levels;
+    if (info->reserved_zero != 0 || info->info_length != 8 || levels >= DX_MAX_LEVELS ||
+        hash_version > DX_HASH_TEA)
+        return 0;
+    if (super_block.s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+        hash_version += 3;
+
+    unsigned __int32 seed[4];
+    for (int i = 0; i < 4; i++) seed[i] = super_block.s_hash_seed[i];
+    unsigned __int32 hash = dx_hash(name, name_len, hash_version, seed);
+
+    // 逐层二分查找最后一个 hash <= 目标值的索引项
+    const dx_entry* entries = (const dx_entry*)(root + 24 + info->info_length);
+    unsigned int count = 0, at = 0;
+    for (int level = 0; level <= levels; level++)
+    {
+        const dx_countlimit* cl = (const dx_countlimit*)entries;
+        unsigned __int16 limit = cl->limit;
+        count = cl->count;
+        if (count == 0 || count > limit || (const unsigned __int8*)(entries + count) > root + block_size)
+            return 0;
+
+        unsigned int lo = 1, hi = count;
+        while (lo < hi)
+        {
+            unsigned int mid = (lo + hi) / 2;
+            if (entries[mid].hash > hash) hi = mid;
+            else lo = mid + 1;
+        }
+        at = lo - 1;
+        if (level == levels) break;
+
+        unsigned __int32 node_bn = bmap(inode, entries[at].block & 0x0FFFFFFF);
+        if (node_bn == 0 || !(root = index_block(node_bn))) return 0;
+        entries = (const dx_entry*)(root + 8); // dx_node 的伪目录项只占 8 字节
+    }
+
+    *usable = true;
+
+    // 扫描叶子块；若下一个索引项的起始哈希与目标相同（冲突链），继续扫描它指向的叶子
+    scratch_t scratch(arena());
+    unsigned __int8* block = scratch.alloc<unsigned __int8>(block_size);
+    for (;;)
+    {
+        unsigned __int32 leaf = entries[at].block & 0x0FFFFFFF;
+        unsigned __int32 bn = bmap(inode, leaf);
+        if (bn == 0 || !load_block(bn, block)) return 0;
+
+        const ext2_dir_entry* de = kern->dir_find(block, name, name_len);
+        if (de)
+        {
+            if (file_type) *file_type = de->file_type;
+            return de->inode;
+        }
+
+        if (++at >= count || (entries[at].hash & ~1u) != hash) return 0;
+    }
+}
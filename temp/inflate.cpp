@@ -0,0 +1,274 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <string.h>
+#include "vdisk.h"
+
+// RFC 1950/1951 解压（zlib 封装的 deflate），只用于 streamOptimized VMDK 的压缩粒度。
+// 输出缓冲区一次给足（一个粒度），不需要滑动窗口；按规范式哈夫曼码逐位解码，参照 zlib 附带的 puff。
+
+#define MAX_BITS  15
+#define MAX_LCODE 286
+#define MAX_DCODE 30
+
+struct huffman_t
+{
+    unsigned __int16 count[MAX_BITS + 1]; // 每种码长的符号个数
+    unsigned __int16 symbol[288];         // 按码值顺序排列的符号
+};
+
+struct inflate_state_t
+{
+    const unsigned __int8* in;
+    size_t in_len;
+    size_t in_pos;
+    unsigned __int32 bit_buf;
+    int bit_cnt;
+    unsigned __int8* out;
+    size_t out_len;
+    size_t out_pos;
+    bool error; // 输入提前结束或数据非法
+};
+
+static int get_bits(inflate_state_t* s, int need)
+{
+    unsigned __int32 val = s->bit_buf;
+    while (s->bit_cnt < need)
+    {
+        if (s->in_pos >= s->in_len)
+        {
+            s->error = true;
+            return 0;
+        }
+        val |= (unsigned __int32)s->in[s->in_pos++] << s->bit_cnt;
+        s->bit_cnt += 8;
+    }
+    s->bit_buf = val >> need;
+    s->bit_cnt -= need;
+    return (int)(val & ((1u << need) - 1));
+}
+
+// 由各符号的码长构造规范式哈夫曼码；返回 0 表示码完整，>0 表示不完整，<0 表示超额
+static int build_huffman(huffman_t* h, const unsigned __int16* length, int n)
+{
+    unsigned __int16 offs[MAX_BITS + 1];
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++) h->count[length[sym]]++;
+    if (h->count[0] == n) return 0; // 没有任何码，只有在不会被用到时才合法
+
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++)
+    {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++) offs[len + 1] = offs[len] + h->count[len];
+    for (int sym = 0; sym < n; sym++)
+        if (length[sym] != 0) h->symbol[offs[length[sym]]++] = (unsigned __int16)sym;
+    return left;
+}
+
+static int decode(inflate_state_t* s, const huffman_t* h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; len++)
+    {
+        code |= get_bits(s, 1);
+        if (s->error) return -1;
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    s->error = true;
+    return -1;
+}
+
+static const unsigned __int16 len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned __int16 len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned __int16 dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned __int16 dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static bool inflate_codes(inflate_state_t* s, const huffman_t* lencode, const huffman_t* distcode)
+{
+    for (;;)
+    {
+        int sym = decode(s, lencode);
+        if (sym < 0) return false;
+        if (sym < 256)
+        {
+            if (s->out_pos >= s->out_len) return false;
+            s->out[s->out_pos++] = (unsigned __int8)sym;
+        }
+        else if (sym == 256)
+        {
+            return true;
+        }
+        else
+        {
+            sym -= 257;
+            if (sym >= 29) return false;
+            size_t len = len_base[sym] + get_bits(s, len_extra[sym]);
+            int dsym = decode(s, distcode);
+            if (dsym < 0 || dsym >= 30) return false;
+            size_t dist = dist_base[dsym] + get_bits(s, dist_extra[dsym]);
+            if (s->error || dist > s->out_pos || len > s->out_len - s->out_pos) return false;
+            // 源和目标可能重叠（dist < len），只能逐字节复制
+            unsigned __int8* dst = s->out + s->out_pos;
+            const unsigned __int8* src = dst - dist;
+            for (size_t i = 0; i < len; i++) dst[i] = src[i];
+            s->out_pos += len;
+        }
+    }
+}
+
+static bool inflate_stored(inflate_state_t* s)
+{
+    s->bit_buf = 0; // 丢弃到字节边界为止的剩余位
+    s->bit_cnt = 0;
+    if (s->in_len - s->in_pos < 4) return false;
+    unsigned len = s->in[s->in_pos] | (s->in[s->in_pos + 1] << 8);
+    unsigned nlen = s->in[s->in_pos + 2] | (s->in[s->in_pos + 3] << 8);
+    s->in_pos += 4;
+    if (len != (~nlen & 0xffff) || len > s->in_len - s->in_pos || len > s->out_len - s->out_pos) return false;
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->in_pos += len;
+    s->out_pos += len;
+    return true;
+}
+
+static bool inflate_fixed(inflate_state_t* s)
+{
+    static huffman_t lencode, distcode;
+    static bool built = false;
+    if (!built)
+    {
+        unsigned __int16 lengths[288];
+        int sym = 0;
+        for (; sym < 144; sym++) lengths[sym] = 8;
+        for (; sym < 256; sym++) lengths[sym] = 9;
+        for (; sym < 280; sym++) lengths[sym] = 7;
+        for (; sym < 288; sym++) lengths[sym] = 8;
+        build_huffman(&lencode, lengths, 288);
+        for (sym = 0; sym < MAX_DCODE; sym++) lengths[sym] = 5;
+        build_huffman(&distcode, lengths, MAX_DCODE);
+        built = true;
+    }
+    return inflate_codes(s, &lencode, &distcode);
+}
+
+static bool inflate_dynamic(inflate_state_t* s)
+{
+    static const unsigned __int8 order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    unsigned __int16 lengths[MAX_LCODE + MAX_DCODE];
+    huffman_t lencode, distcode;
+
+    int nlen = get_bits(s, 5) + 257;
+    int ndist = get_bits(s, 5) + 1;
+    int ncode = get_bits(s, 4) + 4;
+    if (s->error || nlen > MAX_LCODE || ndist > MAX_DCODE) return false;
+
+    int index = 0;
+    for (; index < ncode; index++) lengths[order[index]] = (unsigned __int16)get_bits(s, 3);
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (s->error || build_huffman(&lencode, lengths, 19) != 0) return false; // 码长码必须完整
+
+    index = 0;
+    while (index < nlen + ndist)
+    {
+        int sym = decode(s, &lencode);
+        if (sym < 0) return false;
+        if (sym < 16)
+        {
+            lengths[index++] = (unsigned __int16)sym;
+            continue;
+        }
+        unsigned __int16 len = 0;
+        int repeat;
+        if (sym == 16)
+        {
+            if (index == 0) return false;
+            len = lengths[index - 1];
+            repeat = 3 + get_bits(s, 2);
+        }
+        else if (sym == 17) repeat = 3 + get_bits(s, 3);
+        else repeat = 11 + get_bits(s, 7);
+        if (s->error || index + repeat > nlen + ndist) return false;
+        while (repeat--) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) return false; // 必须有块结束符
+
+    // 不完整的码只允许出现在只有一个码的情况
+    int err = build_huffman(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) return false;
+    err = build_huffman(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) return false;
+    return inflate_codes(s, &lencode, &distcode);
+}
+
+static unsigned __int32 adler32(const unsigned __int8* data, size_t len)
+{
+    unsigned __int32 a = 1, b = 0;
+    while (len > 0)
+    {
+        size_t n = len < 5552 ? len : 5552; // 5552 是保证 b 不溢出 32 位的最大批量
+        len -= n;
+        while (n--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+bool inflate_zlib(const unsigned __int8* src, size_t src_len, unsigned __int8* dst, size_t dst_len, size_t* out_len)
+{
+    if (src_len < 6) return false;
+    unsigned cmf = src[0], flg = src[1];
+    if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) return false;
+
+    inflate_state_t s;
+    s.in = src;
+    s.in_len = src_len;
+    s.in_pos = 2;
+    s.bit_buf = 0;
+    s.bit_cnt = 0;
+    s.out = dst;
+    s.out_len = dst_len;
+    s.out_pos = 0;
+    s.error = false;
+
+    int last;
+    do
+    {
+        last = get_bits(&s, 1);
+        int type = get_bits(&s, 2);
+        if (s.error) return false;
+        bool ok;
+        if (type == 0) ok = inflate_stored(&s);
+        else if (type == 1) ok = inflate_fixed(&s);
+        else if (type == 2) ok = inflate_dynamic(&s);
+        else ok = false;
+        if (!ok || s.error) return false;
+    } while (!last);
+
+    // 校验和按大端存放在压缩数据之后的下一个字节边界
+    if (s.in_len - s.in_pos < 4) return false;
+    const unsigned __int8* t = s.in + s.in_pos;
+    unsigned __int32 sum = ((unsigned __int32)t[0] << 24) | (t[1] << 16) | (t[2] << 8) | t[3];
+    if (sum != adler32(dst, s.out_pos)) return false;
+    *out_len = s.out_pos;
+    return true;
+}
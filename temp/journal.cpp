@@ -0,0 +1,326 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "ext2.h"
+
+// 旁路重做日志（<镜像名>.jnl）格式：
+//   jnl_header_t
+//   count 个 { unsigned __int32 块号; block_size 字节块内容 }
+//   jnl_commit_t
+// 只有 commit 记录完整且校验和匹配的日志才会被重放；重放是幂等的，
+// 因此回写镜像途中崩溃后再次打开镜像会把同一批块重新写一遍。
+
+#define JNL_MAGIC_HEADER 0x4C4A3245 // "E2JL"
+#define JNL_MAGIC_COMMIT 0x434A3245 // "E2JC"
+#define JNL_VERSION      1
+
+struct jnl_header_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 version;
+    unsigned __int32 block_size;
+    unsigned __int32 count;      // 日志中的块数
+    unsigned __int64 base;       // 分区在镜像中的字节偏移
+    unsigned __int64 seq;        // 事务序号
+};
+
+struct jnl_commit_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 count;
+    unsigned __int32 checksum;   // 所有块号和块内容的 FNV-1a 校验和
+    unsigned __int32 reserved;
+};
+
+// FNV-1a 32 位校验和，可分段累加
+unsigned __int32 fnv1a(unsigned __int32 h, const void* data, size_t len)
+{
+    const unsigned __int8* p = (const unsigned __int8*)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 把文件缓冲区和操作系统缓存刷到磁盘
+bool sync_file(FILE* f)
+{
+    if (fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// 按绝对位置读取，不经过 stdio 的缓冲和文件指针，多个线程可以同时对同一个文件调用。
+// Windows 上同步句柄的 ReadFile 仍会移动文件指针，调用者在写之前必须重新定位
+bool read_at(FILE* f, unsigned __int64 off, void* buf, size_t len)
+{
+    unsigned __int8* p = (unsigned __int8*)buf;
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    while (len > 0)
+    {
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)off;
+        ov.OffsetHigh = (DWORD)(off >> 32);
+        DWORD want = len > 0x40000000 ? 0x40000000 : (DWORD)len, got = 0;
+        if (!ReadFile(h, p, want, &got, &ov) || got == 0) return false;
+        p += got;
+        off += got;
+        len -= got;
+    }
+#else
+    int fd = fileno(f);
+    while (len > 0)
+    {
+        ssize_t got = pread(fd, p, len, (off_t)off);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        off += got;
+        len -= got;
+    }
+#endif
+    return true;
+}
+
+void ext2_t::txn_begin()
+{
+    txn_depth++;
+}
+
+bool ext2_t::txn_commit()
+{
+    if (txn_depth == 0) return true;
+    if (--txn_depth > 0) return true; // 嵌套事务，等最外层提交
+    if (txn_failed)
+    {
+        printf("A command in the transaction failed, transaction discarded.\n");
+        txn_abort();
+        return false;
+    }
+    return txn_flush();
+}
+
+void ext2_t::txn_fail(unsigned __int64 mark)
+{
+    if (txn_depth == 0) return;
+    // 这一层还没有写过任何东西（如查找失败）：相当于空提交，不影响外层
+    if (txn_writes == mark)
+    {
+        txn_commit();
+        return;
+    }
+    // 最外层直接丢弃；内层的修改已经混在脏块里无法单独撤销，整个事务作废，最外层提交时丢弃
+    if (txn_depth == 1) txn_abort();
+    else
+    {
+        txn_depth--;
+        txn_failed = true;
+    }
+}
+
+void ext2_t::txn_abort()
+{
+    bool discarded = !txn_dirty.empty();
+    txn_depth = 0;
+    txn_failed = false;
+    if (!discarded) return; // 没有丢弃任何修改（如没有打开事务时的 abort），缓存和索引都仍然有效
+    txn_dirty.clear();
+    dir_slot_map.clear(); // 槽位表和索引块缓存可能反映了被丢弃的修改
+    index_cache.clear();
+    reload_summary(); // 内存中的空闲计数也要回到提交前的状态
+    ns_invalidate(); // 索引中已经追加了被丢弃的修改
+    owners_reset(); // 属主表可能是在事务中按脏块建立的
+}
+
+bool ext2_t::txn_flush()
+{
+    if (txn_dirty.empty()) return true;
+    if (read_only)
+    {
+        // 只读方式下不写日志，脏块直接进入内存覆盖层
+        for (auto it = txn_dirty.begin(); it != txn_dirty.end(); ++it)
+            mem_write((unsigned __int64)it->first << block_shift, it->second.data(), block_size);
+        txn_dirty.clear();
+        return true;
+    }
+
+    // 1. 写重做日志并 fsync，这是整个事务唯一的同步点之一
+    FILE* jf = fopen(journal_path.c_str(), "wb");
+    if (!jf)
+    {
+        // 镜像没有被修改：丢弃事务，连同已经反映了这些修改的缓存
+        printf("Failed to open journal %s, transaction discarded.\n", journal_path.c_str());
+        txn_abort();
+        return false;
+    }
+
+    jnl_header_t header;
+    header.magic = JNL_MAGIC_HEADER;
+    header.version = JNL_VERSION;
+    header.block_size = block_size;
+    header.count = (unsigned __int32)txn_dirty.size();
+    header.base = (unsigned __int64)partition_start * 512;
+    header.seq = txn_seq;
+
+    bool ok = fwrite(&header, sizeof(header), 1, jf) == 1;
+    unsigned __int32 sum = 2166136261u;
+    for (auto it = txn_dirty.begin(); ok && it != txn_dirty.end(); ++it)
+    {
+        sum = fnv1a(sum, &it->first, 4);
+        sum = fnv1a(sum, it->second.data(), block_size);
+        ok = fwrite(&it->first, 4, 1, jf) == 1 &&
+            fwrite(it->second.data(), block_size, 1, jf) == 1;
+    }
+
+    jnl_commit_t commit;
+    commit.magic = JNL_MAGIC_COMMIT;
+    commit.count = header.count;
+    commit.checksum = sum;
+    commit.reserved = 0;
+    EXT2_STAT(STAT_FSYNCS, 1);
+    ok = ok && fwrite(&commit, sizeof(commit), 1, jf) == 1 && sync_file(jf);
+    fclose(jf);
+
+    if (!ok)
+    {
+        // 日志没有完整落盘，镜像保持不变，相当于事务被回滚
+        printf("Failed to write journal, transaction discarded.\n");
+        remove(journal_path.c_str());
+        txn_abort();
+        return false;
+    }
+
+    // 2. checkpoint：按块号顺序回写到镜像，再同步一次
+    for (auto it = txn_dirty.begin(); it != txn_dirty.end(); ++it)
+    {
+        if (!raw_write((unsigned __int64)it->first << block_shift, it->second.data(), block_size))
+        {
+            // 保留日志，下次打开镜像时重放
+            printf("Checkpoint failed at block %u, journal kept for recovery.\n", it->first);
+            txn_dirty.clear();
+            return false;
+        }
+    }
+    EXT2_STAT(STAT_FSYNCS, 1);
+    if (!sync_image())
+    {
+        printf("Failed to sync image, journal kept for recovery.\n");
+        txn_dirty.clear();
+        return false;
+    }
+
+    // 3. 镜像已经持久化，日志可以删除
+    remove(journal_path.c_str());
+    txn_dirty.clear();
+    txn_seq++;
+    return true;
+}
+
+void ext2_t::txn_recover()
+{
+    FILE* jf = fopen(journal_path.c_str(), "rb");
+    if (!jf) return; // 没有日志，上次正常结束
+
+    // 头部的块数不能超过日志文件实际能容纳的数量：损坏的头部按不完整的日志处理，不会按巨大的块数分配内存
+    _fseeki64(jf, 0, SEEK_END);
+    unsigned __int64 jnl_size = (unsigned __int64)_ftelli64(jf);
+    _fseeki64(jf, 0, SEEK_SET);
+
+    jnl_header_t header;
+    std::vector<unsigned __int32> blocks;
+    std::vector<unsigned __int8> data;
+    bool ok = fread(&header, sizeof(header), 1, jf) == 1 &&
+        header.magic == JNL_MAGIC_HEADER && header.version == JNL_VERSION &&
+        header.block_size >= 1024 && header.block_size <= 65536 &&
+        jnl_size >= sizeof(header) + sizeof(jnl_commit_t) &&
+        header.count <= (jnl_size - sizeof(header) - sizeof(jnl_commit_t)) / (4 + (unsigned __int64)header.block_size);
+
+    if (ok)
+    {
+        blocks.resize(header.count);
+        data.resize((size_t)header.count * header.block_size);
+        unsigned __int32 sum = 2166136261u;
+        for (unsigned __int32 i = 0; ok && i < header.count; i++)
+        {
+            unsigned __int8* d = data.data() + (size_t)i * header.block_size;
+            ok = fread(&blocks[i], 4, 1, jf) == 1 && fread(d, header.block_size, 1, jf) == 1;
+            if (ok)
+            {
+                sum = fnv1a(sum, &blocks[i], 4);
+                sum = fnv1a(sum, d, header.block_size);
+            }
+        }
+
+        jnl_commit_t commit;
+        ok = ok && fread(&commit, sizeof(commit), 1, jf) == 1 &&
+            commit.magic == JNL_MAGIC_COMMIT && commit.count == header.count && commit.checksum == sum;
+    }
+    fclose(jf);
+
+    if (!ok)
+    {
+        // 提交记录不完整：事务在写日志途中中断，镜像未被修改，直接丢弃（只读方式下只是不用它）
+        if (read_only) return;
+        printf("Discarding incomplete journal %s\n", journal_path.c_str());
+        remove(journal_path.c_str());
+        return;
+    }
+
+    if (header.base != (unsigned __int64)partition_start * 512)
+    {
+        printf("Journal %s belongs to another partition, ignored\n", journal_path.c_str());
+        return;
+    }
+
+    // 日志只能由本分区的文件系统写出：块大小要与超级块一致，块号要落在文件系统和分区之内，
+    // 否则即使校验和正确也不重放，以免写到相邻分区
+    ext2_super_block sb;
+    unsigned __int64 fs_blocks = 0;
+    if (raw_read(1024, &sb, sizeof(sb)) && sb.s_log_block_size <= 6 && header.block_size == 1024u << sb.s_log_block_size)
+    {
+        fs_blocks = sb.s_blocks_count;
+        if (partition_size && fs_blocks > partition_size * 512 / header.block_size)
+            fs_blocks = partition_size * 512 / header.block_size;
+    }
+    for (unsigned __int32 i = 0; i < header.count; i++)
+    {
+        if (blocks[i] >= fs_blocks)
+        {
+            printf("Journal %s does not match this filesystem (block %u, block size %u), ignored\n",
+                journal_path.c_str(), blocks[i], header.block_size);
+            return;
+        }
+    }
+
+    // 经 raw_write 重放，覆盖层开启时同样只写入覆盖层，只读方式下只写入内存
+    for (unsigned __int32 i = 0; i < header.count; i++)
+    {
+        if (!raw_write((unsigned __int64)blocks[i] * header.block_size, data.data() + (size_t)i * header.block_size, header.block_size))
+        {
+            printf("Journal replay failed at block %u\n", blocks[i]);
+            return;
+        }
+    }
+    if (!sync_image()) return;
+    txn_seq = header.seq + 1;
+    if (read_only) return; // 日志留给下一次以读写方式打开时回写
+
+    printf("Replayed %u blocks from journal (transaction %llu)\n", header.count, header.seq);
+    remove(journal_path.c_str());
+}
@@ -0,0 +1,154 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include "ext2.h"
+
+// 按块大小特化的热路径内核。块大小作为模板参数，每个间接块的指针数、逻辑块号拆分用的位移
+// 和目录块扫描的边界都成为编译期常量，循环中不再出现除法和取模。
+// 打开镜像时由 select_kernels 按 block_size 选出一组函数指针，之后不再判断块大小。
+
+static constexpr unsigned __int32 log2c(unsigned __int32 x)
+{
+    return x <= 1 ? 0 : 1 + log2c(x >> 1);
+}
+
+// 位图中前 nbits 位里第一个为 0 的位，没有空位返回 -1
+template <unsigned __int32 BS>
+static int bitmap_find_zero_k(const unsigned __int8* bitmap, unsigned __int32 nbits)
+{
+    if (nbits > BS * 8) nbits = BS * 8;
+
+    // 先按 8 字节整字跳过全 1 的部分
+    unsigned __int32 words = nbits >> 6;
+    unsigned __int32 w = 0;
+    for (; w < words; w++)
+    {
+        unsigned __int64 v;
+        memcpy(&v, bitmap + (w << 3), 8);
+        if (v != ~(unsigned __int64)0) break;
+    }
+
+    for (unsigned __int32 byte = w << 3; (byte << 3) < nbits; byte++)
+    {
+        unsigned __int8 b = bitmap[byte];
+        if (b == 0xFF) continue;
+        unsigned __int32 bit = 0;
+        while (b & (1 << bit)) bit++;
+        unsigned __int32 n = (byte << 3) + bit;
+        return n < nbits ? (int)n : -1;
+    }
+    return -1;
+}
+
+// 目录块中能容纳新目录项的最大空隙
+template <unsigned __int32 BS>
+static unsigned __int32 dir_block_gap_k(const unsigned __int8* block)
+{
+    unsigned __int32 gap = 0;
+    unsigned __int32 offset = 0;
+    while (offset + 8 <= BS)
+    {
+        const ext2_dir_entry* de = (const ext2_dir_entry*)(block + offset);
+        unsigned __int32 rec_len = rec_len_from_disk(de->rec_len);
+        if (rec_len < 8 || offset + rec_len > BS) break;
+
+        unsigned __int32 used = de->inode ? (8 + ((de->name_len + 3) & ~3u)) : 0;
+        if (rec_len - used > gap) gap = rec_len - used;
+        offset += rec_len;
+    }
+    return gap;
+}
+
+// 在一个目录块中按名字查找目录项
+template <unsigned __int32 BS>
+static const ext2_dir_entry* dir_find_k(const unsigned __int8* block, const char* name, size_t name_len)
+{
+    unsigned __int32 offset = 0;
+    while (offset + 8 <= BS)
+    {
+        const ext2_dir_entry* de = (const ext2_dir_entry*)(block + offset);
+        unsigned __int32 rec_len = rec_len_from_disk(de->rec_len);
+        if (rec_len < 8 || offset + rec_len > BS) break;
+        if (de->name_len == name_len && de->inode != 0 && memcmp(de->name, name, name_len) == 0)
+            return de;
+        offset += rec_len;
+    }
+    return nullptr;
+}
+
+// 单个逻辑块到物理块的映射，只读取路径上的间接块（经过索引块缓存）
+template <unsigned __int32 BS>
+unsigned __int32 ext2_t::bmap_k(const ext2_inode* inode, unsigned __int32 lblk)
+{
+    const unsigned __int32 A = log2c(BS / 4); // 每级间接块消耗的逻辑块号位数
+    const unsigned __int32 MASK = BS / 4 - 1;
+    if (lblk < 12) return inode->i_block[lblk];
+
+    unsigned __int64 rel = lblk - 12;
+    int level;
+    if (rel < (1ull << A)) level = 1;
+    else if ((rel -= 1ull << A) < (1ull << 2 * A)) level = 2;
+    else if ((rel -= 1ull << 2 * A) < (1ull << 3 * A)) level = 3;
+    else return 0;
+
+    unsigned __int32 bn = inode->i_block[11 + level];
+    for (int l = level; l >= 1 && bn != 0; l--)
+    {
+        if (bn >= blocks_count) return 0;
+        const le32* ptr = (const le32*)index_block(bn);
+        if (!ptr) return 0;
+        bn = ptr[(rel >> (A * (l - 1))) & MASK];
+    }
+    return bn < blocks_count ? bn : 0;
+}
+
+// 按逻辑顺序收集间接块 bn 下的数据块号，level 为间接级数（1 为一级间接）
+template <unsigned __int32 BS>
+void ext2_t::collect_indirect_k(unsigned __int32 bn, int level, block_list_t& blocks, block_list_t* meta)
+{
+    const unsigned __int32 PER = BS / 4;
+    if (bn == 0 || bn >= blocks_count)
+    {
+        // 空洞：整棵子树都用 0 填充
+        unsigned __int64 span = 1ull << (log2c(PER) * level);
+        while (span-- > 0 && !blocks.full()) blocks.push(0);
+        return;
+    }
+
+    if (meta) meta->push(bn);
+    scratch_t scratch(arena());
+    le32* ptr = scratch.alloc<le32>(BS);
+    if (!load_block(bn, ptr)) return;
+    if (level == 1)
+    {
+        unsigned __int32 n = blocks.cap - blocks.n < PER ? blocks.cap - blocks.n : PER;
+        for (unsigned __int32 i = 0; i < n; i++)
+        {
+            unsigned __int32 child = ptr[i];
+            blocks.v[blocks.n++] = child < blocks_count ? child : 0;
+        }
+        return;
+    }
+    for (unsigned __int32 i = 0; i < PER && !blocks.full(); i++)
+        collect_indirect_k<BS>(ptr[i], level - 1, blocks, meta);
+}
+
+#define EXT2_KERNELS(bs) \
+    { &ext2_t::bmap_k<bs>, &ext2_t::collect_indirect_k<bs>, dir_block_gap_k<bs>, dir_find_k<bs>, bitmap_find_zero_k<bs> }
+
+const ext2_t::kernels_t* ext2_t::select_kernels(unsigned __int32 block_size)
+{
+    static const kernels_t table[] = {
+        EXT2_KERNELS(1024),
+        EXT2_KERNELS(2048),
+        EXT2_KERNELS(4096),
+        EXT2_KERNELS(8192),
+        EXT2_KERNELS(16384),
+        EXT2_KERNELS(32768),
+        EXT2_KERNELS(65536),
+    };
+    for (int i = 0; i < 7; i++)
+        if (block_size == (1024u << i)) return &table[i];
+    return nullptr;
+}
@@ -1,10 +1,13 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <stdio.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <string.h>
 #include <vector>
 #include <string>
+#include <chrono>
 #include "ext2.h"
 
 // 将命令字符串拆分为单词，并存储在 res 向量中
@@ -24,13 +27,23 @@ void split_cmd(const char* cmd, std::vector<std::string>& res)
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    // --cow：镜像只读，写入进入覆盖层；trace_file：从一开始记录块访问
+    bool cow = false;
+    const char* trace_file = nullptr;
+    for (int i = 3; i < argc; i++)
     {
-        printf("dumpext2 <vmdk_filename> <partition_num>\n");
+        if (strcmp(argv[i], "--cow") == 0) cow = true;
+        else trace_file = argv[i];
+    }
+    if (argc < 3 || argc > 5)
+    {
+        printf("dumpext2 <vmdk_filename> <partition_num> [--cow] [trace_file]\n");
+        printf("partition_num: MBR 主分区 0-3，逻辑分区从 4 起，GPT 为分区项下标；没有分区表的镜像为 0\n");
         return 1;
     }
-    ext2_t ext2(argv[1], atoi(argv[2])); // 初始化 ext2 文件系统对象
+    ext2_t ext2(argv[1], atoi(argv[2]), cow); // 初始化 ext2 文件系统对象
     if (!ext2.valid) return 1; // 如果文件系统无效，退出
+    if (trace_file && !ext2.trace_start(trace_file)) return 1;
 
     //ext2.dump_inode(0x44001);
     //ext2.dump_inode(0xc);
@@ -43,10 +56,12 @@ int main(int argc, char* argv[])
     {
         // 显示提示符，等待输入
         printf("\n-");
-        gets_s(cmd, MAX_PATH);
+        if (!gets_s(cmd, MAX_PATH)) break; // 输入结束（如管道）按 q 处理，析构函数负责关闭跟踪、索引和事务
         split_cmd(cmd, arg);
 
         if (arg.size() == 0 || arg[0] == "") continue; //空命令
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(); // 统计命令耗时
+        ext2.trace_command(arg[0]);
 
         if (arg[0] == "q" || arg[0] == "Q") // 退出命令
         {
@@ -118,7 +133,10 @@ int main(int argc, char* argv[])
                 size_t size;
                 char* content = ext2.read_file(inode_num, &size);
                 if (content) {
-                    printf("File content: %s\n", content);
+                    // 按长度输出，内容中的 NUL 字节不会截断
+                    printf("File content: ");
+                    fwrite(content, 1, size, stdout);
+                    printf("\n");
                     delete[] content;
                 }
             }
@@ -141,6 +159,177 @@ int main(int argc, char* argv[])
                 ext2.delete_directory(parent_inode, arg[2].c_str());
             }
         }
+        else if (arg[0] == "lookup") {
+            if (arg.size() < 3) {
+                printf("Usage: lookup <dir_inode> <name>\n");
+            }
+            else {
+                unsigned int dir_inode = (unsigned int)_strtoi64(arg[1].c_str(), NULL, 10);
+                unsigned char file_type = 0;
+                unsigned int inode_num = ext2.lookup_entry(dir_inode, arg[2].c_str(), &file_type);
+                if (inode_num) printf("%s -> inode %u (type %u)\n", arg[2].c_str(), inode_num, file_type);
+                else printf("'%s' not found.\n", arg[2].c_str());
+            }
+        }
+        else if (arg[0] == "begin") // 开始一批原子提交的修改
+        {
+            ext2.txn_begin();
+        }
+        else if (arg[0] == "commit") // 把 begin 之后的修改一次性写入日志并回写镜像
+        {
+            if (ext2.txn_commit()) printf("Committed.\n");
+        }
+        else if (arg[0] == "abort") // 丢弃 begin 之后尚未提交的修改
+        {
+            ext2.txn_abort();
+            printf("Aborted.\n");
+        }
+        else if (arg[0] == "stats") // 运行统计
+        {
+            if (arg.size() < 2) {
+                ext2.stats.print(stdout);
+            }
+            else if (arg[1] == "on" || arg[1] == "off") {
+                ext2.stats.enabled = arg[1] == "on";
+                printf("Statistics %s.\n", ext2.stats.enabled ? "enabled" : "disabled");
+            }
+            else if (arg[1] == "reset") {
+                ext2.stats.reset();
+            }
+            else if (arg[1] == "json") {
+                FILE* out = arg.size() > 2 ? fopen(arg[2].c_str(), "w") : stdout;
+                if (!out) {
+                    printf("Cannot open %s\n", arg[2].c_str());
+                }
+                else {
+                    ext2.stats.print_json(out);
+                    if (out != stdout) fclose(out);
+                }
+            }
+            else {
+                printf("Usage: stats [on|off|reset|json [file]]\n");
+            }
+        }
+        else if (arg[0] == "format") // 列表类命令的输出格式
+        {
+            out_format_t f;
+            if (arg.size() < 2) {
+                printf("Output format: %s\n", out_format_name(ext2.out_format));
+            }
+            else if (parse_out_format(arg[1].c_str(), f)) {
+                ext2.out_format = f;
+                printf("Output format: %s\n", out_format_name(f));
+            }
+            else {
+                printf("Usage: format [text|ndjson|csv]\n");
+            }
+        }
+        else if (arg[0] == "cow") // 写时复制覆盖层
+        {
+            if (arg.size() < 2) ext2.cow_status();
+            else if (arg[1] == "on") ext2.cow_enable();
+            else if (arg[1] == "commit") ext2.cow_commit();
+            else if (arg[1] == "discard") ext2.cow_discard();
+            else printf("Usage: cow [on|commit|discard]\n");
+        }
+        else if (arg[0] == "disk") // 虚拟磁盘格式
+        {
+            ext2.disk_info();
+        }
+        else if (arg[0] == "export_meta") // 导出只含元数据的镜像
+        {
+            if (arg.size() < 2) printf("Usage: export_meta <file>\n");
+            else ext2.export_meta(arg[1].c_str());
+        }
+        else if (arg[0] == "index") // 命名空间索引
+        {
+            if (arg.size() >= 2 && arg[1] == "build") ext2.index_build();
+            else if (arg.size() == 1) ext2.index_status();
+            else printf("Usage: index [build]\n");
+        }
+        else if (arg[0] == "path") // 按绝对路径查找
+        {
+            if (arg.size() < 2) printf("Usage: path <path>\n");
+            else ext2.show_path(arg[1].c_str());
+        }
+        else if (arg[0] == "name") // inode 的完整路径
+        {
+            if (arg.size() < 2) {
+                printf("Usage: name <inode>\n");
+            }
+            else {
+                unsigned int inode_num = (unsigned int)_strtoi64(arg[1].c_str(), NULL, 10);
+                std::string path;
+                if (ext2.path_of(inode_num, path)) printf("inode %u -> %s\n", inode_num, path.c_str());
+                else printf("inode %u has no name in the index.\n", inode_num);
+            }
+        }
+        else if (arg[0] == "find") // 按名字、大小、时间和类型查找
+        {
+            ext2.find(arg);
+        }
+        else if (arg[0] == "owner") // 块的属主
+        {
+            if (arg.size() < 2) printf("Usage: owner <block>\n");
+            else ext2.show_owner((unsigned __int32)strtoul(arg[1].c_str(), NULL, 0));
+        }
+        else if (arg[0] == "check") // 块位图与属主表的一致性
+        {
+            ext2.check();
+        }
+        else if (arg[0] == "undelete_scan") // 查找可恢复的已删除文件
+        {
+            ext2.undelete_scan(arg);
+        }
+        else if (arg[0] == "recover") // 把已删除文件的数据写到主机
+        {
+            if (arg.size() < 3) printf("Usage: recover <inode> <host_path>\n");
+            else ext2.recover((unsigned __int32)strtoul(arg[1].c_str(), NULL, 0), arg[2].c_str());
+        }
+        else if (arg[0] == "hash") // 文件摘要清单和重复文件报告
+        {
+            ext2.hash(arg);
+        }
+        else if (arg[0] == "dedup_report") // 块级去重分析
+        {
+            ext2.dedup_report(arg);
+        }
+        else if (arg[0] == "defrag") // 碎片整理
+        {
+            ext2.defrag(arg);
+        }
+        else if (arg[0] == "diff") // 与另一个镜像比较
+        {
+            ext2.diff(arg);
+        }
+        else if (arg[0] == "parts") // 列出分区
+        {
+            ext2.parts();
+        }
+        else if (arg[0] == "df") // 块和 inode 用量
+        {
+            ext2.df();
+        }
+        else if (arg[0] == "each") // 在全部 ext2/ext3 分区上执行扫描
+        {
+            ext2.each(arg);
+        }
+        else if (arg[0] == "grep") // 在数据块中查找字节串
+        {
+            ext2.grep(arg);
+        }
+        else if (arg[0] == "trace") // 记录块访问，供 ext2replay 离线分析
+        {
+            if (arg.size() >= 3 && arg[1] == "start") {
+                if (ext2.trace_start(arg[2].c_str())) printf("Tracing to %s\n", arg[2].c_str());
+            }
+            else if (arg.size() >= 2 && arg[1] == "stop") {
+                ext2.trace_stop();
+            }
+            else {
+                printf("Usage: trace start <file> | trace stop\n");
+            }
+        }
         else if (arg[0] == "tree") 
         {
             if (arg.size() > 1) {
@@ -175,6 +364,45 @@ int main(int argc, char* argv[])
             printf("rm <parent_inode> <name>        删除指定文件\n");
             printf("rmdir <parent_inode> <dirname>        删除指定文件夹\n");
             printf("tree <inode>      以树形结构显示目录内容，可选择起始inode\n");
+            printf("lookup <dir_inode> <name>   在目录中按名字查找（支持哈希目录）\n");
+            printf("begin      开始一个事务，之后的修改在 commit 时一次性原子提交\n");
+            printf("commit     提交当前事务\n");
+            printf("abort      丢弃当前事务中尚未提交的修改\n");
+            printf("stats [on|off|reset]   显示/开启/关闭/清零运行统计（I/O、缓存、分配器和各命令的延迟）\n");
+            printf("stats json [file]      以 JSON 格式输出运行统计\n");
+            printf("format [text|ndjson|csv]   设置 ls、ls_root、tree、find 和 dump_inode 的输出格式，不带参数时显示当前格式\n");
+            printf("trace start <file>     把之后的块读写记录到跟踪文件（用 ext2replay 回放）\n");
+            printf("trace stop             停止记录\n");
+            printf("cow        显示写时复制覆盖层的状态\n");
+            printf("cow on     之后的写入只进入覆盖层（<镜像名>.cow），镜像保持不变\n");
+            printf("cow commit     把覆盖层中的修改写回镜像\n");
+            printf("cow discard    丢弃覆盖层中的全部修改\n");
+            printf("disk       显示虚拟磁盘的格式（裸镜像、VMDK 描述符/稀疏/流优化）和区段\n");
+            printf("export_meta <file>     把元数据（不含普通文件数据）导出为稀疏 VMDK，可直接打开分析\n");
+            printf("index      显示命名空间索引（<镜像名>.idx）的状态\n");
+            printf("index build    全盘扫描，重新建立命名空间索引\n");
+            printf("path <path>    按绝对路径查找 inode 及其区段（第一次使用时建立索引）\n");
+            printf("name <inode>   显示 inode 的完整路径\n");
+            printf("find [-name 通配符] [-regex 正则] [-type f|d|l|c|b|p|s] [-size +N|-N|N[k|M|G]]\n");
+            printf("     [-mtime|-ctime +天|-天] [-mmin ±分钟] [-j 线程数]   并行扫描 inode 表和目录块查找文件\n");
+            printf("owner <block>   显示块的属主（inode 和逻辑块号，或元数据类型），块号可用 0x 前缀\n");
+            printf("check      对照块位图检查泄漏、未标记和被重复引用的块\n");
+            printf("undelete_scan [-j 线程数] [-m 最低可信度]   扫描全部 inode 表，按可信度列出可恢复的已删除文件\n");
+            printf("recover <inode> <host_path>   把已删除 inode 的数据写到主机文件，已被重用的块写 0\n");
+            printf("hash [-a sha256|xxh3] [-j 线程数] [-o 清单文件] [路径]   计算路径下全部普通文件的摘要（sha256sum 格式），并列出重复文件\n");
+            printf("dedup_report [-j 线程数]   为全部已分配的数据块计算指纹，统计重复块和按文件、目录可节省的空间\n");
+            printf("defrag [-n] <路径|inode>   把文件或目录下的全部普通文件搬到连续的空闲段，-n 只报告碎片\n");
+            printf("diff [-q] [-j 线程数] <另一个镜像> [分区]   比较两个镜像，列出增加(+)、删除(-)和修改(M)的路径；-q 只看分配有变化的组\n");
+            printf("parts      列出镜像中的全部分区（MBR、扩展分区中的逻辑分区、GPT）及其文件系统\n");
+            printf("df         显示当前分区的块和 inode 用量\n");
+            printf("each <find|check|undelete_scan|df> [参数...]   在镜像的全部 ext2/ext3 分区上并行执行扫描，按分区号输出\n");
+            printf("grep [-j 线程数] [-x] <模式>...   在全部已分配的块中查找字节串（-x 为十六进制），列出所在文件和偏移\n");
+        }
+
+        if (arg[0] != "stats") {
+            unsigned __int64 us = (unsigned __int64)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            ext2.stats.record_command(arg[0], us);
         }
     }
 
@@ -0,0 +1,712 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <chrono>
+#include "ext2.h"
+
+#define EXT2_ROOT_INO 2 // 根目录的 inode 号
+#define EXT2_FT_DIR   2 // 目录项中的目录类型
+
+#define NS_COMPACT_DELTAS 4096 // 修改记录超过这么多条时，关闭时合并成新的基础部分
+
+ns_index_t::ns_index_t()
+    : deltas(0), log(nullptr), map(nullptr), map_size(0), header(nullptr), inode_map(nullptr), nodes(nullptr),
+      slots(nullptr), extent_table(nullptr), names(nullptr)
+{
+#ifdef _WIN32
+    map_file = INVALID_HANDLE_VALUE;
+    map_handle = NULL;
+#endif
+}
+
+ns_index_t::~ns_index_t()
+{
+    if (log) fclose(log);
+    map_close();
+}
+
+bool ns_index_t::map_open(const std::string& p)
+{
+#ifdef _WIN32
+    map_file = CreateFileA(p.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (map_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(map_file, &size) || size.QuadPart == 0) return false;
+    map_handle = CreateFileMappingA(map_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!map_handle) return false;
+    map = (const unsigned __int8*)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+    map_size = (unsigned __int64)size.QuadPart;
+    return map != nullptr;
+#else
+    int fd = ::open(p.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // 映射在关闭文件描述符后仍然有效
+    if (m == MAP_FAILED) return false;
+    map = (const unsigned __int8*)m;
+    map_size = (unsigned __int64)st.st_size;
+    return true;
+#endif
+}
+
+void ns_index_t::map_close()
+{
+    if (!memory.empty())
+    {
+        std::vector<unsigned __int8>().swap(memory);
+        map = nullptr;
+        map_size = 0;
+        header = nullptr;
+        return;
+    }
+#ifdef _WIN32
+    if (map) UnmapViewOfFile(map);
+    if (map_handle) CloseHandle(map_handle);
+    if (map_file != INVALID_HANDLE_VALUE) CloseHandle(map_file);
+    map_handle = NULL;
+    map_file = INVALID_HANDLE_VALUE;
+#else
+    if (map) munmap((void*)map, (size_t)map_size);
+#endif
+    map = nullptr;
+    map_size = 0;
+    header = nullptr;
+}
+
+unsigned __int32 ns_index_t::hash(unsigned __int32 parent, const char* name, size_t len)
+{
+    return fnv1a(fnv1a(2166136261u, &parent, 4), name, len);
+}
+
+bool ns_index_t::open(const std::string& p, const ns_summary_t& summary, std::string* why)
+{
+    path = p;
+    if (!map_open(p))
+    {
+        *why = "";
+        return false;
+    }
+    if (!parse(summary, why)) return false;
+
+    // 重放以前会话追加的修改记录；末尾不完整的记录忽略
+    FILE* f = fopen(p.c_str(), "rb");
+    if (f && _fseeki64(f, (__int64)header->delta_offset, SEEK_SET) == 0)
+    {
+        ns_delta_t d;
+        char name[256];
+        while (fread(&d, sizeof(d), 1, f) == 1 && d.name_len <= 255 && (d.name_len == 0 || fread(name, d.name_len, 1, f) == 1))
+        {
+            apply(d, std::string(name, d.name_len));
+            deltas++;
+        }
+    }
+    if (f) fclose(f);
+    return true;
+}
+
+bool ns_index_t::open_memory(const std::vector<ns_entry_t>& entries, const ns_summary_t& summary)
+{
+    path.clear();
+    serialize(entries, summary, memory);
+    map = memory.data();
+    map_size = memory.size();
+    std::string why;
+    return parse(summary, &why);
+}
+
+bool ns_index_t::parse(const ns_summary_t& summary, std::string* why)
+{
+    header = (const ns_header_t*)map;
+    if (map_size < sizeof(ns_header_t) || header->magic != NSINDEX_MAGIC || header->version != NSINDEX_VERSION)
+    {
+        *why = "not an index file";
+        return false;
+    }
+    if (!header->clean)
+    {
+        *why = "the previous session did not close it";
+        return false;
+    }
+    if (memcmp(&header->summary, &summary, sizeof(summary)) != 0)
+    {
+        *why = "the filesystem was modified elsewhere";
+        return false;
+    }
+
+    // 各部分的位置由头部的计数决定，必须正好排满基础部分
+    unsigned __int64 off = sizeof(ns_header_t);
+    inode_map = (const unsigned __int32*)(map + off);
+    off += ((unsigned __int64)summary.inodes_count + 1) * 4;
+    nodes = (const ns_node_t*)(map + off);
+    off += (unsigned __int64)header->node_count * sizeof(ns_node_t);
+    slots = (const unsigned __int32*)(map + off);
+    off += (unsigned __int64)header->slot_count * 4;
+    extent_table = (const ns_extent_t*)(map + off);
+    off += (unsigned __int64)header->extent_count * sizeof(ns_extent_t);
+    names = (const char*)(map + off);
+    off += header->name_bytes;
+    if (off != header->delta_offset || off > map_size || (header->slot_count & (header->slot_count - 1)) != 0 ||
+        header->slot_count == 0)
+    {
+        *why = "truncated or corrupt";
+        return false;
+    }
+    return true;
+}
+
+void ns_index_t::close(const ns_summary_t& summary)
+{
+    if (log)
+    {
+        // 全部修改记录和新的 summary 落盘之后才重新标记为有效；中途失败时 clean 保持为 0，下次重建
+        unsigned __int32 clean = 1;
+        if (fflush(log) == 0 && _fseeki64(log, offsetof(ns_header_t, summary), SEEK_SET) == 0 &&
+            fwrite(&summary, sizeof(summary), 1, log) == 1 && fflush(log) == 0 &&
+            _fseeki64(log, offsetof(ns_header_t, clean), SEEK_SET) == 0)
+            fwrite(&clean, 4, 1, log);
+        fclose(log);
+        log = nullptr;
+    }
+    map_close();
+}
+
+bool ns_index_t::write(const std::string& p, const std::vector<ns_entry_t>& entries, const ns_summary_t& summary)
+{
+    std::vector<unsigned __int8> data;
+    serialize(entries, summary, data);
+
+    // 先写临时文件再替换，写到一半失败时旧索引不受影响
+    std::string tmp = p + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), data.size(), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    remove(p.c_str());
+    if (!ok || rename(tmp.c_str(), p.c_str()) != 0)
+    {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ns_index_t::serialize(const std::vector<ns_entry_t>& entries, const ns_summary_t& summary, std::vector<unsigned __int8>& out)
+{
+    ns_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.magic = NSINDEX_MAGIC;
+    h.version = NSINDEX_VERSION;
+    h.clean = 1;
+    h.summary = summary;
+    h.node_count = (unsigned __int32)entries.size();
+    h.slot_count = 16;
+    while (h.slot_count < h.node_count * 2) h.slot_count <<= 1;
+
+    std::vector<unsigned __int32> imap((size_t)summary.inodes_count + 1, 0);
+    std::vector<ns_node_t> nodes(entries.size());
+    std::vector<unsigned __int32> slots(h.slot_count, 0);
+    std::vector<ns_extent_t> extents;
+    std::string names;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const ns_entry_t& e = entries[i];
+        ns_node_t& n = nodes[i];
+        n.ino = e.ino;
+        n.parent = e.parent;
+        n.name_off = (unsigned __int32)names.size();
+        n.name_len = (unsigned __int16)e.name.size();
+        n.file_type = e.file_type;
+        n.pad = 0;
+        names += e.name;
+
+        // 硬链接共用第一个目录项的区段
+        if (e.ino <= summary.inodes_count && imap[e.ino] != 0)
+        {
+            const ns_node_t& first = nodes[imap[e.ino] - 1];
+            n.ext_first = first.ext_first;
+            n.ext_count = first.ext_count;
+        }
+        else
+        {
+            n.ext_first = (unsigned __int32)extents.size();
+            n.ext_count = (unsigned __int32)e.extents.size();
+            extents.insert(extents.end(), e.extents.begin(), e.extents.end());
+            if (e.ino <= summary.inodes_count) imap[e.ino] = (unsigned __int32)i + 1;
+        }
+
+        if (e.ino == e.parent) continue; // 根目录自身没有名字，不进哈希表
+        unsigned __int32 s = hash(e.parent, e.name.data(), e.name.size()) & (h.slot_count - 1);
+        while (slots[s] != 0) s = (s + 1) & (h.slot_count - 1);
+        slots[s] = (unsigned __int32)i + 1;
+    }
+    h.extent_count = (unsigned __int32)extents.size();
+    h.name_bytes = (unsigned __int32)names.size();
+    h.delta_offset = sizeof(h) + imap.size() * 4 + nodes.size() * sizeof(ns_node_t) + slots.size() * 4 +
+        extents.size() * sizeof(ns_extent_t) + names.size();
+
+    out.clear();
+    out.reserve((size_t)h.delta_offset);
+    auto put = [&out](const void* p, size_t n) { out.insert(out.end(), (const unsigned __int8*)p, (const unsigned __int8*)p + n); };
+    put(&h, sizeof(h));
+    put(imap.data(), imap.size() * 4);
+    put(nodes.data(), nodes.size() * sizeof(ns_node_t));
+    put(slots.data(), slots.size() * 4);
+    put(extents.data(), extents.size() * sizeof(ns_extent_t));
+    put(names.data(), names.size());
+}
+
+const ns_node_t* ns_index_t::base_lookup(unsigned __int32 parent, const char* name, size_t len)
+{
+    unsigned __int32 mask = header->slot_count - 1;
+    for (unsigned __int32 s = hash(parent, name, len) & mask; slots[s] != 0; s = (s + 1) & mask)
+    {
+        const ns_node_t* n = &nodes[slots[s] - 1];
+        if (n->parent == parent && n->name_len == len && memcmp(names + n->name_off, name, len) == 0) return n;
+    }
+    return nullptr;
+}
+
+unsigned __int32 ns_index_t::lookup(unsigned __int32 parent, const char* name, size_t len, unsigned __int8* file_type)
+{
+    if (!edge_delta.empty())
+    {
+        auto it = edge_delta.find(edge_key_t(parent, std::string(name, len)));
+        if (it != edge_delta.end())
+        {
+            if (file_type) *file_type = it->second.second;
+            return it->second.first;
+        }
+    }
+    if (reset_dirs.count(parent)) return 0;
+    const ns_node_t* n = base_lookup(parent, name, len);
+    if (!n) return 0;
+    if (file_type) *file_type = n->file_type;
+    return n->ino;
+}
+
+bool ns_index_t::name_of(unsigned __int32 ino, unsigned __int32* parent, std::string* name)
+{
+    auto it = node_delta.find(ino);
+    if (it != node_delta.end() && it->second.name_state != 0)
+    {
+        if (it->second.name_state == 2) return false;
+        *parent = it->second.parent;
+        *name = it->second.name;
+        return true;
+    }
+    if (ino > header->summary.inodes_count || inode_map[ino] == 0) return false;
+    const ns_node_t& n = nodes[inode_map[ino] - 1];
+    *parent = n.parent;
+    name->assign(names + n.name_off, n.name_len);
+    return true;
+}
+
+bool ns_index_t::dirty(unsigned __int32 ino)
+{
+    auto it = node_delta.find(ino);
+    return it != node_delta.end() && it->second.dirty;
+}
+
+bool ns_index_t::extents(unsigned __int32 ino, std::vector<ns_extent_t>& out)
+{
+    out.clear();
+    if (dirty(ino)) return false;
+    if (ino > header->summary.inodes_count || inode_map[ino] == 0) return true;
+    const ns_node_t& n = nodes[inode_map[ino] - 1];
+    out.assign(extent_table + n.ext_first, extent_table + n.ext_first + n.ext_count);
+    return true;
+}
+
+void ns_index_t::entries(std::vector<ns_entry_t>& out)
+{
+    out.clear();
+    for (unsigned __int32 i = 0; i < header->node_count; i++)
+    {
+        const ns_node_t& n = nodes[i];
+        std::string name(names + n.name_off, n.name_len);
+        if (n.ino != n.parent && (reset_dirs.count(n.parent) || edge_delta.count(edge_key_t(n.parent, name)))) continue;
+        ns_entry_t e;
+        e.ino = n.ino;
+        e.parent = n.parent;
+        e.name = name;
+        e.file_type = n.file_type;
+        extents(n.ino, e.extents);
+        out.push_back(e);
+    }
+    for (auto it = edge_delta.begin(); it != edge_delta.end(); ++it)
+    {
+        if (it->second.first == 0) continue;
+        ns_entry_t e;
+        e.ino = it->second.first;
+        e.parent = it->first.first;
+        e.name = it->first.second;
+        e.file_type = it->second.second;
+        extents(e.ino, e.extents);
+        out.push_back(e);
+    }
+}
+
+void ns_index_t::apply(const ns_delta_t& d, const std::string& name)
+{
+    switch (d.kind)
+    {
+    case NS_LINK:
+    {
+        edge_delta[edge_key_t(d.parent, name)] = std::make_pair(d.ino, d.file_type);
+        node_delta_t& nd = node_delta[d.ino];
+        if (nd.name_state != 1)
+        {
+            nd.name_state = 1;
+            nd.parent = d.parent;
+            nd.name = name;
+            nd.file_type = d.file_type;
+        }
+        nd.dirty = true; // 新建的 inode 在基础部分中没有（或只有过期的）区段
+        break;
+    }
+    case NS_UNLINK:
+    {
+        unsigned __int32 ino = lookup(d.parent, name.data(), name.size(), nullptr);
+        edge_delta[edge_key_t(d.parent, name)] = std::make_pair(0u, (unsigned __int8)0);
+        unsigned __int32 parent;
+        std::string primary;
+        if (ino && name_of(ino, &parent, &primary) && parent == d.parent && primary == name)
+        {
+            node_delta_t& nd = node_delta[ino];
+            nd.name_state = 2;
+        }
+        break;
+    }
+    case NS_TOUCH:
+        node_delta[d.ino].dirty = true;
+        break;
+    case NS_DROP:
+    {
+        node_delta_t& nd = node_delta[d.ino];
+        nd.name_state = 2;
+        nd.dirty = true;
+        reset_dirs.insert(d.ino);
+        auto first = edge_delta.lower_bound(edge_key_t(d.ino, std::string()));
+        auto last = edge_delta.lower_bound(edge_key_t(d.ino + 1, std::string()));
+        edge_delta.erase(first, last);
+        break;
+    }
+    }
+}
+
+void ns_index_t::append(const ns_delta_t& d, const char* name)
+{
+    std::string n(name ? name : "", d.name_len);
+    apply(d, n);
+    deltas++;
+
+    if (!log && !path.empty())
+    {
+        // 第一次修改：先清除 clean 标志并落盘，之后中途崩溃的会话留下的索引不会被当作有效
+        log = fopen(path.c_str(), "r+b");
+        if (!log) return;
+        unsigned __int32 clean = 0;
+        if (_fseeki64(log, offsetof(ns_header_t, clean), SEEK_SET) != 0 || fwrite(&clean, 4, 1, log) != 1 || fflush(log) != 0)
+        {
+            fclose(log);
+            log = nullptr;
+            return;
+        }
+        _fseeki64(log, 0, SEEK_END);
+    }
+    if (!log) return;
+    fwrite(&d, sizeof(d), 1, log);
+    if (d.name_len) fwrite(n.data(), d.name_len, 1, log);
+}
+
+static ns_delta_t make_delta(ns_delta_kind_t kind, unsigned __int32 ino, unsigned __int32 parent, size_t name_len, unsigned __int8 type)
+{
+    ns_delta_t d;
+    d.kind = kind;
+    d.ino = ino;
+    d.parent = parent;
+    d.name_len = (unsigned __int16)name_len;
+    d.file_type = type;
+    d.pad = 0;
+    return d;
+}
+
+void ns_index_t::link(unsigned __int32 parent, const char* name, unsigned __int32 ino, unsigned __int8 file_type)
+{
+    append(make_delta(NS_LINK, ino, parent, strlen(name), file_type), name);
+}
+
+void ns_index_t::unlink(unsigned __int32 parent, const char* name)
+{
+    append(make_delta(NS_UNLINK, 0, parent, strlen(name), 0), name);
+}
+
+void ns_index_t::touch(unsigned __int32 ino)
+{
+    if (dirty(ino)) return; // 已经需要现场计算，不必重复记录
+    append(make_delta(NS_TOUCH, ino, 0, 0, 0), nullptr);
+}
+
+void ns_index_t::drop(unsigned __int32 ino)
+{
+    append(make_delta(NS_DROP, ino, 0, 0, 0), nullptr);
+}
+
+// ---- ext2_t 中与索引有关的部分 ----
+
+ns_summary_t ext2_t::ns_summary()
+{
+    ns_summary_t s;
+    s.inodes_count = inodes_count;
+    s.wtime = super_block.s_wtime;
+    s.mnt_count = super_block.s_mnt_count;
+    s.free_blocks = super_block.s_free_blocks_count;
+    s.free_inodes = super_block.s_free_inodes_count;
+    s.layout_sum = fnv1a(fnv1a(2166136261u, super_block.s_uuid, sizeof(super_block.s_uuid)),
+        block_group_descriptor_table, sizeof(ext2_group_desc) * block_group_count);
+    return s;
+}
+
+void ext2_t::ns_open()
+{
+    if (read_only) return; // 只读方式不使用索引文件，需要时在内存中建立
+    ns = new ns_index_t;
+    std::string why;
+    if (ns->open(ns_path, ns_summary(), &why)) return;
+    delete ns;
+    ns = nullptr;
+    if (!why.empty())
+    {
+        printf("Namespace index %s is out of date (%s), it will be rebuilt on first use.\n", ns_path.c_str(), why.c_str());
+        remove(ns_path.c_str());
+    }
+}
+
+void ext2_t::ns_close()
+{
+    if (!ns) return;
+    if (read_only || ns->delta_count() < NS_COMPACT_DELTAS)
+    {
+        ns->close(ns_summary());
+    }
+    else
+    {
+        // 修改记录太多，合并成新的基础部分；区段改过的 inode 现场重新计算
+        std::vector<ns_entry_t> entries;
+        ns->entries(entries);
+        for (size_t i = 0; i < entries.size(); i++)
+            if (ns->dirty(entries[i].ino)) inode_extents(entries[i].ino, entries[i].extents);
+        delete ns; // 先解除映射，之后才能替换文件
+        ns = nullptr;
+        if (!ns_index_t::write(ns_path, entries, ns_summary())) remove(ns_path.c_str());
+    }
+    delete ns;
+    ns = nullptr;
+}
+
+void ext2_t::ns_invalidate()
+{
+    if (!ns) return;
+    delete ns;
+    ns = nullptr;
+    if (!read_only) remove(ns_path.c_str());
+}
+
+// 按块映射计算 inode 的区段；设备文件和快速符号链接没有数据块
+void ext2_t::inode_extents(unsigned __int32 ino, std::vector<ns_extent_t>& out)
+{
+    out.clear();
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (ino < 1 || ino > inodes_count || !load_inode(ino, inode)) return;
+    if (!has_block_map(inode)) return;
+
+    block_list_t blocks = new_block_list(size_in_blocks(inode));
+    collect_blocks(inode, blocks, nullptr);
+    for (unsigned __int32 i = 0; i < blocks.n; i++)
+    {
+        unsigned __int32 pb = blocks.v[i];
+        if (pb == 0) continue;
+        if (!out.empty())
+        {
+            ns_extent_t& last = out.back();
+            if (last.lblk + last.len == i && last.pblk + last.len == pb)
+            {
+                last.len++;
+                continue;
+            }
+        }
+        ns_extent_t e = { i, pb, 1 };
+        out.push_back(e);
+    }
+}
+
+// 从根目录广度优先遍历全部目录，建立并打开索引
+bool ext2_t::ns_build()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (ns)
+    {
+        delete ns;
+        ns = nullptr;
+    }
+
+    std::vector<ns_entry_t> entries;
+    std::vector<bool> seen((size_t)inodes_count + 1, false);
+    std::vector<unsigned __int32> queue;
+    ns_entry_t root;
+    root.ino = EXT2_ROOT_INO;
+    root.parent = EXT2_ROOT_INO;
+    root.file_type = EXT2_FT_DIR;
+    inode_extents(EXT2_ROOT_INO, root.extents);
+    entries.push_back(root);
+    seen[EXT2_ROOT_INO] = true;
+    queue.push_back(EXT2_ROOT_INO);
+
+    scratch_t scratch(arena());
+    unsigned __int8* data = scratch.alloc<unsigned __int8>(block_size);
+    for (size_t q = 0; q < queue.size(); q++)
+    {
+        unsigned __int32 dir = queue[q];
+        scratch_t inner(arena());
+        block_list_t blocks;
+        if (!dir_blocks(dir, blocks)) continue;
+        for (unsigned __int32 b = 0; b < blocks.n; b++)
+        {
+            if (blocks.v[b] == 0 || !load_block(blocks.v[b], data)) continue;
+            for (unsigned int off = 0; off + 8 <= block_size;)
+            {
+                const ext2_dir_entry* de = (const ext2_dir_entry*)(data + off);
+                unsigned int rec_len = rec_len_from_disk(de->rec_len);
+                if (rec_len < 8 || off + rec_len > block_size) break;
+                off += rec_len;
+                if (de->inode == 0 || de->inode > inodes_count || de->name_len == 0) continue;
+                if (de->name[0] == '.' && (de->name_len == 1 || (de->name_len == 2 && de->name[1] == '.'))) continue;
+
+                ns_entry_t e;
+                e.ino = de->inode;
+                e.parent = dir;
+                e.name.assign(de->name, de->name_len);
+                e.file_type = de->file_type;
+                if (!seen[e.ino])
+                {
+                    seen[e.ino] = true;
+                    inode_extents(e.ino, e.extents);
+                    if (e.file_type == EXT2_FT_DIR) queue.push_back(e.ino);
+                }
+                entries.push_back(e);
+            }
+        }
+    }
+
+    if (read_only)
+    {
+        ns = new ns_index_t;
+        if (ns->open_memory(entries, ns_summary())) return true;
+        delete ns;
+        ns = nullptr;
+        return false;
+    }
+    if (!ns_index_t::write(ns_path, entries, ns_summary()))
+    {
+        printf("Cannot write namespace index %s\n", ns_path.c_str());
+        return false;
+    }
+    ns = new ns_index_t;
+    std::string why;
+    if (!ns->open(ns_path, ns_summary(), &why))
+    {
+        delete ns;
+        ns = nullptr;
+        return false;
+    }
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("Indexed %zu names in %zu directories (%llu ms), %s is %llu KB\n", entries.size(), queue.size(), ms,
+        ns_path.c_str(), ns->file_size() / 1024);
+    return true;
+}
+
+void ext2_t::index_status()
+{
+    if (!ns)
+    {
+        printf("No namespace index, use \"index build\" or a path query to create %s\n", ns_path.c_str());
+        return;
+    }
+    printf("Namespace index %s: %u names, %u extents, %zu pending changes, %llu KB\n", ns_path.c_str(), ns->node_count(),
+        ns->extent_count(), ns->delta_count(), ns->file_size() / 1024);
+}
+
+// 按绝对路径查找 inode，必要时先建立索引
+unsigned __int32 ext2_t::resolve_path(const char* path, unsigned __int8* file_type)
+{
+    if (!ns && !ns_build()) return 0;
+    unsigned __int32 ino = EXT2_ROOT_INO;
+    unsigned __int8 type = EXT2_FT_DIR;
+    const char* p = path;
+    while (*p)
+    {
+        while (*p == '/') p++;
+        const char* end = p;
+        while (*end && *end != '/') end++;
+        if (end == p) break;
+        if (type != EXT2_FT_DIR) return 0;
+        ino = ns->lookup(ino, p, end - p, &type);
+        if (ino == 0) return 0;
+        p = end;
+    }
+    if (file_type) *file_type = type;
+    return ino;
+}
+
+bool ext2_t::path_of(unsigned __int32 ino, std::string& out)
+{
+    if (!ns && !ns_build()) return false;
+    out.clear();
+    // 逐级向上，每一步都用正向查找确认名字仍然有效；深度上限防止损坏的索引成环
+    for (int depth = 0; ino != EXT2_ROOT_INO; depth++)
+    {
+        unsigned __int32 parent;
+        std::string name;
+        if (depth > 4096 || !ns->name_of(ino, &parent, &name)) return false;
+        if (ns->lookup(parent, name.data(), name.size(), nullptr) != ino) return false;
+        out = "/" + name + out;
+        ino = parent;
+    }
+    if (out.empty()) out = "/";
+    return true;
+}
+
+void ext2_t::show_path(const char* path)
+{
+    unsigned __int8 type = 0;
+    unsigned __int32 ino = resolve_path(path, &type);
+    if (ino == 0)
+    {
+        printf("'%s' not found.\n", path);
+        return;
+    }
+    std::vector<ns_extent_t> ext;
+    if (!ns->extents(ino, ext)) inode_extents(ino, ext);
+    printf("%s -> inode %u (type %u), %zu extents\n", path, ino, (unsigned)type, ext.size());
+    for (size_t i = 0; i < ext.size() && i < 16; i++)
+        printf("  [%u, +%u) -> block %u\n", ext[i].lblk, ext[i].len, ext[i].pblk);
+    if (ext.size() > 16) printf("  ...\n");
+}
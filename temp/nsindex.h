@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "platform.h"
+
+// 持久化的命名空间索引（<镜像名>.idx）：路径 -> inode、inode -> 父目录和名字、inode -> 区段列表。
+// 第一次需要时全盘扫描建立，之后的会话直接把文件映射到内存，查询不再读目录块。
+//
+// 文件格式：ns_header_t，之后依次是
+//   inode 表   unsigned __int32[inodes_count + 1]，inode 号 -> 主目录项序号 + 1（0 表示没有）
+//   目录项     ns_node_t[node_count]，每个名字一项（硬链接有多项）
+//   哈希槽     unsigned __int32[slot_count]，按 (父目录, 名字) 开放寻址，存目录项序号 + 1
+//   区段       ns_extent_t[extent_count]
+//   名字       name_bytes 字节
+// 基础部分之后追加本工具自己的修改（ns_delta_t 记录），打开时重放到内存中。
+//
+// 有效性：头部保存建立/上次正常关闭时超级块的 s_wtime、s_mnt_count 和空闲计数；
+// 第一次修改前先把 clean 清零，正常关闭时再写回新的计数。被其他系统挂载修改过、
+// 或本工具中途崩溃的镜像都对不上，索引作废后重新扫描。
+
+#define NSINDEX_MAGIC   0x58534E45 // "ENSX"
+#define NSINDEX_VERSION 1
+
+#pragma pack(push, 1)
+
+struct ns_summary_t
+{
+    unsigned __int32 inodes_count;
+    unsigned __int32 wtime;
+    unsigned __int32 mnt_count;
+    unsigned __int32 free_blocks;
+    unsigned __int32 free_inodes;
+    unsigned __int32 layout_sum; // 卷 UUID 和组描述符表的校验和，区分重新生成的同样大小的镜像
+};
+
+struct ns_header_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 version;
+    unsigned __int32 clean;   // 1 表示 summary 与镜像一致
+    ns_summary_t summary;
+    unsigned __int32 node_count;
+    unsigned __int32 slot_count; // 2 的幂
+    unsigned __int32 extent_count;
+    unsigned __int32 name_bytes;
+    unsigned __int64 delta_offset; // 基础部分的长度，修改记录从这里开始
+};
+
+struct ns_node_t
+{
+    unsigned __int32 ino;
+    unsigned __int32 parent;
+    unsigned __int32 name_off;
+    unsigned __int16 name_len;
+    unsigned __int8 file_type;
+    unsigned __int8 pad;
+    unsigned __int32 ext_first;
+    unsigned __int32 ext_count;
+};
+
+struct ns_extent_t
+{
+    unsigned __int32 lblk; // 逻辑块号
+    unsigned __int32 pblk; // 物理块号，0 表示空洞
+    unsigned __int32 len;
+};
+
+enum ns_delta_kind_t
+{
+    NS_LINK = 1,   // 新目录项 (parent, name) -> ino
+    NS_UNLINK = 2, // 删除目录项 (parent, name)
+    NS_TOUCH = 3,  // ino 的块映射变了
+    NS_DROP = 4,   // ino 被释放；它作为目录时的全部子项一并失效
+};
+
+struct ns_delta_t
+{
+    unsigned __int32 kind;
+    unsigned __int32 ino;
+    unsigned __int32 parent;
+    unsigned __int16 name_len; // 之后紧跟名字
+    unsigned __int8 file_type;
+    unsigned __int8 pad;
+};
+
+#pragma pack(pop)
+
+// 建立索引时的一项
+struct ns_entry_t
+{
+    unsigned __int32 ino;
+    unsigned __int32 parent;
+    std::string name;
+    unsigned __int8 file_type;
+    std::vector<ns_extent_t> extents;
+};
+
+class ns_index_t
+{
+public:
+    ns_index_t();
+    ~ns_index_t();
+
+    // 映射已有的索引并重放修改记录；文件不存在或与 summary 不符时返回 false
+    bool open(const std::string& path, const ns_summary_t& summary, std::string* why);
+    bool open_memory(const std::vector<ns_entry_t>& entries, const ns_summary_t& summary); // 不落盘，只在内存中建立
+    void close(const ns_summary_t& summary); // 有修改时写回 summary 并标记 clean
+    static bool write(const std::string& path, const std::vector<ns_entry_t>& entries, const ns_summary_t& summary);
+
+    unsigned __int32 lookup(unsigned __int32 parent, const char* name, size_t len, unsigned __int8* file_type);
+    bool name_of(unsigned __int32 ino, unsigned __int32* parent, std::string* name); // 主目录项
+    bool extents(unsigned __int32 ino, std::vector<ns_extent_t>& out); // 块映射改过时返回 false，由调用者现场计算
+    void entries(std::vector<ns_entry_t>& out); // 合并修改后的全部目录项，区段改过的项 extents 为空
+    bool dirty(unsigned __int32 ino);
+
+    void link(unsigned __int32 parent, const char* name, unsigned __int32 ino, unsigned __int8 file_type);
+    void unlink(unsigned __int32 parent, const char* name);
+    void touch(unsigned __int32 ino);
+    void drop(unsigned __int32 ino);
+
+    unsigned __int32 node_count() const { return header ? header->node_count : 0; }
+    unsigned __int32 extent_count() const { return header ? header->extent_count : 0; }
+    size_t delta_count() const { return deltas; }
+    unsigned __int64 file_size() const { return map_size; }
+
+private:
+    // 修改记录重放后的内存状态，查询时优先于映射的基础部分
+    struct node_delta_t
+    {
+        int name_state; // 0 沿用基础部分，1 使用下面的名字，2 没有名字（已删除）
+        unsigned __int32 parent;
+        std::string name;
+        unsigned __int8 file_type;
+        bool dirty; // 块映射改过
+    };
+    typedef std::pair<unsigned __int32, std::string> edge_key_t;
+    std::map<edge_key_t, std::pair<unsigned __int32, unsigned __int8>> edge_delta; // ino 为 0 表示已删除
+    std::map<unsigned __int32, node_delta_t> node_delta;
+    std::set<unsigned __int32> reset_dirs; // 被释放过的目录，基础部分中以它为父目录的项全部无效
+    size_t deltas;
+
+    std::string path; // 内存中的索引为空，修改只进内存
+    FILE* log; // 追加修改记录，第一次修改时打开
+    std::vector<unsigned __int8> memory; // open_memory 建立的索引内容，map 指向这里
+    const unsigned __int8* map;
+    unsigned __int64 map_size;
+#ifdef _WIN32
+    void* map_file;
+    void* map_handle;
+#endif
+    const ns_header_t* header;
+    const unsigned __int32* inode_map;
+    const ns_node_t* nodes;
+    const unsigned __int32* slots;
+    const ns_extent_t* extent_table;
+    const char* names;
+
+    bool map_open(const std::string& path);
+    void map_close();
+    bool parse(const ns_summary_t& summary, std::string* why); // 校验头部并定位各部分
+    static void serialize(const std::vector<ns_entry_t>& entries, const ns_summary_t& summary, std::vector<unsigned __int8>& out);
+    void apply(const ns_delta_t& d, const std::string& name);
+    void append(const ns_delta_t& d, const char* name);
+    const ns_node_t* base_lookup(unsigned __int32 parent, const char* name, size_t len);
+    static unsigned __int32 hash(unsigned __int32 parent, const char* name, size_t len);
+
+    ns_index_t(const ns_index_t&);
+    ns_index_t& operator=(const ns_index_t&);
+};
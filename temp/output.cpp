@@ -0,0 +1,213 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <string.h>
+#include "output.h"
+
+// ---- out_writer_t ----
+
+out_writer_t::out_writer_t(FILE* f) : fp(f), buf(OUT_BUFFER_BYTES), used(0)
+{
+}
+
+out_writer_t& out_writer_t::put(const char* s, size_t len)
+{
+    while (len > 0)
+    {
+        if (used == buf.size()) flush();
+        size_t n = buf.size() - used < len ? buf.size() - used : len;
+        memcpy(buf.data() + used, s, n);
+        used += n;
+        s += n;
+        len -= n;
+    }
+    return *this;
+}
+
+// 两位一组查表转换
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static size_t format_u64(unsigned __int64 v, char* end)
+{
+    char* p = end;
+    while (v >= 100)
+    {
+        unsigned d = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[d + 1];
+        *--p = digit_pairs[d];
+    }
+    if (v >= 10)
+    {
+        *--p = digit_pairs[v * 2 + 1];
+        *--p = digit_pairs[v * 2];
+    }
+    else *--p = (char)('0' + v);
+    return (size_t)(end - p);
+}
+
+out_writer_t& out_writer_t::put_u64(unsigned __int64 v)
+{
+    char tmp[20];
+    size_t n = format_u64(v, tmp + sizeof(tmp));
+    return put(tmp + sizeof(tmp) - n, n);
+}
+
+out_writer_t& out_writer_t::put_hex(unsigned __int64 v, int width)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char tmp[16];
+    int n = 0;
+    do
+    {
+        tmp[15 - n++] = hex[v & 15];
+        v >>= 4;
+    } while (v && n < 16);
+    while (n < width && n < 16) tmp[15 - n++] = '0';
+    return put(tmp + 16 - n, (size_t)n);
+}
+
+out_writer_t& out_writer_t::put_left(const char* s, size_t len, size_t width)
+{
+    put(s, len);
+    for (; len < width; len++) put(' ');
+    return *this;
+}
+
+out_writer_t& out_writer_t::put_u64_left(unsigned __int64 v, size_t width)
+{
+    char tmp[20];
+    size_t n = format_u64(v, tmp + sizeof(tmp));
+    return put_left(tmp + sizeof(tmp) - n, n, width);
+}
+
+out_writer_t& out_writer_t::put_u64_right(unsigned __int64 v, size_t width)
+{
+    char tmp[20];
+    size_t n = format_u64(v, tmp + sizeof(tmp));
+    for (size_t k = n; k < width; k++) put(' ');
+    return put(tmp + sizeof(tmp) - n, n);
+}
+
+void out_writer_t::flush()
+{
+    if (used) fwrite(buf.data(), 1, used, fp);
+    used = 0;
+}
+
+// ---- record_writer_t ----
+
+void record_writer_t::emit(const char* s, size_t len)
+{
+    if (format == OUT_CSV && rows == 0) first_row.append(s, len);
+    else out.put(s, len);
+}
+
+void record_writer_t::key(const char* name)
+{
+    if (format == OUT_NDJSON)
+    {
+        out.put(fields == 0 ? "{\"" : ",\"").put(name).put("\":");
+    }
+    else
+    {
+        if (fields > 0) emit(",", 1);
+        if (rows == 0)
+        {
+            if (fields > 0) header += ',';
+            header += name;
+        }
+    }
+    fields++;
+}
+
+void record_writer_t::quoted(const char* s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (format == OUT_NDJSON)
+    {
+        out.put('"');
+        for (size_t i = 0; i < len; i++)
+        {
+            unsigned char c = (unsigned char)s[i];
+            if (c == '"' || c == '\\') out.put('\\').put((char)c);
+            else if (c >= 0x20) out.put((char)c);
+            else if (c == '\n') out.put("\\n", 2);
+            else if (c == '\t') out.put("\\t", 2);
+            else out.put("\\u00", 4).put(hex[c >> 4]).put(hex[c & 15]);
+        }
+        out.put('"');
+        return;
+    }
+    // CSV：含逗号、引号或换行时加引号，引号写两次
+    bool plain = true;
+    for (size_t i = 0; i < len && plain; i++) plain = s[i] != ',' && s[i] != '"' && s[i] != '\n' && s[i] != '\r';
+    if (plain)
+    {
+        emit(s, len);
+        return;
+    }
+    emit("\"", 1);
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] == '"') emit("\"", 1);
+        emit(s + i, 1);
+    }
+    emit("\"", 1);
+}
+
+void record_writer_t::field(const char* name, unsigned __int64 v)
+{
+    key(name);
+    if (format == OUT_NDJSON || rows > 0)
+    {
+        out.put_u64(v);
+        return;
+    }
+    char tmp[20];
+    size_t n = format_u64(v, tmp + sizeof(tmp));
+    emit(tmp + sizeof(tmp) - n, n);
+}
+
+void record_writer_t::field(const char* name, const char* s, size_t len)
+{
+    key(name);
+    quoted(s, len);
+}
+
+void record_writer_t::end()
+{
+    if (format == OUT_NDJSON)
+    {
+        out.put(fields ? "}\n" : "{}\n");
+    }
+    else if (rows == 0)
+    {
+        out.put(header).put('\n').put(first_row).put('\n');
+        first_row.clear();
+    }
+    else out.put('\n');
+    rows++;
+}
+
+bool parse_out_format(const char* s, out_format_t& f)
+{
+    if (strcmp(s, "text") == 0) f = OUT_TEXT;
+    else if (strcmp(s, "ndjson") == 0 || strcmp(s, "json") == 0) f = OUT_NDJSON;
+    else if (strcmp(s, "csv") == 0) f = OUT_CSV;
+    else return false;
+    return true;
+}
+
+const char* out_format_name(out_format_t f)
+{
+    return f == OUT_NDJSON ? "ndjson" : f == OUT_CSV ? "csv" : "text";
+}
+
+const char* file_type_name(unsigned type)
+{
+    static const char* const names[] = { "unknown", "file", "dir", "chr", "blk", "fifo", "sock", "link" };
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "unknown";
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "platform.h"
+
+// 列表类命令的输出：先写进自己的大缓冲区，满了才 fwrite 一次；整数直接转换，不经过 printf 的格式解析。
+// 同一时刻只应有一个写出器在往 stdout 写，析构时自动刷出。
+
+#define OUT_BUFFER_BYTES (1u << 20)
+
+enum out_format_t
+{
+    OUT_TEXT,   // 各命令原有的文本格式
+    OUT_NDJSON, // 每条记录一行 JSON 对象
+    OUT_CSV     // 第一条记录前输出表头
+};
+
+class out_writer_t
+{
+public:
+    explicit out_writer_t(FILE* f = stdout);
+    ~out_writer_t() { flush(); }
+    out_writer_t& put(char c)
+    {
+        if (used == buf.size()) flush();
+        buf[used++] = c;
+        return *this;
+    }
+    out_writer_t& put(const char* s, size_t len);
+    out_writer_t& put(const char* s) { return put(s, strlen(s)); }
+    out_writer_t& put(const std::string& s) { return put(s.data(), s.size()); }
+    out_writer_t& put_u64(unsigned __int64 v);
+    out_writer_t& put_hex(unsigned __int64 v, int width); // 大写，不足 width 位时左补 0
+    out_writer_t& put_left(const char* s, size_t len, size_t width); // 左对齐，不足 width 时右补空格（%-Ns）
+    out_writer_t& put_u64_left(unsigned __int64 v, size_t width);
+    out_writer_t& put_u64_right(unsigned __int64 v, size_t width); // 右对齐（%Nu）
+    void flush();
+
+private:
+    FILE* fp;
+    std::vector<char> buf;
+    size_t used;
+};
+
+// 结构化记录：begin、若干 field、end 为一条。文本格式不经过这里，由各命令自己排版
+class record_writer_t
+{
+public:
+    record_writer_t(out_writer_t& w, out_format_t f) : out(w), format(f), rows(0), fields(0) {}
+    void begin() { fields = 0; }
+    void field(const char* name, unsigned __int64 v);
+    void field(const char* name, const char* s, size_t len);
+    void field(const char* name, const char* s) { field(name, s, strlen(s)); }
+    void field(const char* name, const std::string& s) { field(name, s.data(), s.size()); }
+    void end();
+
+private:
+    void emit(const char* s, size_t len); // CSV 的第一条记录先攒在 first_row 中
+    void key(const char* name);
+    void quoted(const char* s, size_t len);
+    out_writer_t& out;
+    out_format_t format;
+    unsigned __int64 rows;
+    unsigned fields;       // 本条记录已输出的字段数
+    std::string header;    // CSV 的表头，在第一条记录结束时输出
+    std::string first_row; // CSV 的第一条记录，等表头确定后再输出
+};
+
+bool parse_out_format(const char* s, out_format_t& f);
+const char* out_format_name(out_format_t f);
+const char* file_type_name(unsigned type); // 目录项类型（EXT2_FT_*）在结构化输出中的名字
@@ -0,0 +1,404 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include "ext2.h"
+
+// 写时复制覆盖层（<镜像名>.cow）格式：
+//   cow_header_t
+//   若干 { unsigned __int32 粒度号; COW_GRAIN 字节数据 }
+// 每个粒度第一次被写时追加一条记录（不足一个粒度的写入先从镜像读出整个粒度），
+// 之后的修改原地覆盖该记录，因此旁路文件的大小只与被修改过的粒度数成正比。
+// 打开时顺序扫描记录重建索引；末尾不完整的记录（追加途中崩溃）被忽略。
+// cow commit 回写前先把魔数改成 COW_MAGIC_COMMITTING 并落盘：回写到一半时镜像开头已经变了，指纹对不上，
+// 打开时见到这个魔数就跳过指纹检查，先把回写做完再继续。
+
+#define COW_MAGIC   0x57433245 // "E2CW"
+#define COW_MAGIC_COMMITTING 0x43433245 // "E2CC"，正在回写
+#define COW_VERSION 1
+#define COW_GRAIN   4096       // 与文件系统块大小无关：超级块在块大小确定之前就要经过覆盖层读取
+
+struct cow_header_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 version;
+    unsigned __int32 grain;
+    unsigned __int32 fingerprint; // 创建时镜像中分区第一个粒度（含超级块）的校验和
+    unsigned __int64 base;        // 分区在镜像中的字节偏移
+    unsigned __int64 image_size;  // 创建时镜像文件的大小
+};
+
+// 覆盖层存在期间镜像本身不会被修改，所以用分区开头的内容和镜像大小识别覆盖层属于哪个镜像，
+// 防止把旧覆盖层叠加到重新生成或被其他工具改写过的镜像上
+unsigned __int32 ext2_t::cow_fingerprint()
+{
+    unsigned __int8 data[COW_GRAIN];
+    memset(data, 0, COW_GRAIN);
+    unsigned __int64 abs = (unsigned __int64)partition_start * 512;
+    size_t avail = abs >= image_size ? 0 : (image_size - abs < COW_GRAIN ? (size_t)(image_size - abs) : COW_GRAIN);
+    if (avail && !base_read(0, data, avail)) return 0;
+    return fnv1a(2166136261u, data, COW_GRAIN);
+}
+
+bool ext2_t::cow_open()
+{
+    cow_index.clear();
+    cow_fp = fopen(cow_path.c_str(), "r+b");
+    if (!cow_fp) return cow_reset();
+
+    cow_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, cow_fp) == 1;
+    bool committing = ok && header.magic == COW_MAGIC_COMMITTING;
+    if (!ok || (header.magic != COW_MAGIC && !committing) || header.version != COW_VERSION ||
+        header.grain != COW_GRAIN || header.base != (unsigned __int64)partition_start * 512)
+    {
+        printf("%s is not an overlay of this partition\n", cow_path.c_str());
+        fclose(cow_fp);
+        cow_fp = nullptr;
+        return false;
+    }
+    if (header.image_size != image_size || (!committing && header.fingerprint != cow_fingerprint()))
+    {
+        printf("%s does not match %s (the image was changed after the overlay was created)\n", cow_path.c_str(), image_path.c_str());
+        fclose(cow_fp);
+        cow_fp = nullptr;
+        return false;
+    }
+
+    _fseeki64(cow_fp, 0, SEEK_END);
+    unsigned __int64 size = (unsigned __int64)_ftelli64(cow_fp);
+    unsigned __int64 count = (size - sizeof(header)) / (4 + COW_GRAIN);
+    cow_end = sizeof(header);
+    for (unsigned __int64 i = 0; i < count; i++)
+    {
+        unsigned __int32 grain;
+        if (_fseeki64(cow_fp, cow_end, SEEK_SET) != 0 || fread(&grain, 4, 1, cow_fp) != 1) break;
+        cow_index[grain] = cow_end + 4;
+        cow_end += 4 + COW_GRAIN;
+    }
+    if (committing)
+    {
+        // 上次 cow commit 回写途中中断：镜像处于半新半旧的状态，覆盖层仍然完整，重新回写一遍
+        printf("Overlay %s was being committed when the last session ended, finishing the write-back\n", cow_path.c_str());
+        size_t count = cow_index.size();
+        if (cow_write_back()) printf("Committed %zu blocks to %s.\n", count, image_path.c_str());
+        return cow_fp != nullptr; // 回写失败时覆盖层保留，读取照常经过覆盖层
+    }
+    if (!cow_index.empty()) printf("Using overlay %s (%zu blocks modified)\n", cow_path.c_str(), cow_index.size());
+    return true;
+}
+
+bool ext2_t::cow_reset()
+{
+    if (cow_fp) fclose(cow_fp);
+    cow_index.clear();
+    cow_fp = fopen(cow_path.c_str(), "w+b");
+    if (!cow_fp)
+    {
+        printf("Cannot create overlay %s\n", cow_path.c_str());
+        return false;
+    }
+
+    cow_header_t header;
+    header.magic = COW_MAGIC;
+    header.version = COW_VERSION;
+    header.grain = COW_GRAIN;
+    header.fingerprint = cow_fingerprint();
+    header.base = (unsigned __int64)partition_start * 512;
+    header.image_size = image_size;
+    cow_end = sizeof(header);
+    if (fwrite(&header, sizeof(header), 1, cow_fp) != 1 || fflush(cow_fp) != 0)
+    {
+        printf("Cannot write overlay %s\n", cow_path.c_str());
+        fclose(cow_fp);
+        cow_fp = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ext2_t::cow_read(unsigned __int64 off, void* buf, size_t len)
+{
+    unsigned __int8* dst = (unsigned __int8*)buf;
+    while (len > 0)
+    {
+        unsigned __int32 grain = (unsigned __int32)(off / COW_GRAIN);
+        auto it = cow_index.lower_bound(grain);
+        if (it == cow_index.end() || it->first != grain)
+        {
+            // 到下一个被覆盖的粒度之前都直接读镜像
+            unsigned __int64 stop = it == cow_index.end() ? off + len : (unsigned __int64)it->first * COW_GRAIN;
+            size_t n = stop - off < len ? (size_t)(stop - off) : len;
+            if (!base_read(off, dst, n)) return false;
+            dst += n;
+            off += n;
+            len -= n;
+            continue;
+        }
+
+        unsigned __int32 in_grain = (unsigned __int32)(off % COW_GRAIN);
+        size_t n = COW_GRAIN - in_grain < len ? COW_GRAIN - in_grain : len;
+        EXT2_STAT(STAT_COW_READS, 1);
+        if (!read_at(cow_fp, it->second + in_grain, dst, n)) return false;
+        dst += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool ext2_t::cow_write(unsigned __int64 off, const void* buf, size_t len)
+{
+    const unsigned __int8* src = (const unsigned __int8*)buf;
+    unsigned __int8 data[COW_GRAIN];
+    while (len > 0)
+    {
+        unsigned __int32 grain = (unsigned __int32)(off / COW_GRAIN);
+        unsigned __int32 in_grain = (unsigned __int32)(off % COW_GRAIN);
+        size_t n = COW_GRAIN - in_grain < len ? COW_GRAIN - in_grain : len;
+        EXT2_STAT(STAT_COW_WRITES, 1);
+
+        auto it = cow_index.find(grain);
+        if (it != cow_index.end())
+        {
+            if (_fseeki64(cow_fp, it->second + in_grain, SEEK_SET) != 0 || fwrite(src, n, 1, cow_fp) != 1) return false;
+        }
+        else
+        {
+            // 第一次修改这个粒度：补齐镜像中的原内容（镜像末尾之外按 0 处理）后追加
+            if (n < COW_GRAIN)
+            {
+                memset(data, 0, COW_GRAIN);
+                unsigned __int64 start = (unsigned __int64)grain * COW_GRAIN;
+                unsigned __int64 abs = (unsigned __int64)partition_start * 512 + start;
+                size_t avail = abs >= image_size ? 0 : (image_size - abs < COW_GRAIN ? (size_t)(image_size - abs) : COW_GRAIN);
+                if (avail && !base_read(start, data, avail)) return false;
+            }
+            memcpy(data + in_grain, src, n);
+            if (_fseeki64(cow_fp, cow_end, SEEK_SET) != 0 || fwrite(&grain, 4, 1, cow_fp) != 1 ||
+                fwrite(data, COW_GRAIN, 1, cow_fp) != 1)
+                return false;
+            cow_index[grain] = cow_end + 4;
+            cow_end += 4 + COW_GRAIN;
+        }
+        src += n;
+        off += n;
+        len -= n;
+    }
+    return fflush(cow_fp) == 0; // cow_read 按位置读，不经过 stdio 的缓冲
+}
+
+bool ext2_t::cow_load()
+{
+    FILE* f = fopen(cow_path.c_str(), "rb");
+    if (!f) return true;
+
+    // 与 cow_open 相同的检查；正在提交的覆盖层内容完整，照样叠加，只是不替它回写
+    cow_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    bool committing = ok && header.magic == COW_MAGIC_COMMITTING;
+    if (!ok || (header.magic != COW_MAGIC && !committing) || header.version != COW_VERSION ||
+        header.grain != COW_GRAIN || header.base != (unsigned __int64)partition_start * 512 ||
+        header.image_size != image_size || (!committing && header.fingerprint != cow_fingerprint()))
+    {
+        printf("%s does not match %s, cannot open it read-only\n", cow_path.c_str(), image_path.c_str());
+        fclose(f);
+        return false;
+    }
+
+    unsigned __int32 grain;
+    std::vector<unsigned __int8> data(COW_GRAIN);
+    while (fread(&grain, 4, 1, f) == 1 && fread(data.data(), COW_GRAIN, 1, f) == 1) mem_grains[grain] = data;
+    fclose(f);
+    return true;
+}
+
+bool ext2_t::mem_read(unsigned __int64 off, void* buf, size_t len)
+{
+    unsigned __int8* dst = (unsigned __int8*)buf;
+    while (len > 0)
+    {
+        unsigned __int32 grain = (unsigned __int32)(off / COW_GRAIN);
+        auto it = mem_grains.lower_bound(grain);
+        if (it == mem_grains.end() || it->first != grain)
+        {
+            unsigned __int64 stop = it == mem_grains.end() ? off + len : (unsigned __int64)it->first * COW_GRAIN;
+            size_t n = stop - off < len ? (size_t)(stop - off) : len;
+            if (!base_read(off, dst, n)) return false;
+            dst += n;
+            off += n;
+            len -= n;
+            continue;
+        }
+
+        unsigned __int32 in_grain = (unsigned __int32)(off % COW_GRAIN);
+        size_t n = COW_GRAIN - in_grain < len ? COW_GRAIN - in_grain : len;
+        memcpy(dst, it->second.data() + in_grain, n);
+        dst += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool ext2_t::mem_write(unsigned __int64 off, const void* buf, size_t len)
+{
+    const unsigned __int8* src = (const unsigned __int8*)buf;
+    while (len > 0)
+    {
+        unsigned __int32 grain = (unsigned __int32)(off / COW_GRAIN);
+        unsigned __int32 in_grain = (unsigned __int32)(off % COW_GRAIN);
+        size_t n = COW_GRAIN - in_grain < len ? COW_GRAIN - in_grain : len;
+
+        auto it = mem_grains.find(grain);
+        if (it == mem_grains.end())
+        {
+            // 第一次修改这个粒度：先取镜像中的原内容（镜像末尾之外按 0 处理）
+            std::vector<unsigned __int8> data(COW_GRAIN, 0);
+            unsigned __int64 start = (unsigned __int64)grain * COW_GRAIN;
+            unsigned __int64 abs = (unsigned __int64)partition_start * 512 + start;
+            size_t avail = abs >= image_size ? 0 : (image_size - abs < COW_GRAIN ? (size_t)(image_size - abs) : COW_GRAIN);
+            if (n < COW_GRAIN && avail && !base_read(start, data.data(), avail)) return false;
+            it = mem_grains.insert(std::make_pair(grain, std::move(data))).first;
+        }
+        memcpy(it->second.data() + in_grain, src, n);
+        src += n;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool ext2_t::sync_image()
+{
+    if (read_only) return true;
+    if (cow_fp) return sync_file(cow_fp);
+    return disk ? disk->sync() : sync_file(fp);
+}
+
+bool ext2_t::cow_enable()
+{
+    if (cow_fp) return true;
+    if (read_only)
+    {
+        printf("%s is opened read-only.\n", image_path.c_str());
+        return false;
+    }
+    if (!cow_open()) return false;
+    printf("Overlay enabled, writes go to %s\n", cow_path.c_str());
+    return true;
+}
+
+bool ext2_t::cow_commit()
+{
+    if (!cow_fp)
+    {
+        printf("Overlay is not enabled.\n");
+        return false;
+    }
+    if (txn_depth > 0 || !txn_dirty.empty())
+    {
+        printf("Commit or abort the current transaction first.\n");
+        return false;
+    }
+    if (cow_index.empty())
+    {
+        printf("Overlay is empty.\n");
+        return true;
+    }
+
+    size_t count = cow_index.size();
+    if (!cow_write_back()) return false;
+    printf("Committed %zu blocks to %s.\n", count, image_path.c_str());
+    return true;
+}
+
+bool ext2_t::cow_write_back()
+{
+    // VMDK 容器另外以读写方式打开一份，只有全部区段都是 FLAT 时才能回写
+    FILE* base = nullptr;
+    vdisk_t* target = nullptr;
+    if (disk)
+    {
+        target = new vdisk_t(stats);
+        if (!target->open(image_path.c_str(), true) || !target->writable())
+        {
+            printf("%s has sparse extents, the overlay cannot be written back\n", image_path.c_str());
+            delete target;
+            return false;
+        }
+    }
+    else if (!(base = fopen(image_path.c_str(), "r+b")))
+    {
+        printf("Cannot open %s for writing\n", image_path.c_str());
+        return false;
+    }
+
+    // 先把覆盖层标记为正在提交并落盘，之后任何时刻崩溃，下次打开都会把回写做完
+    unsigned __int32 magic = COW_MAGIC_COMMITTING;
+    bool ok = _fseeki64(cow_fp, 0, SEEK_SET) == 0 && fwrite(&magic, 4, 1, cow_fp) == 1 && sync_file(cow_fp);
+
+    unsigned __int8 data[COW_GRAIN];
+    for (auto it = cow_index.begin(); ok && it != cow_index.end(); ++it)
+    {
+        unsigned __int64 abs = (unsigned __int64)partition_start * 512 + (unsigned __int64)it->first * COW_GRAIN;
+        if (abs >= image_size) continue;
+        size_t n = image_size - abs < COW_GRAIN ? (size_t)(image_size - abs) : COW_GRAIN;
+        ok = _fseeki64(cow_fp, it->second, SEEK_SET) == 0 && fread(data, COW_GRAIN, 1, cow_fp) == 1;
+        if (target) ok = ok && target->write(abs, data, n);
+        else ok = ok && _fseeki64(base, abs, SEEK_SET) == 0 && fwrite(data, n, 1, base) == 1;
+    }
+    if (target)
+    {
+        ok = ok && target->sync();
+        delete target;
+    }
+    else
+    {
+        ok = ok && sync_file(base);
+        ok = fclose(base) == 0 && ok;
+    }
+    if (!ok)
+    {
+        printf("Failed to write overlay back to %s, overlay kept.\n", image_path.c_str());
+        return false;
+    }
+
+    io_dir = 0; // 镜像在 fp 之外被修改，丢弃 stdio 的读缓冲
+    return cow_reset();
+}
+
+bool ext2_t::cow_discard()
+{
+    if (!cow_fp)
+    {
+        printf("Overlay is not enabled.\n");
+        return false;
+    }
+    if (txn_depth > 0 || !txn_dirty.empty())
+    {
+        printf("Commit or abort the current transaction first.\n");
+        return false;
+    }
+
+    size_t count = cow_index.size();
+    if (!cow_reset()) return false;
+    dir_slot_map.clear(); // 缓存和内存中的空闲计数反映的是被丢弃的修改
+    index_cache.clear();
+    reload_summary();
+    ns_invalidate();
+    owners_reset();
+    printf("Discarded %zu modified blocks.\n", count);
+    return true;
+}
+
+void ext2_t::cow_status()
+{
+    if (!cow_fp)
+    {
+        printf("Overlay disabled, writes go directly to %s\n", image_path.c_str());
+        return;
+    }
+    printf("Overlay %s: %zu blocks of %u bytes modified (%llu KB)\n", cow_path.c_str(), cow_index.size(), COW_GRAIN,
+        (unsigned __int64)cow_index.size() * COW_GRAIN / 1024);
+}
@@ -0,0 +1,351 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "ext2.h"
+#include "parallel.h"
+
+#define CHECK_SHOW 10 // check 每类问题最多列出的块段数
+
+// ---- owner_map_t ----
+
+static bool same_run(const owner_extent_t& a, const owner_extent_t& b)
+{
+    if (a.pblk + a.len != b.pblk || a.kind != b.kind || a.owner != b.owner) return false;
+    if (owner_map_t::is_data(a.kind)) return a.lblk + a.len == b.lblk;
+    return a.kind != OWN_INDIRECT && a.kind != OWN_XATTR; // 元数据按组合并
+}
+
+void owner_map_t::build(std::vector<owner_extent_t>& all)
+{
+    std::sort(all.begin(), all.end(), [](const owner_extent_t& x, const owner_extent_t& y) {
+        return x.pblk != y.pblk ? x.pblk < y.pblk : x.owner < y.owner;
+    });
+    items.clear();
+    overlaps.clear();
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        owner_extent_t e = all[i];
+        if (!items.empty())
+        {
+            owner_extent_t& last = items.back();
+            unsigned __int32 last_end = last.pblk + last.len;
+            if (e.pblk < last_end)
+            {
+                // 多个 inode 共享同一个扩展属性块是正常的
+                if (!(e.kind == OWN_XATTR && last.kind == OWN_XATTR && e.pblk == last.pblk)) overlaps.push_back(e);
+                if (e.pblk + e.len <= last_end) continue;
+                unsigned __int32 cut = last_end - e.pblk;
+                e.pblk += cut;
+                e.len -= cut;
+                if (is_data(e.kind)) e.lblk += cut;
+            }
+            if (same_run(last, e))
+            {
+                last.len += e.len;
+                continue;
+            }
+        }
+        items.push_back(e);
+    }
+    items.shrink_to_fit();
+    starts.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) starts[i] = items[i].pblk;
+}
+
+const owner_extent_t* owner_map_t::find(unsigned __int32 pblk) const
+{
+    std::vector<unsigned __int32>::const_iterator it = std::upper_bound(starts.begin(), starts.end(), pblk);
+    if (it == starts.begin()) return nullptr;
+    const owner_extent_t& e = items[(it - starts.begin()) - 1];
+    return pblk - e.pblk < e.len ? &e : nullptr;
+}
+
+size_t owner_map_t::memory() const
+{
+    return starts.capacity() * sizeof(unsigned __int32) + (items.capacity() + overlaps.capacity()) * sizeof(owner_extent_t);
+}
+
+const char* owner_map_t::kind_name(unsigned __int8 kind)
+{
+    static const char* names[OWN_KIND_COUNT] = {
+        "file data", "directory", "symlink target", "data", "indirect block", "extended attributes",
+        "superblock", "group descriptors", "reserved group descriptors", "block bitmap", "inode bitmap", "inode table"
+    };
+    return kind < OWN_KIND_COUNT ? names[kind] : "?";
+}
+
+// ---- 建立 ----
+
+// 追加一个块，与上一项连续时直接延长
+static void add_block(std::vector<owner_extent_t>& v, unsigned __int32 pblk, unsigned __int32 owner, unsigned __int32 lblk,
+    unsigned __int8 kind, unsigned __int8 level)
+{
+    owner_extent_t e = { pblk, 1, owner, lblk, kind, level };
+    if (!v.empty() && same_run(v.back(), e)) v.back().len++;
+    else v.push_back(e);
+}
+
+const owner_map_t* ext2_t::owner_map()
+{
+    if (owners) return owners;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned threads = parallel_run_t::default_threads();
+    std::vector<std::vector<owner_extent_t>> parts(threads);
+
+    // 1. 各组的固定元数据
+    unsigned __int32 gdt_blocks = (unsigned __int32)((block_group_count * sizeof(ext2_group_desc) + block_size - 1) >> block_shift);
+    unsigned __int32 table_blocks = (unsigned __int32)(((unsigned __int64)inodes_per_group * inode_size + block_size - 1) >> block_shift);
+    std::vector<owner_extent_t>& meta = parts[0];
+    for (unsigned __int32 g = 0; g < block_group_count; g++)
+    {
+        const ext2_group_desc& desc = block_group_descriptor_table[g];
+        if (group_has_super(g))
+        {
+            unsigned __int32 b = first_data_block + g * blocks_per_group;
+            owner_extent_t s = { b, 1, g, 0, OWN_SUPER, 0 };
+            owner_extent_t d = { b + 1, gdt_blocks, g, 0, OWN_GDT, 0 };
+            owner_extent_t r = { b + 1 + gdt_blocks, super_block.s_reserved_gdt_blocks, g, 0, OWN_RESERVED_GDT, 0 };
+            meta.push_back(s);
+            meta.push_back(d);
+            if (r.len) meta.push_back(r);
+        }
+        owner_extent_t bb = { desc.bg_block_bitmap, 1, g, 0, OWN_BLOCK_BITMAP, 0 };
+        owner_extent_t ib = { desc.bg_inode_bitmap, 1, g, 0, OWN_INODE_BITMAP, 0 };
+        owner_extent_t it = { desc.bg_inode_table, table_blocks, g, 0, OWN_INODE_TABLE, 0 };
+        meta.push_back(bb);
+        meta.push_back(ib);
+        meta.push_back(it);
+    }
+
+    // 2. 并行扫描 inode 表：直接块、扩展属性块，间接块留到下一步按物理顺序读取
+    struct pending_t
+    {
+        unsigned __int32 pblk;
+        unsigned __int32 ino;
+        unsigned __int32 lblk;
+        unsigned __int8 level;
+        unsigned __int8 kind; // inode 数据块的类型
+    };
+    std::vector<std::vector<pending_t>> pend(threads);
+    unsigned __int32 ptrs = block_size / 4;
+    unsigned __int64 inodes = 0;
+    bool ok = scan_inodes(threads, [&](unsigned w, unsigned __int32 ino, const ext2_inode* inode) {
+        if (inode->i_mode == 0 && inode->i_blocks == 0) return;
+        std::vector<owner_extent_t>& out = parts[w];
+        if (inode->i_file_acl != 0 && inode->i_file_acl < blocks_count) add_block(out, inode->i_file_acl, ino, 0, OWN_XATTR, 0);
+
+        if (!has_block_map(inode)) return;
+        unsigned __int32 type = inode->i_mode & 0xF000;
+        unsigned __int8 kind = type == 0x8000 ? OWN_FILE : type == 0x4000 ? OWN_DIR : type == 0xA000 ? OWN_SYMLINK : OWN_OTHER;
+
+        // 保留 inode 7 的二级间接块之下是保留的组描述符块，已经按布局登记
+        if (ino == 7)
+        {
+            if (inode->i_block[13] != 0 && inode->i_block[13] < blocks_count) add_block(out, inode->i_block[13], ino, 0, OWN_INDIRECT, 2);
+            return;
+        }
+        for (unsigned __int32 i = 0; i < 12; i++)
+            if (inode->i_block[i] != 0 && inode->i_block[i] < blocks_count) add_block(out, inode->i_block[i], ino, i, kind, 0);
+        unsigned __int64 lblk = 12, span = ptrs;
+        for (unsigned __int8 level = 1; level <= 3; level++, lblk += span, span *= ptrs)
+        {
+            unsigned __int32 b = inode->i_block[11 + level];
+            if (b == 0 || b >= blocks_count || lblk > 0xFFFFFFFFu) continue;
+            add_block(out, b, ino, (unsigned __int32)lblk, OWN_INDIRECT, level);
+            pending_t p = { b, ino, (unsigned __int32)lblk, level, kind };
+            pend[w].push_back(p);
+        }
+    }, &inodes);
+
+    // 3. 按级读取间接块：每一级的全部间接块排序后顺序读取，并行解码
+    for (int round = 0; round < 3 && ok; round++)
+    {
+        std::vector<pending_t> todo;
+        for (unsigned t = 0; t < threads; t++)
+        {
+            todo.insert(todo.end(), pend[t].begin(), pend[t].end());
+            pend[t].clear();
+        }
+        if (todo.empty()) break;
+        std::sort(todo.begin(), todo.end(), [](const pending_t& x, const pending_t& y) { return x.pblk < y.pblk; });
+        std::vector<unsigned __int32> blocks(todo.size());
+        for (size_t i = 0; i < todo.size(); i++) blocks[i] = todo[i].pblk;
+        ok = scan_blocks(blocks, threads, [&](unsigned w, size_t index, const unsigned __int8* data) {
+            const pending_t& p = todo[index];
+            const le32* v = (const le32*)data;
+            unsigned __int64 span = 1;
+            for (int l = 1; l < p.level; l++) span *= ptrs;
+            for (unsigned __int32 i = 0; i < ptrs; i++)
+            {
+                unsigned __int32 b = v[i];
+                unsigned __int64 lblk = p.lblk + i * span;
+                if (b == 0 || b >= blocks_count) continue;
+                if (lblk > 0xFFFFFFFFu) break;
+                if (p.level == 1)
+                {
+                    add_block(parts[w], b, p.ino, (unsigned __int32)lblk, p.kind, 0);
+                }
+                else
+                {
+                    add_block(parts[w], b, p.ino, (unsigned __int32)lblk, OWN_INDIRECT, (unsigned __int8)(p.level - 1));
+                    pending_t c = { b, p.ino, (unsigned __int32)lblk, (unsigned __int8)(p.level - 1), p.kind };
+                    pend[w].push_back(c);
+                }
+            }
+        });
+    }
+    if (!ok)
+    {
+        fprintf(con, "Failed to build the block owner map.\n");
+        return nullptr;
+    }
+
+    std::vector<owner_extent_t> all;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        all.insert(all.end(), parts[t].begin(), parts[t].end());
+        std::vector<owner_extent_t>().swap(parts[t]);
+    }
+    owners = new owner_map_t;
+    owners->build(all);
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    fprintf(con, "Owner map: %zu extents (%zu KB) from %llu inodes in %llu ms\n", owners->extents().size(),
+        owners->memory() / 1024, inodes, ms);
+    return owners;
+}
+
+void ext2_t::owners_reset()
+{
+    delete owners;
+    owners = nullptr;
+}
+
+// ---- 命令 ----
+
+bool ext2_t::block_in_use(unsigned __int32 bn)
+{
+    if (bn < first_data_block || bn >= blocks_count) return true; // 不在任何组中（1K 块时的引导块）
+    scratch_t scratch(arena());
+    unsigned __int8* bitmap = scratch.alloc<unsigned __int8>(block_size);
+    unsigned __int32 i = index_in_group(bn);
+    if (!load_block(block_group_descriptor_table[group_of_block(bn)].bg_block_bitmap, bitmap)) return true;
+    return (bitmap[i >> 3] >> (i & 7)) & 1;
+}
+
+void ext2_t::show_owner(unsigned __int32 bn)
+{
+    if (bn >= blocks_count)
+    {
+        printf("Block %u is beyond the end of the filesystem (%u blocks).\n", bn, blocks_count);
+        return;
+    }
+    const owner_map_t* map = owner_map();
+    if (!map) return;
+    bool used = block_in_use(bn);
+    const owner_extent_t* e = map->find(bn);
+    if (!e)
+    {
+        printf("Block %u: %s\n", bn, used ? "allocated in the bitmap but not referenced by anything" : "free");
+        return;
+    }
+
+    std::string path;
+    if (owner_map_t::is_data(e->kind) || e->kind == OWN_INDIRECT || e->kind == OWN_XATTR)
+        if (!path_of(e->owner, path)) path = "?";
+    if (owner_map_t::is_data(e->kind))
+        printf("Block %u: logical block %u of inode %u %s (%s)\n", bn, e->lblk + (bn - e->pblk), e->owner, path.c_str(), owner_map_t::kind_name(e->kind));
+    else if (e->kind == OWN_INDIRECT)
+        printf("Block %u: level %u indirect block of inode %u %s, mapping logical blocks from %u\n", bn, e->level, e->owner, path.c_str(), e->lblk);
+    else if (e->kind == OWN_XATTR)
+        printf("Block %u: extended attribute block of inode %u %s\n", bn, e->owner, path.c_str());
+    else
+        printf("Block %u: %s of group %u\n", bn, owner_map_t::kind_name(e->kind), e->owner);
+    if (!used) printf("  but it is marked free in the block bitmap\n");
+
+    const std::vector<owner_extent_t>& c = map->conflicts();
+    for (size_t i = 0; i < c.size(); i++)
+        if (bn - c[i].pblk < c[i].len)
+            printf("  also claimed as %s by %s %u\n", owner_map_t::kind_name(c[i].kind),
+                owner_map_t::is_data(c[i].kind) || c[i].kind == OWN_INDIRECT || c[i].kind == OWN_XATTR ? "inode" : "group", c[i].owner);
+}
+
+// 对照块位图和属主表：已分配但没有属主（泄漏）、有属主但未分配、多个属主，以及组描述符中的空闲计数
+void ext2_t::check()
+{
+    const owner_map_t* map = owner_map();
+    if (!map) return;
+    const std::vector<owner_extent_t>& items = map->extents();
+    scratch_t scratch(arena());
+    unsigned __int8* bitmap = scratch.alloc<unsigned __int8>(block_size);
+
+    unsigned __int64 leaked = 0, unmarked = 0, bad_groups = 0, free_total = 0;
+    std::vector<std::pair<unsigned __int32, unsigned __int32>> leaked_runs, unmarked_runs; // (起始块, 块数)
+    auto note = [](std::vector<std::pair<unsigned __int32, unsigned __int32>>& runs, unsigned __int32 bn) {
+        if (!runs.empty() && runs.back().first + runs.back().second == bn) runs.back().second++;
+        else if (runs.size() < CHECK_SHOW + 1) runs.push_back(std::make_pair(bn, 1u)); // 多记一段用于判断是否还有更多
+    };
+
+    size_t e = 0;
+    for (unsigned __int32 g = 0; g < block_group_count; g++)
+    {
+        const ext2_group_desc& desc = block_group_descriptor_table[g];
+        if (!load_block(desc.bg_block_bitmap, bitmap))
+        {
+            fprintf(con, "Failed to read block bitmap of group %u.\n", g);
+            return;
+        }
+        unsigned __int32 first = first_data_block + g * blocks_per_group;
+        unsigned __int32 n = blocks_count - first < blocks_per_group ? blocks_count - first : blocks_per_group;
+        unsigned __int32 free_blocks = 0;
+        for (unsigned __int32 i = 0; i < n; i++)
+        {
+            unsigned __int32 bn = first + i;
+            while (e < items.size() && items[e].pblk + items[e].len <= bn) e++;
+            bool owned = e < items.size() && items[e].pblk <= bn;
+            bool used = (bitmap[i >> 3] >> (i & 7)) & 1;
+            if (!used) free_blocks++;
+            if (used && !owned)
+            {
+                leaked++;
+                note(leaked_runs, bn);
+            }
+            else if (owned && !used)
+            {
+                unmarked++;
+                note(unmarked_runs, bn);
+            }
+        }
+        free_total += free_blocks;
+        if (free_blocks != desc.bg_free_blocks_count)
+        {
+            if (bad_groups < CHECK_SHOW) fprintf(con, "Group %u: descriptor says %u free blocks, bitmap has %u\n", g, (unsigned)desc.bg_free_blocks_count, free_blocks);
+            bad_groups++;
+        }
+    }
+
+    auto show = [this](const char* what, unsigned __int64 count, const std::vector<std::pair<unsigned __int32, unsigned __int32>>& runs) {
+        fprintf(con, "%llu blocks %s\n", count, what);
+        for (size_t i = 0; i < runs.size() && i < CHECK_SHOW; i++)
+            fprintf(con, "  %u-%u\n", runs[i].first, runs[i].first + runs[i].second - 1);
+        if (runs.size() > CHECK_SHOW) fprintf(con, "  ...\n");
+    };
+    show("allocated in the bitmap but not referenced (leaked)", leaked, leaked_runs);
+    show("referenced but marked free in the bitmap", unmarked, unmarked_runs);
+
+    const std::vector<owner_extent_t>& c = map->conflicts();
+    fprintf(con, "%zu extents claimed by more than one owner\n", c.size());
+    for (size_t i = 0; i < c.size() && i < CHECK_SHOW; i++)
+    {
+        const owner_extent_t* first = map->find(c[i].pblk);
+        fprintf(con, "  %u-%u: %s of %u, also %s of %u\n", c[i].pblk, c[i].pblk + c[i].len - 1,
+            first ? owner_map_t::kind_name(first->kind) : "?", first ? first->owner : 0, owner_map_t::kind_name(c[i].kind), c[i].owner);
+    }
+    if (c.size() > CHECK_SHOW) fprintf(con, "  ...\n");
+    fprintf(con, "%llu groups with a wrong free block count", bad_groups);
+    if (free_total != super_block.s_free_blocks_count)
+        fprintf(con, "; superblock says %u free blocks, bitmaps have %llu", (unsigned)super_block.s_free_blocks_count, free_total);
+    fprintf(con, "\n");
+}
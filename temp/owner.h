@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "platform.h"
+
+// 块属主反查表：物理块 -> inode 和逻辑块号，或者文件系统元数据的类型。
+// 按物理块号排序的区段数组，连续且属于同一属主的块合并成一项，内存与区段数成正比；
+// 查找时在单独的起始块号数组中二分，命中一次缓存行就能定位。
+
+enum owner_kind_t
+{
+    OWN_FILE,         // 普通文件的数据块
+    OWN_DIR,          // 目录块
+    OWN_SYMLINK,      // 符号链接的目标
+    OWN_OTHER,        // 其他类型 inode 的数据块
+    OWN_INDIRECT,     // 间接块，level 为级数
+    OWN_XATTR,        // 扩展属性块（可能被多个 inode 共享）
+    OWN_SUPER,        // 超级块及其备份，owner 为组号
+    OWN_GDT,          // 组描述符表
+    OWN_RESERVED_GDT, // 为在线扩容保留的组描述符块
+    OWN_BLOCK_BITMAP,
+    OWN_INODE_BITMAP,
+    OWN_INODE_TABLE,
+    OWN_KIND_COUNT
+};
+
+struct owner_extent_t
+{
+    unsigned __int32 pblk;
+    unsigned __int32 len;
+    unsigned __int32 owner; // inode 号；元数据为组号
+    unsigned __int32 lblk;  // 第一块的逻辑块号；间接块为它覆盖的第一个逻辑块
+    unsigned __int8 kind;   // owner_kind_t
+    unsigned __int8 level;  // 间接块的级数
+};
+
+class owner_map_t
+{
+public:
+    // 区段按物理块号排序并合并；重叠的部分（同一块有多个属主）记入 conflicts
+    void build(std::vector<owner_extent_t>& all);
+    const owner_extent_t* find(unsigned __int32 pblk) const; // 不属于任何属主时返回空
+    const std::vector<owner_extent_t>& extents() const { return items; }
+    const std::vector<owner_extent_t>& conflicts() const { return overlaps; }
+    size_t memory() const; // 占用的字节数
+    static const char* kind_name(unsigned __int8 kind);
+    static bool is_data(unsigned __int8 kind) { return kind <= OWN_OTHER; }
+
+private:
+    std::vector<unsigned __int32> starts; // items[i].pblk，二分查找只访问这个数组
+    std::vector<owner_extent_t> items;
+    std::vector<owner_extent_t> overlaps; // 与前一区段重叠的区段
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+// 在后台线程中并行执行 fn(item, worker)，item 取 [0, n)，worker 取 [0, threads)。
+// 构造后立即开始，调用者在 wait 之前可以继续做别的事（例如读下一批数据），析构时自动等待。
+// 工作线程只做计算，镜像 I/O 和 ext2_t 的状态都只在调用线程中访问。
+class parallel_run_t
+{
+public:
+    parallel_run_t(size_t n, unsigned threads, const std::function<void(size_t, unsigned)>& fn)
+        : next(0), count(n), body(fn)
+    {
+        if (threads > n) threads = (unsigned)n;
+        for (unsigned t = 0; t < threads; t++) workers.push_back(std::thread(&parallel_run_t::run, this, t));
+    }
+    ~parallel_run_t() { wait(); }
+
+    void wait()
+    {
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        workers.clear();
+    }
+
+    // 默认线程数：处理器数，最多 8 个（更多的线程受限于单个镜像文件的读取速度）
+    static unsigned default_threads()
+    {
+        unsigned n = std::thread::hardware_concurrency();
+        if (n == 0) n = 1;
+        return n > 8 ? 8 : n;
+    }
+
+private:
+    std::atomic<size_t> next;
+    size_t count;
+    std::function<void(size_t, unsigned)> body;
+    std::vector<std::thread> workers;
+
+    void run(unsigned worker)
+    {
+        for (size_t i = next++; i < count; i = next++) body(i, worker);
+    }
+
+    parallel_run_t(const parallel_run_t&);
+    parallel_run_t& operator=(const parallel_run_t&);
+};
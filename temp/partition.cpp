@@ -0,0 +1,377 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include "ext2.h"
+
+// 分区发现，以及在全部 ext2/ext3 分区上并行执行扫描类命令（each）
+
+typedef le_t<unsigned __int64> le64;
+
+#pragma pack(push, 1)
+
+struct mbr_entry_t
+{
+    unsigned __int8 status;
+    unsigned __int8 chs_first[3];
+    unsigned __int8 type;
+    unsigned __int8 chs_last[3];
+    le32 lba_first; // 主分区和扩展分区相对磁盘开头；逻辑分区相对所在的 EBR，下一个 EBR 相对扩展分区开头
+    le32 sectors;
+};
+
+struct gpt_header_t
+{
+    char signature[8]; // "EFI PART"
+    le32 revision;
+    le32 header_size;
+    le32 header_crc32;
+    le32 reserved;
+    le64 my_lba;
+    le64 alternate_lba;
+    le64 first_usable_lba;
+    le64 last_usable_lba;
+    unsigned __int8 disk_guid[16];
+    le64 entries_lba;
+    le32 entry_count;
+    le32 entry_size;
+    le32 entries_crc32;
+};
+
+struct gpt_entry_t
+{
+    unsigned __int8 type_guid[16];
+    unsigned __int8 unique_guid[16];
+    le64 first_lba;
+    le64 last_lba; // 含最后一个扇区
+    le64 attributes;
+    le16 name[36]; // UTF-16LE
+};
+
+#pragma pack(pop)
+
+#define MBR_TABLE 0x1be
+#define MBR_TYPE_GPT 0xEE
+
+static const unsigned __int8 gpt_linux_fs[16] = { 0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47, 0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4 };
+static const unsigned __int8 gpt_esp[16] = { 0x28, 0x73, 0x2A, 0xC1, 0x1F, 0xF8, 0xD2, 0x11, 0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B };
+static const unsigned __int8 gpt_linux_swap[16] = { 0x6D, 0xFD, 0x57, 0x06, 0xAB, 0xA4, 0xC4, 0x43, 0x84, 0xE5, 0x09, 0x33, 0xC8, 0x4B, 0x4F, 0x4F };
+
+std::string partition_t::type_name() const
+{
+    char buf[40];
+    if (strcmp(scheme, "none") == 0) return "-";
+    if (strcmp(scheme, "gpt") != 0)
+    {
+        snprintf(buf, sizeof(buf), "0x%02X", mbr_type);
+        return buf;
+    }
+    if (memcmp(type_guid, gpt_linux_fs, 16) == 0) return "linux";
+    if (memcmp(type_guid, gpt_esp, 16) == 0) return "efi";
+    if (memcmp(type_guid, gpt_linux_swap, 16) == 0) return "swap";
+    // GUID 的前三段按小端存储
+    const unsigned __int8* g = type_guid;
+    snprintf(buf, sizeof(buf), "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+        g[3], g[2], g[1], g[0], g[5], g[4], g[7], g[6], g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15]);
+    return buf;
+}
+
+bool ext2_t::read_disk(unsigned __int64 off, void* buf, size_t len)
+{
+    if (disk) return disk->read(off, buf, len);
+    io_dir = 0; // Windows 上读会移动文件指针，下一次写必须重新定位
+    return read_at(fp, off, buf, len);
+}
+
+// 读起点处的超级块，填写 fs 及容量
+void ext2_t::probe_partition(partition_t& p)
+{
+    p.fs = "";
+    p.block_size = p.blocks_count = p.free_blocks = p.inodes_count = p.free_inodes = 0;
+    p.label[0] = '\0';
+    ext2_super_block sb;
+    if (p.sectors * PART_SECTOR < 2048 || !read_disk(p.start * PART_SECTOR + 1024, &sb, sizeof(sb))) return;
+    if (sb.s_magic != 0xEF53 || sb.s_log_block_size > 6) return;
+    if (sb.s_feature_incompat & 0x40) p.fs = "ext4"; // INCOMPAT_EXTENTS
+    else p.fs = (sb.s_feature_compat & 0x4) ? "ext3" : "ext2";
+    p.block_size = 1024 << sb.s_log_block_size;
+    p.blocks_count = sb.s_blocks_count;
+    p.free_blocks = sb.s_free_blocks_count;
+    p.inodes_count = sb.s_inodes_count;
+    p.free_inodes = sb.s_free_inodes_count;
+    memcpy(p.label, sb.s_volume_name, 16);
+    p.label[16] = '\0';
+}
+
+static partition_t new_partition(int index, const char* scheme, unsigned __int64 start, unsigned __int64 sectors)
+{
+    partition_t p;
+    p.index = index;
+    p.scheme = scheme;
+    p.start = start;
+    p.sectors = sectors;
+    p.mbr_type = 0;
+    memset(p.type_guid, 0, sizeof(p.type_guid));
+    p.fs = "";
+    return p;
+}
+
+// GPT 头在 lba；主头损坏时由调用者改用磁盘末尾的备份头
+bool ext2_t::read_gpt(unsigned __int64 lba, std::vector<partition_t>& out)
+{
+    unsigned __int8 sector[PART_SECTOR];
+    if (!read_disk(lba * PART_SECTOR, sector, PART_SECTOR)) return false;
+    const gpt_header_t* h = (const gpt_header_t*)sector;
+    unsigned __int32 count = h->entry_count, size = h->entry_size;
+    if (memcmp(h->signature, "EFI PART", 8) != 0 || size < sizeof(gpt_entry_t) || size > 4096 || count == 0) return false;
+    if (count > PART_GPT_ENTRIES_MAX) count = PART_GPT_ENTRIES_MAX;
+
+    std::vector<unsigned __int8> table((size_t)count * size);
+    if (!read_disk((unsigned __int64)h->entries_lba * PART_SECTOR, table.data(), table.size())) return false;
+    for (unsigned __int32 i = 0; i < count; i++)
+    {
+        const gpt_entry_t* e = (const gpt_entry_t*)(table.data() + (size_t)i * size);
+        static const unsigned __int8 unused[16] = { 0 };
+        unsigned __int64 first = e->first_lba, last = e->last_lba;
+        if (memcmp(e->type_guid, unused, 16) == 0 || last < first) continue;
+        partition_t p = new_partition((int)i, "gpt", first, last - first + 1);
+        memcpy(p.type_guid, e->type_guid, 16);
+        for (int k = 0; k < 36 && e->name[k] != 0; k++)
+            p.name += (unsigned __int16)e->name[k] < 0x80 ? (char)(unsigned __int16)e->name[k] : '?';
+        out.push_back(p);
+    }
+    return true;
+}
+
+// 沿扩展分区中的 EBR 链读出逻辑分区，编号从 next_index 开始
+void ext2_t::read_ebr_chain(unsigned __int64 ext_start, unsigned __int64 ext_sectors, int next_index, std::vector<partition_t>& out,
+    std::vector<unsigned __int64>* ebrs)
+{
+    unsigned __int64 ebr = ext_start;
+    for (int n = 0; n < PART_EBR_MAX; n++)
+    {
+        unsigned __int8 sector[PART_SECTOR];
+        if (!read_disk(ebr * PART_SECTOR, sector, PART_SECTOR) || sector[510] != 0x55 || sector[511] != 0xAA) return;
+        if (ebrs) ebrs->push_back(ebr);
+        const mbr_entry_t* e = (const mbr_entry_t*)(sector + MBR_TABLE);
+        if (e[0].type != 0 && e[0].sectors != 0)
+        {
+            partition_t p = new_partition(next_index++, "ebr", ebr + e[0].lba_first, e[0].sectors);
+            p.mbr_type = e[0].type;
+            out.push_back(p);
+        }
+        // 第二项指向下一个 EBR；越出扩展分区或不再前进时停止
+        unsigned __int64 next = ext_start + e[1].lba_first;
+        if (e[1].type == 0 || e[1].lba_first == 0 || next <= ebr || next >= ext_start + ext_sectors) return;
+        ebr = next;
+    }
+}
+
+void ext2_t::list_partitions(std::vector<partition_t>& out)
+{
+    out.clear();
+    unsigned __int8 boot[PART_SECTOR];
+    if (!read_disk(0, boot, PART_SECTOR)) return;
+    const mbr_entry_t* e = (const mbr_entry_t*)(boot + MBR_TABLE);
+    bool mbr = boot[510] == 0x55 && boot[511] == 0xAA;
+
+    bool gpt = false;
+    for (int i = 0; i < 4 && mbr; i++)
+        if (e[i].type == MBR_TYPE_GPT) gpt = true;
+    if (gpt)
+    {
+        if (!read_gpt(1, out) && image_size >= 2 * PART_SECTOR) read_gpt(image_size / PART_SECTOR - 1, out);
+    }
+    else if (mbr)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (e[i].type == 0 || e[i].sectors == 0) continue;
+            partition_t p = new_partition(i, "mbr", e[i].lba_first, e[i].sectors);
+            p.mbr_type = e[i].type;
+            out.push_back(p);
+        }
+        for (int i = 0; i < 4; i++)
+            if (e[i].type == 0x05 || e[i].type == 0x0F || e[i].type == 0x85)
+            {
+                read_ebr_chain(e[i].lba_first, e[i].sectors, 4, out);
+                break; // 只允许一个扩展分区
+            }
+    }
+    for (size_t i = 0; i < out.size(); i++)
+        if (!out[i].is_container()) probe_partition(out[i]);
+
+    // 没有分区表：整个镜像就是一个文件系统
+    if (out.empty())
+    {
+        partition_t p = new_partition(0, "none", 0, image_size / PART_SECTOR);
+        probe_partition(p);
+        if (p.fs[0]) out.push_back(p);
+    }
+}
+
+// 导出元数据时要一并复制的分区表：MBR、GPT 主头和分区项数组及其备份、扩展分区中的每个 EBR
+void ext2_t::partition_table_ranges(std::vector<std::pair<unsigned __int64, unsigned __int64>>& out)
+{
+    out.clear();
+    out.push_back(std::make_pair(0ull, (unsigned __int64)PART_SECTOR));
+    unsigned __int8 boot[PART_SECTOR];
+    if (!read_disk(0, boot, PART_SECTOR) || boot[510] != 0x55 || boot[511] != 0xAA) return;
+    const mbr_entry_t* e = (const mbr_entry_t*)(boot + MBR_TABLE);
+
+    bool gpt = false;
+    for (int i = 0; i < 4; i++)
+        if (e[i].type == MBR_TYPE_GPT) gpt = true;
+    if (gpt)
+    {
+        // 主头指出备份头的位置；主头损坏时备份头按惯例在最后一个扇区
+        unsigned __int64 lba = 1, backup = image_size / PART_SECTOR - 1;
+        for (int k = 0; k < 2; k++, lba = backup)
+        {
+            unsigned __int8 sector[PART_SECTOR];
+            if (lba * PART_SECTOR + PART_SECTOR > image_size || !read_disk(lba * PART_SECTOR, sector, PART_SECTOR)) continue;
+            const gpt_header_t* h = (const gpt_header_t*)sector;
+            if (memcmp(h->signature, "EFI PART", 8) != 0) continue;
+            if (k == 0 && h->alternate_lba > 1 && h->alternate_lba < image_size / PART_SECTOR) backup = h->alternate_lba;
+            unsigned __int64 table = (unsigned __int64)h->entry_count * h->entry_size;
+            if (table > (unsigned __int64)PART_GPT_ENTRIES_MAX * 4096) table = (unsigned __int64)PART_GPT_ENTRIES_MAX * 4096;
+            table = (table + PART_SECTOR - 1) / PART_SECTOR * PART_SECTOR;
+            out.push_back(std::make_pair(lba * PART_SECTOR, (unsigned __int64)PART_SECTOR));
+            unsigned __int64 at = (unsigned __int64)h->entries_lba * PART_SECTOR;
+            if (at < image_size) out.push_back(std::make_pair(at, std::min(table, image_size - at)));
+        }
+    }
+    else
+    {
+        std::vector<partition_t> logical;
+        std::vector<unsigned __int64> ebrs;
+        for (int i = 0; i < 4; i++)
+            if (e[i].type == 0x05 || e[i].type == 0x0F || e[i].type == 0x85)
+            {
+                read_ebr_chain(e[i].lba_first, e[i].sectors, 4, logical, &ebrs);
+                break;
+            }
+        for (size_t i = 0; i < ebrs.size(); i++) out.push_back(std::make_pair(ebrs[i] * PART_SECTOR, (unsigned __int64)PART_SECTOR));
+    }
+    std::sort(out.begin(), out.end());
+}
+
+void ext2_t::parts()
+{
+    std::vector<partition_t> list;
+    list_partitions(list);
+    if (list.empty())
+    {
+        printf("No partitions found.\n");
+        return;
+    }
+    printf("%3s %-5s %12s %12s %10s  %-8s %-5s %s\n", "#", "Table", "Start", "Sectors", "Size(MB)", "Type", "FS", "Label");
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        const partition_t& p = list[i];
+        std::string label = p.label[0] ? p.label : p.name;
+        printf("%3d %-5s %12llu %12llu %10llu  %-8s %-5s %s%s\n", p.index, p.scheme, p.start, p.sectors,
+            p.sectors * PART_SECTOR >> 20, p.type_name().c_str(), p.fs[0] ? p.fs : "-", label.c_str(),
+            p.start == partition_start ? "  (open)" : "");
+    }
+}
+
+void ext2_t::df()
+{
+    // 计数取自内存中的超级块，包含本次运行中尚未回写的分配；与 df 相同，保留块不计入可用
+    unsigned __int64 kb = block_size >> 10;
+    unsigned __int64 free_blocks = super_block.s_free_blocks_count, reserved = super_block.s_r_blocks_count;
+    unsigned __int64 total = (unsigned __int64)blocks_count * kb, used = total - free_blocks * kb;
+    unsigned __int64 avail = free_blocks > reserved ? (free_blocks - reserved) * kb : 0;
+    unsigned __int32 inodes_free = super_block.s_free_inodes_count;
+    char label[17];
+    memcpy(label, super_block.s_volume_name, 16);
+    label[16] = '\0';
+    fprintf(con, "%12s %12s %12s %4s %10s %10s %10s  %s\n", "1K-blocks", "Used", "Available", "Use%", "Inodes", "IUsed", "IFree", "Label");
+    fprintf(con, "%12llu %12llu %12llu %3llu%% %10u %10u %10u  %s\n", total, used, avail,
+        used + avail ? (used * 100 + used + avail - 1) / (used + avail) : 0, inodes_count, inodes_count - inodes_free, inodes_free, label);
+}
+
+// each <命令> [参数...]：在镜像的全部 ext2/ext3 分区上同时执行扫描类命令。
+// 每个分区一个线程，各自的输出先写入临时文件，全部结束后按分区号依次打印；
+// 各分区的批量读取经同一个 io_gate 轮流进行，磁盘上同一时刻只有一段大块顺序读，解析仍然并行。
+void ext2_t::each(const std::vector<std::string>& args)
+{
+    static const char* const commands[] = { "find", "check", "undelete_scan", "df" };
+    bool known = false;
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]) && args.size() > 1; i++)
+        if (args[1] == commands[i]) known = true;
+    if (!known)
+    {
+        printf("Usage: each <find|check|undelete_scan|df> [args...]\n");
+        return;
+    }
+    std::vector<std::string> sub(args.begin() + 1, args.end());
+
+    std::vector<partition_t> list;
+    list_partitions(list);
+    struct job_t
+    {
+        const partition_t* part;
+        ext2_t* fs;
+        bool owned; // 为本命令打开的分区，结束后关闭
+        FILE* out;
+    };
+    std::vector<job_t> jobs;
+    std::mutex gate;
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        if (!list[i].is_ext()) continue;
+        job_t j = { &list[i], this, false, tmpfile() };
+        if (!j.out) continue;
+        // 当前分区直接使用本对象，能看到尚未提交的修改；其他分区以只读方式打开，不留下任何旁路文件
+        if (list[i].start != partition_start)
+        {
+            j.fs = new ext2_t(image_path.c_str(), list[i].index, false, true);
+            j.owned = true;
+            if (!j.fs->valid)
+            {
+                delete j.fs;
+                fclose(j.out);
+                continue;
+            }
+        }
+        j.fs->con = j.out;
+        j.fs->io_gate = &gate;
+        jobs.push_back(j);
+    }
+    if (jobs.empty())
+    {
+        printf("No ext2/ext3 partitions found.\n");
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < jobs.size(); i++)
+        threads.push_back(std::thread([&sub](ext2_t* fs) {
+            if (sub[0] == "find") fs->find(sub);
+            else if (sub[0] == "check") fs->check();
+            else if (sub[0] == "undelete_scan") fs->undelete_scan(sub);
+            else fs->df();
+            fflush(fs->con);
+        }, jobs[i].fs));
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const partition_t& p = *jobs[i].part;
+        printf("== Partition %d (%s, %s, start sector %llu, %llu MB) ==\n", p.index, p.scheme, p.fs, p.start, p.sectors * PART_SECTOR >> 20);
+        fflush(stdout);
+        rewind(jobs[i].out);
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), jobs[i].out)) > 0) fwrite(buf, 1, n, stdout);
+        fclose(jobs[i].out);
+        jobs[i].fs->con = stdout;
+        jobs[i].fs->io_gate = nullptr;
+        if (jobs[i].owned) delete jobs[i].fs;
+    }
+}
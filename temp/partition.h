@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "platform.h"
+
+// 分区发现：MBR 的 4 个主分区、扩展分区中的 EBR 链和 GPT（保护性 MBR 中有 0xEE 分区时）。
+// 分区号与命令行上的 partition_num 一致：MBR 主分区为槽位号 0-3，逻辑分区从 4 开始按链上的顺序编号，
+// GPT 为分区项的下标。没有分区表而开头就是 ext2 文件系统的镜像作为 0 号分区。扇区固定为 512 字节。
+
+#define PART_SECTOR 512
+#define PART_EBR_MAX 128       // EBR 链最多跟随的节点数，防止链成环
+#define PART_GPT_ENTRIES_MAX 1024
+
+struct partition_t
+{
+    int index;                   // 分区号
+    const char* scheme;          // "mbr"、"ebr"（逻辑分区）、"gpt"、"none"（整个镜像）
+    unsigned __int64 start;      // 起始扇区
+    unsigned __int64 sectors;
+    unsigned __int8 mbr_type;    // MBR 分区类型；GPT 中为 0
+    unsigned __int8 type_guid[16]; // GPT 分区类型（磁盘上的字节序）
+    std::string name;            // GPT 分区名（只保留 ASCII）
+    // 以下取自起点处的超级块，fs 为空时不是 ext2/ext3
+    const char* fs;              // "ext2"、"ext3"、"ext4"（带 extents，本工具不能解释）或空
+    unsigned __int32 block_size;
+    unsigned __int32 blocks_count;
+    unsigned __int32 free_blocks;
+    unsigned __int32 inodes_count;
+    unsigned __int32 free_inodes;
+    char label[17];
+
+    bool is_ext() const { return fs && fs[0] && strcmp(fs, "ext4") != 0; } // 能由 ext2_t 打开
+    bool is_container() const { return mbr_type == 0x05 || mbr_type == 0x0F || mbr_type == 0x85; } // 扩展分区本身
+    std::string type_name() const; // 类型的可读名字：MBR 为十六进制类型号，GPT 为常见类型名或 GUID
+};
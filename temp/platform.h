@@ -0,0 +1,42 @@
+#pragma once
+
+// 非 MSVC 编译器（Linux 上的 gcc/clang）下补齐代码中用到的 MSVC 专有类型和 CRT 函数，
+// 使文件系统核心和命令行工具可以在 Linux 上编译。MSVC 下本文件不起作用。
+#ifndef _MSC_VER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define __int8 char
+#define __int16 short
+#define __int32 int
+#define __int64 long long
+#define _int32 int
+
+#define _fseeki64 fseeko // 需要 _FILE_OFFSET_BITS=64，见 CMakeLists.txt
+#define _ftelli64 ftello
+#define _strtoi64 strtoll
+
+#ifndef MAX_PATH
+#define MAX_PATH 260
+#endif
+
+// 线程安全的 ctime，buf 至少 26 字节
+static inline int ctime_s(char* buf, size_t size, const time_t* t)
+{
+    (void)size;
+    return ctime_r(t, buf) ? 0 : 1;
+}
+
+// 读入一行并去掉换行符；输入结束时返回空指针（与 MSVC 的 gets_s 一致）
+static inline char* gets_s(char* buf, size_t size)
+{
+    if (!fgets(buf, (int)size, stdin)) return nullptr;
+    size_t len = strlen(buf);
+    if (len && buf[len - 1] == '\n') buf[len - 1] = '\0';
+    return buf;
+}
+
+#endif
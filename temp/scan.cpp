@@ -0,0 +1,183 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "ext2.h"
+#include "parallel.h"
+
+// 全盘并行扫描：镜像 I/O 都在调用线程中按物理顺序大块读取，解析交给工作线程；
+// 每批数据读完后立即开始解析，同时读取下一批，I/O 和计算互相重叠。
+
+#define SCAN_BATCH_BYTES (16u << 20) // 每批读取的数据量
+#define SCAN_SLICE_INODES 2048       // 每个工作项处理的 inode 数
+#define SCAN_SLICE_BLOCKS 64         // 每个工作项处理的块数
+#define SCAN_RUN_BLOCKS 256          // 物理连续的块一次最多读取这么多块
+
+// each 命令中几个分区同时扫描时，一批数据读完才轮到下一个分区，磁盘上始终是大块的顺序读
+std::unique_lock<std::mutex> ext2_t::io_turn()
+{
+    return io_gate ? std::unique_lock<std::mutex>(*io_gate) : std::unique_lock<std::mutex>();
+}
+
+bool ext2_t::scan_inodes(unsigned threads, const inode_visitor_t& fn, unsigned __int64* scanned, const inode_visitor_t* unused)
+{
+    // 一个块组中从第一个到最后一个在用 inode 的 inode 表
+    struct chunk_t
+    {
+        unsigned __int32 first_ino;
+        unsigned __int32 count;
+        std::vector<unsigned __int8> bitmap;
+        std::vector<unsigned __int8> table;
+    };
+
+    unsigned __int32 g = 0;
+    bool ok = true;
+    auto read_batch = [&](std::vector<chunk_t>& batch) {
+        std::unique_lock<std::mutex> turn = io_turn();
+        batch.clear();
+        size_t bytes = 0;
+        for (; g < block_group_count && bytes < SCAN_BATCH_BYTES && ok; g++)
+        {
+            chunk_t c;
+            c.first_ino = g * inodes_per_group + 1;
+            c.bitmap.resize(block_size);
+            if (!load_block(block_group_descriptor_table[g].bg_inode_bitmap, c.bitmap.data()))
+            {
+                ok = false;
+                break;
+            }
+            // inode 表只读到最后一个在用 inode 为止；要访问空闲 inode 时读取整张表
+            c.count = unused ? inodes_per_group : 0;
+            for (unsigned __int32 i = inodes_per_group; i > 0 && c.count == 0; i--)
+                if ((c.bitmap[(i - 1) >> 3] >> ((i - 1) & 7)) & 1) c.count = i;
+            if (c.count == 0) continue;
+            c.table.resize((size_t)c.count * inode_size);
+            if (!read_bytes((unsigned __int64)block_group_descriptor_table[g].bg_inode_table << block_shift, c.table.data(), c.table.size()))
+            {
+                ok = false;
+                break;
+            }
+            bytes += c.table.size();
+            batch.push_back(std::move(c));
+        }
+    };
+
+    std::atomic<unsigned __int64> used(0);
+    std::vector<chunk_t> cur, next;
+    read_batch(cur);
+    while (!cur.empty() && ok)
+    {
+        std::vector<std::pair<size_t, unsigned __int32>> items; // (chunk, 起始下标)
+        for (size_t c = 0; c < cur.size(); c++)
+            for (unsigned __int32 s = 0; s < cur[c].count; s += SCAN_SLICE_INODES) items.push_back(std::make_pair(c, s));
+        {
+            parallel_run_t run(items.size(), threads, [&](size_t i, unsigned worker) {
+                const chunk_t& c = cur[items[i].first];
+                unsigned __int32 end = items[i].second + SCAN_SLICE_INODES < c.count ? items[i].second + SCAN_SLICE_INODES : c.count;
+                unsigned __int64 n = 0;
+                for (unsigned __int32 k = items[i].second; k < end; k++)
+                {
+                    if (!((c.bitmap[k >> 3] >> (k & 7)) & 1))
+                    {
+                        if (unused) (*unused)(worker, c.first_ino + k, (const ext2_inode*)(c.table.data() + (size_t)k * inode_size));
+                        continue;
+                    }
+                    fn(worker, c.first_ino + k, (const ext2_inode*)(c.table.data() + (size_t)k * inode_size));
+                    n++;
+                }
+                used += n;
+            });
+            read_batch(next);
+        }
+        cur.swap(next);
+    }
+    if (scanned) *scanned = used;
+    return ok;
+}
+
+bool ext2_t::scan_blocks(const std::vector<unsigned __int32>& blocks, unsigned threads, const block_visitor_t& fn)
+{
+    size_t pos = 0;
+    bool ok = true;
+    // 一批为 blocks[first, pos)，数据按同样的顺序排列；物理连续的块合并成一次读取
+    auto read_batch = [&](std::vector<unsigned __int8>& data, size_t* first) {
+        std::unique_lock<std::mutex> turn = io_turn();
+        *first = pos;
+        data.clear();
+        while (pos < blocks.size() && data.size() < SCAN_BATCH_BYTES && ok)
+        {
+            size_t end = pos + 1;
+            while (end < blocks.size() && end - pos < SCAN_RUN_BLOCKS && blocks[end] == blocks[end - 1] + 1) end++;
+            size_t at = data.size();
+            data.resize(at + ((end - pos) << block_shift));
+            if (!read_bytes((unsigned __int64)blocks[pos] << block_shift, data.data() + at, (end - pos) << block_shift)) ok = false;
+            pos = end;
+        }
+    };
+
+    std::vector<unsigned __int8> cur, next;
+    size_t cur_first, next_first;
+    read_batch(cur, &cur_first);
+    while (!cur.empty() && ok)
+    {
+        size_t count = cur.size() >> block_shift;
+        {
+            parallel_run_t run((count + SCAN_SLICE_BLOCKS - 1) / SCAN_SLICE_BLOCKS, threads, [&](size_t i, unsigned worker) {
+                size_t end = (i + 1) * SCAN_SLICE_BLOCKS < count ? (i + 1) * SCAN_SLICE_BLOCKS : count;
+                for (size_t b = i * SCAN_SLICE_BLOCKS; b < end; b++) fn(worker, cur_first + b, cur.data() + (b << block_shift));
+            });
+            read_batch(next, &next_first);
+        }
+        cur.swap(next);
+        cur_first = next_first;
+    }
+    return ok;
+}
+
+bool ext2_t::read_block_bitmaps(unsigned threads, std::vector<unsigned __int8>& bitmap)
+{
+    std::vector<std::pair<unsigned __int32, unsigned __int32>> where(block_group_count); // (位图块号, 组号)
+    for (unsigned __int32 g = 0; g < block_group_count; g++)
+        where[g] = std::make_pair((unsigned __int32)block_group_descriptor_table[g].bg_block_bitmap, g);
+    std::sort(where.begin(), where.end());
+    std::vector<unsigned __int32> blocks(block_group_count);
+    for (unsigned __int32 g = 0; g < block_group_count; g++) blocks[g] = where[g].first;
+    size_t stride = (blocks_per_group + 7) >> 3;
+    size_t n = stride < block_size ? stride : block_size;
+    bitmap.assign((size_t)block_group_count * stride, 0);
+    return scan_blocks(blocks, threads, [&](unsigned, size_t index, const unsigned __int8* data) {
+        memcpy(bitmap.data() + (size_t)where[index].second * stride, data, n);
+    });
+}
+
+bool ext2_t::scan_dir_entries(const std::vector<unsigned __int32>& dirs, unsigned threads, const dirent_visitor_t& fn, unsigned __int64* scanned)
+{
+    // 收集全部目录块（间接块在这里读取），按物理块号排序后顺序读取
+    std::vector<std::pair<unsigned __int32, unsigned __int32>> refs; // (物理块号, 目录 inode)
+    for (size_t d = 0; d < dirs.size(); d++)
+    {
+        scratch_t scratch(arena());
+        block_list_t list;
+        if (!dir_blocks(dirs[d], list)) continue;
+        for (unsigned __int32 b = 0; b < list.n; b++)
+            if (list.v[b] != 0 && list.v[b] < blocks_count) refs.push_back(std::make_pair(list.v[b], dirs[d]));
+    }
+    std::sort(refs.begin(), refs.end());
+    if (scanned) *scanned = refs.size();
+
+    std::vector<unsigned __int32> blocks(refs.size());
+    for (size_t i = 0; i < refs.size(); i++) blocks[i] = refs[i].first;
+    return scan_blocks(blocks, threads, [&](unsigned worker, size_t index, const unsigned __int8* data) {
+        unsigned __int32 dir = refs[index].second;
+        for (unsigned int off = 0; off + 8 <= block_size;)
+        {
+            const ext2_dir_entry* de = (const ext2_dir_entry*)(data + off);
+            unsigned int rec_len = rec_len_from_disk(de->rec_len);
+            if (rec_len < 8 || off + rec_len > block_size) break;
+            off += rec_len;
+            if (de->inode == 0 || de->inode > inodes_count || de->name_len == 0 || 8u + de->name_len > rec_len) continue;
+            fn(worker, dir, de);
+        }
+    });
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "platform.h"
+
+// 按块号分片的块缓存：每片一把锁，不同的块大多落在不同的片上，多个线程同时查询时很少互相等待。
+// 条目插入后内容不再改变，读路径上也不淘汰，find/insert 返回的指针在 erase_range/clear 之前一直有效；
+// 这两个操作只在修改镜像时调用，与并发查询互斥由调用者保证（ext2_t 的写操作本来就不能与查询并发）。
+
+#define SHARD_BITS 6
+#define SHARD_ERASE_BY_KEY 4096 // erase_range 的范围小于此数时逐个键删除，否则逐片扫描
+
+class shard_cache_t
+{
+public:
+    shard_cache_t() : count(0) {}
+
+    const unsigned __int8* find(unsigned __int32 key)
+    {
+        shard_t& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.lock);
+        auto it = s.items.find(key);
+        return it == s.items.end() ? nullptr : it->second.data();
+    }
+    // 已有同一个键时（另一个线程先读到了）保留原来的内容
+    const unsigned __int8* insert(unsigned __int32 key, std::vector<unsigned __int8>&& data)
+    {
+        shard_t& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.lock);
+        auto r = s.items.insert(std::make_pair(key, std::move(data)));
+        if (r.second) count++;
+        return r.first->second.data();
+    }
+    void erase_range(unsigned __int32 first, unsigned __int32 last) // [first, last]
+    {
+        if (count == 0) return;
+        if ((unsigned __int64)last - first < SHARD_ERASE_BY_KEY)
+        {
+            for (unsigned __int64 k = first; k <= last; k++)
+            {
+                shard_t& s = shard_of((unsigned __int32)k);
+                std::lock_guard<std::mutex> lock(s.lock);
+                count -= s.items.erase((unsigned __int32)k);
+            }
+            return;
+        }
+        // 范围很大（如整段搬迁）：逐片扫描
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+        {
+            shard_t& s = shards[i];
+            std::lock_guard<std::mutex> lock(s.lock);
+            for (auto it = s.items.begin(); it != s.items.end(); )
+            {
+                if (it->first >= first && it->first <= last)
+                {
+                    it = s.items.erase(it);
+                    count--;
+                }
+                else ++it;
+            }
+        }
+    }
+    void clear()
+    {
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards[i].lock);
+            shards[i].items.clear();
+        }
+        count = 0;
+    }
+    size_t size() const { return count; }
+
+private:
+    enum { SHARD_COUNT = 1 << SHARD_BITS };
+    struct shard_t
+    {
+        std::mutex lock;
+        std::unordered_map<unsigned __int32, std::vector<unsigned __int8>> items;
+        unsigned __int8 pad[64]; // 相邻两片的锁不在同一缓存行，没有伪共享（不用 alignas，C++14 的 new 不保证超对齐）
+    };
+    shard_t shards[SHARD_COUNT];
+    std::atomic<size_t> count;
+
+    // 乘法散列取高位：相邻的块号和间隔固定的块号（如各组的同类元数据）都能分散到不同的片
+    shard_t& shard_of(unsigned __int32 key) { return shards[(key * 2654435761u) >> (32 - SHARD_BITS)]; }
+
+    shard_cache_t(const shard_cache_t&);
+    shard_cache_t& operator=(const shard_cache_t&);
+};
@@ -0,0 +1,139 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+static const char* const stat_names[STAT_COUNT] = {
+    "seeks",
+    "read_calls",
+    "write_calls",
+    "bytes_read",
+    "bytes_written",
+    "fsyncs",
+    "txn_overlays",
+    "cow_reads",
+    "cow_writes",
+    "gt_cache_hits",
+    "gt_cache_misses",
+    "grain_cache_hits",
+    "grain_cache_misses",
+    "zero_grain_reads",
+    "index_cache_hits",
+    "index_cache_misses",
+    "dir_slot_hits",
+    "dir_slot_misses",
+    "block_allocs",
+    "block_frees",
+    "inode_allocs",
+    "inode_frees",
+    "bitmap_scans",
+    "bitmap_rmw",
+};
+
+latency_hist_t::latency_hist_t() : count(0), total_us(0), max_us(0)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void latency_hist_t::add(unsigned __int64 us)
+{
+    int b = 0;
+    while (b < BUCKETS - 1 && (us >> (b + 1)) != 0) b++;
+    buckets[b]++;
+    count++;
+    total_us += us;
+    if (us > max_us) max_us = us;
+}
+
+unsigned __int64 latency_hist_t::percentile(double p) const
+{
+    if (count == 0) return 0;
+    unsigned __int64 want = (unsigned __int64)(p * count + 0.5);
+    if (want == 0) want = 1;
+    unsigned __int64 seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (seen >= want)
+        {
+            unsigned __int64 upper = (2ull << b) - 1;
+            return upper < max_us ? upper : max_us;
+        }
+    }
+    return max_us;
+}
+
+stats_t::stats_t() : enabled(false)
+{
+    reset();
+}
+
+void stats_t::reset()
+{
+    for (int i = 0; i < STAT_COUNT; i++) counters[i] = 0;
+    commands.clear();
+}
+
+void stats_t::record_command(const std::string& name, unsigned __int64 us)
+{
+    if (enabled) commands[name].add(us);
+}
+
+const char* stats_t::name(stat_id_t id)
+{
+    return stat_names[id];
+}
+
+void stats_t::print(FILE* out) const
+{
+    fprintf(out, "Statistics %s\n", enabled ? "enabled" : "disabled");
+    for (int i = 0; i < STAT_COUNT; i++)
+        fprintf(out, "  %-20s %llu\n", stat_names[i], (unsigned __int64)counters[i]);
+
+    if (commands.empty()) return;
+    fprintf(out, "\n  %-12s %8s %12s %10s %10s %10s %10s\n", "command", "count", "total(ms)", "avg(us)", "p50(us)", "p99(us)", "max(us)");
+    for (auto it = commands.begin(); it != commands.end(); ++it)
+    {
+        const latency_hist_t& h = it->second;
+        fprintf(out, "  %-12s %8llu %12.3f %10llu %10llu %10llu %10llu\n", it->first.c_str(), h.count,
+            h.total_us / 1000.0, h.total_us / h.count, h.percentile(0.5), h.percentile(0.99), h.max_us);
+    }
+}
+
+// 命令名来自用户输入，输出 JSON 前转义
+static void print_json_string(FILE* out, const std::string& s)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+void stats_t::print_json(FILE* out) const
+{
+    fprintf(out, "{\"enabled\":%s,\"counters\":{", enabled ? "true" : "false");
+    for (int i = 0; i < STAT_COUNT; i++)
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", stat_names[i], (unsigned __int64)counters[i]);
+    fprintf(out, "},\"commands\":{");
+    for (auto it = commands.begin(); it != commands.end(); ++it)
+    {
+        const latency_hist_t& h = it->second;
+        if (it != commands.begin()) fputc(',', out);
+        print_json_string(out, it->first);
+        fprintf(out, ":{\"count\":%llu,\"total_us\":%llu,\"max_us\":%llu,\"p50_us\":%llu,\"p99_us\":%llu,\"buckets\":[",
+            h.count, h.total_us, h.max_us, h.percentile(0.5), h.percentile(0.99));
+        // 只输出到最后一个非空桶
+        int last = latency_hist_t::BUCKETS - 1;
+        while (last > 0 && h.buckets[last] == 0) last--;
+        for (int b = 0; b <= last; b++)
+            fprintf(out, "%s%llu", b ? "," : "", h.buckets[b]);
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}\n");
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdio.h>
+#include <map>
+#include <atomic>
+#include <string>
+#include "platform.h"
+
+// 运行统计：I/O、缓存、分配器等热路径上的计数器，以及按 REPL 命令分类的延迟直方图。
+// 默认关闭，关闭时每个统计点只多一次对 enabled 的判断；编译时定义 EXT2_NO_STATS 则完全去掉。
+
+enum stat_id_t
+{
+    STAT_SEEKS,           // 实际执行的定位（同方向的顺序读写不再定位）
+    STAT_READ_CALLS,      // 对镜像的读调用次数
+    STAT_WRITE_CALLS,     // 对镜像的 fwrite 次数
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_FSYNCS,          // 日志和镜像的同步次数
+    STAT_TXN_OVERLAYS,    // 读取时用事务脏块覆盖的块数
+    STAT_COW_READS,       // 从写时复制覆盖层读取的粒度数
+    STAT_COW_WRITES,      // 写入写时复制覆盖层的粒度数
+    STAT_VDISK_GT_HITS,   // VMDK 粒度表缓存命中
+    STAT_VDISK_GT_MISSES,
+    STAT_VDISK_GRAIN_HITS, // 解压后的 VMDK 粒度缓存命中
+    STAT_VDISK_GRAIN_MISSES,
+    STAT_VDISK_ZERO_READS, // 未分配的粒度或 ZERO 区段，直接填 0 不读文件
+    STAT_INDEX_HITS,      // 索引块缓存命中
+    STAT_INDEX_MISSES,
+    STAT_DIRSLOT_HITS,    // 目录空闲槽位表命中
+    STAT_DIRSLOT_MISSES,
+    STAT_BLOCK_ALLOCS,
+    STAT_BLOCK_FREES,
+    STAT_INODE_ALLOCS,
+    STAT_INODE_FREES,
+    STAT_BITMAP_SCANS,    // 分配时读取并扫描的位图块数
+    STAT_BITMAP_RMW,      // 位图块的读-改-写次数
+    STAT_COUNT
+};
+
+// 以 2 的幂为桶边界的延迟直方图：第 i 桶统计 [2^i, 2^(i+1)) 微秒，第 0 桶包括 0
+struct latency_hist_t
+{
+    enum { BUCKETS = 40 };
+    unsigned __int64 count;
+    unsigned __int64 total_us;
+    unsigned __int64 max_us;
+    unsigned __int64 buckets[BUCKETS];
+
+    latency_hist_t();
+    void add(unsigned __int64 us);
+    unsigned __int64 percentile(double p) const; // 返回所在桶的上界（不超过 max_us）
+};
+
+class stats_t
+{
+public:
+    stats_t();
+
+    bool enabled;
+    std::atomic<unsigned __int64> counters[STAT_COUNT]; // 多个线程同时查询时也能正确累加
+    std::map<std::string, latency_hist_t> commands; // 命令名 -> 延迟直方图
+
+    void add(stat_id_t id, unsigned __int64 n) { counters[id].fetch_add(n, std::memory_order_relaxed); }
+    void record_command(const std::string& name, unsigned __int64 us);
+    void reset();
+    void print(FILE* out) const; // 表格形式
+    void print_json(FILE* out) const;
+    static const char* name(stat_id_t id);
+};
+
+// 在 ext2_t 的成员函数中使用
+#ifdef EXT2_NO_STATS
+#define EXT2_STAT(id, n) ((void)0)
+#else
+#define EXT2_STAT(id, n) do { if (stats.enabled) stats.add(id, n); } while (0)
+#endif
@@ -0,0 +1,140 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include "ext2.h"
+
+trace_writer_t::trace_writer_t() : fp(nullptr), ok(false), records(0), start_us(0), cmd(0)
+{
+}
+
+trace_writer_t::~trace_writer_t()
+{
+    close();
+}
+
+unsigned __int64 trace_writer_t::now_us()
+{
+    return (unsigned __int64)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool trace_writer_t::open(const char* path, unsigned __int32 block_size)
+{
+    close();
+    fp = fopen(path, "wb");
+    if (!fp) return false;
+
+    ok = true;
+    records = 0;
+    cmd = 0;
+    cmd_ids.clear();
+    buffer.clear();
+    buffer.reserve(BUFFER_SIZE);
+    start_us = now_us();
+
+    trace_header_t header;
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.block_size = block_size;
+    header.reserved = 0;
+    header.start_time = (unsigned __int64)time(NULL);
+    append(&header, sizeof(header));
+    return true;
+}
+
+bool trace_writer_t::close()
+{
+    if (!fp) return true;
+    flush();
+    ok = fclose(fp) == 0 && ok;
+    fp = nullptr;
+    return ok;
+}
+
+void trace_writer_t::append(const void* data, size_t len)
+{
+    const unsigned __int8* p = (const unsigned __int8*)data;
+    buffer.insert(buffer.end(), p, p + len);
+    if (buffer.size() >= BUFFER_SIZE) flush();
+}
+
+void trace_writer_t::flush()
+{
+    if (!buffer.empty() && fwrite(buffer.data(), buffer.size(), 1, fp) != 1) ok = false;
+    buffer.clear();
+}
+
+void trace_writer_t::set_command(const std::string& name)
+{
+    if (!fp) return;
+    auto it = cmd_ids.find(name);
+    if (it != cmd_ids.end())
+    {
+        cmd = it->second;
+        return;
+    }
+
+    // 编号只有 1 字节，超过 255 个不同的命令名后归到最后一个编号
+    if (cmd_ids.size() >= 255)
+    {
+        cmd = 255;
+        return;
+    }
+    cmd = (unsigned __int8)(cmd_ids.size() + 1);
+    cmd_ids[name] = cmd;
+
+    size_t len = name.size() < 255 ? name.size() : 255;
+    trace_record_t r;
+    r.time_us = now_us() - start_us;
+    r.block = cmd;
+    r.size = (unsigned __int32)len;
+    r.offset = 0;
+    r.kind = TRACE_COMMAND;
+    r.cmd = cmd;
+    append(&r, sizeof(r));
+    append(name.data(), len);
+}
+
+void trace_writer_t::record(trace_kind_t kind, unsigned __int64 off, size_t len, unsigned __int32 block_shift)
+{
+    if (!fp || len == 0) return;
+    trace_record_t r;
+    r.time_us = now_us() - start_us;
+    r.block = (unsigned __int32)(off >> block_shift);
+    r.size = (unsigned __int32)len;
+    r.offset = (unsigned __int16)(off & ((1u << block_shift) - 1));
+    r.kind = (unsigned __int8)kind;
+    r.cmd = cmd;
+    std::lock_guard<std::mutex> hold(lock);
+    append(&r, sizeof(r));
+    records++;
+}
+
+bool ext2_t::trace_start(const char* path)
+{
+    trace_stop();
+    trace = new trace_writer_t;
+    if (!trace->open(path, block_size))
+    {
+        printf("Cannot create trace file %s\n", path);
+        delete trace;
+        trace = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool ext2_t::trace_stop()
+{
+    if (!trace) return true;
+    unsigned __int64 n = trace->count();
+    bool ok = trace->close();
+    delete trace;
+    trace = nullptr;
+    if (ok) printf("Trace closed, %llu accesses recorded.\n", n);
+    else printf("Failed to write trace file.\n");
+    return ok;
+}
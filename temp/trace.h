@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include "platform.h"
+
+// 块访问跟踪：记录 ext2_t 经 read_bytes/write_bytes 发出的每一次读写，
+// 写成紧凑的二进制文件，供 ext2replay 离线回放，评估不同大小和淘汰策略的块缓存。
+//
+// 文件格式：trace_header_t，之后是若干 trace_record_t。kind 为 TRACE_COMMAND 的记录
+// 定义一个命令编号（block 为编号，size 为名字长度），紧跟 size 字节的命令名；
+// 其他记录的 cmd 字段引用这些编号，0 表示不属于任何命令（如打开镜像时的读取）。
+
+#define TRACE_MAGIC   0x52543245 // "E2TR"
+#define TRACE_VERSION 1
+
+enum trace_kind_t
+{
+    TRACE_READ = 0,
+    TRACE_WRITE = 1,
+    TRACE_COMMAND = 2,
+};
+
+#pragma pack(push, 1)
+
+struct trace_header_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 version;
+    unsigned __int32 block_size;
+    unsigned __int32 reserved;
+    unsigned __int64 start_time; // 开始记录的时间（Unix 秒）
+};
+
+struct trace_record_t
+{
+    unsigned __int64 time_us;    // 距开始记录的微秒数
+    unsigned __int32 block;      // 起始块号
+    unsigned __int32 size;       // 字节数
+    unsigned __int16 offset;     // 在起始块内的偏移
+    unsigned __int8 kind;        // trace_kind_t
+    unsigned __int8 cmd;         // 命令编号
+};
+
+#pragma pack(pop)
+
+class trace_writer_t
+{
+public:
+    trace_writer_t();
+    ~trace_writer_t();
+
+    bool open(const char* path, unsigned __int32 block_size);
+    bool close(); // 写出缓冲区并关闭，返回是否全部写入成功
+    void set_command(const std::string& name); // 之后的访问都归到这个命令名下
+    void record(trace_kind_t kind, unsigned __int64 off, size_t len, unsigned __int32 block_shift);
+    unsigned __int64 count() const { return records; }
+
+private:
+    enum { BUFFER_SIZE = 64 * 1024 };
+    FILE* fp;
+    bool ok;
+    unsigned __int64 records;
+    unsigned __int64 start_us;
+    unsigned __int8 cmd;
+    std::map<std::string, unsigned __int8> cmd_ids;
+    std::vector<unsigned __int8> buffer;
+    std::mutex lock; // 多个线程同时查询时 record 逐个追加
+
+    void append(const void* data, size_t len);
+    void flush();
+    static unsigned __int64 now_us();
+};
@@ -0,0 +1,295 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include "ext2.h"
+#include "parallel.h"
+
+// 删除文件恢复：free_inode 只清位图并记下删除时间，块指针保留不动，
+// 数据块只要还没被重新分配就能原样读回。可信度按仍然完好的数据块占应有块数的比例计算
+
+#define UNDELETE_RUN_BLOCKS 256 // recover 时物理连续的块一次最多读取这么多块
+
+// 数据块的现状
+enum
+{
+    BLK_INTACT, // 空闲，或者仍然属于这个 inode（孤儿 inode）
+    BLK_LEAKED, // 位图中已分配但没有任何属主，内容可能还在
+    BLK_REUSED, // 已经属于别的 inode 或元数据
+    BLK_BAD     // 块号越界
+};
+
+struct ext2_t::undelete_t
+{
+    unsigned __int32 ino;
+    unsigned __int32 mode;
+    unsigned __int32 dtime;
+    unsigned __int32 mtime;
+    unsigned __int64 size;
+    unsigned __int32 expected; // 按大小应有的数据块数
+    unsigned __int32 i_block[15];
+    bool orphan; // inode 仍在位图中，只是链接数为 0
+    unsigned __int32 count[4]; // 各种现状的数据块数，其余的块没有映射（空洞或间接块已损坏）
+    std::vector<unsigned __int32> blocks; // keep_blocks 时：逻辑块 -> 可以读取的物理块，0 表示不可用
+
+    unsigned confidence() const
+    {
+        if (expected == 0) return 0;
+        return (unsigned)(((unsigned __int64)count[BLK_INTACT] * 2 + count[BLK_LEAKED]) * 50 / expected);
+    }
+};
+
+// 读取候选 inode 的全部块映射：直接块在调用线程中判断，间接块按级排序后顺序读取、并行解码。
+// 间接块本身已被重用或内容不像块号表时，它下面的数据块都算丢失
+bool ext2_t::undelete_map(std::vector<undelete_t>& cands, unsigned threads, bool keep_blocks)
+{
+    const owner_map_t* map = owner_map();
+    if (!map) return false;
+
+    std::vector<unsigned __int8> bitmap;
+    if (!read_block_bitmaps(threads, bitmap)) return false;
+
+    auto classify = [&](unsigned __int32 ino, unsigned __int32 bn) -> int {
+        if (bn < first_data_block || bn >= blocks_count) return BLK_BAD;
+        const owner_extent_t* e = map->find(bn);
+        if (e) return (owner_map_t::is_data(e->kind) || e->kind == OWN_INDIRECT) && e->owner == ino ? BLK_INTACT : BLK_REUSED;
+        return bitmap_test(bitmap, bn) ? BLK_LEAKED : BLK_INTACT;
+    };
+
+    struct pending_t
+    {
+        unsigned __int32 pblk;
+        unsigned __int32 cand;
+        unsigned __int32 lblk;
+        unsigned __int32 level;
+    };
+    std::vector<std::vector<pending_t>> pend(threads);
+    std::vector<std::vector<unsigned __int32>> counts(threads, std::vector<unsigned __int32>(cands.size() * 4, 0)); // 每个线程分开计数
+    unsigned __int32 ptrs = block_size / 4;
+
+    auto note = [&](unsigned w, unsigned __int32 c, unsigned __int32 lblk, unsigned __int32 bn) {
+        int state = classify(cands[c].ino, bn);
+        counts[w][c * 4 + state]++;
+        if (keep_blocks && state <= BLK_LEAKED) cands[c].blocks[lblk] = bn; // 不同线程写不同的逻辑块
+    };
+    for (unsigned __int32 c = 0; c < cands.size(); c++)
+    {
+        undelete_t& u = cands[c];
+        memset(u.count, 0, sizeof(u.count));
+        if (keep_blocks) u.blocks.assign(u.expected, 0);
+        for (unsigned __int32 i = 0; i < 12 && i < u.expected; i++)
+            if (u.i_block[i] != 0) note(0, c, i, u.i_block[i]);
+        unsigned __int64 lblk = 12, span = ptrs;
+        for (unsigned __int32 level = 1; level <= 3 && lblk < u.expected; level++, lblk += span, span *= ptrs)
+        {
+            unsigned __int32 b = u.i_block[11 + level];
+            if (b == 0 || classify(u.ino, b) >= BLK_REUSED) continue;
+            pending_t p = { b, c, (unsigned __int32)lblk, level };
+            pend[0].push_back(p);
+        }
+    }
+
+    bool ok = true;
+    for (int round = 0; round < 3 && ok; round++)
+    {
+        std::vector<pending_t> todo;
+        for (unsigned t = 0; t < threads; t++)
+        {
+            todo.insert(todo.end(), pend[t].begin(), pend[t].end());
+            pend[t].clear();
+        }
+        if (todo.empty()) break;
+        std::sort(todo.begin(), todo.end(), [](const pending_t& x, const pending_t& y) { return x.pblk < y.pblk; });
+        std::vector<unsigned __int32> blocks(todo.size());
+        for (size_t i = 0; i < todo.size(); i++) blocks[i] = todo[i].pblk;
+        ok = scan_blocks(blocks, threads, [&](unsigned w, size_t index, const unsigned __int8* data) {
+            const pending_t& p = todo[index];
+            const undelete_t& u = cands[p.cand];
+            const le32* v = (const le32*)data;
+            unsigned __int64 span = 1;
+            for (unsigned __int32 l = 1; l < p.level; l++) span *= ptrs;
+            unsigned __int32 n = (unsigned __int32)((u.expected - p.lblk + span - 1) / span); // 用到的指针数
+            if (n > ptrs) n = ptrs;
+            // 块号表里出现越界的值说明这个块已经被别的内容覆盖
+            for (unsigned __int32 i = 0; i < n; i++)
+                if (v[i] != 0 && (v[i] < first_data_block || v[i] >= blocks_count)) return;
+            for (unsigned __int32 i = 0; i < n; i++)
+            {
+                unsigned __int32 b = v[i];
+                unsigned __int32 lblk = (unsigned __int32)(p.lblk + i * span);
+                if (b == 0) continue;
+                if (p.level == 1) note(w, p.cand, lblk, b);
+                else if (classify(u.ino, b) < BLK_REUSED)
+                {
+                    pending_t c = { b, p.cand, lblk, p.level - 1 };
+                    pend[w].push_back(c);
+                }
+            }
+        });
+    }
+    for (size_t c = 0; c < cands.size(); c++)
+        for (unsigned t = 0; t < threads; t++)
+            for (int s = 0; s < 4; s++) cands[c].count[s] += counts[t][c * 4 + s];
+    return ok;
+}
+
+void ext2_t::undelete_scan(const std::vector<std::string>& args)
+{
+    unsigned threads = parallel_run_t::default_threads();
+    unsigned min_confidence = 1;
+    bool usage = false;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if (args[i] == "-j" && i + 1 < args.size()) threads = (unsigned)atoi(args[++i].c_str());
+        else if (args[i] == "-m" && i + 1 < args.size()) min_confidence = (unsigned)atoi(args[++i].c_str());
+        else usage = true;
+    }
+    if (usage || threads == 0 || threads > 64)
+    {
+        fprintf(con, "Usage: undelete_scan [-j threads] [-m min_confidence]\n");
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // 1. 并行扫描全部 inode 表：位图中空闲但留有块指针的 inode，以及链接数为 0 的孤儿 inode
+    std::vector<std::vector<undelete_t>> found(threads);
+    auto candidate = [&](unsigned w, unsigned __int32 ino, const ext2_inode* inode, bool orphan) {
+        unsigned __int32 type = inode->i_mode & 0xF000;
+        if ((type != 0x8000 && type != 0x4000 && type != 0xA000) || !has_block_map(inode)) return;
+        if (inode->i_size == 0 || ino < super_block.s_first_ino) return;
+        undelete_t u = undelete_t();
+        u.ino = ino;
+        u.mode = inode->i_mode;
+        u.dtime = inode->i_dtime;
+        u.mtime = inode->i_mtime;
+        u.size = inode->i_size;
+        if (type == 0x8000) u.size |= (unsigned __int64)inode->i_size_high << 32;
+        u.orphan = orphan;
+        u.expected = size_in_blocks(inode);
+        bool any = false;
+        for (int i = 0; i < 15; i++)
+        {
+            u.i_block[i] = inode->i_block[i];
+            if (u.i_block[i] == 0) continue;
+            if (u.i_block[i] < first_data_block || u.i_block[i] >= blocks_count) return; // 块映射不可信
+            any = true;
+        }
+        if (any) found[w].push_back(u);
+    };
+    inode_visitor_t unused = [&](unsigned w, unsigned __int32 ino, const ext2_inode* inode) {
+        if (inode->i_mode != 0) candidate(w, ino, inode, false);
+    };
+    bool ok = scan_inodes(threads, [&](unsigned w, unsigned __int32 ino, const ext2_inode* inode) {
+        if (inode->i_links_count == 0 && inode->i_dtime != 0) candidate(w, ino, inode, true);
+    }, nullptr, &unused);
+    if (!ok)
+    {
+        fprintf(con, "Failed to read inode tables.\n");
+        return;
+    }
+    std::vector<undelete_t> cands;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        cands.insert(cands.end(), found[t].begin(), found[t].end());
+        std::vector<undelete_t>().swap(found[t]);
+    }
+
+    // 2. 块映射逐块对照属主表和块位图
+    if (!undelete_map(cands, threads, false))
+    {
+        fprintf(con, "Failed to read block maps of deleted inodes.\n");
+        return;
+    }
+
+    // 3. 可信度高的在前，同样可信度时最近删除的在前
+    std::sort(cands.begin(), cands.end(), [](const undelete_t& x, const undelete_t& y) {
+        unsigned a = x.confidence(), b = y.confidence();
+        return a != b ? a > b : x.dtime != y.dtime ? x.dtime > y.dtime : x.ino < y.ino;
+    });
+    size_t shown = 0;
+    for (size_t i = 0; i < cands.size(); i++)
+    {
+        const undelete_t& u = cands[i];
+        unsigned confidence = u.confidence();
+        if (confidence < min_confidence) continue;
+        unsigned __int32 type = u.mode & 0xF000;
+        fprintf(con, "%8u %3u%%  %c %12llu  %s  %u/%u blocks intact", u.ino, confidence, type == 0x4000 ? 'd' : type == 0xA000 ? 'l' : 'f',
+            u.size, u.dtime ? time2str(u.dtime) : "(no deletion time)      ", u.count[BLK_INTACT], u.expected);
+        if (u.count[BLK_LEAKED]) fprintf(con, ", %u unreferenced", u.count[BLK_LEAKED]);
+        if (u.count[BLK_REUSED]) fprintf(con, ", %u reused", u.count[BLK_REUSED]);
+        if (u.orphan) fprintf(con, ", orphan");
+        fprintf(con, "\n");
+        shown++;
+    }
+    unsigned __int64 ms = (unsigned __int64)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    fprintf(con, "%zu recoverable of %zu deleted inodes (%u inodes scanned, %u threads, %llu ms)\n", shown, cands.size(),
+        inodes_count, threads, ms);
+}
+
+bool ext2_t::recover(unsigned __int32 ino, const char* host_path)
+{
+    if (ino < 1 || ino > inodes_count)
+    {
+        printf("Invalid inode number.\n");
+        return false;
+    }
+    scratch_t scratch(arena());
+    ext2_inode* inode = scratch.alloc<ext2_inode>(inode_size);
+    if (!load_inode(ino, inode))
+    {
+        printf("Failed to read inode.\n");
+        return false;
+    }
+    std::vector<undelete_t> cands(1);
+    undelete_t& u = cands[0];
+    u.ino = ino;
+    u.size = inode->i_size;
+    if ((inode->i_mode & 0xF000) == 0x8000) u.size |= (unsigned __int64)inode->i_size_high << 32;
+    u.expected = size_in_blocks(inode);
+    for (int i = 0; i < 15; i++) u.i_block[i] = inode->i_block[i];
+    if (!undelete_map(cands, parallel_run_t::default_threads(), true))
+    {
+        printf("Failed to read the block map.\n");
+        return false;
+    }
+
+    FILE* out = fopen(host_path, "wb");
+    if (!out)
+    {
+        printf("Cannot create %s\n", host_path);
+        return false;
+    }
+    // 按逻辑顺序写出，物理连续的块合并读取；不可用的块写 0
+    std::vector<unsigned __int8> buf((size_t)UNDELETE_RUN_BLOCKS << block_shift);
+    unsigned __int64 written = 0;
+    bool ok = true;
+    for (unsigned __int32 l = 0; l < u.expected && written < u.size && ok; )
+    {
+        unsigned __int32 n = 1;
+        if (u.blocks[l] != 0)
+            while (l + n < u.expected && n < UNDELETE_RUN_BLOCKS && u.blocks[l + n] == u.blocks[l] + n) n++;
+        size_t bytes = (size_t)n << block_shift;
+        if (u.size - written < bytes) bytes = (size_t)(u.size - written);
+        if (u.blocks[l] == 0) memset(buf.data(), 0, bytes);
+        else if (!read_bytes((unsigned __int64)u.blocks[l] << block_shift, buf.data(), bytes)) ok = false;
+        if (ok && fwrite(buf.data(), 1, bytes, out) != bytes) ok = false;
+        written += bytes;
+        l += n;
+    }
+    if (fclose(out) != 0) ok = false;
+    if (!ok)
+    {
+        printf("Failed to write %s\n", host_path);
+        return false;
+    }
+    unsigned __int32 lost = u.expected - u.count[BLK_INTACT] - u.count[BLK_LEAKED];
+    printf("Recovered %llu bytes of inode %u to %s (%u%% confidence): %u of %u blocks intact", u.size, ino, host_path,
+        u.confidence(), u.count[BLK_INTACT], u.expected);
+    if (u.count[BLK_LEAKED]) printf(", %u unreferenced", u.count[BLK_LEAKED]);
+    if (lost) printf(", %u reused or missing (written as zeros)", lost);
+    printf("\n");
+    return true;
+}
@@ -0,0 +1,585 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include "ext2.h"
+
+#define VMDK_GD_AT_END   0xffffffffffffffffull // streamOptimized：粒度目录位置写在文件末尾的头部副本中
+#define VMDK_FLAG_COMPRESSED (1u << 16)
+#define VMDK_MAX_GRAIN   (1u << 20) // 规范中粒度通常为 64KB，超过 1MB 视为损坏
+#define VMDK_GT_CACHE    1024       // 缓存的粒度表数（每张 512 项时约 2MB，覆盖 32GB）
+#define VMDK_GRAIN_CACHE 128        // 缓存的解压后粒度数（64KB 粒度时 8MB）
+
+vdisk_t::vdisk_t(stats_t& s)
+    : stats(s), rw(false), capacity(0), gt_cache(VMDK_GT_CACHE), grain_cache(VMDK_GRAIN_CACHE)
+{
+}
+
+vdisk_t::~vdisk_t()
+{
+    for (size_t i = 0; i < extents.size(); i++)
+        if (extents[i].fp) fclose(extents[i].fp);
+}
+
+// 读取文件开头，判断是稀疏格式的头部还是文本描述符
+static size_t read_head(const char* path, char* buf, size_t len)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t n = fread(buf, 1, len, f);
+    fclose(f);
+    return n;
+}
+
+static bool is_descriptor(const char* text, size_t len)
+{
+    const char* tag = "# Disk DescriptorFile";
+    return len >= strlen(tag) && memcmp(text, tag, strlen(tag)) == 0;
+}
+
+bool vdisk_t::probe(const char* path)
+{
+    char head[64];
+    size_t n = read_head(path, head, sizeof(head));
+    if (n >= 4 && *(unsigned __int32*)head == VMDK_SPARSE_MAGIC) return true;
+    return is_descriptor(head, n);
+}
+
+// 描述符中 key=value 或 key="value" 的值，没有时返回空串
+static std::string descriptor_value(const std::string& text, const char* key)
+{
+    size_t pos = 0, klen = strlen(key);
+    while (pos < text.size())
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.compare(0, klen, key) != 0) continue;
+        size_t eq = line.find('=', klen);
+        if (eq == std::string::npos || line.find_first_not_of(" \t", klen) != eq) continue;
+        std::string value = line.substr(eq + 1);
+        size_t b = value.find_first_not_of(" \t\"");
+        size_t e = value.find_last_not_of(" \t\"\r");
+        return b == std::string::npos ? std::string() : value.substr(b, e - b + 1);
+    }
+    return std::string();
+}
+
+// 差分磁盘需要父磁盘提供未分配的粒度，这里没有实现
+static bool has_parent(const std::string& text)
+{
+    std::string parent = descriptor_value(text, "parentCID");
+    return !parent.empty() && parent != "ffffffff";
+}
+
+bool vdisk_t::open(const char* path, bool writable)
+{
+    rw = writable;
+    char head[sizeof(vmdk_sparse_header_t)];
+    size_t n = read_head(path, head, sizeof(head));
+    if (n >= 4 && *(unsigned __int32*)head == VMDK_SPARSE_MAGIC)
+    {
+        // monolithicSparse / streamOptimized：描述符内嵌在稀疏文件中，只有一个区段
+        extent_t e;
+        e.type = EXTENT_SPARSE;
+        e.path = path;
+        e.start = 0;
+        extents.push_back(e); // 先放入列表，失败时由析构函数关闭文件
+        if (!open_sparse(extents.back(), 0)) return false;
+        capacity = extents.back().length;
+        return true;
+    }
+
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    std::string text;
+    char buf[4096];
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0 && text.size() < (1u << 20)) text.append(buf, n);
+    fclose(f);
+    if (!is_descriptor(text.data(), text.size()))
+    {
+        printf("%s is not a VMDK descriptor\n", path);
+        return false;
+    }
+    return open_descriptor(path, text);
+}
+
+bool vdisk_t::open_descriptor(const std::string& path, const std::string& text)
+{
+    create_type = descriptor_value(text, "createType");
+    if (has_parent(text))
+    {
+        printf("%s is a differencing disk, which is not supported\n", path.c_str());
+        return false;
+    }
+
+    // 区段文件名相对于描述符所在目录
+    size_t slash = path.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+    // 区段行：<访问方式> <扇区数> <类型> ["文件名" [起始扇区]]
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        char access[16], type[16];
+        unsigned __int64 sectors;
+        if (sscanf(line.c_str(), "%15s %llu %15s", access, &sectors, type) != 3) continue;
+        if (strcmp(access, "RW") != 0 && strcmp(access, "RDONLY") != 0 && strcmp(access, "NOACCESS") != 0) continue;
+
+        extent_t e;
+        e.fp = nullptr;
+        e.start = capacity;
+        e.length = sectors * 512;
+        e.file_offset = 0;
+        size_t q1 = line.find('"'), q2 = q1 == std::string::npos ? q1 : line.find('"', q1 + 1);
+        if (q2 != std::string::npos)
+        {
+            e.path = dir + line.substr(q1 + 1, q2 - q1 - 1);
+            unsigned __int64 offset = 0;
+            if (sscanf(line.c_str() + q2 + 1, "%llu", &offset) == 1) e.file_offset = offset * 512;
+        }
+
+        if (strcmp(type, "ZERO") == 0)
+        {
+            e.type = EXTENT_ZERO;
+            extents.push_back(e);
+        }
+        else if (strcmp(type, "FLAT") == 0 || strcmp(type, "VMFS") == 0)
+        {
+            e.type = EXTENT_FLAT;
+            bool w = rw && strcmp(access, "RW") == 0;
+            e.fp = fopen(e.path.c_str(), w ? "r+b" : "rb");
+            if (!e.fp)
+            {
+                printf("Cannot open extent %s\n", e.path.c_str());
+                return false;
+            }
+            if (!w) rw = false;
+            extents.push_back(e);
+        }
+        else if (strcmp(type, "SPARSE") == 0)
+        {
+            e.type = EXTENT_SPARSE;
+            extents.push_back(e);
+            if (!open_sparse(extents.back(), e.length)) return false;
+        }
+        else
+        {
+            printf("Unsupported extent type %s in %s\n", type, path.c_str());
+            return false;
+        }
+        capacity += extents.back().length;
+    }
+
+    if (extents.empty())
+    {
+        printf("No extents in %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool vdisk_t::open_sparse(extent_t& e, unsigned __int64 max_length)
+{
+    e.fp = fopen(e.path.c_str(), "rb");
+    if (!e.fp)
+    {
+        printf("Cannot open extent %s\n", e.path.c_str());
+        return false;
+    }
+
+    vmdk_sparse_header_t header;
+    if (!pread(e.fp, 0, &header, sizeof(header)) || header.magic != VMDK_SPARSE_MAGIC || header.version > 3)
+    {
+        printf("%s: not a VMDK sparse extent\n", e.path.c_str());
+        return false;
+    }
+    if (header.gd_offset == VMDK_GD_AT_END)
+    {
+        // streamOptimized 在写完所有粒度后才知道粒度目录的位置，文件末尾依次是
+        // 尾部标记、头部副本和结束标记（各一个扇区）
+        _fseeki64(e.fp, 0, SEEK_END);
+        unsigned __int64 size = (unsigned __int64)_ftelli64(e.fp);
+        if (size < 1536 || !pread(e.fp, size - 1024, &header, sizeof(header)) || header.magic != VMDK_SPARSE_MAGIC ||
+            header.gd_offset == VMDK_GD_AT_END)
+        {
+            printf("%s: missing footer\n", e.path.c_str());
+            return false;
+        }
+    }
+
+    if (header.grain_size == 0 || (header.grain_size & (header.grain_size - 1)) || header.grain_size * 512 > VMDK_MAX_GRAIN ||
+        header.gtes_per_gt == 0 || header.gtes_per_gt > 65536)
+    {
+        printf("%s: bad grain geometry\n", e.path.c_str());
+        return false;
+    }
+    e.grain_bytes = header.grain_size * 512;
+    e.gtes_per_gt = header.gtes_per_gt;
+    e.compressed = (header.flags & VMDK_FLAG_COMPRESSED) && header.compress_algorithm != 0;
+    if (e.compressed && header.compress_algorithm != 1)
+    {
+        printf("%s: unsupported compression %u\n", e.path.c_str(), header.compress_algorithm);
+        return false;
+    }
+    e.length = header.capacity * 512;
+    if (max_length && max_length < e.length) e.length = max_length;
+
+    if (create_type.empty() && header.descriptor_offset && header.descriptor_size && header.descriptor_size < 2048)
+    {
+        std::string text((size_t)header.descriptor_size * 512, '\0');
+        if (pread(e.fp, header.descriptor_offset * 512, &text[0], text.size()))
+        {
+            text.resize(strlen(text.c_str()));
+            create_type = descriptor_value(text, "createType");
+            if (has_parent(text))
+            {
+                printf("%s is a differencing disk, which is not supported\n", e.path.c_str());
+                return false;
+            }
+        }
+    }
+    if (create_type.empty()) create_type = e.compressed ? "streamOptimized" : "monolithicSparse";
+
+    unsigned __int64 span = e.grain_bytes * e.gtes_per_gt; // 一张粒度表覆盖的字节数
+    e.gd.resize((size_t)((header.capacity * 512 + span - 1) / span));
+    if (!e.gd.empty() && !pread(e.fp, header.gd_offset * 512, e.gd.data(), e.gd.size() * 4))
+    {
+        printf("%s: cannot read grain directory\n", e.path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool vdisk_t::pread(FILE* fp, unsigned __int64 pos, void* buf, size_t len)
+{
+    return read_at(fp, pos, buf, len);
+}
+
+bool vdisk_t::read(unsigned __int64 off, void* buf, size_t len)
+{
+    unsigned __int8* dst = (unsigned __int8*)buf;
+    if (off > capacity || len > capacity - off) return false;
+    for (size_t i = 0; i < extents.size() && len > 0; i++)
+    {
+        const extent_t& e = extents[i];
+        if (off >= e.start + e.length) continue;
+        unsigned __int64 rel = off - e.start;
+        size_t n = e.length - rel < len ? (size_t)(e.length - rel) : len;
+        if (!read_extent(i, rel, dst, n)) return false;
+        dst += n;
+        off += n;
+        len -= n;
+    }
+    return len == 0;
+}
+
+bool vdisk_t::read_extent(size_t idx, unsigned __int64 off, unsigned __int8* buf, size_t len)
+{
+    extent_t& e = extents[idx];
+    switch (e.type)
+    {
+    case EXTENT_FLAT:
+        return pread(e.fp, e.file_offset + off, buf, len);
+    case EXTENT_ZERO:
+        EXT2_STAT(STAT_VDISK_ZERO_READS, 1);
+        memset(buf, 0, len);
+        return true;
+    default:
+    {
+        // 粒度表和粒度缓存是共享的，稀疏区段的读取逐个进行；FLAT 和 ZERO 区段不加锁
+        std::lock_guard<std::mutex> hold(sparse_lock);
+        return read_sparse(idx, off, buf, len);
+    }
+    }
+}
+
+bool vdisk_t::read_sparse(size_t idx, unsigned __int64 off, unsigned __int8* buf, size_t len)
+{
+    extent_t& e = extents[idx];
+    // 未压缩的粒度在文件中往往连续存放，相邻粒度合并成一次读取
+    unsigned __int64 run_pos = 0;
+    unsigned __int8* run_dst = nullptr;
+    size_t run_len = 0;
+
+    while (len > 0)
+    {
+        unsigned __int64 grain = off / e.grain_bytes;
+        size_t in_grain = (size_t)(off % e.grain_bytes);
+        size_t n = e.grain_bytes - in_grain < len ? (size_t)(e.grain_bytes - in_grain) : len;
+        unsigned __int32 gt = (unsigned __int32)(grain / e.gtes_per_gt);
+
+        unsigned __int32 sector = 0;
+        if (gt < e.gd.size() && e.gd[gt] != 0)
+        {
+            const unsigned __int32* table = grain_table(idx, gt);
+            if (!table) return false;
+            sector = table[grain % e.gtes_per_gt];
+        }
+
+        if (sector <= 1) // 0 为未分配，1 为全零粒度
+        {
+            EXT2_STAT(STAT_VDISK_ZERO_READS, 1);
+            memset(buf, 0, n);
+        }
+        else if (e.compressed)
+        {
+            const unsigned __int8* data = grain_data(idx, grain, sector);
+            if (!data) return false;
+            memcpy(buf, data + in_grain, n);
+        }
+        else
+        {
+            unsigned __int64 pos = (unsigned __int64)sector * 512 + in_grain;
+            if (run_len && run_pos + run_len == pos && run_dst + run_len == buf)
+            {
+                run_len += n;
+            }
+            else
+            {
+                if (run_len && !pread(e.fp, run_pos, run_dst, run_len)) return false;
+                run_pos = pos;
+                run_dst = buf;
+                run_len = n;
+            }
+        }
+        buf += n;
+        off += n;
+        len -= n;
+    }
+    return run_len == 0 || pread(e.fp, run_pos, run_dst, run_len);
+}
+
+const unsigned __int32* vdisk_t::grain_table(size_t idx, unsigned __int32 gt)
+{
+    unsigned __int64 key = ((unsigned __int64)idx << 32) | gt;
+    std::vector<unsigned __int32>* table = gt_cache.find(key);
+    if (table)
+    {
+        EXT2_STAT(STAT_VDISK_GT_HITS, 1);
+        return table->data();
+    }
+
+    EXT2_STAT(STAT_VDISK_GT_MISSES, 1);
+    extent_t& e = extents[idx];
+    std::vector<unsigned __int32> data(e.gtes_per_gt);
+    if (!pread(e.fp, (unsigned __int64)e.gd[gt] * 512, data.data(), data.size() * 4)) return nullptr;
+    table = gt_cache.insert(key);
+    table->swap(data);
+    return table->data();
+}
+
+const unsigned __int8* vdisk_t::grain_data(size_t idx, unsigned __int64 grain, unsigned __int32 sector)
+{
+    unsigned __int64 key = ((unsigned __int64)idx << 40) | grain;
+    std::vector<unsigned __int8>* cached = grain_cache.find(key);
+    if (cached)
+    {
+        EXT2_STAT(STAT_VDISK_GRAIN_HITS, 1);
+        return cached->data();
+    }
+
+    // 压缩粒度的标记：8 字节逻辑扇区号、4 字节压缩后长度，紧跟压缩数据
+    EXT2_STAT(STAT_VDISK_GRAIN_MISSES, 1);
+    extent_t& e = extents[idx];
+    unsigned __int8 marker[12];
+    unsigned __int64 pos = (unsigned __int64)sector * 512;
+    if (!pread(e.fp, pos, marker, sizeof(marker))) return nullptr;
+    unsigned __int64 lba = *(unsigned __int64*)marker;
+    unsigned __int32 size = *(unsigned __int32*)(marker + 8);
+    if (lba != grain * (e.grain_bytes / 512) || size == 0 || size > 2 * e.grain_bytes + 1024)
+    {
+        printf("%s: bad grain marker at sector %u\n", e.path.c_str(), sector);
+        return nullptr;
+    }
+    packed.resize(size);
+    if (!pread(e.fp, pos + sizeof(marker), packed.data(), size)) return nullptr;
+
+    std::vector<unsigned __int8> data((size_t)e.grain_bytes);
+    size_t out = 0;
+    if (!inflate_zlib(packed.data(), size, data.data(), data.size(), &out))
+    {
+        printf("%s: corrupt compressed grain %llu\n", e.path.c_str(), grain);
+        return nullptr;
+    }
+    memset(data.data() + out, 0, data.size() - out); // 磁盘末尾的粒度可能不满
+    cached = grain_cache.insert(key);
+    cached->swap(data);
+    return cached->data();
+}
+
+bool vdisk_t::write(unsigned __int64 off, const void* buf, size_t len)
+{
+    const unsigned __int8* src = (const unsigned __int8*)buf;
+    if (!rw || off > capacity || len > capacity - off) return false;
+    for (size_t i = 0; i < extents.size() && len > 0; i++)
+    {
+        const extent_t& e = extents[i];
+        if (off >= e.start + e.length) continue;
+        if (e.type != EXTENT_FLAT) return false;
+        unsigned __int64 rel = off - e.start;
+        size_t n = e.length - rel < len ? (size_t)(e.length - rel) : len;
+        // 立即交给操作系统，按位置的读取才能看到
+        if (_fseeki64(e.fp, e.file_offset + rel, SEEK_SET) != 0 || fwrite(src, n, 1, e.fp) != 1 || fflush(e.fp) != 0) return false;
+        src += n;
+        off += n;
+        len -= n;
+    }
+    return len == 0;
+}
+
+bool vdisk_t::sync()
+{
+    bool ok = true;
+    for (size_t i = 0; i < extents.size(); i++)
+        if (extents[i].type == EXTENT_FLAT && rw) ok = sync_file(extents[i].fp) && ok;
+    return ok;
+}
+
+bool vdisk_t::writable() const
+{
+    if (!rw) return false;
+    for (size_t i = 0; i < extents.size(); i++)
+        if (extents[i].type != EXTENT_FLAT) return false;
+    return true;
+}
+
+void vdisk_t::print_info()
+{
+    static const char* const type_names[] = { "FLAT", "ZERO", "SPARSE" };
+    printf("VMDK %s, %llu MB, %s\n", create_type.empty() ? "(unknown type)" : create_type.c_str(), capacity >> 20,
+        writable() ? "read-write" : "read-only");
+    for (size_t i = 0; i < extents.size(); i++)
+    {
+        const extent_t& e = extents[i];
+        printf("  extent %zu: %-6s %12llu +%llu MB  %s", i, type_names[e.type], e.start >> 9, e.length >> 20, e.path.c_str());
+        if (e.type == EXTENT_SPARSE)
+            printf("  (grain %llu KB, %zu grain tables%s)", e.grain_bytes >> 10, e.gd.size(), e.compressed ? ", compressed" : "");
+        printf("\n");
+    }
+    printf("  cached: %zu grain tables, %zu decompressed grains\n", gt_cache.size(), grain_cache.size());
+}
+
+void ext2_t::disk_info()
+{
+    if (!disk)
+    {
+        printf("Raw image %s, %llu MB\n", image_path.c_str(), image_size >> 20);
+        return;
+    }
+    disk->print_info();
+}
+
+sparse_writer_t::sparse_writer_t() : fp(nullptr), capacity_sectors(0), grain_sectors(0), overhead(0), next_sector(0)
+{
+}
+
+sparse_writer_t::~sparse_writer_t()
+{
+    if (fp)
+    {
+        // 没有 close 成功的文件不完整，不保留
+        fclose(fp);
+        remove(path.c_str());
+    }
+}
+
+bool sparse_writer_t::write_at(unsigned __int64 sector, const void* data, size_t len)
+{
+    return _fseeki64(fp, sector * 512, SEEK_SET) == 0 && fwrite(data, len, 1, fp) == 1;
+}
+
+bool sparse_writer_t::open(const char* p, unsigned __int64 capacity, unsigned __int32 grain_bytes)
+{
+    path = p;
+    capacity_sectors = (capacity + 511) / 512;
+    grain_sectors = grain_bytes / 512;
+    tables.clear();
+    fp = fopen(p, "w+b");
+    if (!fp) return false;
+
+    // 内嵌描述符紧跟头部，粒度从下一个粒度边界开始
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    char text[1024];
+    int len = snprintf(text, sizeof(text),
+        "# Disk DescriptorFile\nversion=1\nCID=fffffffe\nparentCID=ffffffff\ncreateType=\"monolithicSparse\"\n\n"
+        "# Extent description\nRW %llu SPARSE \"%s\"\n\n# The Disk Data Base\nddb.virtualHWVersion = \"4\"\n",
+        capacity_sectors, name.c_str());
+    if (len < 0 || len >= (int)sizeof(text)) return false;
+    std::vector<unsigned __int8> desc(text, text + len);
+    desc.resize((desc.size() + 511) / 512 * 512, 0);
+    overhead = (1 + desc.size() / 512 + grain_sectors - 1) / grain_sectors * grain_sectors;
+    next_sector = overhead;
+
+    vmdk_sparse_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = VMDK_SPARSE_MAGIC;
+    header.version = 1;
+    header.descriptor_offset = 1;
+    header.descriptor_size = desc.size() / 512;
+    if (!write_at(0, &header, sizeof(header)) || !write_at(1, desc.data(), desc.size())) return false;
+    return true;
+}
+
+bool sparse_writer_t::put_grain(unsigned __int64 grain, const void* data)
+{
+    unsigned __int32 gt = (unsigned __int32)(grain / GTES_PER_GT);
+    std::vector<unsigned __int32>& table = tables[gt];
+    if (table.empty()) table.resize(GTES_PER_GT, 0);
+    unsigned __int32& entry = table[grain % GTES_PER_GT];
+    unsigned __int64 sector = entry ? entry : next_sector; // 重复写入同一粒度时原地覆盖
+    if (!write_at(sector, data, (size_t)grain_sectors * 512)) return false;
+    if (!entry)
+    {
+        entry = (unsigned __int32)sector;
+        next_sector += grain_sectors;
+    }
+    return true;
+}
+
+bool sparse_writer_t::close()
+{
+    // 没有任何粒度的粒度表不写出，对应的目录项为 0（整张表未分配）
+    unsigned __int64 span = (unsigned __int64)grain_sectors * GTES_PER_GT;
+    std::vector<unsigned __int32> gd((size_t)((capacity_sectors + span - 1) / span), 0);
+    unsigned __int64 sector = next_sector;
+    for (auto it = tables.begin(); it != tables.end(); ++it)
+    {
+        if (it->first >= gd.size() || !write_at(sector, it->second.data(), GTES_PER_GT * 4)) return false;
+        gd[it->first] = (unsigned __int32)sector;
+        sector += GTES_PER_GT * 4 / 512;
+    }
+    unsigned __int64 gd_offset = sector;
+    const unsigned __int8* gd_data = (const unsigned __int8*)gd.data();
+    std::vector<unsigned __int8> gd_bytes(gd_data, gd_data + gd.size() * 4);
+    gd_bytes.resize((gd_bytes.size() + 511) / 512 * 512, 0);
+    if (!gd_bytes.empty() && !write_at(gd_offset, gd_bytes.data(), gd_bytes.size())) return false;
+    next_sector = gd_offset + gd_bytes.size() / 512;
+
+    vmdk_sparse_header_t header;
+    if (_fseeki64(fp, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, fp) != 1) return false;
+    header.flags = 1; // 换行符检测字段有效
+    header.capacity = capacity_sectors;
+    header.grain_size = grain_sectors;
+    header.gtes_per_gt = GTES_PER_GT;
+    header.rgd_offset = 0;
+    header.gd_offset = gd_offset;
+    header.overhead = overhead;
+    header.single_end_line = '\n';
+    header.non_end_line = ' ';
+    header.double_end_line1 = '\r';
+    header.double_end_line2 = '\n';
+    if (!write_at(0, &header, sizeof(header))) return false;
+
+    bool ok = fclose(fp) == 0;
+    fp = nullptr;
+    if (!ok) remove(path.c_str());
+    return ok;
+}
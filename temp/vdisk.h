@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <mutex>
+#include "platform.h"
+#include "stats.h"
+
+// VMDK 虚拟磁盘：把描述符文件、monolithicSparse 和 streamOptimized 镜像还原成按字节寻址的磁盘。
+// 裸镜像（包括 -flat.vmdk）不经过这里，仍由 ext2_t 直接读写。
+//
+// 支持的区段（extent）：FLAT/VMFS（可读写）、ZERO、SPARSE（托管稀疏格式，KDMV 头）。
+// 稀疏区段按粒度目录 -> 粒度表 -> 粒度两级寻址；粒度表按需读入并缓存，
+// 未分配的粒度直接读出 0，不做任何 I/O；压缩粒度解压后放入粒度缓存。
+// 稀疏区段只读，写入需要配合写时复制覆盖层。
+
+bool inflate_zlib(const unsigned __int8* src, size_t src_len, unsigned __int8* dst, size_t dst_len, size_t* out_len); // 解压 zlib 格式的数据，见 inflate.cpp
+
+#define VMDK_SPARSE_MAGIC 0x564d444b // "KDMV"
+
+#pragma pack(push, 1)
+
+struct vmdk_sparse_header_t
+{
+    unsigned __int32 magic;
+    unsigned __int32 version;
+    unsigned __int32 flags;
+    unsigned __int64 capacity;          // 扇区数
+    unsigned __int64 grain_size;        // 每个粒度的扇区数
+    unsigned __int64 descriptor_offset; // 内嵌描述符的扇区号
+    unsigned __int64 descriptor_size;
+    unsigned __int32 gtes_per_gt;       // 每张粒度表的项数
+    unsigned __int64 rgd_offset;        // 冗余粒度目录
+    unsigned __int64 gd_offset;         // 粒度目录；streamOptimized 中为 GD_AT_END，真实值在文件末尾的副本中
+    unsigned __int64 overhead;
+    unsigned __int8 unclean_shutdown;
+    char single_end_line;
+    char non_end_line;
+    char double_end_line1;
+    char double_end_line2;
+    unsigned __int16 compress_algorithm; // 1 为 deflate
+    unsigned __int8 pad[433];
+};
+
+#pragma pack(pop)
+
+// 按最近使用顺序淘汰的定长缓存
+template <typename V>
+class lru_cache_t
+{
+public:
+    explicit lru_cache_t(size_t cap) : capacity(cap) {}
+
+    V* find(unsigned __int64 key)
+    {
+        auto it = items.find(key);
+        if (it == items.end()) return nullptr;
+        order.splice(order.begin(), order, it->second.second);
+        return &it->second.first;
+    }
+    V* insert(unsigned __int64 key) // 返回新插入的值，必要时先淘汰最久未用的一项
+    {
+        if (items.size() >= capacity)
+        {
+            items.erase(order.back());
+            order.pop_back();
+        }
+        order.push_front(key);
+        auto& slot = items[key];
+        slot.second = order.begin();
+        return &slot.first;
+    }
+    void clear() { items.clear(); order.clear(); }
+    size_t size() const { return items.size(); }
+
+private:
+    size_t capacity;
+    std::list<unsigned __int64> order; // 表头最近使用
+    std::map<unsigned __int64, std::pair<V, std::list<unsigned __int64>::iterator>> items;
+};
+
+class vdisk_t
+{
+public:
+    explicit vdisk_t(stats_t& s);
+    ~vdisk_t();
+
+    static bool probe(const char* path); // 是否为需要经过本层解析的 VMDK（描述符或稀疏格式）
+    bool open(const char* path, bool writable);
+    bool read(unsigned __int64 off, void* buf, size_t len);
+    bool write(unsigned __int64 off, const void* buf, size_t len); // 只能写 FLAT 区段
+    bool sync(); // 把各区段文件的写入同步到磁盘
+    bool writable() const; // 全部区段都是 FLAT 且以读写方式打开
+    unsigned __int64 size() const { return capacity; }
+    void print_info(); // 打印磁盘类型、区段和缓存状态
+
+private:
+    enum extent_type_t { EXTENT_FLAT, EXTENT_ZERO, EXTENT_SPARSE };
+
+    struct extent_t
+    {
+        extent_type_t type;
+        std::string path;
+        FILE* fp;
+        unsigned __int64 start;  // 在虚拟磁盘中的起始字节
+        unsigned __int64 length; // 字节数
+        unsigned __int64 file_offset; // FLAT：数据在文件中的起始字节
+
+        // SPARSE
+        unsigned __int64 grain_bytes;
+        unsigned __int32 gtes_per_gt;
+        bool compressed; // streamOptimized：粒度表项指向 { lba, size, 压缩数据 } 标记
+        std::vector<unsigned __int32> gd; // 粒度目录：粒度表号 -> 粒度表所在扇区
+    };
+
+    stats_t& stats;
+    std::string create_type;
+    bool rw;
+    unsigned __int64 capacity;
+    std::vector<extent_t> extents;
+
+    // 粒度表缓存：键为 (区段号 << 32) | 粒度表号，每张表 gtes_per_gt 项
+    lru_cache_t<std::vector<unsigned __int32>> gt_cache;
+    // 解压后的粒度缓存：键为 (区段号 << 40) | 粒度号
+    lru_cache_t<std::vector<unsigned __int8>> grain_cache;
+    std::vector<unsigned __int8> packed; // 读取压缩粒度的临时缓冲区
+    std::mutex sparse_lock; // 保护上面的两个缓存和 packed；多个线程读稀疏区段时逐个进行
+
+    bool open_descriptor(const std::string& path, const std::string& text);
+    bool open_sparse(extent_t& e, unsigned __int64 max_length);
+    bool read_extent(size_t idx, unsigned __int64 off, unsigned __int8* buf, size_t len);
+    bool read_sparse(size_t idx, unsigned __int64 off, unsigned __int8* buf, size_t len);
+    const unsigned __int32* grain_table(size_t idx, unsigned __int32 gt);
+    const unsigned __int8* grain_data(size_t idx, unsigned __int64 grain, unsigned __int32 sector);
+    bool pread(FILE* fp, unsigned __int64 pos, void* buf, size_t len);
+
+    vdisk_t(const vdisk_t&);
+    vdisk_t& operator=(const vdisk_t&);
+};
+
+// 写出 monolithicSparse 格式的 VMDK：只有 put_grain 写入过的粒度占用空间，其余读出为 0。
+// 粒度按任意顺序写入均可，粒度表和粒度目录在 close 时写到文件末尾，再回填头部。
+class sparse_writer_t
+{
+public:
+    sparse_writer_t();
+    ~sparse_writer_t();
+
+    bool open(const char* path, unsigned __int64 capacity, unsigned __int32 grain_bytes); // capacity 为虚拟磁盘字节数
+    bool put_grain(unsigned __int64 grain, const void* data); // 写入一个完整粒度
+    bool close(); // 写出粒度表、粒度目录和头部
+    unsigned __int64 file_size() const { return next_sector * 512; }
+
+private:
+    enum { GTES_PER_GT = 512 };
+    FILE* fp;
+    std::string path;
+    unsigned __int64 capacity_sectors;
+    unsigned __int32 grain_sectors;
+    unsigned __int64 overhead;    // 第一个粒度之前的扇区数
+    unsigned __int64 next_sector; // 下一个粒度写入的位置
+    std::map<unsigned __int32, std::vector<unsigned __int32>> tables; // 粒度表号 -> 粒度表，只保存用到的表
+
+    bool write_at(unsigned __int64 sector, const void* data, size_t len);
+    sparse_writer_t(const sparse_writer_t&);
+    sparse_writer_t& operator=(const sparse_writer_t&);
+};